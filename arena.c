@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_HEADER ARENA_ROUND(sizeof(ArenaChunk))
+
+static char *chunk_data(ArenaChunk *chunk) {
+    return (char *)chunk + ARENA_HEADER;
+}
+
+static ArenaChunk *new_chunk(Arena *arena, size_t min_size) {
+    size_t capacity = arena->chunk_size;
+    // Oversized requests get a dedicated chunk
+    if (min_size > capacity) capacity = min_size;
+
+    ArenaChunk *chunk = malloc(ARENA_HEADER + capacity);
+    if (!chunk) return NULL;
+    chunk->prev = arena->head;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    arena->head = chunk;
+    return chunk;
+}
+
+void arena_init(Arena *arena, size_t chunk_size) {
+    arena->head = NULL;
+    arena->chunk_size = chunk_size > 0 ? ARENA_ROUND(chunk_size) : ARENA_DEFAULT_CHUNK;
+    arena->allocated = 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    if (arena->chunk_size == 0) arena_init(arena, 0);
+    size = ARENA_ROUND(size > 0 ? size : 1);
+
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->capacity - chunk->used < size) {
+        chunk = new_chunk(arena, size);
+        if (!chunk) return NULL;
+    }
+
+    void *ptr = chunk_data(chunk) + chunk->used;
+    chunk->used += size;
+    arena->allocated += size;
+    return ptr;
+}
+
+void *arena_calloc(Arena *arena, size_t count, size_t size) {
+    if (size != 0 && count > (size_t)-1 / size) return NULL;
+    void *ptr = arena_alloc(arena, count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t n) {
+    char *copy = arena_alloc(arena, n + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+char *arena_vsprintf(Arena *arena, const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (len < 0) return NULL;
+
+    char *buf = arena_alloc(arena, (size_t)len + 1);
+    if (!buf) return NULL;
+    vsnprintf(buf, (size_t)len + 1, fmt, args);
+    return buf;
+}
+
+char *arena_sprintf(Arena *arena, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    char *buf = arena_vsprintf(arena, fmt, args);
+    va_end(args);
+    return buf;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+
+    ArenaChunk *chunk = arena->head;
+    size_t old_rounded = ARENA_ROUND(old_size > 0 ? old_size : 1);
+    size_t new_rounded = ARENA_ROUND(new_size > 0 ? new_size : 1);
+
+    // The last allocation in the current chunk can grow without a copy
+    if (chunk && (char *)ptr + old_rounded == chunk_data(chunk) + chunk->used &&
+        chunk->used - old_rounded + new_rounded <= chunk->capacity) {
+        chunk->used = chunk->used - old_rounded + new_rounded;
+        arena->allocated = arena->allocated - old_rounded + new_rounded;
+        return ptr;
+    }
+
+    if (new_size <= old_size) return ptr;
+    void *grown = arena_alloc(arena, new_size);
+    if (grown) memcpy(grown, ptr, old_size);
+    return grown;
+}
+
+ArenaMark arena_mark(const Arena *arena) {
+    ArenaMark mark;
+    mark.chunk = arena->head;
+    mark.used = arena->head ? arena->head->used : 0;
+    mark.allocated = arena->allocated;
+    return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    while (arena->head && arena->head != mark.chunk) {
+        ArenaChunk *prev = arena->head->prev;
+        free(arena->head);
+        arena->head = prev;
+    }
+    if (arena->head) arena->head->used = mark.used;
+    arena->allocated = mark.allocated;
+}
+
+void arena_reset(Arena *arena) {
+    if (!arena->head) return;
+    // Free everything except the oldest chunk, which is kept warm
+    while (arena->head->prev) {
+        ArenaChunk *prev = arena->head->prev;
+        free(arena->head);
+        arena->head = prev;
+    }
+    arena->head->used = 0;
+    arena->allocated = 0;
+}
+
+void arena_free(Arena *arena) {
+    while (arena->head) {
+        ArenaChunk *prev = arena->head->prev;
+        free(arena->head);
+        arena->head = prev;
+    }
+    arena->allocated = 0;
+}
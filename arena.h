@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+
+// A chunk of arena memory. Chunks are chained newest-first.
+typedef struct ArenaChunk {
+    struct ArenaChunk *prev;
+    size_t capacity;
+    size_t used;
+    // Allocation space follows the header
+} ArenaChunk;
+
+// Region allocator: allocations are bump-pointer carves out of large chunks
+// and are released all at once by arena_reset/arena_free (or back to a mark).
+// An arena is not thread-safe; give each worker thread its own.
+typedef struct {
+    ArenaChunk *head;
+    size_t chunk_size;
+    size_t allocated;   // Bytes handed out since the last reset
+} Arena;
+
+// Saved position for scoped allocations (e.g. one request inside a command)
+typedef struct {
+    ArenaChunk *chunk;
+    size_t used;
+    size_t allocated;
+} ArenaMark;
+
+void arena_init(Arena *arena, size_t chunk_size);
+
+// Returns NULL only when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+char *arena_strdup(Arena *arena, const char *s);
+char *arena_strndup(Arena *arena, const char *s, size_t n);
+char *arena_sprintf(Arena *arena, const char *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+char *arena_vsprintf(Arena *arena, const char *fmt, va_list args);
+
+// Grow the most recent allocation in place when possible, otherwise copy it
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+ArenaMark arena_mark(const Arena *arena);
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+// Release everything but keep the first chunk for reuse
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+// Per-command arena, reset when the command finishes (defined in main.c)
+extern Arena g_arena;
+
+#endif // ARENA_H
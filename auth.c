@@ -1,5 +1,12 @@
 #define _GNU_SOURCE
 #include "cdrive.h"
+#ifdef _WIN32
+#include <process.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
 
 // Platform-specific function definitions, moved from cdrive.h to be local to this file.
 #ifdef _WIN32 // Windows specific definitions
@@ -381,18 +388,32 @@ int load_client_credentials(ClientCredentials *creds) {
     return 0;
 }
 
+#define RESPONSE_INITIAL_CAPACITY 4096
+
 size_t write_response_callback(char *contents, size_t size, size_t nmemb, void *userp) {
     size_t total_size = size * nmemb;
     APIResponse *response = (APIResponse *)userp;
+    PROBE_CHUNK_RECEIVED(total_size);
 
-    char *new_data = realloc(response->data, response->size + total_size + 1);
-    
-    if (!new_data) {
-        print_error("Failed to allocate memory for response");
-        return 0;
+    // Double the buffer instead of reallocating on every libcurl chunk
+    if (response->size + total_size + 1 > response->capacity) {
+        size_t new_capacity = response->capacity ? response->capacity : RESPONSE_INITIAL_CAPACITY;
+        while (new_capacity < response->size + total_size + 1) new_capacity *= 2;
+
+        char *new_data;
+        if (response->arena) {
+            new_data = arena_realloc(response->arena, response->data, response->capacity, new_capacity);
+        } else {
+            new_data = realloc(response->data, new_capacity);
+        }
+        if (!new_data) {
+            print_error("Failed to allocate memory for response");
+            return 0;
+        }
+        response->data = new_data;
+        response->capacity = new_capacity;
     }
-    
-    response->data = new_data;
+
     memcpy(&(response->data[response->size]), contents, total_size);
     response->size += total_size;
     response->data[response->size] = '\0';
@@ -400,47 +421,226 @@ size_t write_response_callback(char *contents, size_t size, size_t nmemb, void *
     return total_size;
 }
 
-int cdrive_api_get(const char *url, APIResponse *response) {
-    for (int attempt = 0; attempt < 2; attempt++) {
-        if (attempt > 0) {
-            if (refresh_access_token(&g_tokens) != 0 || save_tokens(&g_tokens) != 0) break;
-        }
+void api_response_free(APIResponse *response) {
+    if (!response->arena) free(response->data);
+    response->data = NULL;
+    response->size = 0;
+    response->capacity = 0;
+}
 
-        CURL *curl = curl_easy_init();
-        if (!curl) {
-            if (response->data) free(response->data);
-            return -1;
+#define API_URL_SIZE 512
+static char g_api_urls[API_URL_COUNT][API_URL_SIZE];
+static pthread_once_t g_api_urls_once = PTHREAD_ONCE_INIT;
+
+// Tokens and the client secret go to the API root, so plain http is only
+// accepted for a server on this machine
+static int api_root_is_loopback(const char *root) {
+    const char *host = root + 7; // Past "http://"
+    const char *at = strpbrk(host, "@/");
+    if (at && *at == '@') host = at + 1;
+    size_t len;
+    if (host[0] == '[') {
+        const char *end = strchr(host, ']');
+        if (!end) return 0;
+        len = (size_t)(end - host) + 1;
+    } else {
+        len = strcspn(host, ":/?#");
+    }
+    if (len == 9 && strncasecmp(host, "localhost", 9) == 0) return 1;
+    if (len == 5 && strncmp(host, "[::1]", 5) == 0) return 1;
+
+    // 127.0.0.0/8, dotted quad only
+    unsigned a, b, c, d;
+    char tail;
+    char quad[16];
+    if (len >= sizeof(quad)) return 0;
+    memcpy(quad, host, len);
+    quad[len] = '\0';
+    return sscanf(quad, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) == 4 &&
+           a == 127 && b < 256 && c < 256 && d < 256;
+}
+
+static void api_urls_init(void) {
+    static const char *const paths[API_URL_COUNT] = {
+        "/drive/v3/files", "/upload/drive/v3/files", "/drive/v3/about", "/drive/v3/changes", "/token"
+    };
+    const char *root = getenv(API_ROOT_ENV);
+    size_t root_len = root ? strlen(root) : 0;
+    if (root && strncmp(root, "http://", 7) != 0 && strncmp(root, "https://", 8) != 0) {
+        print_warning("Ignoring " API_ROOT_ENV ": it must start with http:// or https://");
+        root = NULL;
+    }
+    if (root && strncmp(root, "http://", 7) == 0 && !api_root_is_loopback(root)) {
+        print_warning("Ignoring " API_ROOT_ENV ": plain http:// is only allowed for localhost and 127.0.0.0/8");
+        root = NULL;
+    }
+    if (root && root_len > API_URL_SIZE - 64) {
+        print_warning("Ignoring " API_ROOT_ENV ": it is too long");
+        root = NULL;
+    }
+    while (root && root_len > 0 && root[root_len - 1] == '/') root_len--;
+
+    for (int i = 0; i < API_URL_COUNT; i++) {
+        if (root) {
+            snprintf(g_api_urls[i], sizeof(g_api_urls[i]), "%.*s%s", (int)root_len, root, paths[i]);
+        } else if (i == API_TOKEN) {
+            snprintf(g_api_urls[i], sizeof(g_api_urls[i]), "https://oauth2.googleapis.com/token");
+        } else {
+            snprintf(g_api_urls[i], sizeof(g_api_urls[i]), "https://www.googleapis.com%s", paths[i]);
         }
+    }
+}
+
+static void api_urls_skip(void) {}
+
+void api_urls_reload(void) {
+    pthread_once(&g_api_urls_once, api_urls_skip);
+    api_urls_init();
+}
+
+const char *api_url(ApiUrl which) {
+    pthread_once(&g_api_urls_once, api_urls_init);
+    return g_api_urls[which];
+}
+
+json_object *cdrive_json_parse(const char *data) {
+    PROFILE_SCOPE(PROF_JSON);
+    return json_tokener_parse(data);
+}
+
+// Connection cache shared by every request in the process, so consecutive
+// and concurrent requests reuse warm TLS connections instead of each
+// handle opening its own. A daemon worker keeps it across commands.
+static CURLSH *g_share = NULL;
+static pthread_once_t g_share_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_share_locks[CURL_LOCK_DATA_LAST];
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)handle;
+    (void)access;
+    (void)userptr;
+    pthread_mutex_lock(&g_share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle;
+    (void)userptr;
+    pthread_mutex_unlock(&g_share_locks[data]);
+}
+
+static void share_init(void) {
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_init(&g_share_locks[i], NULL);
+    g_share = curl_share_init();
+    if (!g_share) return;
+    curl_share_setopt(g_share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(g_share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    // Fresh connections still skip the lookup and resume the TLS session
+    curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+void cdrive_easy_setup(CURL *curl) {
+    pthread_once(&g_share_once, share_init);
+    if (g_share) curl_easy_setopt(curl, CURLOPT_SHARE, g_share);
+    netcache_setup(curl);
+    transport_setup(curl);
+}
+
+CURL *cdrive_easy_init(void) {
+    CURL *curl = curl_easy_init();
+    if (curl) cdrive_easy_setup(curl);
+    return curl;
+}
+
+CURLcode cdrive_easy_perform(CURL *curl) {
+    int retries = retry_take_pending();
+    PROBE_REQUEST_START(curl, retries);
+    CURLcode res = curl_easy_perform(curl);
+    transport_record(curl, res, retries);
+    return res;
+}
+
+// Routes body data to the caller's sink, except for error responses,
+// which are kept aside for retry classification
+typedef struct {
+    CURL *curl;
+    curl_write_callback write_fn;
+    void *sink;
+    RetryErrorBody error;
+} ApiSink;
+
+static size_t api_sink_write(char *data, size_t size, size_t nmemb, void *userdata) {
+    ApiSink *api = (ApiSink *)userdata;
+    if (retry_capture_error(api->curl, &api->error, data, size * nmemb)) return size * nmemb;
+    return api->write_fn(data, size, nmemb, api->sink);
+}
+
+// Shared GET path: performs the request into the given write sink and
+// retries per the retry policy, resetting the sink before each new attempt.
+static int api_get_with_retry(const char *url, curl_write_callback write_fn, void *sink,
+                              void (*reset_sink)(void *sink)) {
+    RetryState retry = {0};
+
+    for (;;) {
+        CURL *curl = cdrive_easy_init();
+        if (!curl) return -1;
 
         char auth_header[MAX_HEADER_SIZE];
-        snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
+        retry.token_generation = token_auth_header(auth_header, sizeof(auth_header));
         struct curl_slist *headers = curl_slist_append(NULL, auth_header);
+        ApiSink api = { curl, write_fn, sink, { {0}, 0 } };
 
         curl_easy_setopt(curl, CURLOPT_URL, url);
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, api_sink_write);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &api);
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
 
-        CURLcode res = curl_easy_perform(curl);
+        pacer_admit(PACE_METADATA);
+        CURLcode res = cdrive_easy_perform(curl);
         long http_code = 0;
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
+        if (res == CURLE_OK && http_code == 200) {
+            curl_slist_free_all(headers);
+            curl_easy_cleanup(curl);
+            return 0;
+        }
+
+        int again = retry_next(&retry, curl, res, http_code, api.error.data);
         curl_slist_free_all(headers);
         curl_easy_cleanup(curl);
+        if (!again) return -1;
 
-        if (res == CURLE_OK && http_code == 200) return 0;
-        if (res != CURLE_OK || (http_code != 401 && http_code != 403)) break;
-
-        // Auth error — clean response data for retry
-        if (response->data) { free(response->data); response->data = NULL; response->size = 0; }
+        // Discard anything received before the failure
+        reset_sink(sink);
     }
+}
+
+static void reset_api_response(void *sink) {
+    APIResponse *response = (APIResponse *)sink;
+    // Keep the buffer for the retry, just discard its contents
+    response->size = 0;
+    if (response->data) response->data[0] = '\0';
+}
+
+static void reset_json_stream(void *sink) {
+    json_stream_reset((JsonStream *)sink);
+}
 
-    if (response->data) { free(response->data); response->data = NULL; }
+int cdrive_api_get(const char *url, APIResponse *response) {
+    if (api_get_with_retry(url, write_response_callback, response, reset_api_response) == 0) return 0;
+    api_response_free(response);
     return -1;
 }
 
+int cdrive_api_get_stream(const char *url, JsonStream *stream) {
+    if (api_get_with_retry(url, json_stream_write_callback, stream, reset_json_stream) != 0) return -1;
+    return json_stream_finish(stream);
+}
+
 int start_local_server(char *auth_code, const char *auth_url, int open_browser) {
     cdrive_socket_t server_fd, new_socket;
     struct sockaddr_in address;
@@ -585,12 +785,21 @@ char *url_encode(const char *str) {
     return result;
 }
 
+// Append "&name=value" to url with value URL-encoded
+void url_append_param(char *url, size_t url_size, const char *name, const char *value) {
+    size_t len = strlen(url);
+    char *encoded = url_encode(value);
+    if (!encoded) return;
+    snprintf(url + len, url_size - len, "&%s=%s", name, encoded);
+    free(encoded);
+}
+
 static int exchange_code_for_tokens(const char *auth_code, OAuthTokens *tokens) {
     CURL *curl;
     CURLcode res;
     APIResponse response = {0};
     
-    curl = curl_easy_init();
+    curl = cdrive_easy_init();
     if (!curl) {
         print_error("Error initializing curl");
         return -1;
@@ -625,7 +834,7 @@ static int exchange_code_for_tokens(const char *auth_code, OAuthTokens *tokens)
     printf("Exchanging authorization code for access tokens...\n");
     
     // Perform request
-    res = curl_easy_perform(curl);
+    res = cdrive_easy_perform(curl);
     
     // Check HTTP status code
     long http_code = 0;
@@ -636,7 +845,7 @@ static int exchange_code_for_tokens(const char *auth_code, OAuthTokens *tokens)
     if (res != CURLE_OK) {
         print_error("Error exchanging code");
         printf("Details: %s\n", curl_easy_strerror(res));
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
     
@@ -644,15 +853,15 @@ static int exchange_code_for_tokens(const char *auth_code, OAuthTokens *tokens)
     
     if (http_code != 200) {
         print_error("HTTP error during token exchange");
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
     
     // Parse JSON response
-    json_object *root = json_tokener_parse(response.data);
+    json_object *root = cdrive_json_parse(response.data);
     if (!root) {
         print_error("Error parsing token response");
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
     
@@ -678,7 +887,7 @@ static int exchange_code_for_tokens(const char *auth_code, OAuthTokens *tokens)
     }
     
     json_object_put(root);
-    if (response.data) free(response.data);
+    api_response_free(&response);
     
     return strlen(tokens->access_token) > 0 ? 0 : -1;
 }
@@ -700,7 +909,7 @@ int refresh_access_token(OAuthTokens *tokens) {
         }
     }
 
-    curl = curl_easy_init();
+    curl = cdrive_easy_init();
     if (!curl) {
         print_error("Error initializing curl for token refresh");
         return -1;
@@ -719,21 +928,21 @@ int refresh_access_token(OAuthTokens *tokens) {
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
 
     // Perform request
-    res = curl_easy_perform(curl);
+    res = cdrive_easy_perform(curl);
 
     long http_code = 0;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
     curl_easy_cleanup(curl);
 
     if (res != CURLE_OK || http_code != 200) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
 
     // Parse JSON response
-    json_object *root = json_tokener_parse(response.data);
+    json_object *root = cdrive_json_parse(response.data);
     if (!root) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
 
@@ -747,11 +956,132 @@ int refresh_access_token(OAuthTokens *tokens) {
     }
 
     json_object_put(root);
-    if (response.data) free(response.data);
+    api_response_free(&response);
 
     return 0;
 }
 
+// token.json as of our last load or save, to spot refreshes by other processes
+static long long g_token_file_mtime_ns = 0;
+
+static void token_file_path(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s%s%s%s%s", getenv(HOME_ENV), PATH_SEP, CONFIG_DIR, PATH_SEP, name);
+}
+
+// Exclusive advisory lock shared by every cdrive process, held while
+// refreshing. Gives up after TOKEN_LOCK_TIMEOUT_MS so a stuck process cannot
+// block the rest; returns -1 then and the refresh goes ahead unlocked.
+static int token_file_lock(void) {
+    char lock_path[MAX_PATH_SIZE];
+    token_file_path(lock_path, sizeof(lock_path), TOKEN_LOCK_FILE);
+#ifdef _WIN32
+    int fd = _open(lock_path, _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE);
+    if (fd < 0) return -1;
+    OVERLAPPED ov = {0};
+    HANDLE handle = (HANDLE)_get_osfhandle(fd);
+    for (int waited = 0; waited < TOKEN_LOCK_TIMEOUT_MS; waited += 50) {
+        if (LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov)) return fd;
+        Sleep(50);
+    }
+    _close(fd);
+    return -1;
+#else
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    for (int waited = 0; waited < TOKEN_LOCK_TIMEOUT_MS; waited += 50) {
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) return fd;
+        cdrive_usleep(50 * 1000);
+    }
+    close(fd);
+    return -1;
+#endif
+}
+
+static void token_file_unlock(int fd) {
+    if (fd < 0) return;
+#ifdef _WIN32
+    OVERLAPPED ov = {0};
+    UnlockFileEx((HANDLE)_get_osfhandle(fd), 0, 1, 0, &ov);
+    _close(fd);
+#else
+    flock(fd, LOCK_UN);
+    close(fd);
+#endif
+}
+
+static int token_file_changed(void) {
+    char token_path[MAX_PATH_SIZE];
+    token_file_path(token_path, sizeof(token_path), TOKEN_FILE);
+    struct stat sb;
+    return stat(token_path, &sb) == 0 && CDRIVE_STAT_MTIME_NS(sb) != g_token_file_mtime_ns;
+}
+
+// --- Token manager ---
+// Requests copy the access token under a read lock; a refresh swaps the
+// new one in under the write lock. Refreshes are single-flight: a 401 only
+// triggers one if no refresh has happened since its request was built, and
+// callers that arrive while one is running wait for it and share its result.
+static pthread_rwlock_t g_token_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t g_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_refresh_cond = PTHREAD_COND_INITIALIZER;
+static unsigned g_refresh_count = 0;   // Refresh attempts; guarded by both locks
+static int g_refresh_running = 0;
+static int g_refresh_result = 0;
+
+unsigned token_auth_header(char *out, size_t size) {
+    pthread_rwlock_rdlock(&g_token_lock);
+    snprintf(out, size, "Authorization: Bearer %s", g_tokens.access_token);
+    unsigned generation = g_refresh_count;
+    pthread_rwlock_unlock(&g_token_lock);
+    return generation;
+}
+
+int token_refresh(unsigned seen_generation) {
+    pthread_mutex_lock(&g_refresh_lock);
+    while (g_refresh_running) pthread_cond_wait(&g_refresh_cond, &g_refresh_lock);
+    if (g_refresh_count != seen_generation) {
+        // Refreshed (or tried) since the caller's request was built
+        int result = g_refresh_result;
+        pthread_mutex_unlock(&g_refresh_lock);
+        return result;
+    }
+    g_refresh_running = 1;
+    pthread_rwlock_rdlock(&g_token_lock);
+    OAuthTokens fresh = g_tokens;
+    pthread_rwlock_unlock(&g_token_lock);
+    pthread_mutex_unlock(&g_refresh_lock);
+
+    // The network round trip happens with no in-process lock held. Other
+    // cdrive processes are kept out by the file lock: whoever loses the race
+    // finds token.json rewritten and adopts the new token instead.
+    int result;
+    int lock_fd = token_file_lock();
+    OAuthTokens on_disk = {0};
+    if (token_file_changed() && load_tokens(&on_disk) == 0 &&
+        strcmp(on_disk.access_token, fresh.access_token) != 0) {
+        fresh = on_disk;
+        result = 0;
+    } else {
+        result = refresh_access_token(&fresh) == 0 ? 1 : -1;
+        if (result > 0 && save_tokens(&fresh) != 0) {
+            print_warning("Could not save the refreshed token; it will be refreshed again next time.");
+        }
+    }
+    token_file_unlock(lock_fd);
+
+    pthread_mutex_lock(&g_refresh_lock);
+    pthread_rwlock_wrlock(&g_token_lock);
+    if (result >= 0) g_tokens = fresh;
+    g_refresh_count++;
+    pthread_rwlock_unlock(&g_token_lock);
+    g_refresh_result = result >= 0 ? 0 : -1;
+    g_refresh_running = 0;
+    pthread_cond_broadcast(&g_refresh_cond);
+    pthread_mutex_unlock(&g_refresh_lock);
+    PROBE_TOKEN_REFRESH(result);
+    return result;
+}
+
 int cdrive_auth_login(int headless) {
     char auth_url[MAX_URL_SIZE];
     char auth_code[256] = {0};
@@ -1046,13 +1376,24 @@ int cdrive_auth_login(int headless) {
 }
 
 
+// Written beside the old file and renamed over it, so a crash or a
+// concurrent reader never sees a half-written token.json
 int save_tokens(const OAuthTokens *tokens) {
+    PROFILE_SCOPE(PROF_TOKEN_IO);
     char token_path[MAX_PATH_SIZE];
+    char tmp_path[MAX_PATH_SIZE + 32];
     const char *home_dir = getenv(HOME_ENV);
     
     snprintf(token_path, sizeof(token_path), "%s%s%s%s%s", home_dir, PATH_SEP, CONFIG_DIR, PATH_SEP, TOKEN_FILE);
-    
-    FILE *file = fopen(token_path, "w");
+#ifdef _WIN32
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", token_path, (long)_getpid());
+    FILE *file = fopen(tmp_path, "w");
+#else
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", token_path, (long)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file && fd >= 0) close(fd);
+#endif
     if (!file) {
         perror("Error saving tokens");
         return -1;
@@ -1065,11 +1406,33 @@ int save_tokens(const OAuthTokens *tokens) {
     fprintf(file, "  \"expires_in\": %d\n", tokens->expires_in);
     fprintf(file, "}\n");
     
-    fclose(file);
+    int ok = fflush(file) == 0;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, token_path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, token_path) == 0;
+#endif
+    if (!ok) {
+        perror("Error saving tokens");
+        remove(tmp_path);
+        return -1;
+    }
+    struct stat sb;
+    if (stat(token_path, &sb) == 0) g_token_file_mtime_ns = CDRIVE_STAT_MTIME_NS(sb);
     return 0;
 }
 
 int load_tokens(OAuthTokens *tokens) {
+    // Commands all start by loading the token; a long-lived process (the
+    // daemon) only needs to re-read it when another process replaced it
+    static int g_tokens_loaded = 0;
+    if (tokens == &g_tokens && g_tokens_loaded && !token_file_changed()) return 0;
+    PROFILE_SCOPE(PROF_TOKEN_IO);
+
     char token_path[MAX_PATH_SIZE];
     const char *home_dir = getenv(HOME_ENV);
     
@@ -1082,6 +1445,8 @@ int load_tokens(OAuthTokens *tokens) {
     
     char buffer[2048];
     size_t bytes_read = fread(buffer, 1, sizeof(buffer) - 1, file);
+    struct stat sb;
+    if (fstat(fileno(file), &sb) == 0) g_token_file_mtime_ns = CDRIVE_STAT_MTIME_NS(sb);
     fclose(file);
     buffer[bytes_read] = '\0';
     
@@ -1112,23 +1477,27 @@ int load_tokens(OAuthTokens *tokens) {
     }
     
     json_object_put(root);
+    if (tokens == &g_tokens) g_tokens_loaded = 1;
     return 0;
 }
 
 int get_user_info(char *user_name, size_t name_size) {
     APIResponse response = {0};
+    response.arena = &g_arena;
 
     if (strlen(g_tokens.access_token) == 0) {
         return -1;
     }
 
-    if (cdrive_api_get("https://www.googleapis.com/drive/v3/about?fields=user", &response) != 0) {
+    char url[MAX_URL_SIZE];
+    snprintf(url, sizeof(url), "%s?fields=user", api_url(API_ABOUT));
+    if (cdrive_api_get(url, &response) != 0) {
         return -1;
     }
 
     // Parse response to get user name
     if (response.data) {
-        json_object *root = json_tokener_parse(response.data);
+        json_object *root = cdrive_json_parse(response.data);
         if (root) {
             json_object *user_obj, *display_name_obj;
             
@@ -1140,12 +1509,12 @@ int get_user_info(char *user_name, size_t name_size) {
                 user_name[name_size - 1] = '\0';
                 
                 json_object_put(root);
-                free(response.data);
+                api_response_free(&response);
                 return 0;
             }
             json_object_put(root);
         }
-        free(response.data);
+        api_response_free(&response);
     }
     
     return -1;
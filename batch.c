@@ -0,0 +1,607 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "batch.h"
+#include "daemon.h"
+
+#ifdef _WIN32
+
+int cdrive_batch(const char *path) {
+    (void)path;
+    print_error("Batch mode is not supported on Windows.");
+    return -1;
+}
+
+#else
+
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+
+// Parent to worker, followed by argv as `length` NUL-separated bytes
+typedef struct {
+    uint32_t seq;
+    uint32_t argc;
+    uint32_t length;
+} BatchJob;
+
+// Worker to parent, followed by the command's stdout then its stderr
+typedef struct {
+    uint32_t seq;
+    int32_t exit_code;
+    uint32_t out_len;
+    uint32_t err_len;
+} BatchReply;
+
+typedef struct {
+    pid_t pid;
+    int fd;       // -1 once the worker is gone
+    int busy;
+    uint32_t seq; // Command in flight while busy
+} BatchWorker;
+
+// One input command, from parsing until its output has been printed
+typedef struct {
+    int line;
+    int barrier;        // A `wait` line
+    int argc;
+    char **argv;        // Full argv, starting with "cdrive" and the batch's flags
+    char *args;         // Backing storage for argv, laid out contiguously
+    size_t args_len;
+    int first_arg;      // Where the line's own words start in argv
+    int done;
+    int exit_code;
+    char *out;
+    size_t out_len;
+    char *err;
+    size_t err_len;
+} BatchCommand;
+
+typedef struct {
+    FILE *in;
+    int line;
+    int eof;
+    int jobs;
+    BatchWorker workers[BATCH_MAX_JOBS];
+    int worker_count;
+    int inflight;
+    uint32_t next_seq;
+    uint32_t next_print;
+    BatchCommand window[BATCH_WINDOW];
+    int total;
+    int failed;
+    char quota[16];
+} Batch;
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Whole contents of a scratch file; NULL with *len 0 when it is empty
+static char *slurp(FILE *f, size_t *len) {
+    *len = 0;
+    if (fseek(f, 0, SEEK_END) != 0) return NULL;
+    long size = ftell(f);
+    if (size <= 0) return NULL;
+    char *data = malloc((size_t)size);
+    if (!data) return NULL;
+    rewind(f);
+    *len = fread(data, 1, (size_t)size, f);
+    return data;
+}
+
+// --- Worker side ---
+
+static int run_job(int fd, const BatchJob *job, char *payload, int saved[2]) {
+    char *argv[DAEMON_MAX_ARGS + 1];
+    char *p = payload;
+    char *end = payload + job->length;
+    for (uint32_t i = 0; i < job->argc; i++) {
+        if (p >= end) return -1;
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+    argv[job->argc] = NULL;
+
+    FILE *out = tmpfile();
+    FILE *err = tmpfile();
+    BatchReply reply = { job->seq, 1, 0, 0 };
+    char *out_data = NULL;
+    char *err_data = NULL;
+    size_t out_len = 0;
+    size_t err_len = 0;
+
+    if (out && err) {
+        fflush(stdout);
+        fflush(stderr);
+        dup2(fileno(out), STDOUT_FILENO);
+        dup2(fileno(err), STDERR_FILENO);
+        reply.exit_code = daemon_run_command((int)job->argc, argv);
+        dup2(saved[0], STDOUT_FILENO);
+        dup2(saved[1], STDERR_FILENO);
+        out_data = slurp(out, &out_len);
+        err_data = slurp(err, &err_len);
+    } else {
+        static const char msg[] = "Could not create scratch files for the command's output\n";
+        err_len = sizeof(msg) - 1;
+        err_data = malloc(err_len);
+        if (err_data) memcpy(err_data, msg, err_len);
+        else err_len = 0;
+    }
+    if (out) fclose(out);
+    if (err) fclose(err);
+
+    reply.out_len = (uint32_t)out_len;
+    reply.err_len = (uint32_t)err_len;
+    int rc = write_all(fd, &reply, sizeof(reply)) == 0 &&
+             write_all(fd, out_data, out_len) == 0 &&
+             write_all(fd, err_data, err_len) == 0 ? 0 : -1;
+    free(out_data);
+    free(err_data);
+    return rc;
+}
+
+static void worker_loop(int fd) {
+    g_daemon_worker = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    // The batch itself may be on stdin
+    int devnull = open("/dev/null", O_RDONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+    int saved[2] = { dup(STDOUT_FILENO), dup(STDERR_FILENO) };
+
+    for (;;) {
+        BatchJob job;
+        if (read_all(fd, &job, sizeof(job)) != 0) break;
+        if (job.argc < 1 || job.argc > DAEMON_MAX_ARGS || job.length > DAEMON_MAX_REQUEST) break;
+        char *payload = malloc(job.length + 1);
+        if (!payload || read_all(fd, payload, job.length) != 0) break;
+        payload[job.length] = '\0';
+        int rc = run_job(fd, &job, payload, saved);
+        free(payload);
+        if (rc != 0) break;
+    }
+    // _exit() skips atexit handlers
+    netcache_save();
+    _exit(0);
+}
+
+// --- Parsing ---
+
+// Split shell-style words in place: '...' is literal, "..." and bare words
+// honour backslash escapes, and # starts a comment. Returns the word count,
+// or -1 on an unterminated quote or too many words.
+static int split_words(char *line, char *words[], int max) {
+    int count = 0;
+    char *r = line;
+    char *w = line;
+
+    for (;;) {
+        while (*r == ' ' || *r == '\t' || *r == '\r' || *r == '\n') r++;
+        if (*r == '\0' || *r == '#') return count;
+        if (count == max) return -1;
+        words[count++] = w;
+
+        while (*r && *r != ' ' && *r != '\t' && *r != '\r' && *r != '\n') {
+            if (*r == '\'') {
+                r++;
+                while (*r && *r != '\'') *w++ = *r++;
+                if (*r != '\'') return -1;
+                r++;
+            } else if (*r == '"') {
+                r++;
+                while (*r && *r != '"') {
+                    if (*r == '\\' && (r[1] == '"' || r[1] == '\\')) r++;
+                    *w++ = *r++;
+                }
+                if (*r != '"') return -1;
+                r++;
+            } else {
+                if (*r == '\\' && r[1]) r++;
+                *w++ = *r++;
+            }
+        }
+        // Step past the separator first: w may have caught up with r
+        if (*r) r++;
+        *w++ = '\0';
+    }
+}
+
+// `["mkdir", "x"]` or `{"args": ["mkdir", "x"]}`
+static int parse_json_words(const char *line, char *words[], int max, char **storage) {
+    json_object *root = json_tokener_parse(line);
+    if (!root) return -1;
+
+    json_object *args = root;
+    if (json_object_get_type(root) == json_type_object &&
+        !json_object_object_get_ex(root, "args", &args)) {
+        args = NULL;
+    }
+    if (!args || json_object_get_type(args) != json_type_array ||
+        (int)json_object_array_length(args) > max) {
+        json_object_put(root);
+        return -1;
+    }
+
+    int count = (int)json_object_array_length(args);
+    size_t size = 1;
+    for (int i = 0; i < count; i++) {
+        json_object *arg = json_object_array_get_idx(args, (size_t)i);
+        if (json_object_get_type(arg) != json_type_string) {
+            json_object_put(root);
+            return -1;
+        }
+        size += strlen(json_object_get_string(arg)) + 1;
+    }
+
+    char *p = *storage = malloc(size);
+    if (!p) {
+        json_object_put(root);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const char *arg = json_object_get_string(json_object_array_get_idx(args, (size_t)i));
+        words[i] = p;
+        p = stpcpy(p, arg) + 1;
+    }
+    json_object_put(root);
+    return count;
+}
+
+// Fail a command without running it; msg becomes its stderr
+static void set_error(BatchCommand *cmd, const char *msg) {
+    free(cmd->err);
+    cmd->err = strdup(msg);
+    cmd->err_len = cmd->err ? strlen(cmd->err) : 0;
+    cmd->done = 1;
+    cmd->exit_code = 1;
+}
+
+// Build the full argv: "cdrive", the batch's own global flags, then the words
+static int build_argv(Batch *b, BatchCommand *cmd, char *words[], int count) {
+    const char *prefix[10];
+    char trace_flag[MAX_PATH_SIZE + 16];
+    int n = 0;
+    prefix[n++] = "cdrive";
+    if (g_json_mode) prefix[n++] = "--json";
+    if (g_show_stats) prefix[n++] = "--stats";
+    if (g_http3) prefix[n++] = "--http3";
+    if (g_profile) prefix[n++] = "--profile";
+    if (trace_enabled()) {
+        // Workers append to the same file; lines are written whole
+        const char *path = trace_path();
+        snprintf(trace_flag, sizeof(trace_flag), "--trace-timing%s%s", path ? "=" : "", path ? path : "");
+        prefix[n++] = trace_flag;
+    }
+    prefix[n++] = "--quota";
+    prefix[n++] = b->quota;
+
+    if (count > 0 && strcmp(words[0], "cdrive") == 0) {
+        words++;
+        count--;
+    }
+    if (count == 0 || n + count > DAEMON_MAX_ARGS) return -1;
+
+    size_t size = 0;
+    for (int i = 0; i < n; i++) size += strlen(prefix[i]) + 1;
+    for (int i = 0; i < count; i++) size += strlen(words[i]) + 1;
+    if (size > DAEMON_MAX_REQUEST) return -1;
+
+    cmd->argv = malloc(sizeof(char *) * (size_t)(n + count + 1));
+    char *p = cmd->args = malloc(size);
+    if (!cmd->argv || !p) return -1;
+    cmd->argc = n + count;
+    cmd->args_len = size;
+    cmd->first_arg = n;
+    for (int i = 0; i < n + count; i++) {
+        cmd->argv[i] = p;
+        p = stpcpy(p, i < n ? prefix[i] : words[i - n]) + 1;
+    }
+    cmd->argv[cmd->argc] = NULL;
+    return 0;
+}
+
+// Read lines up to the next command or `wait`. Returns 0 at end of input.
+static int read_command(Batch *b, BatchCommand *cmd) {
+    char *line = NULL;
+    size_t cap = 0;
+    memset(cmd, 0, sizeof(*cmd));
+
+    while (getline(&line, &cap, b->in) >= 0) {
+        b->line++;
+        char *start = line;
+        while (*start == ' ' || *start == '\t') start++;
+        if (*start == '\0' || *start == '\n' || *start == '\r' || *start == '#') continue;
+
+        cmd->line = b->line;
+        char *words[DAEMON_MAX_ARGS];
+        char *storage = NULL;
+        int count = (*start == '[' || *start == '{')
+            ? parse_json_words(start, words, DAEMON_MAX_ARGS, &storage)
+            : split_words(start, words, DAEMON_MAX_ARGS);
+
+        if (count == 1 && strcmp(words[0], "wait") == 0) {
+            cmd->barrier = 1;
+        } else if (count < 0) {
+            set_error(cmd, "Could not parse the line (unbalanced quotes or bad JSON)\n");
+        } else if (build_argv(b, cmd, words, count) != 0) {
+            set_error(cmd, "Empty or oversized command\n");
+        } else if (!daemon_can_run(cmd->argc, cmd->argv)) {
+            // Prompts, browsers and long-running watchers cannot share a batch
+            char msg[256];
+            snprintf(msg, sizeof(msg), "'%s' cannot run in a batch\n", cmd->argv[cmd->first_arg]);
+            set_error(cmd, msg);
+        }
+        free(storage);
+        free(line);
+        return 1;
+    }
+    free(line);
+    return 0;
+}
+
+// --- Parent side ---
+
+static BatchWorker *idle_worker(Batch *b) {
+    for (int i = 0; i < b->worker_count; i++) {
+        if (b->workers[i].fd >= 0 && !b->workers[i].busy) return &b->workers[i];
+    }
+
+    // Reuse the slot of a worker that died, else grow the pool up to --jobs
+    BatchWorker *slot = NULL;
+    for (int i = 0; i < b->worker_count && !slot; i++) {
+        if (b->workers[i].fd < 0) slot = &b->workers[i];
+    }
+    if (!slot) {
+        if (b->worker_count == b->jobs) return NULL;
+        slot = &b->workers[b->worker_count++];
+        slot->fd = -1;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) return NULL;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return NULL;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        for (int i = 0; i < b->worker_count; i++) {
+            if (b->workers[i].fd >= 0) close(b->workers[i].fd);
+        }
+        worker_loop(sv[1]);
+    }
+    close(sv[1]);
+    slot->pid = pid;
+    slot->fd = sv[0];
+    slot->busy = 0;
+    return slot;
+}
+
+static void free_command(BatchCommand *cmd) {
+    free(cmd->argv);
+    free(cmd->args);
+    free(cmd->out);
+    free(cmd->err);
+    memset(cmd, 0, sizeof(*cmd));
+}
+
+// Copy text to a stream with every line tagged by its input line number
+static void print_tagged(FILE *stream, int line, const char *data, size_t len) {
+    size_t start = 0;
+    while (start < len) {
+        const char *nl = memchr(data + start, '\n', len - start);
+        size_t end = nl ? (size_t)(nl - data) : len;
+        fprintf(stream, "[%d] %.*s\n", line, (int)(end - start), data + start);
+        start = end + 1;
+    }
+}
+
+static void print_result(Batch *b, BatchCommand *cmd) {
+    b->total++;
+    if (cmd->exit_code != 0) b->failed++;
+
+    if (g_json_mode) {
+        json_object *obj = json_object_new_object();
+        json_object *args = json_object_new_array();
+        for (int i = cmd->first_arg; i < cmd->argc; i++) {
+            json_object_array_add(args, json_object_new_string(cmd->argv[i]));
+        }
+        json_object_object_add(obj, "line", json_object_new_int(cmd->line));
+        json_object_object_add(obj, "args", args);
+        json_object_object_add(obj, "exit_code", json_object_new_int(cmd->exit_code));
+        json_object_object_add(obj, "stdout", json_object_new_string_len(cmd->out ? cmd->out : "", (int)cmd->out_len));
+        json_object_object_add(obj, "stderr", json_object_new_string_len(cmd->err ? cmd->err : "", (int)cmd->err_len));
+        printf("%s\n", json_object_to_json_string(obj));
+        json_object_put(obj);
+    } else {
+        print_tagged(stdout, cmd->line, cmd->out, cmd->out_len);
+        fflush(stdout);
+        print_tagged(stderr, cmd->line, cmd->err, cmd->err_len);
+        if (cmd->exit_code != 0) fprintf(stderr, "[%d] exit status %d\n", cmd->line, cmd->exit_code);
+    }
+    fflush(stdout);
+}
+
+// Print every finished result that is next in input order
+static void flush_results(Batch *b) {
+    while (b->next_print != b->next_seq) {
+        BatchCommand *cmd = &b->window[b->next_print % BATCH_WINDOW];
+        if (!cmd->done) break;
+        print_result(b, cmd);
+        free_command(cmd);
+        b->next_print++;
+    }
+}
+
+// Queue a command in input order and, unless it already failed parsing,
+// hand it to a worker
+static void dispatch(Batch *b, BatchWorker *w, BatchCommand *cmd) {
+    uint32_t seq = b->next_seq++;
+    BatchCommand *slot = &b->window[seq % BATCH_WINDOW];
+    *slot = *cmd;
+    if (slot->done) {
+        flush_results(b);
+        return;
+    }
+
+    BatchJob job = { seq, (uint32_t)slot->argc, (uint32_t)slot->args_len };
+    w->busy = 1;
+    w->seq = seq;
+    b->inflight++;
+    // On failure the worker is gone; collect() sees the hang-up and fails
+    // the command
+    if (write_all(w->fd, &job, sizeof(job)) == 0) write_all(w->fd, slot->args, slot->args_len);
+}
+
+static void worker_lost(Batch *b, BatchWorker *w) {
+    close(w->fd);
+    w->fd = -1;
+    w->busy = 0;
+    waitpid(w->pid, NULL, 0);
+    b->inflight--;
+    set_error(&b->window[w->seq % BATCH_WINDOW], "The batch worker running this command exited\n");
+}
+
+// Wait for at least one worker to report back
+static void collect(Batch *b) {
+    struct pollfd pfd[BATCH_MAX_JOBS];
+    BatchWorker *polled[BATCH_MAX_JOBS];
+    int n = 0;
+    for (int i = 0; i < b->worker_count; i++) {
+        if (b->workers[i].fd >= 0 && b->workers[i].busy) {
+            pfd[n].fd = b->workers[i].fd;
+            pfd[n].events = POLLIN;
+            polled[n++] = &b->workers[i];
+        }
+    }
+    if (n == 0 || poll(pfd, (nfds_t)n, -1) < 0) return;
+
+    for (int i = 0; i < n; i++) {
+        if (!pfd[i].revents) continue;
+        BatchWorker *w = polled[i];
+        BatchCommand *cmd = &b->window[w->seq % BATCH_WINDOW];
+        BatchReply reply;
+        if (read_all(w->fd, &reply, sizeof(reply)) != 0 || reply.seq != w->seq) {
+            worker_lost(b, w);
+            continue;
+        }
+
+        cmd->out = reply.out_len ? malloc(reply.out_len) : NULL;
+        cmd->err = reply.err_len ? malloc(reply.err_len) : NULL;
+        if ((reply.out_len && !cmd->out) || (reply.err_len && !cmd->err) ||
+            read_all(w->fd, cmd->out, reply.out_len) != 0 ||
+            read_all(w->fd, cmd->err, reply.err_len) != 0) {
+            free(cmd->out);
+            cmd->out = NULL;
+            worker_lost(b, w);
+            continue;
+        }
+        cmd->out_len = reply.out_len;
+        cmd->err_len = reply.err_len;
+        cmd->exit_code = reply.exit_code;
+        cmd->done = 1;
+        w->busy = 0;
+        b->inflight--;
+    }
+    flush_results(b);
+}
+
+int cdrive_batch(const char *path) {
+    Batch *b = calloc(1, sizeof(Batch));
+    if (!b) return -1;
+
+    b->in = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        b->in = fopen(path, "r");
+        if (!b->in) {
+            print_error("Could not open the batch file");
+            free(b);
+            return -1;
+        }
+    }
+
+    b->jobs = g_jobs > 0 ? g_jobs : BATCH_DEFAULT_JOBS;
+    if (b->jobs > BATCH_MAX_JOBS) b->jobs = BATCH_MAX_JOBS;
+    // Workers pace themselves independently, so they split the quota
+    int quota = pacer_get_quota();
+    snprintf(b->quota, sizeof(b->quota), "%d", quota > 0 ? (quota + b->jobs - 1) / b->jobs : 0);
+
+    // Loaded once here so every worker starts with the token in memory
+    load_tokens(&g_tokens);
+
+    BatchCommand next;
+    int have_next = 0;
+    for (;;) {
+        if (!have_next && !b->eof) {
+            if (read_command(b, &next)) have_next = 1;
+            else b->eof = 1;
+        }
+
+        if (have_next && next.barrier) {
+            if (b->inflight == 0) {
+                have_next = 0;
+                continue;
+            }
+        } else if (have_next && b->next_seq - b->next_print < BATCH_WINDOW) {
+            BatchWorker *w = next.done ? NULL : idle_worker(b);
+            if (next.done || w) {
+                dispatch(b, w, &next);
+                have_next = 0;
+                continue;
+            }
+            if (b->inflight == 0) {
+                set_error(&next, "Could not start a batch worker\n");
+                continue;
+            }
+        }
+
+        if (b->inflight == 0 && !have_next && b->eof) break;
+        collect(b);
+    }
+    flush_results(b);
+
+    for (int i = 0; i < b->worker_count; i++) {
+        if (b->workers[i].fd < 0) continue;
+        close(b->workers[i].fd);
+        waitpid(b->workers[i].pid, NULL, 0);
+    }
+    if (b->in != stdin) fclose(b->in);
+
+    int failed = b->failed;
+    if (!g_json_mode && b->total > 0) {
+        fprintf(stderr, "%d command(s), %d failed\n", b->total, failed);
+    }
+    free(b);
+    return failed == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_DEFAULT_JOBS 4    // Commands run at once unless --jobs says otherwise
+#define BATCH_MAX_JOBS 32
+#define BATCH_WINDOW 256        // Results held back waiting for an earlier line
+
+// `cdrive batch [FILE]`: run one command per input line (from FILE, or stdin
+// when FILE is omitted or "-"). A line is either shell-style words, as typed
+// after `cdrive`, or a JSON array of arguments (NDJSON). Commands run
+// concurrently in a pool of worker processes that keep their connections and
+// token between commands; each command's output is printed in input order,
+// tagged with its line number. A line reading `wait` holds later commands
+// until everything before it has finished. Returns 0 if every command
+// succeeded.
+int cdrive_batch(const char *path);
+
+#endif // BATCH_H
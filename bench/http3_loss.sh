@@ -0,0 +1,57 @@
+#!/bin/sh
+# Compare HTTP/3 (--http3) with TCP for a Drive download under packet loss.
+#
+#   sudo bench/http3_loss.sh <file-id> [loss-percents] [runs]
+#
+# Adds netem loss and 40ms delay to the interface of the default route
+# (override with IFACE=...), downloads the file `runs` times per transport
+# at each loss rate, and prints the median wall time and the protocols the
+# transfers actually used. Needs root for tc, an authenticated cdrive
+# (run as the user whose HOME holds ~/.cdrive, e.g. sudo -E) and a libcurl
+# with HTTP/3 support. The qdisc is removed on exit.
+set -eu
+
+FILE_ID=${1:?usage: $0 <file-id> [loss-percents] [runs]}
+LOSSES=${2:-"0 1 3"}
+RUNS=${3:-5}
+CDRIVE=$(realpath "${CDRIVE:-./out/dist/cdrive}")
+IFACE=${IFACE:-$(ip route show default | awk '{ for (i = 1; i < NF; i++) if ($i == "dev") print $(i + 1); exit }')}
+WORKDIR=$(mktemp -d)
+
+cleanup() {
+    tc qdisc del dev "$IFACE" root 2>/dev/null || true
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT INT TERM
+
+# Seconds for one download; the stats line goes to $WORKDIR/stats
+run_once() {
+    rm -f "$WORKDIR"/out.bin*
+    start=$(date +%s.%N)
+    (cd "$WORKDIR" && CDRIVE_NO_DAEMON=1 "$CDRIVE" pull "$FILE_ID" out.bin --json --stats "$@" \
+        >/dev/null 2>"$WORKDIR/stats") || true
+    end=$(date +%s.%N)
+    echo "$end - $start" | bc
+}
+
+median() {
+    sort -n | awk '{ v[NR] = $1 } END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+printf "%-6s %-8s %10s  %s\n" "loss" "mode" "median(s)" "protocols (last run)"
+for loss in $LOSSES; do
+    tc qdisc replace dev "$IFACE" root netem delay 40ms loss "${loss}%"
+    for mode in tcp http3; do
+        flags=""
+        [ "$mode" = http3 ] && flags="--http3"
+        : > "$WORKDIR/times"
+        i=0
+        while [ "$i" -lt "$RUNS" ]; do
+            # shellcheck disable=SC2086
+            run_once $flags >> "$WORKDIR/times"
+            i=$((i + 1))
+        done
+        protocols=$(grep -o '"protocols":{[^}]*}' "$WORKDIR/stats" || echo "-")
+        printf "%-6s %-8s %10.2f  %s\n" "${loss}%" "$mode" "$(median < "$WORKDIR/times")" "$protocols"
+    done
+done
@@ -0,0 +1,867 @@
+#!/usr/bin/env python3
+"""Local stand-in for the parts of the Drive v3 API that cdrive uses.
+
+    python3 bench/mock_drive.py [--port 0] [--seed-files N] [--seed-large BYTES]
+
+Point cdrive at it with CDRIVE_API_ROOT=http://127.0.0.1:<port>. Serves:
+
+  POST   /token                                  OAuth token refresh
+  GET    /drive/v3/about                         user info
+  GET    /drive/v3/files?q=&pageSize=&pageToken= list (parents, name, trashed)
+  POST   /drive/v3/files                         create (folders)
+  GET    /drive/v3/files/<id>[?alt=media]        metadata, or content with Range
+  PATCH  /drive/v3/files/<id>                    update metadata (rename, trash)
+  DELETE /drive/v3/files/<id>
+  POST   /drive/v3/files/<id>/permissions        share
+  GET    /drive/v3/changes[/startPageToken]      change feed for sync
+  POST   /upload/drive/v3/files?uploadType=multipart|resumable
+  PATCH  /upload/drive/v3/files/<id>?uploadType=multipart|resumable
+  PUT    <resumable session URL>                 chunk with Content-Range
+
+State lives in memory. Seeded content: a folder "bench-small" holding
+--seed-files files of --seed-size bytes, a file "bench-large" of
+--seed-large bytes, and an empty folder "bench-uploads". Any bearer token
+starting with "mock-" is accepted. Prints "listening on <url>" once ready.
+
+WAN and fault emulation, per connection (all off by default):
+
+  --rtt-ms, --jitter-ms   added before every response, plus one RTT for the
+                          handshake of a new connection
+  --bandwidth-mbit        cap on body bytes each way
+  --loss                  percent of segments lost; each loss costs a round
+                          trip and halves the window. Bodies move in
+                          windows that start at 10 segments and grow per
+                          RTT (slow start, again after idle), so this needs
+                          --rtt-ms
+  --stall-rate/--stall-ms a body pauses once, like a retransmission
+                          timeout, and the window starts over
+  --reset-rate            a media download or upload body is cut at a
+                          random point with a TCP RST
+  --list-reset-rate       the same for files.list response bodies
+  --error-rate            a request is answered with one of --error-codes
+                          (429,503), with Retry-After if --retry-after is set
+
+Every random choice comes from --fault-seed, the request's transfer
+("media:<id>", "upload:<name or id>", otherwise method and URL) and how
+often that transfer was seen, so a run meets the same faults however its
+requests interleave. GET /_mock/stats reports what happened since the last
+POST /_mock/reset: body bytes each way, resent_bytes (payload of a
+transfer that had already crossed the wire), the faults injected, and
+recovery_ms, the time from a transfer's first fault until the arrival of
+the attempt that went through without one.
+"""
+
+import argparse
+import hashlib
+import json
+import random
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+FOLDER_MIME = "application/vnd.google-apps.folder"
+MAX_PAGE_SIZE = 1000
+MSS = 1448
+INITIAL_WINDOW = 10 * MSS           # RFC 6928
+MAX_WINDOW = 4 << 20                # Stands in for the receive window
+IO_CHUNK = 64 << 10
+KEY_PREFIX = 4096                   # Upload bytes read before naming the transfer
+NAME_FIELD = re.compile(rb'"name"\s*:\s*"((?:[^"\\]|\\.)*)"')
+ERROR_REASONS = {403: "userRateLimitExceeded", 429: "rateLimitExceeded"}
+
+
+def pattern_bytes(size, seed=0):
+    """Deterministic, poorly compressible content of the given size."""
+    block = hashlib.sha256(str(seed).encode()).digest() * 2048  # 64 KiB
+    whole, rest = divmod(size, len(block))
+    return block * whole + block[:rest]
+
+
+def rfc3339(ts):
+    return time.strftime("%Y-%m-%dT%H:%M:%S.000Z", time.gmtime(ts))
+
+
+class Reset(Exception):
+    """Abort the connection with an RST."""
+
+
+class Wan:
+    """Link and fault settings shared by all connections, and what they did."""
+
+    def __init__(self, args):
+        self.rtt = args.rtt_ms / 1000.0
+        self.jitter = args.jitter_ms / 1000.0
+        self.rate = args.bandwidth_mbit * 1e6 / 8
+        self.loss = args.loss / 100.0
+        self.stall_rate = args.stall_rate
+        self.stall = args.stall_ms / 1000.0
+        self.reset_rate = args.reset_rate
+        self.list_reset_rate = args.list_reset_rate
+        self.error_rate = args.error_rate
+        self.error_codes = args.error_codes
+        self.retry_after = args.retry_after
+        self.seed = args.fault_seed
+        self.idle_restart = max(0.2, 2 * self.rtt)
+        self.lock = threading.Lock()
+        self.reset_stats()
+
+    def reset_stats(self):
+        with self.lock:
+            self.seen = {}          # Transfer key -> requests so far
+            self.covered = {}       # Transfer key -> merged [start, end) spans moved
+            self.pending = {}       # Transfer key -> time of its first unrecovered fault
+            self.recoveries = []
+            self.counters = dict(requests=0, bytes_sent=0, bytes_received=0, resent_bytes=0,
+                                 injected_errors=0, resets=0, stalls=0, lost_segments=0)
+
+    def rng(self, key):
+        with self.lock:
+            n = self.seen.get(key, 0)
+            self.seen[key] = n + 1
+            self.counters["requests"] += 1
+        return random.Random("%s:%s:%d" % (self.seed, key, n))
+
+    def count(self, name, n=1):
+        with self.lock:
+            self.counters[name] += n
+
+    def moved(self, key, start, end):
+        """Payload bytes [start, end) of a transfer crossed the wire; the
+        part that had crossed before is resent."""
+        if end <= start:
+            return
+        with self.lock:
+            spans = self.covered.get(key, [])
+            self.counters["resent_bytes"] += sum(max(0, min(end, e) - max(start, s)) for s, e in spans)
+            merged = []
+            for s, e in sorted(spans + [(start, end)]):
+                if merged and s <= merged[-1][1]:
+                    merged[-1] = (merged[-1][0], max(merged[-1][1], e))
+                else:
+                    merged.append((s, e))
+            self.covered[key] = merged
+
+    def fault(self, key, kind):
+        with self.lock:
+            self.counters[kind] += 1
+            self.pending.setdefault(key, time.monotonic())
+
+    def succeeded(self, key, arrived):
+        with self.lock:
+            failed_at = self.pending.pop(key, None)
+            if failed_at is not None:
+                self.recoveries.append(max(0.0, arrived - failed_at))
+
+    def snapshot(self):
+        with self.lock:
+            out = dict(self.counters)
+            out["recovery_ms"] = [round(r * 1000, 3) for r in self.recoveries]
+            out["unrecovered"] = len(self.pending)
+        return out
+
+
+class Store:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.files = {}
+        self.order = []          # Insertion order, for stable listings
+        self.changes = []        # (file id, removed)
+        self.sessions = {}       # Resumable upload id -> state
+        self.next_id = 1
+        self.tokens_issued = 0
+        self.add_folder("root", "My Drive", parents=[], log=False)
+
+    def new_id(self, prefix="f"):
+        self.next_id += 1
+        return "%s%06d" % (prefix, self.next_id)
+
+    def record(self, file_id, removed=False):
+        self.changes.append((file_id, removed))
+
+    def add_folder(self, file_id, name, parents, log=True):
+        self.files[file_id] = {
+            "id": file_id, "name": name, "mimeType": FOLDER_MIME, "parents": parents,
+            "trashed": False, "modifiedTime": rfc3339(time.time()), "revision": 1,
+        }
+        self.order.append(file_id)
+        if log:
+            self.record(file_id)
+        return self.files[file_id]
+
+    def put_file(self, file_id, name, parents, data, mime="application/octet-stream"):
+        f = self.files.get(file_id)
+        if f is None:
+            f = {"id": file_id, "parents": parents, "trashed": False, "revision": 0}
+            self.files[file_id] = f
+            self.order.append(file_id)
+        f.update(name=name, mimeType=mime, data=data, md5=hashlib.md5(data).hexdigest(),
+                 modifiedTime=rfc3339(time.time()))
+        f["revision"] += 1
+        self.record(file_id)
+        return f
+
+    def seed(self, small_count, small_size, large_size):
+        self.add_folder("bench-small", "bench-small", ["root"], log=False)
+        self.add_folder("bench-uploads", "bench-uploads", ["root"], log=False)
+        for i in range(small_count):
+            self.put_file("bench-small-%06d" % i, "file-%06d.bin" % i, ["bench-small"],
+                          pattern_bytes(small_size, i))
+        if large_size > 0:
+            self.put_file("bench-large", "bench-large.bin", ["root"], pattern_bytes(large_size, "large"))
+        self.changes.clear()
+
+
+def resource(f):
+    """A file as the API returns it, with every field cdrive asks for."""
+    out = {
+        "kind": "drive#file", "id": f["id"], "name": f["name"], "mimeType": f["mimeType"],
+        "parents": f["parents"], "trashed": f["trashed"], "modifiedTime": f["modifiedTime"],
+        "headRevisionId": "r%d" % f["revision"],
+    }
+    if "data" in f:
+        size = str(len(f["data"]))
+        out.update(size=size, quotaBytesUsed=size, md5Checksum=f["md5"])
+    return out
+
+
+QUERY_CLAUSES = [
+    (re.compile(r"^'((?:[^'\\]|\\.)*)'\s+in\s+parents$"), "parent"),
+    (re.compile(r"^name\s*=\s*'((?:[^'\\]|\\.)*)'$"), "name"),
+    (re.compile(r"^name\s+contains\s+'((?:[^'\\]|\\.)*)'$"), "contains"),
+    (re.compile(r"^trashed\s*=\s*(true|false)$"), "trashed"),
+    (re.compile(r"^mimeType\s*=\s*'([^']*)'$"), "mime"),
+    (re.compile(r"^mimeType\s*!=\s*'([^']*)'$"), "not_mime"),
+]
+
+
+def compile_query(q):
+    """Turn the q expressions cdrive sends into a predicate; unknown
+    clauses match everything."""
+    tests = []
+    for clause in re.split(r"\s+and\s+", q.strip()) if q else []:
+        clause = clause.strip().strip("()")
+        for regex, kind in QUERY_CLAUSES:
+            m = regex.match(clause)
+            if not m:
+                continue
+            value = m.group(1).replace("\\'", "'").replace("\\\\", "\\")
+            if kind == "parent":
+                tests.append(lambda f, v=value: v in f["parents"])
+            elif kind == "name":
+                tests.append(lambda f, v=value: f["name"] == v)
+            elif kind == "contains":
+                tests.append(lambda f, v=value.lower(): v in f["name"].lower())
+            elif kind == "trashed":
+                tests.append(lambda f, v=(value == "true"): f["trashed"] == v)
+            elif kind == "mime":
+                tests.append(lambda f, v=value: f["mimeType"] == v)
+            else:
+                tests.append(lambda f, v=value: f["mimeType"] != v)
+            break
+    return lambda f: all(t(f) for t in tests)
+
+
+def parse_multipart(body, content_type):
+    """Parts of a multipart/related or multipart/form-data body, as
+    (headers, payload) with lower-cased header names."""
+    m = re.search(r'boundary="?([^";]+)"?', content_type or "")
+    if not m:
+        return []
+    delimiter = b"--" + m.group(1).encode()
+    parts = []
+    for chunk in body.split(delimiter)[1:]:
+        if chunk.startswith(b"--"):
+            break
+        head, _, payload = chunk.partition(b"\r\n\r\n")
+        headers = {}
+        for line in head.decode("latin-1").split("\r\n"):
+            if ":" in line:
+                k, v = line.split(":", 1)
+                headers[k.strip().lower()] = v.strip()
+        if payload.endswith(b"\r\n"):
+            payload = payload[:-2]
+        parts.append((headers, payload))
+    return parts
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Headers and body are separate writes; with Nagle on, small responses
+    # stall on the client's delayed ACK and the bench measures that instead
+    disable_nagle_algorithm = True
+    server_version = "MockDrive/1.0"
+    store = None
+    wan = None
+    root_url = ""
+
+    def setup(self):
+        super().setup()
+        self.cwnd = INITIAL_WINDOW
+        self.ssthresh = None
+        self.last_io = 0.0
+        self.fresh = True
+        self.rng = None
+
+    def handle(self):
+        try:
+            super().handle()
+        except Reset:
+            # Linger 0 turns the close into an RST
+            self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+            self.rfile.close()
+            self.wfile.close()
+            self.connection.close()
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            sys.stderr.write("mock: " + fmt % args + "\n")
+
+    # -- link emulation --------------------------------------------------
+
+    def paced(self, total, io, cut, counter):
+        """Move total body bytes with io(offset, n), one congestion window
+        per round trip at most. With cut set, stops after that many bytes
+        and raises Reset."""
+        wan = self.wan
+        end = total if cut is None else cut
+        if wan.rtt and time.monotonic() - self.last_io > wan.idle_restart:
+            self.cwnd = INITIAL_WINDOW
+        stall_at = None
+        if wan.stall_rate and total and self.rng.random() < wan.stall_rate:
+            stall_at = self.rng.randrange(total)
+        pos = 0
+        while pos < end:
+            if stall_at is not None and pos >= stall_at:
+                stall_at = None
+                wan.count("stalls")
+                time.sleep(wan.stall)
+                self.ssthresh = max(2 * MSS, self.cwnd // 2)
+                self.cwnd = INITIAL_WINDOW
+            n = end - pos
+            if wan.rtt:
+                n = min(n, self.cwnd)
+            elif wan.rate:
+                n = min(n, IO_CHUNK)
+            if stall_at is not None and stall_at > pos:
+                n = min(n, stall_at - pos)
+            started = time.monotonic()
+            for off in range(pos, pos + n, IO_CHUNK):
+                io(off, min(IO_CHUNK, pos + n - off))
+            wan.count(counter, n)
+            pos += n
+            self.flight(n, pos < end, started)
+        self.last_io = time.monotonic()
+        if cut is not None:
+            raise Reset()
+
+    def flight(self, n, more, started):
+        """Window bookkeeping for n bytes just moved; sleeps out the rest of
+        the round."""
+        wan = self.wan
+        duration = n / wan.rate if wan.rate else 0.0
+        if wan.rtt and more:
+            duration = max(duration, wan.rtt)
+        lost = sum(self.rng.random() < wan.loss for _ in range(-(-n // MSS))) if wan.loss else 0
+        if lost:
+            # Fast retransmit: one more round trip, half the window
+            wan.count("lost_segments", lost)
+            duration += wan.rtt
+            self.ssthresh = max(2 * MSS, self.cwnd // 2)
+            self.cwnd = self.ssthresh
+        elif wan.rtt:
+            slow_start = self.ssthresh is None or self.cwnd < self.ssthresh
+            self.cwnd = min(self.cwnd * 2 if slow_start else self.cwnd + MSS, MAX_WINDOW)
+        delay = duration - (time.monotonic() - started)
+        if delay > 0:
+            time.sleep(delay)
+
+    def request_key(self, method, path, head):
+        """The transfer a request belongs to, stable across its retries."""
+        parts = path.split("/")
+        if method == "GET" and len(parts) == 5 and path.startswith("/drive/v3/files/") \
+                and self.query.get("alt") == "media":
+            return "media:" + parts[4]
+        if path.startswith("/upload/"):
+            if "upload_id" in self.query:
+                with self.store.lock:
+                    session = self.store.sessions.get(self.query["upload_id"])
+                if session:
+                    return session["key"]
+            elif len(parts) > 5:
+                return "upload:" + parts[5]
+            else:
+                m = NAME_FIELD.search(head)
+                if m:
+                    return "upload:" + m.group(1).decode("utf-8", "replace")
+        return "%s %s" % (method, self.path)
+
+    def start_request(self, key):
+        self.key = key
+        self.rng = self.wan.rng(key)
+        # Drawn up front so later draws do not depend on which faults apply:
+        # reset?, where to cut, error?, which code
+        self.faults = [self.rng.random() for _ in range(4)]
+
+    def receive(self, method, path):
+        """Read the request body at the link's pace; may cut an upload short."""
+        if method not in ("POST", "PUT", "PATCH"):
+            self.start_request(self.request_key(method, path, b""))
+            return b""
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            body = self.read_body()
+            self.start_request(self.request_key(method, path, body))
+            return body
+        length = int(self.headers.get("Content-Length") or 0)
+        body = bytearray(self.rfile.read(min(length, KEY_PREFIX)))
+        self.start_request(self.request_key(method, path, body))
+        cut = None
+        if self.key.startswith("upload:") and self.faults[0] < self.wan.reset_rate and length > len(body):
+            cut = int(self.faults[1] * (length - len(body)))
+
+        def read(off, n):
+            data = self.rfile.read(n)
+            if len(data) < n:
+                raise ConnectionResetError()
+            body.extend(data)
+
+        head = len(body)
+        self.wan.count("bytes_received", head)
+        try:
+            self.paced(length - head, read, cut, "bytes_received")
+        finally:
+            # Resumable session starts carry only metadata
+            if (self.key.startswith("upload:") and self.query.get("uploadType") != "resumable") \
+                    or "upload_id" in self.query:
+                m = re.match(r"bytes (\d+)-", self.headers.get("Content-Range", ""))
+                start = int(m.group(1)) if m else 0
+                self.wan.moved(self.key, start, start + len(body))
+            if cut is not None:
+                self.wan.fault(self.key, "resets")
+        return bytes(body)
+
+    def respond_delay(self):
+        wan = self.wan
+        delay = wan.rtt + (self.rng.uniform(0, wan.jitter) if wan.jitter else 0.0)
+        if self.fresh:
+            delay += wan.rtt
+            self.fresh = False
+        if delay > 0:
+            time.sleep(delay)
+
+    def inject_error(self, path):
+        wan = self.wan
+        if path == "/token" or not wan.error_codes or self.faults[2] >= wan.error_rate:
+            return False
+        code = wan.error_codes[int(self.faults[3] * len(wan.error_codes))]
+        wan.fault(self.key, "injected_errors")
+        headers = {"Retry-After": str(wan.retry_after)} if wan.retry_after else None
+        self.error(code, "Injected by mock_drive.py", ERROR_REASONS.get(code, "backendError"), headers)
+        return True
+
+    # -- plumbing --------------------------------------------------------
+
+    def read_body(self):
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            data = bytearray()
+            while True:
+                size = int(self.rfile.readline().split(b";")[0].strip() or b"0", 16)
+                if size == 0:
+                    self.rfile.readline()
+                    return bytes(data)
+                data += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length") or 0))
+
+    def send(self, status, body=b"", content_type="application/json; charset=UTF-8", headers=None):
+        if isinstance(body, (dict, list)):
+            body = json.dumps(body).encode()
+        self.status = status
+        self.send_response(status)
+        if body or status not in (204, 304):
+            self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        for k, v in (headers or {}).items():
+            self.send_header(k, v)
+        self.end_headers()
+        if self.command == "HEAD" or not body:
+            return
+        if self.rng is None:
+            self.wfile.write(body)
+            return
+        cut = None
+        media = self.key.startswith("media:") and status in (200, 206)
+        listing = self.key.startswith("GET /drive/v3/files?") and status == 200
+        if (media and self.faults[0] < self.wan.reset_rate) or \
+                (listing and self.faults[0] < self.wan.list_reset_rate):
+            cut = int(self.faults[1] * len(body))
+        if media:
+            self.wan.moved(self.key, self.body_offset, self.body_offset + (len(body) if cut is None else cut))
+        try:
+            self.paced(len(body), lambda off, n: self.wfile.write(body[off:off + n]), cut, "bytes_sent")
+        except Reset:
+            self.wan.fault(self.key, "resets")
+            raise
+
+    def error(self, status, message, reason="badRequest", headers=None):
+        self.send(status, {"error": {"code": status, "message": message,
+                                     "errors": [{"reason": reason, "message": message}]}}, headers=headers)
+
+    def authorized(self):
+        auth = self.headers.get("Authorization", "")
+        if auth.startswith("Bearer mock-"):
+            return True
+        self.error(401, "Request had invalid authentication credentials.", "authError")
+        return False
+
+    def route(self):
+        url = urlsplit(self.path)
+        self.query = {k: v[-1] for k, v in parse_qs(url.query, keep_blank_values=True).items()}
+        return url.path.rstrip("/")
+
+    def do_GET(self):
+        self.dispatch("GET")
+
+    def do_POST(self):
+        self.dispatch("POST")
+
+    def do_PUT(self):
+        self.dispatch("PUT")
+
+    def do_PATCH(self):
+        self.dispatch("PATCH")
+
+    def do_DELETE(self):
+        self.dispatch("DELETE")
+
+    def dispatch(self, method):
+        path = self.route()
+        self.rng = None
+        self.status = 0
+        self.body_offset = 0
+        if path.startswith("/_mock/"):
+            return self.control(method, path)
+        arrived = time.monotonic()
+        try:
+            body = self.receive(method, path)
+            self.respond_delay()
+            if self.inject_error(path):
+                return
+            self.handle_api(method, path, body)
+            if 0 < self.status < 400:
+                self.wan.succeeded(self.key, arrived)
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+
+    def control(self, method, path):
+        self.read_body()
+        if path == "/_mock/stats" and method == "GET":
+            return self.send(200, self.wan.snapshot())
+        if path == "/_mock/reset" and method == "POST":
+            self.wan.reset_stats()
+            return self.send(204)
+        self.error(404, "Not found: %s %s" % (method, path), "notFound")
+
+    def handle_api(self, method, path, body):
+        if path == "/token" and method == "POST":
+            return self.token(body)
+        if not self.authorized():
+            return
+        parts = path.split("/")
+        if path == "/drive/v3/about" and method == "GET":
+            return self.send(200, {"user": {"displayName": "Mock User", "emailAddress": "mock@example.invalid"}})
+        if path == "/drive/v3/changes/startPageToken" and method == "GET":
+            with self.store.lock:
+                return self.send(200, {"startPageToken": str(len(self.store.changes))})
+        if path == "/drive/v3/changes" and method == "GET":
+            return self.list_changes()
+        if path == "/drive/v3/files":
+            if method == "GET":
+                return self.list_files()
+            if method == "POST":
+                return self.create(body)
+        if path.startswith("/drive/v3/files/"):
+            file_id = parts[4]
+            if len(parts) == 6 and parts[5] == "permissions" and method == "POST":
+                return self.share(file_id, body)
+            if len(parts) == 5:
+                if method == "GET":
+                    return self.get(file_id)
+                if method == "PATCH":
+                    return self.update(file_id, body)
+                if method == "DELETE":
+                    return self.delete(file_id)
+        if path == "/upload/drive/v3/files" or path.startswith("/upload/drive/v3/files/"):
+            file_id = parts[5] if len(parts) > 5 else None
+            if method == "PUT" and "upload_id" in self.query:
+                return self.resumable_chunk(body)
+            if (method == "POST" and file_id is None) or (method == "PATCH" and file_id):
+                if self.query.get("uploadType") == "resumable":
+                    return self.resumable_start(file_id, body)
+                return self.multipart(file_id, body)
+        self.error(404, "Not found: %s %s" % (method, path), "notFound")
+
+    # -- endpoints -------------------------------------------------------
+
+    def token(self, body):
+        form = {k: v[-1] for k, v in parse_qs(body.decode()).items()}
+        if form.get("grant_type") != "refresh_token" or not form.get("refresh_token"):
+            return self.send(400, {"error": "invalid_grant"})
+        with self.store.lock:
+            self.store.tokens_issued += 1
+            token = "mock-%d" % self.store.tokens_issued
+        self.send(200, {"access_token": token, "expires_in": 3599, "token_type": "Bearer",
+                        "scope": "https://www.googleapis.com/auth/drive"})
+
+    def list_files(self):
+        try:
+            size = max(1, min(int(self.query.get("pageSize", 100)), MAX_PAGE_SIZE))
+            start = int(self.query.get("pageToken") or 0)
+        except ValueError:
+            return self.error(400, "Invalid pageSize or pageToken", "invalid")
+        match = compile_query(self.query.get("q", ""))
+        with self.store.lock:
+            hits = [resource(self.store.files[i]) for i in self.store.order
+                    if i != "root" and match(self.store.files[i])]
+        page = {"kind": "drive#fileList", "files": hits[start:start + size]}
+        if start + size < len(hits):
+            page["nextPageToken"] = str(start + size)
+        self.send(200, page)
+
+    def lookup(self, file_id):
+        f = self.store.files.get(file_id)
+        if f is None:
+            self.error(404, "File not found: %s." % file_id, "notFound")
+        return f
+
+    def get(self, file_id):
+        with self.store.lock:
+            f = self.lookup(file_id)
+            if f is None:
+                return
+            meta = resource(f)
+            data = f.get("data")
+        if self.query.get("alt") != "media":
+            return self.send(200, meta)
+        if data is None:
+            return self.error(403, "Only files with binary content can be downloaded.", "fileNotDownloadable")
+        total = len(data)
+        rng = self.headers.get("Range")
+        if not rng:
+            return self.send(200, data, "application/octet-stream")
+        m = re.match(r"bytes=(\d*)-(\d*)$", rng.strip())
+        if not m or (not m.group(1) and not m.group(2)):
+            return self.send(200, data, "application/octet-stream")
+        if m.group(1):
+            first = int(m.group(1))
+            last = min(int(m.group(2)), total - 1) if m.group(2) else total - 1
+        else:
+            first, last = max(0, total - int(m.group(2))), total - 1
+        if first >= total or first > last:
+            return self.send(416, b"", headers={"Content-Range": "bytes */%d" % total})
+        self.body_offset = first
+        self.send(206, data[first:last + 1], "application/octet-stream",
+                  {"Content-Range": "bytes %d-%d/%d" % (first, last, total)})
+
+    def metadata(self, body):
+        if not body:
+            return {}
+        try:
+            meta = json.loads(body)
+        except ValueError:
+            return None
+        return meta if isinstance(meta, dict) else None
+
+    def create(self, body):
+        meta = self.metadata(body)
+        if meta is None or not meta.get("name"):
+            return self.error(400, "Invalid file metadata", "invalid")
+        with self.store.lock:
+            parents = meta.get("parents") or ["root"]
+            file_id = self.store.new_id("d" if meta.get("mimeType") == FOLDER_MIME else "f")
+            if meta.get("mimeType") == FOLDER_MIME:
+                f = self.store.add_folder(file_id, meta["name"], parents)
+            else:
+                f = self.store.put_file(file_id, meta["name"], parents, b"",
+                                        meta.get("mimeType", "application/octet-stream"))
+            out = resource(f)
+        self.send(200, out)
+
+    def update(self, file_id, body):
+        meta = self.metadata(body)
+        if meta is None:
+            return self.error(400, "Invalid file metadata", "invalid")
+        with self.store.lock:
+            f = self.lookup(file_id)
+            if f is None:
+                return
+            if "name" in meta:
+                f["name"] = meta["name"]
+            if "trashed" in meta:
+                f["trashed"] = bool(meta["trashed"])
+            for p in filter(None, self.query.get("removeParents", "").split(",")):
+                if p in f["parents"]:
+                    f["parents"].remove(p)
+            for p in filter(None, self.query.get("addParents", "").split(",")):
+                f["parents"].append(p)
+            f["modifiedTime"] = rfc3339(time.time())
+            self.store.record(file_id, f["trashed"])
+            out = resource(f)
+        self.send(200, out)
+
+    def delete(self, file_id):
+        with self.store.lock:
+            if self.lookup(file_id) is None:
+                return
+            del self.store.files[file_id]
+            self.store.order.remove(file_id)
+            self.store.record(file_id, True)
+        self.send(204)
+
+    def share(self, file_id, body):
+        meta = self.metadata(body) or {}
+        with self.store.lock:
+            if self.lookup(file_id) is None:
+                return
+            perm_id = self.store.new_id("p")
+        self.send(200, {"kind": "drive#permission", "id": perm_id, "type": meta.get("type", "user"),
+                        "role": meta.get("role", "reader"), "emailAddress": meta.get("emailAddress", "")})
+
+    def list_changes(self):
+        try:
+            start = int(self.query.get("pageToken") or 0)
+            size = max(1, min(int(self.query.get("pageSize", 100)), MAX_PAGE_SIZE))
+        except ValueError:
+            return self.error(400, "Invalid pageToken", "invalid")
+        with self.store.lock:
+            log = self.store.changes[start:start + size]
+            out = []
+            for file_id, removed in log:
+                f = self.store.files.get(file_id)
+                change = {"kind": "drive#change", "fileId": file_id, "removed": removed or f is None}
+                if f is not None:
+                    change["file"] = resource(f)
+                out.append(change)
+            end = start + len(log)
+            done = end >= len(self.store.changes)
+        page = {"kind": "drive#changeList", "changes": out}
+        page["newStartPageToken" if done else "nextPageToken"] = str(end)
+        self.send(200, page)
+
+    def finish_upload(self, file_id, meta, data):
+        """Store an uploaded body under file_id (new file when None)."""
+        with self.store.lock:
+            existing = self.store.files.get(file_id) if file_id else None
+            if file_id and existing is None:
+                return self.error(404, "File not found: %s." % file_id, "notFound")
+            if existing is None:
+                file_id = self.store.new_id("f")
+            name = meta.get("name") or (existing["name"] if existing else "Untitled")
+            parents = meta.get("parents") or (existing["parents"] if existing else ["root"])
+            mime = meta.get("mimeType") or "application/octet-stream"
+            out = resource(self.store.put_file(file_id, name, parents, data, mime))
+        self.send(200, out)
+
+    def multipart(self, file_id, body):
+        parts = parse_multipart(body, self.headers.get("Content-Type"))
+        if len(parts) < 2:
+            return self.error(400, "Expected metadata and media parts", "badContent")
+        meta = self.metadata(parts[0][1])
+        if meta is None:
+            return self.error(400, "Invalid metadata part", "badContent")
+        if "content-type" in parts[1][0] and "mimeType" not in meta:
+            meta["mimeType"] = parts[1][0]["content-type"]
+        self.finish_upload(file_id, meta, parts[1][1])
+
+    def resumable_start(self, file_id, body):
+        meta = self.metadata(body)
+        if meta is None:
+            return self.error(400, "Invalid file metadata", "invalid")
+        with self.store.lock:
+            upload_id = self.store.new_id("u")
+            self.store.sessions[upload_id] = {"file_id": file_id, "meta": meta, "data": bytearray(),
+                                              "key": self.key}
+        location = "%s/upload/drive/v3/files%s?uploadType=resumable&upload_id=%s" % (
+            self.root_url, "/" + file_id if file_id else "", upload_id)
+        self.send(200, b"", headers={"Location": location})
+
+    def resumable_chunk(self, body):
+        with self.store.lock:
+            session = self.store.sessions.get(self.query["upload_id"])
+        if session is None:
+            return self.error(404, "No such upload session", "notFound")
+        m = re.match(r"bytes (\*|(\d+)-(\d+))/(\*|\d+)$", self.headers.get("Content-Range", "bytes */*"))
+        if not m:
+            return self.error(400, "Invalid Content-Range", "badContent")
+        data = session["data"]
+        if m.group(2) is not None:
+            if int(m.group(2)) != len(data) or int(m.group(3)) - int(m.group(2)) + 1 != len(body):
+                return self.error(400, "Chunk does not continue the upload", "badContent")
+            data += body
+        total = m.group(4)
+        if total != "*" and len(data) == int(total):
+            with self.store.lock:
+                self.store.sessions.pop(self.query["upload_id"], None)
+            return self.finish_upload(session["file_id"], session["meta"], bytes(data))
+        headers = {"Range": "bytes=0-%d" % (len(data) - 1)} if data else {}
+        self.send(308, b"", headers=headers)
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+    request_queue_size = 128
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=0, help="0 picks a free port")
+    parser.add_argument("--seed-files", type=int, default=0, help="files in the bench-small folder")
+    parser.add_argument("--seed-size", type=int, default=4096, help="bytes per bench-small file")
+    parser.add_argument("--seed-large", type=int, default=0, help="bytes in the bench-large file")
+    parser.add_argument("--verbose", action="store_true", help="log every request to stderr")
+    wan = parser.add_argument_group("WAN and fault emulation")
+    wan.add_argument("--rtt-ms", type=float, default=0, help="round-trip time")
+    wan.add_argument("--jitter-ms", type=float, default=0, help="extra uniform delay per response")
+    wan.add_argument("--bandwidth-mbit", type=float, default=0, help="per-connection cap, 0 for none")
+    wan.add_argument("--loss", type=float, default=0, help="percent of segments lost")
+    wan.add_argument("--stall-rate", type=float, default=0, help="chance a body stalls once")
+    wan.add_argument("--stall-ms", type=float, default=1000, help="length of a stall")
+    wan.add_argument("--reset-rate", type=float, default=0, help="chance a media body is cut by an RST")
+    wan.add_argument("--list-reset-rate", type=float, default=0, help="chance a files.list body is cut by an RST")
+    wan.add_argument("--error-rate", type=float, default=0, help="chance a request gets an error status")
+    wan.add_argument("--error-codes", default="429,503", help="statuses to inject, comma-separated")
+    wan.add_argument("--retry-after", type=int, default=0, help="Retry-After seconds on injected errors")
+    wan.add_argument("--fault-seed", default="1", help="seed for every random choice")
+    args = parser.parse_args()
+    for name in ("stall_rate", "reset_rate", "list_reset_rate", "error_rate"):
+        if not 0 <= getattr(args, name) <= 1:
+            parser.error("--%s must be between 0 and 1" % name.replace("_", "-"))
+    if not 0 <= args.loss <= 100:
+        parser.error("--loss is a percentage")
+    try:
+        args.error_codes = [int(c) for c in args.error_codes.split(",") if c.strip()]
+    except ValueError:
+        parser.error("--error-codes takes HTTP statuses such as 429,503")
+
+    store = Store()
+    store.seed(args.seed_files, args.seed_size, args.seed_large)
+    server = Server((args.host, args.port), Handler)
+    server.verbose = args.verbose
+    Handler.store = store
+    Handler.wan = Wan(args)
+    Handler.root_url = "http://%s:%d" % (args.host, server.server_address[1])
+    print("listening on %s" % Handler.root_url, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
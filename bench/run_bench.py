@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+"""End-to-end benchmarks for cdrive against bench/mock_drive.py.
+
+    python3 bench/run_bench.py [--cdrive out/dist/cdrive] [--runs 3] [--output FILE]
+                               [--net lan,wan,flaky] [--variant NAME="CDRIVE ARGS"]...
+
+Starts the mock server, points a throwaway HOME at it (CDRIVE_API_ROOT)
+and times each scenario:
+
+  upload_small    many small files with one `cdrive upload 'dir/*'`
+  upload_large    one large file
+  download_large  `cdrive pull` of a large file
+  list_recursive  `cdrive list -R` of a folder with thousands of files
+
+Each scenario runs once per --net profile (the mock server's link and
+fault settings, see NET_PROFILES) and --variant (extra cdrive arguments,
+e.g. j1="--jobs 1" j8="--jobs 8", or "--retry-budget 0"), and prints one
+JSON object per line on stdout (and to --output): wall time, throughput,
+request latency percentiles from --trace-timing, CPU time and peak RSS of
+the cdrive process, and from the server the retries, resent_bytes (payload
+sent again after a failure), faults injected and time_to_recover_ms (from
+a transfer's first fault until the attempt that got through arrived).
+
+Values are medians over the successful runs, except peak_rss_kib (the
+largest), and latency and time_to_recover_ms (over all requests of all
+runs). Server statistics are reset before every run and faults depend only
+on --fault-seed, so every run of a scenario meets the same faults. Pacing
+is turned off (--quota 0) so the numbers measure cdrive.
+"""
+
+import argparse
+import json
+import os
+import shlex
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.request
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# mock_drive.py options per --net profile
+WAN = ["--rtt-ms", "80", "--jitter-ms", "5", "--bandwidth-mbit", "50", "--loss", "1"]
+NET_PROFILES = {
+    "lan": [],
+    "wan": WAN,
+    "flaky": WAN + ["--reset-rate", "0.2", "--error-rate", "0.05", "--stall-rate", "0.1", "--stall-ms", "1500"],
+}
+FAULTS = ("injected_errors", "resets", "stalls", "lost_segments")
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    return sorted_values[min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))]
+
+
+def start_server(args, net):
+    cmd = [sys.executable, os.path.join(BENCH_DIR, "mock_drive.py"), "--port", "0",
+           "--seed-files", str(args.list_files), "--seed-large", str(args.large_mb << 20),
+           "--fault-seed", str(args.fault_seed)]
+    cmd.extend(NET_PROFILES[net] + args.server_arg)
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, text=True)
+    line = proc.stdout.readline().strip()
+    if not line.startswith("listening on "):
+        proc.kill()
+        sys.exit("mock server did not start: %r" % line)
+    return proc, line.split(" ", 2)[2]
+
+
+def server_call(root, path, method="GET"):
+    with urllib.request.urlopen(urllib.request.Request(root + path, method=method)) as resp:
+        body = resp.read()
+    return json.loads(body) if body else None
+
+
+def make_home(root):
+    config = os.path.join(root, ".cdrive")
+    os.makedirs(config, exist_ok=True)
+    with open(os.path.join(config, "client_id.json"), "w") as f:
+        json.dump({"client_id": "mock", "client_secret": "mock"}, f)
+    # Not a token the server accepts, so every run starts with a refresh
+    with open(os.path.join(config, "token.json"), "w") as f:
+        json.dump({"access_token": "stale", "refresh_token": "mock-refresh",
+                   "token_type": "Bearer", "expires_in": 3599}, f)
+
+
+def sample_peak_rss(pid, stop, peak):
+    """Track VmHWM of the running process. ru_maxrss is no good here: a
+    child forked from this interpreter starts with the interpreter's RSS as
+    its high-water mark, and exec keeps it."""
+    path = "/proc/%d/status" % pid
+    while True:
+        try:
+            with open(path) as f:
+                for line in f:
+                    if line.startswith("VmHWM:"):
+                        peak[0] = max(peak[0], int(line.split()[1]))
+                        break
+        except OSError:
+            return
+        if stop.wait(0.005):
+            return
+
+
+def run_cdrive(cdrive, argv, env, cwd, trace_path):
+    """Run one command; returns wall seconds, exit status, rusage, peak RSS
+    in KiB and the stderr tail."""
+    if os.path.exists(trace_path):
+        os.remove(trace_path)
+    cmd = [cdrive, "--quota", "0", "--trace-timing=" + trace_path] + argv
+    start = time.monotonic()
+    # Popen returns once the exec has happened, so every sample is cdrive's
+    proc = subprocess.Popen(cmd, cwd=cwd, env=env, stdin=subprocess.DEVNULL,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    peak, stop = [0], threading.Event()
+    sampler = None
+    if os.path.exists("/proc/self/status"):
+        sampler = threading.Thread(target=sample_peak_rss, args=(proc.pid, stop, peak), daemon=True)
+        sampler.start()
+    err = proc.stderr.read()
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    wall = time.monotonic() - start
+    stop.set()
+    if sampler:
+        sampler.join()
+    else:
+        peak[0] = usage.ru_maxrss // 1024 if sys.platform == "darwin" else usage.ru_maxrss
+    return wall, proc.returncode, usage, peak[0], err.decode(errors="replace")[-500:]
+
+
+def read_trace(path):
+    """Latency in ms of every request, and how many of them were retries."""
+    latencies, retries = [], 0
+    if not os.path.exists(path):
+        return latencies, retries
+    with open(path) as f:
+        for line in f:
+            try:
+                record = json.loads(line)
+                latencies.append(record["total_us"] / 1000.0)
+                retries += record.get("retries", 0) > 0
+            except (ValueError, KeyError):
+                continue
+    return latencies, retries
+
+
+def spread(values, points=(("p50", 50), ("p90", 90), ("p99", 99), ("max", 100))):
+    values = sorted(values)
+    return {k: round(percentile(values, p), 3) for k, p in points}
+
+
+def scenario(name, args, ctx, argv, payload_bytes, prepare=None):
+    walls, users, systems, rss, latencies, retries = [], [], [], [], [], []
+    resent, faults, recoveries = [], {k: [] for k in FAULTS}, []
+    failures, unrecovered, last_failure = 0, 0, None
+    trace = os.path.join(ctx["work"], "trace.ndjson")
+    for _ in range(args.runs):
+        if prepare:
+            prepare()
+        server_call(ctx["root"], "/_mock/reset", "POST")
+        wall, code, usage, peak_rss, err = run_cdrive(args.cdrive, ctx["cdrive_args"] + argv, ctx["env"], ctx["work"], trace)
+        stats = server_call(ctx["root"], "/_mock/stats")
+        resent.append(stats["resent_bytes"])
+        for k in FAULTS:
+            faults[k].append(stats[k])
+        recoveries.extend(stats["recovery_ms"])
+        unrecovered += stats["unrecovered"]
+        if code != 0:
+            failures += 1
+            last_failure = {"exit_code": code, "stderr": err}
+            continue
+        walls.append(wall)
+        users.append(usage.ru_utime)
+        systems.append(usage.ru_stime)
+        rss.append(peak_rss)
+        run_latencies, run_retries = read_trace(trace)
+        latencies.extend(run_latencies)
+        retries.append(run_retries)
+
+    result = {"scenario": name, "net": ctx["net"], "variant": ctx["variant"], "runs": len(walls),
+              "failed_runs": failures, "ok": failures == 0, "bytes": payload_bytes,
+              "resent_bytes": int(statistics.median(resent)),
+              "faults": {k: int(statistics.median(v)) for k, v in faults.items()},
+              "time_to_recover_ms": dict(spread(recoveries, (("p50", 50), ("p90", 90), ("max", 100))),
+                                         count=len(recoveries)),
+              "unrecovered": unrecovered}
+    if last_failure:
+        result["failure"] = last_failure
+    if not walls:
+        return result
+    wall = statistics.median(walls)
+    result.update({
+        "wall_s": round(wall, 4),
+        "throughput_mib_s": round(payload_bytes / wall / (1 << 20), 2) if payload_bytes else None,
+        "requests": len(latencies) // len(walls),
+        "retries": int(statistics.median(retries)),
+        "latency_ms": spread(latencies),
+        "cpu_s": {"user": round(statistics.median(users), 4), "sys": round(statistics.median(systems), 4)},
+        "peak_rss_kib": max(rss),
+    })
+    return result
+
+
+def parse_variant(text):
+    name, sep, cdrive_args = text.partition("=")
+    if not sep or not name:
+        raise argparse.ArgumentTypeError("expected NAME=\"cdrive args\"")
+    return name, shlex.split(cdrive_args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--cdrive", default="out/dist/cdrive")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--upload-files", type=int, default=50, help="files in upload_small")
+    parser.add_argument("--upload-size", type=int, default=64 << 10, help="bytes per upload_small file")
+    parser.add_argument("--large-mb", type=int, default=64, help="size of the large upload and download")
+    parser.add_argument("--list-files", type=int, default=5000, help="files in the listed folder")
+    parser.add_argument("--only", help="comma-separated scenarios to run")
+    parser.add_argument("--net", default="lan",
+                        help="comma-separated network profiles: %s" % ", ".join(NET_PROFILES))
+    parser.add_argument("--variant", type=parse_variant, action="append", default=[],
+                        help='NAME="cdrive args" to compare (repeatable)')
+    parser.add_argument("--fault-seed", default="1", help="seed for the server's random choices")
+    parser.add_argument("--server-arg", action="append", default=[],
+                        help="extra argument for mock_drive.py (repeatable)")
+    parser.add_argument("--output", help="also write the results to this file")
+    args = parser.parse_args()
+    args.cdrive = os.path.abspath(args.cdrive)
+    if not os.access(args.cdrive, os.X_OK):
+        sys.exit("cdrive binary not found: %s (run make first)" % args.cdrive)
+    nets = args.net.split(",")
+    unknown = [n for n in nets if n not in NET_PROFILES]
+    if unknown:
+        sys.exit("unknown network profile(s): %s" % ", ".join(unknown))
+    variants = args.variant or [("default", [])]
+
+    work = tempfile.mkdtemp(prefix="cdrive-bench-")
+    server = None
+    try:
+        make_home(work)
+        env = dict(os.environ, HOME=work, CDRIVE_NO_DAEMON="1")
+        env.pop("CDRIVE_DAEMON_SOCKET", None)
+
+        small_dir = os.path.join(work, "small")
+        os.makedirs(small_dir)
+        for i in range(args.upload_files):
+            with open(os.path.join(small_dir, "up-%04d.bin" % i), "wb") as f:
+                f.write(os.urandom(args.upload_size))
+        large_path = os.path.join(work, "large.bin")
+        with open(large_path, "wb") as f:
+            for _ in range(args.large_mb):
+                f.write(os.urandom(1 << 20))
+        download_path = os.path.join(work, "download.bin")
+
+        def clear_download():
+            for path in (download_path, download_path + ".part"):
+                if os.path.exists(path):
+                    os.remove(path)
+
+        scenarios = {
+            "upload_small": lambda ctx: scenario(
+                "upload_small", args, ctx, ["upload", os.path.join(small_dir, "*.bin"), "bench-uploads"],
+                args.upload_files * args.upload_size),
+            "upload_large": lambda ctx: scenario(
+                "upload_large", args, ctx, ["upload", large_path, "bench-uploads"], args.large_mb << 20),
+            "download_large": lambda ctx: scenario(
+                "download_large", args, ctx, ["pull", "bench-large", download_path], args.large_mb << 20,
+                prepare=clear_download),
+            "list_recursive": lambda ctx: scenario(
+                "list_recursive", args, ctx, ["list", "-R", "bench-small"], 0),
+        }
+        wanted = args.only.split(",") if args.only else list(scenarios)
+        unknown = [w for w in wanted if w not in scenarios]
+        if unknown:
+            sys.exit("unknown scenario(s): %s" % ", ".join(unknown))
+
+        out = open(args.output, "w") if args.output else None
+        failed = 0
+        for net in nets:
+            server, root = start_server(args, net)
+            for variant, cdrive_args in variants:
+                ctx = {"net": net, "variant": variant, "cdrive_args": cdrive_args, "root": root,
+                       "work": work, "env": dict(env, CDRIVE_API_ROOT=root)}
+                for name in wanted:
+                    result = scenarios[name](ctx)
+                    failed += not result["ok"]
+                    line = json.dumps(result)
+                    print(line, flush=True)
+                    if out:
+                        out.write(line + "\n")
+            server.terminate()
+            server.wait()
+            server = None
+        if out:
+            out.close()
+        return 1 if failed else 0
+    finally:
+        if server:
+            server.terminate()
+            server.wait()
+        shutil.rmtree(work, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
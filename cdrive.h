@@ -18,6 +18,19 @@
 #include <json-c/json.h>
 #include "download.h"
 #include "compat.h"
+#include "jstream.h"
+#include "arena.h"
+#include "listing.h"
+#include "hashcache.h"
+#include "retry.h"
+#include "pacer.h"
+#include "limiter.h"
+#include "netcache.h"
+#include "transport.h"
+#include "trace.h"
+#include "metrics.h"
+#include "profile.h"
+#include "probes.h"
 
 // Platform-specific includes
 #ifdef _WIN32 // Windows specific definitions
@@ -59,6 +72,8 @@
 #define MAX_RESPONSE_SIZE 8192
 #define CONFIG_DIR ".cdrive"
 #define TOKEN_FILE "token.json"
+#define TOKEN_LOCK_FILE "token.lock"
+#define TOKEN_LOCK_TIMEOUT_MS 30000
 #define CLIENT_ID_FILE "client_id.json"
 #define UPDATE_CACHE_FILE "update_cache.json"
 #define UPDATE_CACHE_EXPIRE_HOURS 4  // Cache update checks for 4 hours
@@ -79,12 +94,53 @@
 
 // OAuth2 Configuration
 #define OAUTH_AUTH_URL "https://accounts.google.com/o/oauth2/v2/auth"
-#define OAUTH_TOKEN_URL "https://oauth2.googleapis.com/token"
-#define DRIVE_API_URL "https://www.googleapis.com/drive/v3/files"
-#define UPLOAD_API_URL "https://www.googleapis.com/upload/drive/v3/files"
 #define REDIRECT_URI "http://localhost:8080"
 #define SCOPE "https://www.googleapis.com/auth/drive"
 
+// API endpoints. CDRIVE_API_ROOT (e.g. http://127.0.0.1:8765) sends every
+// Drive and token request to that server instead, under the same paths
+// (the token endpoint at <root>/token); bench/mock_drive.py is one. Plain
+// http:// roots must be loopback addresses.
+#define API_ROOT_ENV "CDRIVE_API_ROOT"
+typedef enum {
+    API_FILES,      // .../drive/v3/files
+    API_UPLOAD,     // .../upload/drive/v3/files
+    API_ABOUT,      // .../drive/v3/about
+    API_CHANGES,    // .../drive/v3/changes
+    API_TOKEN,      // OAuth token endpoint
+    API_URL_COUNT
+} ApiUrl;
+const char *api_url(ApiUrl which);
+// Take CDRIVE_API_ROOT from the environment again; only between daemon
+// commands, with no requests in flight
+void api_urls_reload(void);
+#define OAUTH_TOKEN_URL api_url(API_TOKEN)
+#define DRIVE_API_URL api_url(API_FILES)
+#define UPLOAD_API_URL api_url(API_UPLOAD)
+
+// Fields requested back from media uploads
+#define UPLOAD_RESULT_FIELDS "id,md5Checksum,headRevisionId"
+
+// A single media upload. Without file_id a new file is created under
+// parent_id; with file_id the existing file's content is replaced in place
+// (files.update), so its ID and sharing stay the same.
+typedef struct {
+    const char *source_path;
+    const char *name;        // Remote name for new files (defaults to the basename)
+    const char *parent_id;   // NULL or "root" for My Drive
+    const char *file_id;
+    int show_progress;
+} UploadRequest;
+
+typedef struct {
+    char id[128];
+    char md5[33];
+    char head_revision[128];
+    long http_code;
+    char protocol[16];       // HTTP version the media went over
+    char local_md5[33];      // Of the bytes sent, taken as they streamed; "" if not read through in order
+} UploadResult;
+
 // Menu options
 typedef enum {
     MENU_CREDENTIALS = 0,
@@ -93,9 +149,13 @@ typedef enum {
 } MenuOption;
 
 // Structures
+// Response body buffer. Grows geometrically; when arena is set the buffer
+// lives in that arena and must not be passed to free().
 typedef struct {
     char *data;
     size_t size;
+    size_t capacity;
+    Arena *arena;
 } APIResponse;
 
 typedef struct {
@@ -110,24 +170,33 @@ typedef struct {
     char client_secret[256];
 } ClientCredentials;
 
+// Options for `cdrive list`
+#define LIST_ONLY_ALL 0
+#define LIST_ONLY_FOLDERS 1
+#define LIST_ONLY_FILES 2
+
 typedef struct {
-    char id[64];
-    char name[256];
-    char webViewLink[MAX_URL_SIZE];
-    char webContentLink[MAX_URL_SIZE];
-} DriveFile;
+    ListingSortKey sort;   // LISTING_SORT_NONE keeps Drive's order
+    int descending;
+    int only;              // LIST_ONLY_*
+} ListOptions;
 
 // Global variables (declared in main.c)
 extern ClientCredentials g_client_creds;
 extern OAuthTokens g_tokens;
 extern char g_last_upload_link[MAX_URL_SIZE];
 extern int g_json_mode;
+extern int g_jobs;
 
 // Function declarations
 int cdrive_auth_login(int headless);
-int cdrive_upload(const char *source_path, const char *target_folder);
-int cdrive_list_files(const char *folder_id);
+// hashes (optional) is used to check the uploaded bytes against the local file
+int cdrive_upload(const char *source_path, const char *target_folder, HashCache *hashes);
+int cdrive_upload_media(const UploadRequest *req, UploadResult *result);
+int cdrive_list_files(const char *folder_id, const ListOptions *opts);
 int cdrive_create_folder(const char *folder_name, const char *parent_id);
+int cdrive_create_folder_id(const char *folder_name, const char *parent_id, char *id_out, size_t id_size);
+int cdrive_du(const char *folder_id, int top_k);
 
 // Version and update information
 #define CDRIVE_VERSION "1.0.2"
@@ -149,10 +218,28 @@ int save_tokens(const OAuthTokens *tokens);
 int load_tokens(OAuthTokens *tokens);
 int load_client_credentials(ClientCredentials *creds);
 int refresh_access_token(OAuthTokens *tokens);
+// Thread-safe access to g_tokens once a command is running. Builds the
+// Authorization header and returns the token generation it came from.
+unsigned token_auth_header(char *out, size_t size);
+// Refresh after a 401 on a request built from seen_generation. Concurrent
+// callers share one refresh. Returns 1 if this call refreshed, 0 if it
+// reused another caller's refresh, -1 on failure.
+int token_refresh(unsigned seen_generation);
 int get_user_info(char *user_name, size_t name_size);
 char *get_file_mime_type(const char *filename);
 size_t write_response_callback(char *contents, size_t size, size_t nmemb, void *userp);
+void api_response_free(APIResponse *response);
+// json_tokener_parse() for response bodies, timed under --profile
+json_object *cdrive_json_parse(const char *data);
+// Easy handles on the process-wide connection pool; use these for Drive and
+// OAuth requests (cdrive_easy_setup() again after curl_easy_reset())
+CURL *cdrive_easy_init(void);
+void cdrive_easy_setup(CURL *curl);
+// curl_easy_perform() plus per-transfer accounting (--stats protocols,
+// --trace-timing)
+CURLcode cdrive_easy_perform(CURL *curl);
 int cdrive_api_get(const char *url, APIResponse *response);
+int cdrive_api_get_stream(const char *url, JsonStream *stream);
 void print_usage(void);
 void print_version(void);
 void print_version_with_update_check(void);
@@ -162,11 +249,13 @@ int download_and_install_update(const UpdateInfo *update_info, int auto_install)
 int compare_versions(const char *current, const char *latest);
 int start_local_server(char *auth_code, const char *auth_url, int open_browser);
 char *url_encode(const char *str);
+void url_append_param(char *url, size_t url_size, const char *name, const char *value);
+void format_size(char *buf, size_t size, double bytes);
 
 // Search and share commands
 int cdrive_search(const char *query);
 int cdrive_share(const char *file_id, const char *email, const char *role);
-int cdrive_glob(const char *pattern, char ***results, int *count);
+int cdrive_glob(Arena *arena, const char *pattern, char ***results, int *count);
 
 // Interactive UI functions
 int show_interactive_menu(const char *title, const char **options, int num_options);
@@ -56,6 +56,20 @@
     static inline int cdrive_socket_write(cdrive_socket_t fd, const char *buf, int len) { return write(fd, buf, len); }
 #endif
 
+// Nanosecond stat timestamps (st_mtim is st_mtimespec on macOS; whole seconds on Windows)
+#ifndef _WIN32
+    #ifdef __APPLE__
+        #define CDRIVE_STAT_MTIME_NS(st) ((long long)(st).st_mtimespec.tv_sec * 1000000000LL + (st).st_mtimespec.tv_nsec)
+        #define CDRIVE_STAT_CTIME_NS(st) ((long long)(st).st_ctimespec.tv_sec * 1000000000LL + (st).st_ctimespec.tv_nsec)
+    #else
+        #define CDRIVE_STAT_MTIME_NS(st) ((long long)(st).st_mtim.tv_sec * 1000000000LL + (st).st_mtim.tv_nsec)
+        #define CDRIVE_STAT_CTIME_NS(st) ((long long)(st).st_ctim.tv_sec * 1000000000LL + (st).st_ctim.tv_nsec)
+    #endif
+#else
+    #define CDRIVE_STAT_MTIME_NS(st) ((long long)(st).st_mtime * 1000000000LL)
+    #define CDRIVE_STAT_CTIME_NS(st) ((long long)(st).st_ctime * 1000000000LL)
+#endif
+
 // Platform-compatible getch for interactive terminal
 #ifdef _WIN32
     #include <conio.h>
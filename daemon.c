@@ -0,0 +1,568 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "daemon.h"
+
+int g_daemon_worker = 0;
+
+#ifdef _WIN32
+
+int daemon_forward(int argc, char *argv[], int *exit_code) {
+    (void)argc;
+    (void)argv;
+    (void)exit_code;
+    return -1;
+}
+
+int cdrive_daemon(const char *action) {
+    (void)action;
+    print_error("The daemon is not supported on Windows.");
+    return -1;
+}
+
+#else
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define DAEMON_MAGIC 0x43445231u   // "CDR1"
+
+// Sent first, with the client's stdin, stdout and stderr attached as
+// SCM_RIGHTS; followed by `length` bytes: cwd, argv, then envc entries of
+// g_forwarded_env ("NAME=value", or "NAME" when unset), NUL-separated
+typedef struct {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t length;
+    uint32_t envc;
+} DaemonRequest;
+
+// Commands that only talk to Drive and print; everything interactive,
+// long-running or signal-driven stays in the calling process
+static const char *const g_forwardable[] = {
+    "upload", "list", "mkdir", "du", "sync", "pull", "search", "share", NULL
+};
+
+// Environment a command takes from the client rather than the daemon
+static const char *const g_forwarded_env[] = {
+    "http_proxy", "HTTP_PROXY", "https_proxy", "HTTPS_PROXY", "all_proxy", "ALL_PROXY",
+    "no_proxy", "NO_PROXY", API_ROOT_ENV, "CDRIVE_MD5_BACKEND", NULL
+};
+#define FORWARDED_ENV_COUNT (sizeof(g_forwarded_env) / sizeof(g_forwarded_env[0]) - 1)
+
+// The worker's own values, put back after each command
+static char *g_daemon_env[FORWARDED_ENV_COUNT];
+
+static volatile sig_atomic_t g_daemon_stop = 0;
+
+static void daemon_signal_handler(int sig) {
+    (void)sig;
+    g_daemon_stop = 1;
+}
+
+static int daemon_path(char *out, size_t size, const char *name) {
+    const char *home = getenv(HOME_ENV);
+    if (!home) return -1;
+    int n = snprintf(out, size, "%s/%s/%s", home, CONFIG_DIR, name);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+static int socket_address(struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    return daemon_path(addr->sun_path, sizeof(addr->sun_path), DAEMON_SOCKET_FILE);
+}
+
+static int connect_daemon(void) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int daemon_running(void) {
+    int fd = connect_daemon();
+    if (fd < 0) return 0;
+    close(fd);
+    return 1;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// First argument that is not a global flag (flags with a value skip it)
+static const char *command_name(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "--retry-budget") == 0 ||
+            strcmp(argv[i], "--quota") == 0) {
+            i++;
+        } else if (strncmp(argv[i], "--", 2) != 0) {
+            return argv[i];
+        }
+    }
+    return NULL;
+}
+
+int daemon_can_run(int argc, char *argv[]) {
+    const char *command = command_name(argc, argv);
+    int forwardable = 0;
+    for (int i = 0; command && g_forwardable[i]; i++) {
+        if (strcmp(command, g_forwardable[i]) == 0) forwardable = 1;
+    }
+    // Bare `pull` is the interactive browser
+    return forwardable && !(strcmp(command, "pull") == 0 && argc < 3) && argc <= DAEMON_MAX_ARGS;
+}
+
+int daemon_forward(int argc, char *argv[], int *exit_code) {
+    const char *no_daemon = getenv("CDRIVE_NO_DAEMON");
+    if (no_daemon && no_daemon[0] && strcmp(no_daemon, "0") != 0) return -1;
+    if (!daemon_can_run(argc, argv)) return -1;
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+
+    size_t length = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) length += strlen(argv[i]) + 1;
+    for (size_t i = 0; i < FORWARDED_ENV_COUNT; i++) {
+        const char *value = getenv(g_forwarded_env[i]);
+        length += strlen(g_forwarded_env[i]) + (value ? strlen(value) + 1 : 0) + 1;
+    }
+    if (length > DAEMON_MAX_REQUEST) return -1;
+
+    int fd = connect_daemon();
+    if (fd < 0) return -1;
+
+    char *payload = malloc(length);
+    if (!payload) {
+        close(fd);
+        return -1;
+    }
+    size_t off = 0;
+    memcpy(payload, cwd, strlen(cwd) + 1);
+    off += strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) {
+        memcpy(payload + off, argv[i], strlen(argv[i]) + 1);
+        off += strlen(argv[i]) + 1;
+    }
+    for (size_t i = 0; i < FORWARDED_ENV_COUNT; i++) {
+        const char *value = getenv(g_forwarded_env[i]);
+        if (value) off += (size_t)sprintf(payload + off, "%s=%s", g_forwarded_env[i], value) + 1;
+        else off += (size_t)sprintf(payload + off, "%s", g_forwarded_env[i]) + 1;
+    }
+
+    DaemonRequest req = { DAEMON_MAGIC, (uint32_t)argc, (uint32_t)length, (uint32_t)FORWARDED_ENV_COUNT };
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // Nothing has run yet if sending fails, so the caller can still fall back
+    fflush(stdout);
+    fflush(stderr);
+    ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    int ok = sent == (ssize_t)sizeof(req) && write_all(fd, payload, length) == 0;
+    free(payload);
+    if (!ok) {
+        close(fd);
+        return -1;
+    }
+
+    int32_t code;
+    if (read_all(fd, &code, sizeof(code)) != 0) {
+        // Past this point the command may have done things; do not rerun it
+        print_error("Lost the connection to the cdrive daemon");
+        code = 1;
+    }
+    close(fd);
+    *exit_code = code;
+    return 0;
+}
+
+// --- Daemon side ---
+
+static int peer_is_owner(int fd) {
+#ifdef __linux__
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+static int forwarded_env_index(const char *name, size_t len) {
+    for (size_t i = 0; i < FORWARDED_ENV_COUNT; i++) {
+        if (strlen(g_forwarded_env[i]) == len && strncmp(g_forwarded_env[i], name, len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// Give the command the client's proxy and cdrive settings. Names outside
+// g_forwarded_env are ignored, and ones the client did not send keep the
+// daemon's value.
+static void apply_client_env(char *const *entries, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const char *eq = strchr(entries[i], '=');
+        size_t len = eq ? (size_t)(eq - entries[i]) : strlen(entries[i]);
+        int index = forwarded_env_index(entries[i], len);
+        if (index < 0) continue;
+        if (eq) setenv(g_forwarded_env[index], eq + 1, 1);
+        else unsetenv(g_forwarded_env[index]);
+    }
+}
+
+static void restore_daemon_env(void) {
+    for (size_t i = 0; i < FORWARDED_ENV_COUNT; i++) {
+        if (g_daemon_env[i]) setenv(g_forwarded_env[i], g_daemon_env[i], 1);
+        else unsetenv(g_forwarded_env[i]);
+    }
+}
+
+// Receive a request; fills argv and env (pointing into *payload) and the
+// client fds
+static int receive_request(int conn, char **payload, char **cwd, int *argc, char *argv[],
+                           char *env[], uint32_t *envc, int fds[3]) {
+    DaemonRequest req;
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    fds[0] = fds[1] = fds[2] = -1;
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 3)) {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
+    }
+    if (n != (ssize_t)sizeof(req) || fds[2] < 0 || req.magic != DAEMON_MAGIC ||
+        req.argc < 1 || req.argc > DAEMON_MAX_ARGS || req.length > DAEMON_MAX_REQUEST ||
+        req.envc > FORWARDED_ENV_COUNT) {
+        return -1;
+    }
+
+    *payload = malloc(req.length + 1);
+    if (!*payload || read_all(conn, *payload, req.length) != 0) return -1;
+    (*payload)[req.length] = '\0';
+
+    char *p = *payload;
+    char *end = *payload + req.length;
+    *cwd = p;
+    p += strlen(p) + 1;
+    for (uint32_t i = 0; i < req.argc; i++) {
+        if (p >= end) return -1;
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+    argv[req.argc] = NULL;
+    *argc = (int)req.argc;
+    for (uint32_t i = 0; i < req.envc; i++) {
+        if (p >= end) return -1;
+        env[i] = p;
+        p += strlen(p) + 1;
+    }
+    *envc = req.envc;
+    return 0;
+}
+
+// Per-command globals go back to their defaults; the warm state (curl,
+// connection pool, tokens, client credentials) carries over
+static void reset_command_state(void) {
+    g_json_mode = 0;
+    g_jobs = 0;
+    g_show_stats = 0;
+    g_http3 = 0;
+    g_last_upload_link[0] = '\0';
+    retry_reset();
+    transport_reset();
+    trace_reset();
+    metrics_reset();
+    profile_reset();
+    pacer_set_quota(PACER_DEFAULT_QUOTA);
+    // Settings read once per process, from an environment that may have changed
+    api_urls_reload();
+    md5_multi_reselect();
+}
+
+int daemon_run_command(int argc, char *argv[]) {
+    reset_command_state();
+    int code = cdrive_main(argc, argv);
+    if (g_show_stats) retry_print_stats();
+    trace_print_summary();
+    metrics_write();
+    profile_print();
+    fflush(stdout);
+    fflush(stderr);
+    arena_free(&g_arena);
+    return code;
+}
+
+static void serve(int conn, int saved[3]) {
+    char *payload = NULL;
+    char *cwd = NULL;
+    char *argv[DAEMON_MAX_ARGS + 1];
+    char *env[FORWARDED_ENV_COUNT];
+    uint32_t envc = 0;
+    int argc = 0;
+    int fds[3];
+    int32_t code = 1;
+
+    if (peer_is_owner(conn) && receive_request(conn, &payload, &cwd, &argc, argv, env, &envc, fds) == 0 &&
+        chdir(cwd) == 0) {
+        for (int i = 0; i < 3; i++) dup2(fds[i], i);
+        // Interactive clients expect prompt output, as they would in-process
+        setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, 0);
+
+        apply_client_env(env, envc);
+        code = daemon_run_command(argc, argv);
+        restore_daemon_env();
+        for (int i = 0; i < 3; i++) dup2(saved[i], i);
+    }
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(payload);
+
+    write_all(conn, &code, sizeof(code));
+    close(conn);
+}
+
+static void worker_loop(int listen_fd) {
+    g_daemon_worker = 1;
+    // A client that goes away must not take the worker with it
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+
+    int saved[3];
+    for (int i = 0; i < 3; i++) saved[i] = dup(i);
+    for (size_t i = 0; i < FORWARDED_ENV_COUNT; i++) {
+        const char *value = getenv(g_forwarded_env[i]);
+        g_daemon_env[i] = value ? strdup(value) : NULL;
+    }
+
+    for (int served = 0; served < DAEMON_REQUESTS_PER_WORKER; served++) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        serve(conn, saved);
+    }
+    // _exit() skips atexit handlers
+    netcache_save();
+    _exit(0);
+}
+
+static pid_t spawn_worker(int listen_fd) {
+    pid_t pid = fork();
+    if (pid == 0) worker_loop(listen_fd);
+    return pid;
+}
+
+// Bind the socket and supervise the workers until SIGTERM/SIGINT
+static int run_daemon(void) {
+    struct sockaddr_un addr;
+    char pid_path[PATH_MAX];
+    if (setup_config_dir() != 0 || socket_address(&addr) != 0 ||
+        daemon_path(pid_path, sizeof(pid_path), DAEMON_PID_FILE) != 0) {
+        print_error("Could not prepare ~/.cdrive for the daemon");
+        return -1;
+    }
+    // Only a socket nobody answers on is stale; never take over a live daemon
+    if (daemon_running()) {
+        print_error("The cdrive daemon is already running.");
+        return -1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return -1;
+    unlink(addr.sun_path);   // Stale socket from a daemon that did not shut down
+    mode_t old_mask = umask(0177);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(listen_fd, 128) != 0) {
+        perror("cdrive daemon");
+        close(listen_fd);
+        return -1;
+    }
+
+    FILE *pid_file = fopen(pid_path, "w");
+    if (pid_file) {
+        fprintf(pid_file, "%ld\n", (long)getpid());
+        fclose(pid_file);
+    }
+
+    // Warm state every worker inherits: curl stays initialized for the
+    // daemon's lifetime, and credentials are read once
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (load_tokens(&g_tokens) != 0) {
+        print_warning("Not authenticated yet; commands will fail until 'cdrive auth login' is run.");
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    pid_t workers[DAEMON_WORKERS] = {0};
+    while (!g_daemon_stop) {
+        for (int i = 0; i < DAEMON_WORKERS; i++) {
+            if (workers[i] <= 0) workers[i] = spawn_worker(listen_fd);
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        for (int i = 0; pid > 0 && i < DAEMON_WORKERS; i++) {
+            if (workers[i] == pid) workers[i] = 0;
+        }
+    }
+
+    for (int i = 0; i < DAEMON_WORKERS; i++) {
+        if (workers[i] > 0) kill(workers[i], SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0) {}
+    close(listen_fd);
+    unlink(addr.sun_path);
+    unlink(pid_path);
+    curl_global_cleanup();
+    return 0;
+}
+
+static long read_pid(void) {
+    char pid_path[PATH_MAX];
+    if (daemon_path(pid_path, sizeof(pid_path), DAEMON_PID_FILE) != 0) return -1;
+    FILE *fp = fopen(pid_path, "r");
+    if (!fp) return -1;
+    long pid = -1;
+    if (fscanf(fp, "%ld", &pid) != 1) pid = -1;
+    fclose(fp);
+    return pid;
+}
+
+static int start_daemon(void) {
+    if (daemon_running()) {
+        print_info("The cdrive daemon is already running.");
+        return 0;
+    }
+
+    char log_path[PATH_MAX];
+    if (setup_config_dir() != 0 || daemon_path(log_path, sizeof(log_path), DAEMON_LOG_FILE) != 0) {
+        print_error("Could not prepare ~/.cdrive for the daemon");
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        print_error("Could not start the daemon");
+        return -1;
+    }
+    if (pid == 0) {
+        setsid();
+        int null_fd = open("/dev/null", O_RDWR);
+        int log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+        }
+        if (log_fd >= 0) dup2(log_fd, STDERR_FILENO);
+        _exit(run_daemon() == 0 ? 0 : 1);
+    }
+
+    // Wait for the socket to come up so the next command already uses it
+    for (int i = 0; i < 100 && !daemon_running(); i++) cdrive_usleep(20 * 1000);
+    if (!daemon_running()) {
+        print_error("The daemon did not start; see ~/.cdrive/daemon.log");
+        return -1;
+    }
+    print_success("cdrive daemon started");
+    return 0;
+}
+
+static int stop_daemon(void) {
+    // After a crash the pid file may name an unrelated process by now
+    if (!daemon_running()) {
+        char pid_path[PATH_MAX];
+        if (daemon_path(pid_path, sizeof(pid_path), DAEMON_PID_FILE) == 0) unlink(pid_path);
+        print_info("The cdrive daemon is not running.");
+        return 0;
+    }
+    long pid = read_pid();
+    if (pid <= 0 || kill((pid_t)pid, SIGTERM) != 0) {
+        print_error("Could not signal the cdrive daemon; is ~/.cdrive/daemon.pid current?");
+        return -1;
+    }
+    for (int i = 0; i < 250 && daemon_running(); i++) cdrive_usleep(20 * 1000);
+    print_success("cdrive daemon stopped");
+    return 0;
+}
+
+int cdrive_daemon(const char *action) {
+    if (strcmp(action, "start") == 0) return start_daemon();
+    if (strcmp(action, "stop") == 0) return stop_daemon();
+    if (strcmp(action, "run") == 0) return run_daemon();
+    if (strcmp(action, "status") == 0) {
+        if (daemon_running()) {
+            print_colored("[*] ", COLOR_BLUE);
+            printf("cdrive daemon is running (pid %ld)\n", read_pid());
+        } else {
+            print_info("The cdrive daemon is not running.");
+        }
+        return 0;
+    }
+    print_error("Unknown daemon action");
+    return -1;
+}
+
+#endif // _WIN32
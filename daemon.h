@@ -0,0 +1,35 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#define DAEMON_SOCKET_FILE "daemon.sock"
+#define DAEMON_PID_FILE "daemon.pid"
+#define DAEMON_LOG_FILE "daemon.log"
+#define DAEMON_WORKERS 4                 // Commands served at once
+#define DAEMON_REQUESTS_PER_WORKER 1000  // Recycle workers to bound any leaks
+#define DAEMON_MAX_ARGS 256
+#define DAEMON_MAX_REQUEST (64 * 1024)
+
+// Set in daemon worker processes, which run many commands in turn
+extern int g_daemon_worker;
+
+// The whole CLI, as run in-process; main() and daemon workers call it
+int cdrive_main(int argc, char *argv[]);
+
+// Run the command in a running daemon, passing it our cwd and stdio. Returns
+// 0 with the command's exit code in exit_code, or -1 if the command must run
+// in-process (no daemon, CDRIVE_NO_DAEMON set, or a command that needs this
+// process, like auth or watch).
+int daemon_forward(int argc, char *argv[], int *exit_code);
+
+// Whether a command can run away from the calling process: it only talks
+// to Drive and prints (no prompts, browser or signal handling)
+int daemon_can_run(int argc, char *argv[]);
+
+// Run one command in a process that serves many (a daemon or batch worker):
+// per-command globals are reset first and stdio flushed after. Unix only.
+int daemon_run_command(int argc, char *argv[]);
+
+// `cdrive daemon start|stop|status|run`
+int cdrive_daemon(const char *action);
+
+#endif // DAEMON_H
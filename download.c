@@ -5,26 +5,20 @@
 #include <stdlib.h>  // Needed for system()
 #include <string.h>  // Needed for strlen
 
-// Struct to hold file information for the interactive browser
-typedef struct {
-    char id[256];
-    char name[256];
-    int is_folder;
-} BrowserFile;
-
 // Struct to manage data for both file writing and progress bar
 struct DownloadProgressData {
     FILE *fp;
     time_t start_time;
     const char *filename;
+    CURL *curl;
+    RetryErrorBody error;   // Error responses are kept out of the .part file
 };
 
 
 // --- Forward declarations for local functions ---
-static int fetch_files_for_browser(const char *folder_id, BrowserFile **files, int *count);
+static int fetch_files_for_browser(const char *folder_id, Listing *files);
 static int get_file_metadata(const char *file_id, char *filename_out, size_t filename_size);
 static int download_file_with_progress(const char *file_id, const char *filename);
-static void format_size(char *buf, size_t size, double bytes);
 static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
 static size_t write_file_callback(void *ptr, size_t size, size_t nmemb, void *stream);
 
@@ -62,18 +56,24 @@ int cdrive_pull_file_by_id(const char *file_id, const char *output_filename) {
 int cdrive_pull_interactive(void) {
     char current_folder_id[256] = "root";
     char current_folder_name[256] = "My Drive";
+    int result = 0;
 
     while (1) {
-        BrowserFile *files = NULL;
-        int file_count = 0;
+        // Option strings for one folder view are dropped in one rewind
+        ArenaMark scope = arena_mark(&g_arena);
+        Listing files;
+        listing_init(&files);
 
-        if (fetch_files_for_browser(current_folder_id, &files, &file_count) != 0) {
+        if (fetch_files_for_browser(current_folder_id, &files) != 0) {
             print_error("Failed to fetch files from Google Drive.");
-            if (files) free(files);
-            return -1;
+            listing_free(&files);
+            result = -1;
+            break;
         }
 
+        int file_count = files.order_count;
         if (file_count == 0) {
+            listing_free(&files);
             print_info("This folder is empty. Press enter to go back.");
             getchar();
             if (strcmp(current_folder_id, "root") != 0) {
@@ -85,20 +85,14 @@ int cdrive_pull_interactive(void) {
             }
         }
 
-        const char **options = malloc(sizeof(char *) * (file_count + 2));
-        if (!options) { print_error("Memory allocation failed."); free(files); return -1; }
-
-        char **option_strings = malloc(sizeof(char *) * file_count);
-        if (!option_strings) { print_error("Memory allocation failed."); free(files); free(options); return -1; }
+        const char **options = arena_alloc(&g_arena, sizeof(char *) * (size_t)(file_count + 2));
+        if (!options) { print_error("Memory allocation failed."); listing_free(&files); result = -1; break; }
 
-        for (int i = 0; i < file_count; i++) {
-            option_strings[i] = malloc(512);
-            if (files[i].is_folder) {
-                snprintf(option_strings[i], 512, "[DIR] %s", files[i].name);
-            } else {
-                snprintf(option_strings[i], 512, "[FILE] %s", files[i].name);
-            }
-            options[i] = option_strings[i];
+        for (int k = 0; k < file_count; k++) {
+            int i = (int)files.order[k];
+            const char *name = listing_name(&files, i);
+            options[k] = arena_sprintf(&g_arena, "%s %s", listing_is_folder(&files, i) ? "[DIR]" : "[FILE]", name);
+            if (!options[k]) options[k] = name;
         }
         options[file_count] = "[..] Go Back";
         options[file_count + 1] = "Exit Browser";
@@ -111,32 +105,28 @@ int cdrive_pull_interactive(void) {
         // Terminal was already restored by disable_raw_mode() inside show_interactive_menu.
         // The stty call was removed because it does not exist on Windows.
 
-        for (int i = 0; i < file_count; i++) { free(option_strings[i]); }
-        free(option_strings);
-        free(options);
-
-        if (choice == -1 || choice == file_count + 1) { free(files); break; }
+        if (choice == -1 || choice == file_count + 1) { listing_free(&files); break; }
 
         if (choice == file_count) {
             if (strcmp(current_folder_id, "root") != 0) {
                 strcpy(current_folder_id, "root");
                 strcpy(current_folder_name, "My Drive");
             }
-            free(files);
-            continue;
-        }
-
-        if (files[choice].is_folder) {
-            strcpy(current_folder_id, files[choice].id);
-            strcpy(current_folder_name, files[choice].name);
         } else {
-            download_file_with_progress(files[choice].id, files[choice].name);
+            int i = (int)files.order[choice];
+            if (listing_is_folder(&files, i)) {
+                snprintf(current_folder_id, sizeof(current_folder_id), "%s", listing_id(&files, i));
+                snprintf(current_folder_name, sizeof(current_folder_name), "%s", listing_name(&files, i));
+            } else {
+                download_file_with_progress(listing_id(&files, i), listing_name(&files, i));
+            }
         }
 
-        free(files);
+        listing_free(&files);
+        arena_rewind(&g_arena, scope);
     }
 
-    return 0;
+    return result;
 }
 
 
@@ -144,66 +134,43 @@ int cdrive_pull_interactive(void) {
 
 static int get_file_metadata(const char *file_id, char *filename_out, size_t filename_size) {
     APIResponse response = {0};
+    response.arena = &g_arena;
 
-    char url[1024];
-    snprintf(url, sizeof(url), "https://www.googleapis.com/drive/v3/files/%s?fields=name", file_id);
+    char *url = arena_sprintf(&g_arena, "%s/%s?fields=name", DRIVE_API_URL, file_id);
+    if (!url) return -1;
 
     if (cdrive_api_get(url, &response) != 0) {
         return -1;
     }
 
-    json_object *root = json_tokener_parse(response.data);
-    if (!root) { free(response.data); return -1; }
+    json_object *root = cdrive_json_parse(response.data);
+    if (!root) { api_response_free(&response); return -1; }
     json_object *name_obj;
     if (json_object_object_get_ex(root, "name", &name_obj)) {
         strncpy(filename_out, json_object_get_string(name_obj), filename_size - 1);
         filename_out[filename_size - 1] = '\0';
     } else {
         json_object_put(root);
-        free(response.data);
+        api_response_free(&response);
         return -1;
     }
     json_object_put(root);
-    free(response.data);
+    api_response_free(&response);
     return 0;
 }
 
-static int fetch_files_for_browser(const char *folder_id, BrowserFile **files, int *count) {
-    APIResponse response = {0};
-
-    char url[1024];
+static int fetch_files_for_browser(const char *folder_id, Listing *files) {
     char *encoded_folder_id = url_encode(folder_id);
-    snprintf(url, sizeof(url),
-             "%s?q='%s'%%20in%%20parents%%20and%%20trashed=false&fields=files(id,name,mimeType)&orderBy=folder,name",
-             DRIVE_API_URL, encoded_folder_id);
+    if (!encoded_folder_id) return -1;
+
+    char q[512];
+    snprintf(q, sizeof(q), "%%27%s%%27%%20in%%20parents%%20and%%20trashed=false", encoded_folder_id);
     free(encoded_folder_id);
 
-    if (cdrive_api_get(url, &response) != 0) {
-        return -1;
-    }
-    json_object *root = json_tokener_parse(response.data);
-    if (!root) { free(response.data); return -1; }
-    json_object *files_array;
-    if (json_object_object_get_ex(root, "files", &files_array)) {
-        *count = json_object_array_length(files_array);
-        *files = malloc(sizeof(BrowserFile) * (*count));
-        for (int i = 0; i < *count; i++) {
-            json_object *file_obj = json_object_array_get_idx(files_array, i);
-            json_object *id_obj, *name_obj, *mime_obj;
-            json_object_object_get_ex(file_obj, "id", &id_obj);
-            json_object_object_get_ex(file_obj, "name", &name_obj);
-            json_object_object_get_ex(file_obj, "mimeType", &mime_obj);
-            strncpy((*files)[i].id, json_object_get_string(id_obj), sizeof((*files)[i].id) - 1);
-            strncpy((*files)[i].name, json_object_get_string(name_obj), sizeof((*files)[i].name) - 1);
-            (*files)[i].is_folder = (strcmp(json_object_get_string(mime_obj), "application/vnd.google-apps.folder") == 0);
-        }
-    }
-    json_object_put(root);
-    free(response.data);
-    return 0;
+    return listing_fetch(files, q, "folder,name");
 }
 
-static void format_size(char *buf, size_t size, double bytes) {
+void format_size(char *buf, size_t size, double bytes) {
     const char *suffixes[] = {"B", "KB", "MB", "GB", "TB"};
     int i = 0;
     while (bytes >= 1024 && i < 4) {
@@ -214,7 +181,10 @@ static void format_size(char *buf, size_t size, double bytes) {
 }
 
 static size_t write_file_callback(void *ptr, size_t size, size_t nmemb, void *stream) {
+    PROFILE_SCOPE(PROF_DISK_WRITE);
     struct DownloadProgressData *data = (struct DownloadProgressData *)stream;
+    if (retry_capture_error(data->curl, &data->error, ptr, size * nmemb)) return size * nmemb;
+    PROBE_CHUNK_RECEIVED(size * nmemb);
     return fwrite(ptr, size, nmemb, data->fp);
 }
 
@@ -225,6 +195,7 @@ static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow
     double elapsed = difftime(now, data->start_time);
 
     if (dltotal <= 0) return 0;
+    PROFILE_SCOPE(PROF_PROGRESS);
 
     int percentage = (int)(((double)dlnow / (double)dltotal) * 100);
 
@@ -277,6 +248,7 @@ static int download_file_with_progress(const char *file_id, const char *filename
     CURL *curl;
     CURLcode res;
     long http_code = 0;
+    char protocol[16] = "unknown";
 
     // Build .part filename for resumable download
     char part_filename[MAX_PATH_SIZE + 5];
@@ -294,6 +266,7 @@ static int download_file_with_progress(const char *file_id, const char *filename
     // Get existing file size for resume
     fseek(fp, 0, SEEK_END);
     resume_offset = ftell(fp);
+    PROBE_FILE_OPEN(part_filename, file_id, resume_offset);
 
     if (resume_offset > 0) {
         print_info("Resuming partial download");
@@ -302,21 +275,23 @@ static int download_file_with_progress(const char *file_id, const char *filename
 
     struct DownloadProgressData progress_data = { .fp = fp, .filename = filename };
 
-    for (int attempt = 0; attempt < 2; attempt++) {
-        if (attempt > 0) {
-            if (refresh_access_token(&g_tokens) != 0 || save_tokens(&g_tokens) != 0) break;
-        }
-
-        curl = curl_easy_init();
+    RetryState retry = {0};
+    res = CURLE_FAILED_INIT;
+    for (;;) {
+        curl = cdrive_easy_init();
         if (!curl) break;
 
         char url[MAX_URL_SIZE];
-        snprintf(url, sizeof(url), "https://www.googleapis.com/drive/v3/files/%s?alt=media", file_id);
+        snprintf(url, sizeof(url), "%s/%s?alt=media", DRIVE_API_URL, file_id);
         char auth_header[MAX_HEADER_SIZE];
-        snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
+        retry.token_generation = token_auth_header(auth_header, sizeof(auth_header));
         struct curl_slist *headers = curl_slist_append(NULL, auth_header);
         
+        pacer_admit(PACE_MEDIA);
         progress_data.start_time = time(NULL);
+        progress_data.curl = curl;
+        progress_data.error.len = 0;
+        progress_data.error.data[0] = '\0';
 
         curl_easy_setopt(curl, CURLOPT_URL, url);
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
@@ -334,19 +309,31 @@ static int download_file_with_progress(const char *file_id, const char *filename
             curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, resume_offset);
         }
 
-        res = curl_easy_perform(curl);
+        res = cdrive_easy_perform(curl);
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        snprintf(protocol, sizeof(protocol), "%s", transport_protocol(curl));
+
+        // A resumed transfer answers 206 with the remaining bytes
+        if (res == CURLE_OK && (http_code == 200 || (http_code == 206 && resume_offset > 0))) {
+            http_code = 200;
+            curl_slist_free_all(headers);
+            curl_easy_cleanup(curl);
+            break;
+        }
+
+        int again = retry_next(&retry, curl, res, http_code, progress_data.error.data);
         curl_slist_free_all(headers);
         curl_easy_cleanup(curl);
+        if (!again) break;
 
-        if (res == CURLE_OK && http_code == 200) break;
-        if (res != CURLE_OK || (http_code != 401 && http_code != 403)) break;
-
+        // Pick up after whatever arrived before the failure
+        fflush(fp);
+        resume_offset = ftell(fp);
         fprintf(stderr, "\n");
-        print_warning("Authentication token expired. Refreshing and retrying...");
-        // Don't rewind — we are appending with "ab" mode
+        print_warning("Download interrupted. Retrying...");
     }
 
+    PROBE_FILE_CLOSE(part_filename, file_id, ftell(fp));
     fclose(fp);
 
     if (res != CURLE_OK || http_code != 200) {
@@ -374,5 +361,6 @@ static int download_file_with_progress(const char *file_id, const char *filename
 
     print_success("File downloaded successfully!");
     printf("Saved as: %s\n", filename);
+    if (g_http3) printf("Transferred over %s\n", protocol);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "walk.h"
+
+#define DU_DEFAULT_TOP 10
+#define DU_PROGRESS_INTERVAL_MS 500.0
+
+// Per-folder accumulator. Only folders get a node, so memory grows with the
+// number of folders rather than the number of items in the drive.
+typedef struct {
+    char *id;
+    char *path;
+    int parent;            // Index of the parent node, -1 for the root
+    long long self_bytes;  // Bytes of files directly inside this folder
+    long long total_bytes; // Filled in by the final roll-up
+    long long files;
+} DuNode;
+
+// Bounded min-heap that keeps the K largest entries seen so far
+typedef struct {
+    long long bytes;
+    char *path;
+    char *id;
+} DuHeapItem;
+
+typedef struct {
+    DuHeapItem *items;
+    int count;
+    int capacity;
+} DuHeap;
+
+typedef struct {
+    DuNode *nodes;
+    int node_count;
+    int node_capacity;
+
+    // ID -> node index, open addressing
+    int *index_slots;
+    size_t index_capacity;
+
+    DuHeap top_files;
+    long long total_bytes;
+    long long files;
+    long long folders;
+    int out_of_memory;   // A folder could not be recorded; the walk stopped
+    struct timespec last_progress;
+} DuState;
+
+static unsigned long du_hash(const char *s) {
+    unsigned long hash = 5381;
+    while (*s) hash = ((hash << 5) + hash) + (unsigned char)*s++;
+    return hash;
+}
+
+static int du_index_find(const DuState *state, const char *id) {
+    if (state->index_capacity == 0) return -1;
+    size_t i = du_hash(id) & (state->index_capacity - 1);
+    while (state->index_slots[i] >= 0) {
+        if (strcmp(state->nodes[state->index_slots[i]].id, id) == 0) return state->index_slots[i];
+        i = (i + 1) & (state->index_capacity - 1);
+    }
+    return -1;
+}
+
+static int du_index_rebuild(DuState *state, size_t capacity) {
+    int *slots = malloc(sizeof(int) * capacity);
+    if (!slots) return -1;
+    for (size_t i = 0; i < capacity; i++) slots[i] = -1;
+    for (int n = 0; n < state->node_count; n++) {
+        size_t i = du_hash(state->nodes[n].id) & (capacity - 1);
+        while (slots[i] >= 0) i = (i + 1) & (capacity - 1);
+        slots[i] = n;
+    }
+    free(state->index_slots);
+    state->index_slots = slots;
+    state->index_capacity = capacity;
+    return 0;
+}
+
+static int du_add_node(DuState *state, const char *id, const char *path, int parent) {
+    if (state->node_count == state->node_capacity) {
+        int new_capacity = state->node_capacity ? state->node_capacity * 2 : 256;
+        DuNode *nodes = realloc(state->nodes, sizeof(DuNode) * (size_t)new_capacity);
+        if (!nodes) return -1;
+        state->nodes = nodes;
+        state->node_capacity = new_capacity;
+    }
+    if ((size_t)(state->node_count + 1) * 2 > state->index_capacity) {
+        if (du_index_rebuild(state, state->index_capacity ? state->index_capacity * 2 : 512) != 0) return -1;
+    }
+
+    DuNode *node = &state->nodes[state->node_count];
+    memset(node, 0, sizeof(*node));
+    node->id = strdup(id);
+    node->path = strdup(path);
+    node->parent = parent;
+    if (!node->id || !node->path) {
+        free(node->id);
+        free(node->path);
+        return -1;
+    }
+
+    size_t i = du_hash(id) & (state->index_capacity - 1);
+    while (state->index_slots[i] >= 0) i = (i + 1) & (state->index_capacity - 1);
+    state->index_slots[i] = state->node_count;
+    return state->node_count++;
+}
+
+static void heap_swap(DuHeap *heap, int a, int b) {
+    DuHeapItem tmp = heap->items[a];
+    heap->items[a] = heap->items[b];
+    heap->items[b] = tmp;
+}
+
+static void heap_sift_down(DuHeap *heap, int i) {
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < heap->count && heap->items[left].bytes < heap->items[smallest].bytes) smallest = left;
+        if (right < heap->count && heap->items[right].bytes < heap->items[smallest].bytes) smallest = right;
+        if (smallest == i) return;
+        heap_swap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+// Offer an entry to the heap; copies the strings only if it is kept
+static void heap_offer(DuHeap *heap, long long bytes, const char *path, const char *id) {
+    if (heap->capacity <= 0) return;
+    if (heap->count == heap->capacity) {
+        if (bytes <= heap->items[0].bytes) return;
+        free(heap->items[0].path);
+        free(heap->items[0].id);
+        heap->items[0].bytes = bytes;
+        heap->items[0].path = strdup(path);
+        heap->items[0].id = strdup(id);
+        heap_sift_down(heap, 0);
+        return;
+    }
+
+    int i = heap->count++;
+    heap->items[i].bytes = bytes;
+    heap->items[i].path = strdup(path);
+    heap->items[i].id = strdup(id);
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap->items[parent].bytes <= heap->items[i].bytes) break;
+        heap_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_free(DuHeap *heap) {
+    for (int i = 0; i < heap->count; i++) {
+        free(heap->items[i].path);
+        free(heap->items[i].id);
+    }
+    free(heap->items);
+    memset(heap, 0, sizeof(*heap));
+}
+
+static void du_state_free(DuState *state) {
+    heap_free(&state->top_files);
+    for (int i = 0; i < state->node_count; i++) {
+        free(state->nodes[i].id);
+        free(state->nodes[i].path);
+    }
+    free(state->nodes);
+    free(state->index_slots);
+}
+
+static int compare_heap_desc(const void *a, const void *b) {
+    const DuHeapItem *x = (const DuHeapItem *)a;
+    const DuHeapItem *y = (const DuHeapItem *)b;
+    if (x->bytes < y->bytes) return 1;
+    if (x->bytes > y->bytes) return -1;
+    return 0;
+}
+
+static void du_print_progress(DuState *state, int force) {
+    if (g_json_mode) return;
+
+    struct timespec now;
+    clock_gettime_mono(&now);
+    double elapsed_ms = (now.tv_sec - state->last_progress.tv_sec) * 1000.0 +
+                        (now.tv_nsec - state->last_progress.tv_nsec) / 1000000.0;
+    if (!force && elapsed_ms < DU_PROGRESS_INTERVAL_MS) return;
+    state->last_progress = now;
+    PROFILE_SCOPE(PROF_PROGRESS);
+
+    char total_str[32];
+    format_size(total_str, sizeof(total_str), (double)state->total_bytes);
+    fprintf(stderr, "\r\033[K%s[*]%s Scanned %lld folder(s), %lld file(s): %s",
+            COLOR_BLUE, COLOR_RESET, state->folders, state->files, total_str);
+    fflush(stderr);
+}
+
+static int du_collect(const WalkEntry *entry, void *userdata) {
+    DuState *state = (DuState *)userdata;
+
+    int parent = du_index_find(state, entry->parent_id);
+    if (entry->is_folder) {
+        state->folders++;
+        // A folder already seen through another parent keeps its first placement
+        if (du_index_find(state, entry->id) < 0 &&
+            du_add_node(state, entry->id, entry->path, parent) < 0) {
+            state->out_of_memory = 1;
+            return 1;
+        }
+    } else {
+        long long bytes = entry->quota_bytes >= 0 ? entry->quota_bytes :
+                          (entry->size >= 0 ? entry->size : 0);
+        state->files++;
+        state->total_bytes += bytes;
+        if (parent >= 0) {
+            state->nodes[parent].self_bytes += bytes;
+            state->nodes[parent].files++;
+        }
+        heap_offer(&state->top_files, bytes, entry->path, entry->id);
+    }
+
+    du_print_progress(state, 0);
+    return 0;
+}
+
+static void du_print_heap(const char *title, DuHeap *heap) {
+    qsort(heap->items, (size_t)heap->count, sizeof(DuHeapItem), compare_heap_desc);
+
+    if (g_json_mode) {
+        printf("\"%s\":[", title);
+        for (int i = 0; i < heap->count; i++) {
+            printf("%s{\"id\":", i ? "," : "");
+            json_print_string(stdout, heap->items[i].id);
+            printf(",\"path\":");
+            json_print_string(stdout, heap->items[i].path);
+            printf(",\"bytes\":%lld}", heap->items[i].bytes);
+        }
+        printf("]");
+        return;
+    }
+
+    printf("\n");
+    print_colored(title, COLOR_BOLD);
+    printf("\n");
+    for (int i = 0; i < heap->count; i++) {
+        char size_str[32];
+        format_size(size_str, sizeof(size_str), (double)heap->items[i].bytes);
+        printf("  %12s  %-50s  ", size_str, heap->items[i].path[0] ? heap->items[i].path : ".");
+        print_colored(heap->items[i].id, COLOR_YELLOW);
+        printf("\n");
+    }
+}
+
+int cdrive_du(const char *folder_id, int top_k) {
+    if (load_tokens(&g_tokens) != 0) {
+        print_error("Not authenticated. Run 'cdrive auth login' first.");
+        return -1;
+    }
+    if (top_k <= 0) top_k = DU_DEFAULT_TOP;
+
+    DuState state;
+    memset(&state, 0, sizeof(state));
+    state.top_files.capacity = top_k;
+    state.top_files.items = calloc((size_t)top_k, sizeof(DuHeapItem));
+    if (!state.top_files.items || du_add_node(&state, folder_id, "", -1) != 0) {
+        print_error("Memory allocation failed.");
+        heap_free(&state.top_files);
+        return -1;
+    }
+    clock_gettime_mono(&state.last_progress);
+
+    WalkOptions opts = {0};
+    opts.concurrency = g_jobs;
+
+    WalkStats stats = {0};
+    int result = cdrive_walk(folder_id, &opts, du_collect, &state, &stats);
+    du_print_progress(&state, 1);
+    if (!g_json_mode) fprintf(stderr, "\n");
+    if (state.out_of_memory) {
+        // Totals would silently miss the folder's whole subtree
+        print_error("Memory allocation failed.");
+        du_state_free(&state);
+        return -1;
+    }
+
+    // Nodes are created parent-before-child, so a reverse sweep rolls every
+    // subtree total up into its ancestors in a single pass.
+    for (int i = state.node_count - 1; i >= 0; i--) {
+        state.nodes[i].total_bytes += state.nodes[i].self_bytes;
+        if (state.nodes[i].parent >= 0) {
+            state.nodes[state.nodes[i].parent].total_bytes += state.nodes[i].total_bytes;
+        }
+    }
+
+    DuHeap top_folders = {0};
+    top_folders.capacity = top_k;
+    top_folders.items = calloc((size_t)top_k, sizeof(DuHeapItem));
+    for (int i = 1; i < state.node_count; i++) {
+        heap_offer(&top_folders, state.nodes[i].total_bytes, state.nodes[i].path, state.nodes[i].id);
+    }
+
+    if (g_json_mode) {
+        printf("{\"command\":\"du\",\"folder\":");
+        json_print_string(stdout, folder_id);
+        printf(",\"total_bytes\":%lld,\"folders\":%lld,\"files\":%lld,",
+               state.total_bytes, state.folders, state.files);
+        du_print_heap("top_folders", &top_folders);
+        printf(",");
+        du_print_heap("top_files", &state.top_files);
+        printf("}\n");
+    } else {
+        char total_str[32];
+        format_size(total_str, sizeof(total_str), (double)state.total_bytes);
+        printf("\n");
+        print_colored("[+] ", COLOR_GREEN);
+        printf("Total: %s in %lld file(s), %lld folder(s)\n", total_str, state.files, state.folders);
+        du_print_heap("LARGEST FOLDERS", &top_folders);
+        du_print_heap("LARGEST FILES", &state.top_files);
+        printf("\n");
+    }
+
+    if (result != 0 && stats.failed_folders > 0) {
+        print_warning("Some folders could not be listed; totals are incomplete.");
+        fprintf(stderr, "%d folder(s) failed\n", stats.failed_folders);
+    }
+
+    heap_free(&top_folders);
+    du_state_free(&state);
+
+    return result;
+}
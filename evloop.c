@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "evloop.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <errno.h>
+#define EV_MAX_EVENTS 64
+#endif
+
+struct EventLoop {
+    CURLM *multi;
+    int running;            // Transfers added to the multi handle
+    Transfer *deferred;     // Waiting to start, sorted by due time
+    Transfer *active;       // Added to the multi handle, most recent first
+    long long timer_ns;     // libcurl's next timeout, -1 when none
+#ifdef __linux__
+    int epfd;
+#endif
+};
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime_mono(&ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int timer_callback(CURLM *multi, long timeout_ms, void *userp) {
+    EventLoop *loop = (EventLoop *)userp;
+    (void)multi;
+    loop->timer_ns = timeout_ms < 0 ? -1 : now_ns() + timeout_ms * 1000000LL;
+    return 0;
+}
+
+#ifdef __linux__
+// libcurl tells us which sockets to watch for what; mirror it into epoll
+static int socket_callback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+    EventLoop *loop = (EventLoop *)userp;
+    (void)easy;
+
+    if (what == CURL_POLL_REMOVE) {
+        // The socket may already be closed, so a failure here is expected
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, s, NULL);
+        curl_multi_assign(loop->multi, s, NULL);
+        return 0;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+
+    if (socketp) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_MOD, s, &ev);
+    } else {
+        // A reused descriptor number can still be registered
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, s, &ev) != 0 && errno == EEXIST) {
+            epoll_ctl(loop->epfd, EPOLL_CTL_MOD, s, &ev);
+        }
+        curl_multi_assign(loop->multi, s, loop);
+    }
+    return 0;
+}
+#endif
+
+EventLoop *ev_loop_new(void) {
+    EventLoop *loop = calloc(1, sizeof(EventLoop));
+    if (!loop) return NULL;
+    loop->timer_ns = -1;
+    loop->multi = curl_multi_init();
+    if (!loop->multi) {
+        free(loop);
+        return NULL;
+    }
+    curl_multi_setopt(loop->multi, CURLMOPT_TIMERFUNCTION, timer_callback);
+    curl_multi_setopt(loop->multi, CURLMOPT_TIMERDATA, loop);
+
+#ifdef __linux__
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        curl_multi_cleanup(loop->multi);
+        free(loop);
+        return NULL;
+    }
+    curl_multi_setopt(loop->multi, CURLMOPT_SOCKETFUNCTION, socket_callback);
+    curl_multi_setopt(loop->multi, CURLMOPT_SOCKETDATA, loop);
+#endif
+    return loop;
+}
+
+void ev_loop_free(EventLoop *loop) {
+    if (!loop) return;
+    curl_multi_cleanup(loop->multi);
+#ifdef __linux__
+    close(loop->epfd);
+#endif
+    free(loop);
+}
+
+int ev_submit(EventLoop *loop, Transfer *t) {
+    curl_easy_setopt(t->easy, CURLOPT_PRIVATE, t);
+    PROBE_REQUEST_START(t->easy, t->retries);
+    if (curl_multi_add_handle(loop->multi, t->easy) != CURLM_OK) return -1;
+    t->prev = NULL;
+    t->next = loop->active;
+    if (loop->active) loop->active->prev = t;
+    loop->active = t;
+    loop->running++;
+    return 0;
+}
+
+// Take t off the multi handle and the in-flight list
+static void detach(EventLoop *loop, Transfer *t) {
+    curl_multi_remove_handle(loop->multi, t->easy);
+    if (t->prev) t->prev->next = t->next;
+    else loop->active = t->next;
+    if (t->next) t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+    loop->running--;
+}
+
+void ev_submit_after(EventLoop *loop, Transfer *t, long long delay_ms) {
+    t->due_ns = now_ns() + (delay_ms > 0 ? delay_ms : 0) * 1000000LL;
+    Transfer **link = &loop->deferred;
+    while (*link && (*link)->due_ns <= t->due_ns) link = &(*link)->next;
+    t->next = *link;
+    *link = t;
+}
+
+// Hand finished transfers back to their owners
+static void reap_done(EventLoop *loop) {
+    CURLMsg *msg;
+    int queued;
+    while ((msg = curl_multi_info_read(loop->multi, &queued))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        CURL *easy = msg->easy_handle;
+        CURLcode res = msg->data.result;
+        Transfer *t = NULL;
+        long http_code = 0;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&t);
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+        detach(loop, t);
+        transport_record(easy, res, t->retries);
+        t->done(loop, t, res, http_code);
+    }
+}
+
+// Start deferred transfers that are due; returns ms until the next one, or -1
+static long start_due(EventLoop *loop) {
+    long long now = now_ns();
+    while (loop->deferred && loop->deferred->due_ns <= now) {
+        Transfer *t = loop->deferred;
+        loop->deferred = t->next;
+        t->next = NULL;
+        if (ev_submit(loop, t) != 0) t->done(loop, t, CURLE_FAILED_INIT, 0);
+    }
+    if (!loop->deferred) return -1;
+    return (long)((loop->deferred->due_ns - now + 999999) / 1000000);
+}
+
+static long next_wait_ms(EventLoop *loop, long deferred_ms) {
+    long wait = deferred_ms;
+    if (loop->timer_ns >= 0) {
+        long long ns = loop->timer_ns - now_ns();
+        long timer_ms = ns > 0 ? (long)((ns + 999999) / 1000000) : 0;
+        if (wait < 0 || timer_ms < wait) wait = timer_ms;
+    }
+    return wait;
+}
+
+int ev_run(EventLoop *loop) {
+    int still_running = 0;
+#ifdef __linux__
+    struct epoll_event events[EV_MAX_EVENTS];
+#endif
+
+    for (;;) {
+        long deferred_ms = start_due(loop);
+        if (loop->running == 0 && !loop->deferred) return 0;
+        long wait = next_wait_ms(loop, deferred_ms);
+
+#ifdef __linux__
+        int n = epoll_wait(loop->epfd, events, EV_MAX_EVENTS, (int)wait);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            int mask = 0;
+            if (events[i].events & EPOLLIN) mask |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT) mask |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) mask |= CURL_CSELECT_ERR;
+            curl_multi_socket_action(loop->multi, events[i].data.fd, mask, &still_running);
+        }
+        if (loop->timer_ns >= 0 && loop->timer_ns <= now_ns()) {
+            loop->timer_ns = -1;
+            curl_multi_socket_action(loop->multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
+        }
+#else
+        if (loop->running > 0) {
+            curl_multi_perform(loop->multi, &still_running);
+            curl_multi_wait(loop->multi, NULL, 0, (int)(wait >= 0 && wait < 1000 ? wait : 1000), NULL);
+            curl_multi_perform(loop->multi, &still_running);
+        } else if (deferred_ms > 0) {
+            cdrive_usleep(deferred_ms * 1000);
+        }
+#endif
+        reap_done(loop);
+    }
+}
+
+void ev_cancel_all(EventLoop *loop) {
+    while (loop->active) {
+        Transfer *t = loop->active;
+        detach(loop, t);
+        t->done(loop, t, CURLE_ABORTED_BY_CALLBACK, 0);
+    }
+    while (loop->deferred) {
+        Transfer *t = loop->deferred;
+        loop->deferred = t->next;
+        t->next = NULL;
+        t->done(loop, t, CURLE_ABORTED_BY_CALLBACK, 0);
+    }
+}
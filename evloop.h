@@ -0,0 +1,45 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <curl/curl.h>
+
+typedef struct EventLoop EventLoop;
+typedef struct Transfer Transfer;
+
+// Runs on the loop thread once the transfer has finished and been detached
+// from the loop. The owner may resubmit it (as-is or after curl_easy_reset)
+// or free it.
+typedef void (*transfer_done_fn)(EventLoop *loop, Transfer *t, CURLcode res, long http_code);
+
+// One request in flight. Embed it in the state machine that owns the
+// request; the loop allocates nothing per transfer.
+struct Transfer {
+    CURL *easy;
+    transfer_done_fn done;
+    long long due_ns;    // Start time while deferred
+    int retries;         // Times this request was sent before, for --trace-timing
+    Transfer *next;      // Deferred or in-flight list link
+    Transfer *prev;      // In-flight list back link
+};
+
+// Single-threaded transfer loop: curl_multi_socket_action driven by epoll
+// on Linux, curl_multi_wait elsewhere. Every transfer shares one connection
+// pool, so thousands in flight cost their buffers rather than threads.
+EventLoop *ev_loop_new(void);
+void ev_loop_free(EventLoop *loop);
+
+// Start t->easy; t->done is called when it completes
+int ev_submit(EventLoop *loop, Transfer *t);
+
+// Start t->easy after delay_ms, without blocking the loop (backoff, pacing)
+void ev_submit_after(EventLoop *loop, Transfer *t, long long delay_ms);
+
+// Run until no transfer is in flight or waiting. Returns -1 on a loop error.
+int ev_run(EventLoop *loop);
+
+// Detach every transfer still in flight or waiting and complete it with
+// CURLE_ABORTED_BY_CALLBACK, e.g. after ev_run() failed, so owners can free
+// them. t->done must not resubmit while this runs.
+void ev_cancel_all(EventLoop *loop);
+
+#endif // EVLOOP_H
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "hashcache.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#define HASH_CACHE_MAGIC "CDHASH1"
+#define HASH_CACHE_VERSION 1
+#define HASH_CACHE_MIN_SLOTS 1024
+// Hits on entries older than this are re-recorded so they do not expire
+#define HASH_CACHE_REFRESH_DAYS 30
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t slots;
+    uint64_t count;
+} HashFileHeader;
+
+static uint64_t key_hash(const HashKey *key) {
+    // splitmix64 finalizer over dev and inode
+    uint64_t x = key->ino ^ (key->dev * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static int same_file(const HashKey *a, const HashKey *b) {
+    return a->dev == b->dev && a->ino == b->ino;
+}
+
+static int same_version(const HashKey *a, const HashKey *b) {
+    return same_file(a, b) && a->size == b->size && a->mtime_ns == b->mtime_ns && a->ctime_ns == b->ctime_ns;
+}
+
+static int cache_file_path(char *out, size_t out_size) {
+    const char *home_dir = getenv(HOME_ENV);
+    if (!home_dir) return -1;
+    int n = snprintf(out, out_size, "%s/%s/%s", home_dir, CONFIG_DIR, HASH_CACHE_FILE);
+    return (n < 0 || (size_t)n >= out_size) ? -1 : 0;
+}
+
+static int hex_to_digest(const char *hex, unsigned char digest[MD5_DIGEST_SIZE]) {
+    for (int i = 0; i < MD5_DIGEST_SIZE; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) return -1;
+        digest[i] = (unsigned char)byte;
+    }
+    return 0;
+}
+
+// Slot holding this file (any version), or the empty slot where it would go
+static size_t probe(const HashRecord *table, size_t slots, const HashKey *key) {
+    size_t i = (size_t)key_hash(key) & (slots - 1);
+    while (table[i].last_used != 0 && !same_file(&table[i].key, key)) i = (i + 1) & (slots - 1);
+    return i;
+}
+
+void hash_key_from_stat(HashKey *key, const struct stat *sb) {
+    memset(key, 0, sizeof(*key));
+    key->dev = (uint64_t)sb->st_dev;
+    key->ino = (uint64_t)sb->st_ino;
+    key->size = (int64_t)sb->st_size;
+    key->mtime_ns = CDRIVE_STAT_MTIME_NS(*sb);
+    key->ctime_ns = CDRIVE_STAT_CTIME_NS(*sb);
+}
+
+int hash_cache_open(HashCache *cache) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->today = (uint32_t)(time(NULL) / 86400);
+
+#ifdef _WIN32
+    // st_ino is always 0 on Windows, so files cannot be told apart
+    cache->disabled = 1;
+    return 0;
+#else
+    char path[1024];
+    if (cache_file_path(path, sizeof(path)) != 0) return 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(HashFileHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const HashFileHeader *header = (const HashFileHeader *)map;
+    uint64_t slots = header->slots;
+    if (memcmp(header->magic, HASH_CACHE_MAGIC, sizeof(HASH_CACHE_MAGIC)) != 0 ||
+        header->version != HASH_CACHE_VERSION || header->record_size != sizeof(HashRecord) ||
+        slots == 0 || (slots & (slots - 1)) != 0 || header->count * 2 > slots ||
+        (size_t)sb.st_size != sizeof(HashFileHeader) + slots * sizeof(HashRecord)) {
+        munmap(map, (size_t)sb.st_size);
+        return 0; // Foreign or damaged file; it is replaced on the next save
+    }
+
+    cache->map = map;
+    cache->map_size = (size_t)sb.st_size;
+    cache->table = (const HashRecord *)((const char *)map + sizeof(HashFileHeader));
+    cache->table_slots = (size_t)slots;
+    return 0;
+#endif
+}
+
+void hash_cache_close(HashCache *cache) {
+#ifndef _WIN32
+    if (cache->map) munmap(cache->map, cache->map_size);
+#endif
+    free(cache->overlay);
+    pthread_mutex_destroy(&cache->lock);
+    cache->map = NULL;
+    cache->table = NULL;
+    cache->overlay = NULL;
+}
+
+// Caller holds cache->lock
+static int overlay_put(HashCache *cache, const HashRecord *record) {
+    if ((cache->overlay_count + 1) * 2 > cache->overlay_slots) {
+        size_t slots = cache->overlay_slots ? cache->overlay_slots * 2 : HASH_CACHE_MIN_SLOTS;
+        HashRecord *overlay = calloc(slots, sizeof(HashRecord));
+        if (!overlay) return -1;
+        for (size_t i = 0; i < cache->overlay_slots; i++) {
+            if (cache->overlay[i].last_used == 0) continue;
+            overlay[probe(overlay, slots, &cache->overlay[i].key)] = cache->overlay[i];
+        }
+        free(cache->overlay);
+        cache->overlay = overlay;
+        cache->overlay_slots = slots;
+    }
+
+    size_t i = probe(cache->overlay, cache->overlay_slots, &record->key);
+    if (cache->overlay[i].last_used == 0) cache->overlay_count++;
+    cache->overlay[i] = *record;
+    return 0;
+}
+
+int hash_cache_lookup(HashCache *cache, const HashKey *key, char hex[MD5_HEX_SIZE]) {
+    if (cache->disabled) return -1;
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->overlay_count > 0) {
+        const HashRecord *record = &cache->overlay[probe(cache->overlay, cache->overlay_slots, key)];
+        if (record->last_used != 0) {
+            // The overlay supersedes the table for this file
+            int hit = same_version(&record->key, key);
+            if (hit) md5_to_hex(record->md5, hex);
+            pthread_mutex_unlock(&cache->lock);
+            return hit ? 0 : -1;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (!cache->table) return -1;
+    const HashRecord *record = &cache->table[probe(cache->table, cache->table_slots, key)];
+    if (record->last_used == 0 || !same_version(&record->key, key)) return -1;
+    md5_to_hex(record->md5, hex);
+
+    if (record->last_used + HASH_CACHE_REFRESH_DAYS < cache->today) {
+        HashRecord refreshed = *record;
+        refreshed.last_used = cache->today;
+        pthread_mutex_lock(&cache->lock);
+        overlay_put(cache, &refreshed);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    return 0;
+}
+
+void hash_cache_store(HashCache *cache, const HashKey *key, const char hex[MD5_HEX_SIZE]) {
+    if (cache->disabled) return;
+
+    HashRecord record;
+    memset(&record, 0, sizeof(record));
+    record.key = *key;
+    record.last_used = cache->today;
+    if (hex_to_digest(hex, record.md5) != 0) return;
+
+    pthread_mutex_lock(&cache->lock);
+    overlay_put(cache, &record);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Rebuild the table from the overlay plus every unexpired entry it does not
+// supersede, write it beside the old one and rename it into place. Not safe
+// to call while other threads are using the cache.
+int hash_cache_save(HashCache *cache) {
+    if (cache->disabled || cache->overlay_count == 0) return 0;
+
+#ifdef _WIN32
+    return 0;
+#else
+    char path[1024];
+    char tmp_path[1100];
+    if (cache_file_path(path, sizeof(path)) != 0) return -1;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+    uint32_t oldest = cache->today > HASH_CACHE_MAX_AGE_DAYS ? cache->today - HASH_CACHE_MAX_AGE_DAYS : 0;
+    size_t live = cache->overlay_count;
+    for (size_t i = 0; i < cache->table_slots; i++) {
+        if (cache->table[i].last_used >= oldest && cache->table[i].last_used != 0) live++;
+    }
+    size_t slots = HASH_CACHE_MIN_SLOTS;
+    while (slots < live * 2) slots *= 2;
+
+    HashRecord *table = calloc(slots, sizeof(HashRecord));
+    if (!table) return -1;
+
+    size_t count = 0;
+    for (size_t i = 0; i < cache->overlay_slots; i++) {
+        if (cache->overlay[i].last_used == 0) continue;
+        table[probe(table, slots, &cache->overlay[i].key)] = cache->overlay[i];
+        count++;
+    }
+    for (size_t i = 0; i < cache->table_slots; i++) {
+        const HashRecord *record = &cache->table[i];
+        if (record->last_used == 0 || record->last_used < oldest) continue;
+        size_t slot = probe(table, slots, &record->key);
+        if (table[slot].last_used != 0) continue; // Superseded by the overlay
+        table[slot] = *record;
+        count++;
+    }
+
+    HashFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HASH_CACHE_MAGIC, sizeof(HASH_CACHE_MAGIC));
+    header.version = HASH_CACHE_VERSION;
+    header.record_size = sizeof(HashRecord);
+    header.slots = slots;
+    header.count = count;
+
+    FILE *fp = fopen(tmp_path, "wb");
+    int ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(table, sizeof(HashRecord), slots, fp) == slots;
+    if (fp && fclose(fp) != 0) ok = 0;
+    free(table);
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    // Switch to the new table so the cache stays usable after saving
+    if (cache->map) munmap(cache->map, cache->map_size);
+    free(cache->overlay);
+    cache->map = NULL;
+    cache->table = NULL;
+    cache->table_slots = 0;
+    cache->overlay = NULL;
+    cache->overlay_slots = 0;
+    cache->overlay_count = 0;
+    int disabled = cache->disabled;
+    pthread_mutex_destroy(&cache->lock);
+    hash_cache_open(cache);
+    cache->disabled = disabled;
+    return 0;
+#endif
+}
+
+// Don't remember a checksum of contents that changed while we read them
+void hash_cache_store_if_unchanged(HashCache *cache, const char *path, const HashKey *key,
+                                   const char hex[MD5_HEX_SIZE]) {
+    struct stat sb;
+    HashKey after;
+    if (stat(path, &sb) == 0) {
+        hash_key_from_stat(&after, &sb);
+        if (same_version(&after, key)) hash_cache_store(cache, key, hex);
+    }
+}
+
+// Files handed to one md5_files() call: a few per lane, so lanes whose file
+// ends early pick up another instead of idling
+#define HASH_CACHE_MAX_BATCH (MD5_MAX_LANES * 4)
+
+typedef struct {
+    HashCache *cache;
+    HashJob *jobs;
+    int count;
+    int next;
+    int failed;
+    int batch;
+    pthread_mutex_t lock;
+} HashPool;
+
+// Each worker claims a batch of uncached files and runs them through the
+// multi-buffer hasher, so every thread keeps all of its SIMD lanes busy.
+static void *hash_worker(void *arg) {
+    HashPool *pool = (HashPool *)arg;
+    int batch_size = pool->batch;
+    const char *paths[HASH_CACHE_MAX_BATCH];
+    char hex[HASH_CACHE_MAX_BATCH][MD5_HEX_SIZE];
+    int status[HASH_CACHE_MAX_BATCH];
+    int index[HASH_CACHE_MAX_BATCH];
+
+    for (;;) {
+        int n = 0;
+        pthread_mutex_lock(&pool->lock);
+        while (n < batch_size && pool->next < pool->count) {
+            int i = pool->next++;
+            if (pool->jobs[i].status == 1) continue;
+            index[n] = i;
+            paths[n] = pool->jobs[i].path;
+            n++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        if (n == 0) break;
+
+        md5_files(paths, n, hex, status);
+
+        int failed = 0;
+        for (int k = 0; k < n; k++) {
+            HashJob *job = &pool->jobs[index[k]];
+            job->status = status[k];
+            if (status[k] != 0) {
+                failed++;
+                continue;
+            }
+            memcpy(job->md5, hex[k], MD5_HEX_SIZE);
+            hash_cache_store_if_unchanged(pool->cache, job->path, &job->key, job->md5);
+        }
+        if (failed > 0) {
+            pthread_mutex_lock(&pool->lock);
+            pool->failed += failed;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+    return NULL;
+}
+
+int hash_cache_fill(HashCache *cache, HashJob *jobs, int count, int threads) {
+    int misses = 0;
+    for (int i = 0; i < count; i++) {
+        if (hash_cache_lookup(cache, &jobs[i].key, jobs[i].md5) == 0) {
+            jobs[i].status = 1;
+        } else {
+            jobs[i].status = 0;
+            misses++;
+        }
+    }
+    if (misses == 0) return 0;
+
+    // Spread few files across threads; with many, fill every lane
+    if (threads < 1) threads = 1;
+    int batch = (misses + threads - 1) / threads;
+    if (batch > md5_multi_lanes() * 4) batch = md5_multi_lanes() * 4;
+    if (threads > (misses + batch - 1) / batch) threads = (misses + batch - 1) / batch;
+    HashPool pool = { cache, jobs, count, 0, 0, batch, PTHREAD_MUTEX_INITIALIZER };
+
+    pthread_t *workers = calloc((size_t)threads, sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < threads && pthread_create(&workers[started], NULL, hash_worker, &pool) == 0) {
+        started++;
+    }
+    if (started == 0) hash_worker(&pool); // Hash inline rather than fail
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&pool.lock);
+    return pool.failed;
+}
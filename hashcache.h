@@ -0,0 +1,77 @@
+#ifndef HASHCACHE_H
+#define HASHCACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "md5.h"
+
+#define HASH_CACHE_FILE "hashcache.bin"
+#define HASH_CACHE_MAX_AGE_DAYS 180
+
+// Identity of one version of a file's contents. Any write changes mtime or
+// ctime, and a replaced file gets a new inode, so an exact match means the
+// cached checksum is still valid.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+} HashKey;
+
+// On-disk record; the file is an open-addressing table of these
+typedef struct {
+    HashKey key;
+    unsigned char md5[MD5_DIGEST_SIZE];
+    uint32_t last_used;   // Days since the epoch; 0 marks an empty slot
+    uint32_t reserved;
+} HashRecord;
+
+// Persistent MD5 cache in ~/.cdrive/hashcache.bin. The table is mapped
+// read-only and probed in place, so a lookup costs no file reads beyond the
+// pages touched; new results go to an in-memory overlay that is merged
+// into a fresh table by hash_cache_save(). Safe to use from several threads.
+typedef struct {
+    const HashRecord *table;   // Mapped table, NULL when there is none yet
+    size_t table_slots;
+    void *map;
+    size_t map_size;
+
+    HashRecord *overlay;       // Entries added or refreshed this run
+    size_t overlay_slots;
+    size_t overlay_count;
+
+    uint32_t today;
+    int disabled;              // No stable inode numbers on this platform
+    pthread_mutex_t lock;
+} HashCache;
+
+// One file to checksum with hash_cache_fill()
+typedef struct {
+    const char *path;
+    HashKey key;
+    char md5[MD5_HEX_SIZE];
+    int status;                // 1 = from cache, 0 = hashed, -1 = unreadable
+} HashJob;
+
+void hash_key_from_stat(HashKey *key, const struct stat *sb);
+
+// A missing or unreadable cache file just starts an empty cache
+int hash_cache_open(HashCache *cache);
+void hash_cache_close(HashCache *cache);
+int hash_cache_save(HashCache *cache);
+
+// Returns 0 and fills hex on a hit, -1 on a miss
+int hash_cache_lookup(HashCache *cache, const HashKey *key, char hex[MD5_HEX_SIZE]);
+void hash_cache_store(HashCache *cache, const HashKey *key, const char hex[MD5_HEX_SIZE]);
+// hash_cache_store() for a checksum just computed from path's contents:
+// skipped if the file no longer matches key
+void hash_cache_store_if_unchanged(HashCache *cache, const char *path, const HashKey *key,
+                                   const char hex[MD5_HEX_SIZE]);
+
+// Fill in md5 for every job: cached files first, then the rest hashed on
+// up to `threads` threads. Returns the number of unreadable files.
+int hash_cache_fill(HashCache *cache, HashJob *jobs, int count, int threads);
+
+#endif // HASHCACHE_H
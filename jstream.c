@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "jstream.h"
+#include "profile.h"
+#include "probes.h"
+
+// What the parser accepts next outside of strings and bare tokens
+enum {
+    EXPECT_VALUE = 0,
+    EXPECT_KEY,
+    EXPECT_COLON,
+    EXPECT_COMMA,
+    EXPECT_END
+};
+
+void json_stream_init(JsonStream *js, const char *array_key,
+                      JsonField *item_fields, int num_item_fields,
+                      JsonField *top_fields, int num_top_fields,
+                      json_item_callback callback, void *userdata) {
+    memset(js, 0, sizeof(*js));
+    js->array_key = array_key;
+    js->item_fields = item_fields;
+    js->num_item_fields = num_item_fields;
+    js->top_fields = top_fields;
+    js->num_top_fields = num_top_fields;
+    js->callback = callback;
+    js->userdata = userdata;
+    json_stream_reset(js);
+}
+
+static void clear_fields(JsonField *fields, int num_fields) {
+    for (int i = 0; i < num_fields; i++) {
+        fields[i].found = 0;
+        fields[i].is_string = 0;
+        if (fields[i].dest && fields[i].dest_size > 0) fields[i].dest[0] = '\0';
+    }
+}
+
+void json_stream_reset(JsonStream *js) {
+    memset(js->stack, 0, sizeof(*js) - offsetof(JsonStream, stack));
+    clear_fields(js->top_fields, js->num_top_fields);
+    clear_fields(js->item_fields, js->num_item_fields);
+}
+
+static JsonField *find_field(JsonField *fields, int num_fields, const char *key) {
+    for (int i = 0; i < num_fields; i++) {
+        if (strcmp(fields[i].key, key) == 0) return &fields[i];
+    }
+    return NULL;
+}
+
+// Field that the value about to start should be decoded into, if any
+static JsonField *value_target(JsonStream *js) {
+    if (js->depth == 1 && js->stack[0] == '{') {
+        return find_field(js->top_fields, js->num_top_fields, js->key);
+    }
+    if (js->items_depth && js->depth == js->items_depth + 1 && js->stack[js->depth - 1] == '{') {
+        return find_field(js->item_fields, js->num_item_fields, js->key);
+    }
+    return NULL;
+}
+
+static void begin_capture(JsonStream *js, int is_string) {
+    js->capture = value_target(js);
+    js->capture_len = 0;
+    if (js->capture) {
+        js->capture->found = 1;
+        js->capture->is_string = is_string;
+    }
+}
+
+static void end_capture(JsonStream *js) {
+    JsonField *field = js->capture;
+    if (field && field->dest && field->dest_size > 0) {
+        field->dest[js->capture_len] = '\0';
+        if (!field->is_string && strcmp(field->dest, "null") == 0) {
+            field->dest[0] = '\0';
+            field->found = 0;
+        }
+    }
+    js->capture = NULL;
+}
+
+static void put_bytes(JsonStream *js, const char *bytes, size_t len) {
+    if (js->string_is_key) {
+        // Over-long keys cannot match any field; remember that they overflowed
+        if (js->key_len + len >= JSTREAM_MAX_KEY) {
+            js->key_len = JSTREAM_MAX_KEY;
+            return;
+        }
+        memcpy(js->key + js->key_len, bytes, len);
+        js->key_len += len;
+        return;
+    }
+    JsonField *field = js->capture;
+    if (!field || !field->dest || field->dest_size == 0) return;
+    size_t room = field->dest_size - 1 - js->capture_len;
+    if (len > room) len = room;
+    memcpy(field->dest + js->capture_len, bytes, len);
+    js->capture_len += len;
+}
+
+static void put_codepoint(JsonStream *js, unsigned cp) {
+    char utf8[4];
+    size_t len;
+    if (cp < 0x80) {
+        utf8[0] = (char)cp;
+        len = 1;
+    } else if (cp < 0x800) {
+        utf8[0] = (char)(0xC0 | (cp >> 6));
+        utf8[1] = (char)(0x80 | (cp & 0x3F));
+        len = 2;
+    } else if (cp < 0x10000) {
+        utf8[0] = (char)(0xE0 | (cp >> 12));
+        utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (cp & 0x3F));
+        len = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (cp >> 18));
+        utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (cp & 0x3F));
+        len = 4;
+    }
+    put_bytes(js, utf8, len);
+}
+
+// A high surrogate not followed by a low one becomes U+FFFD
+static void flush_surrogate(JsonStream *js) {
+    if (js->high_surrogate) {
+        put_codepoint(js, 0xFFFD);
+        js->high_surrogate = 0;
+    }
+}
+
+static void finish_unicode_escape(JsonStream *js) {
+    unsigned cp = js->unicode_value;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        flush_surrogate(js);
+        js->high_surrogate = cp;
+        return;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (js->high_surrogate) {
+            cp = 0x10000 + ((js->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+            js->high_surrogate = 0;
+        } else {
+            cp = 0xFFFD;
+        }
+        put_codepoint(js, cp);
+        return;
+    }
+    flush_surrogate(js);
+    put_codepoint(js, cp);
+}
+
+// A top-level value ends the document; a nested one waits for ',' or a close
+static void end_value(JsonStream *js) {
+    js->expect = js->depth == 0 ? EXPECT_END : EXPECT_COMMA;
+}
+
+static void end_string(JsonStream *js) {
+    flush_surrogate(js);
+    js->in_string = 0;
+    if (js->string_is_key) {
+        if (js->key_len >= JSTREAM_MAX_KEY) js->key_len = 0;
+        js->key[js->key_len] = '\0';
+        js->string_is_key = 0;
+        js->expect = EXPECT_COLON;
+    } else {
+        end_capture(js);
+        end_value(js);
+    }
+}
+
+static int is_bare_char(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '-' || c == '+' || c == '.';
+}
+
+static void open_container(JsonStream *js, char c) {
+    if (js->depth >= JSTREAM_MAX_DEPTH) {
+        js->error = 1;
+        return;
+    }
+    int enters_items = c == '[' && js->depth == 1 && js->stack[0] == '{' &&
+                       js->array_key && strcmp(js->key, js->array_key) == 0;
+    int starts_item = c == '{' && js->items_depth && js->depth == js->items_depth;
+
+    js->stack[js->depth++] = c;
+    js->expect = c == '{' ? EXPECT_KEY : EXPECT_VALUE;
+    js->key[0] = '\0';
+
+    if (enters_items) js->items_depth = js->depth;
+    if (starts_item) clear_fields(js->item_fields, js->num_item_fields);
+}
+
+static void close_container(JsonStream *js, char c) {
+    if (js->depth == 0) {
+        js->error = 1;
+        return;
+    }
+    char open = js->stack[js->depth - 1];
+    if ((c == '}' && open != '{') || (c == ']' && open != '[')) {
+        js->error = 1;
+        return;
+    }
+
+    if (c == '}' && js->items_depth && js->depth == js->items_depth + 1) {
+        js->items++;
+        if (!js->stopped && js->callback &&
+            js->callback(js->item_fields, js->num_item_fields, js->userdata) != 0) {
+            js->stopped = 1;
+        }
+    }
+    if (c == ']' && js->depth == js->items_depth) js->items_depth = 0;
+
+    js->depth--;
+    end_value(js);
+}
+
+int json_stream_feed(JsonStream *js, const char *data, size_t len) {
+    PROFILE_SCOPE(PROF_JSON);
+    size_t i = 0;
+    while (i < len && !js->error) {
+        unsigned char c = (unsigned char)data[i];
+
+        if (js->in_string) {
+            if (js->unicode_digits > 0) {
+                unsigned digit;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+                else { js->error = 1; break; }
+                js->unicode_value = (js->unicode_value << 4) | digit;
+                if (--js->unicode_digits == 0) finish_unicode_escape(js);
+                i++;
+            } else if (js->escape) {
+                js->escape = 0;
+                char out;
+                switch (c) {
+                    case '"': out = '"'; break;
+                    case '\\': out = '\\'; break;
+                    case '/': out = '/'; break;
+                    case 'b': out = '\b'; break;
+                    case 'f': out = '\f'; break;
+                    case 'n': out = '\n'; break;
+                    case 'r': out = '\r'; break;
+                    case 't': out = '\t'; break;
+                    case 'u':
+                        js->unicode_digits = 4;
+                        js->unicode_value = 0;
+                        i++;
+                        continue;
+                    default:
+                        js->error = 1;
+                        continue;
+                }
+                flush_surrogate(js);
+                put_bytes(js, &out, 1);
+                i++;
+            } else if (c == '\\') {
+                js->escape = 1;
+                i++;
+            } else if (c == '"') {
+                end_string(js);
+                i++;
+            } else {
+                // Copy the whole run of plain characters in one go
+                size_t start = i;
+                while (i < len && data[i] != '"' && data[i] != '\\') i++;
+                flush_surrogate(js);
+                put_bytes(js, data + start, i - start);
+            }
+            continue;
+        }
+
+        if (js->in_bare) {
+            if (is_bare_char(c)) {
+                put_bytes(js, (const char *)&data[i], 1);
+                i++;
+                continue;
+            }
+            js->in_bare = 0;
+            end_capture(js);
+            end_value(js);
+            // Fall through and handle the delimiter
+        }
+
+        i++;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') continue;
+
+        switch (js->expect) {
+            case EXPECT_KEY:
+                if (c == '"') {
+                    js->in_string = 1;
+                    js->string_is_key = 1;
+                    js->key_len = 0;
+                } else if (c == '}') {
+                    close_container(js, (char)c);
+                } else {
+                    js->error = 1;
+                }
+                break;
+
+            case EXPECT_COLON:
+                if (c == ':') js->expect = EXPECT_VALUE;
+                else js->error = 1;
+                break;
+
+            case EXPECT_COMMA:
+                if (c == ',') {
+                    js->expect = js->stack[js->depth - 1] == '{' ? EXPECT_KEY : EXPECT_VALUE;
+                } else if (c == '}' || c == ']') {
+                    close_container(js, (char)c);
+                } else {
+                    js->error = 1;
+                }
+                break;
+
+            case EXPECT_VALUE:
+                if (c == '{' || c == '[') {
+                    open_container(js, (char)c);
+                } else if (c == ']') {
+                    close_container(js, (char)c);
+                } else if (c == '"') {
+                    js->in_string = 1;
+                    js->string_is_key = 0;
+                    begin_capture(js, 1);
+                } else if (is_bare_char(c)) {
+                    js->in_bare = 1;
+                    begin_capture(js, 0);
+                    put_bytes(js, (const char *)&data[i - 1], 1);
+                } else {
+                    js->error = 1;
+                }
+                break;
+
+            default:
+                // Trailing garbage after the document
+                js->error = 1;
+                break;
+        }
+    }
+    return js->error ? -1 : 0;
+}
+
+int json_stream_finish(const JsonStream *js) {
+    return (!js->error && js->depth == 0 && js->expect == EXPECT_END) ? 0 : -1;
+}
+
+size_t json_stream_write_callback(char *contents, size_t size, size_t nmemb, void *userp) {
+    size_t total_size = size * nmemb;
+    PROBE_CHUNK_RECEIVED(total_size);
+    // Keep consuming malformed bodies (e.g. HTML error pages); the HTTP status
+    // decides whether the request failed.
+    json_stream_feed((JsonStream *)userp, contents, total_size);
+    return total_size;
+}
+
+void json_print_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        switch (*p) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (*p < 0x20) fprintf(out, "\\u%04x", *p);
+                else fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void json_print_fields(FILE *out, const JsonField *fields, int num_fields) {
+    int first = 1;
+    fputc('{', out);
+    for (int i = 0; i < num_fields; i++) {
+        if (!fields[i].found) continue;
+        if (!first) fputc(',', out);
+        first = 0;
+        json_print_string(out, fields[i].key);
+        fputc(':', out);
+        if (fields[i].is_string) json_print_string(out, fields[i].dest);
+        else fputs(fields[i].dest, out);
+    }
+    fputc('}', out);
+}
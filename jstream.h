@@ -0,0 +1,80 @@
+#ifndef JSTREAM_H
+#define JSTREAM_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define JSTREAM_MAX_DEPTH 64
+#define JSTREAM_MAX_KEY 64
+
+// A field to extract. The parser decodes the value straight into dest
+// (truncating to dest_size - 1 bytes) without building a document tree.
+typedef struct {
+    const char *key;
+    char *dest;
+    size_t dest_size;
+    int found;       // Set when the field was present (and not null)
+    int is_string;   // Set when the value was a JSON string
+} JsonField;
+
+// Called for every completed element of the item array, with item_fields
+// filled in. Return non-zero to ignore the rest of the document.
+typedef int (*json_item_callback)(JsonField *fields, int num_fields, void *userdata);
+
+// Incremental parser for Drive-style responses: a top-level object holding
+// scalar fields (e.g. nextPageToken) and one array of objects (e.g. files).
+// Bytes can be fed in arbitrary chunks as libcurl delivers them.
+typedef struct {
+    const char *array_key;
+    JsonField *item_fields;
+    int num_item_fields;
+    JsonField *top_fields;
+    int num_top_fields;
+    json_item_callback callback;
+    void *userdata;
+
+    // Parser state
+    char stack[JSTREAM_MAX_DEPTH];
+    int depth;
+    int expect;
+    int items_depth;        // Depth of the item array, 0 when not inside it
+    int in_string;
+    int string_is_key;
+    int escape;
+    int unicode_digits;
+    unsigned unicode_value;
+    unsigned high_surrogate;
+    int in_bare;
+    char key[JSTREAM_MAX_KEY];
+    size_t key_len;
+    JsonField *capture;
+    size_t capture_len;
+    int items;
+    int stopped;
+    int error;
+} JsonStream;
+
+void json_stream_init(JsonStream *js, const char *array_key,
+                      JsonField *item_fields, int num_item_fields,
+                      JsonField *top_fields, int num_top_fields,
+                      json_item_callback callback, void *userdata);
+
+// Forget all parser state (e.g. before retrying a request)
+void json_stream_reset(JsonStream *js);
+
+// Returns 0 while the input is well-formed so far, -1 once it is not
+int json_stream_feed(JsonStream *js, const char *data, size_t len);
+
+// Returns 0 if a complete document was parsed
+int json_stream_finish(const JsonStream *js);
+
+// libcurl CURLOPT_WRITEFUNCTION adapter; userp is a JsonStream
+size_t json_stream_write_callback(char *contents, size_t size, size_t nmemb, void *userp);
+
+// Write s as a quoted, escaped JSON string
+void json_print_string(FILE *out, const char *s);
+
+// Write the found fields as a JSON object, keeping strings quoted
+void json_print_fields(FILE *out, const JsonField *fields, int num_fields);
+
+#endif // JSTREAM_H
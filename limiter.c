@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "limiter.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int used;
+    int limit;
+    int max;
+    int peak;
+    int in_flight;
+
+    // Current window; it closes after `limit` completions
+    int completions;
+    long long bytes;
+    long long busy_ns;          // Time with at least one transfer running
+    long long busy_since_ns;
+    double latency_sum;         // Size-normalized, see latency_sample()
+    long long throttle_mark;    // Retry counters when the window opened
+
+    double prev_throughput;     // Bytes per second in the previous window
+    double baseline_latency;
+    int flat_windows;
+
+    int increases;
+    int decreases;
+    char last_reason[64];
+} Limiter;
+
+static Limiter g_limiter = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .limit = LIMITER_INITIAL,
+    .max = LIMITER_DEFAULT_MAX,
+    .peak = LIMITER_INITIAL,
+};
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime_mono(&ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Throttling shows up in the retry counters, including 429s that a retry
+// later got past
+static long long throttle_count(void) {
+    RetryStats s;
+    retry_get_stats(&s);
+    return s.rate_limited + s.server_errors;
+}
+
+// Milliseconds per transfer with a fixed 1 MiB allowance for per-request
+// overhead, so a mix of small and large files gives comparable samples
+static double latency_sample(long long bytes, long long elapsed_ms) {
+    return (double)elapsed_ms / (1.0 + (double)bytes / (1024.0 * 1024.0));
+}
+
+static void set_limit(Limiter *l, int limit, const char *reason) {
+    if (limit < 1) limit = 1;
+    if (limit > l->max) limit = l->max;
+    if (limit == l->limit) return;
+
+    if (limit > l->limit) l->increases++;
+    else l->decreases++;
+    if (g_show_stats && !g_json_mode) {
+        fprintf(stderr, "%s[concurrency]%s %d -> %d: %s\n", COLOR_CYAN, COLOR_RESET, l->limit, limit, reason);
+    }
+    snprintf(l->last_reason, sizeof(l->last_reason), "%s", reason);
+    l->limit = limit;
+    if (limit > l->peak) l->peak = limit;
+    pthread_cond_broadcast(&l->cond);
+}
+
+static void close_window(Limiter *l) {
+    double seconds = l->busy_ns / 1e9;
+    double throughput = seconds > 0 ? l->bytes / seconds : 0;
+    double latency = l->latency_sum / l->completions;
+    long long throttles = throttle_count();
+
+    if (throttles != l->throttle_mark) {
+        set_limit(l, l->limit / 2, "throttled by Drive (429/5xx)");
+        l->flat_windows = 0;
+    } else if (l->baseline_latency > 0 && latency > l->baseline_latency * LIMITER_LATENCY_TOLERANCE &&
+               throughput <= l->prev_throughput * LIMITER_GROWTH) {
+        // More transfers only made each one slower
+        set_limit(l, l->limit * 3 / 4, "latency rising without more throughput");
+        l->flat_windows = 0;
+    } else if (throughput > l->prev_throughput * LIMITER_GROWTH) {
+        set_limit(l, l->limit + 1, "throughput improving");
+        l->flat_windows = 0;
+    } else if (++l->flat_windows >= LIMITER_PROBE_WINDOWS) {
+        // Conditions change; check now and then whether more would help
+        set_limit(l, l->limit + 1, "probing for more throughput");
+        l->flat_windows = 0;
+    }
+
+    // The baseline tracks the best latency seen, drifting up slowly so one
+    // lucky window does not pin it forever
+    if (l->baseline_latency == 0 || latency < l->baseline_latency) l->baseline_latency = latency;
+    else l->baseline_latency += (latency - l->baseline_latency) / 16;
+
+    l->prev_throughput = throughput;
+    l->completions = 0;
+    l->bytes = 0;
+    l->busy_ns = 0;
+    l->latency_sum = 0;
+    l->throttle_mark = throttles;
+}
+
+void limiter_init(int max) {
+    Limiter *l = &g_limiter;
+    pthread_mutex_lock(&l->lock);
+    l->max = max > 0 ? max : LIMITER_DEFAULT_MAX;
+    l->limit = l->max < LIMITER_INITIAL ? l->max : LIMITER_INITIAL;
+    l->peak = l->limit;
+    l->used = 1;
+    l->throttle_mark = throttle_count();
+    pthread_mutex_unlock(&l->lock);
+}
+
+void limiter_acquire(void) {
+    Limiter *l = &g_limiter;
+    pthread_mutex_lock(&l->lock);
+    while (l->in_flight >= l->limit) pthread_cond_wait(&l->cond, &l->lock);
+    if (l->in_flight++ == 0) l->busy_since_ns = now_ns();
+    pthread_mutex_unlock(&l->lock);
+}
+
+void limiter_release(long long bytes, long long elapsed_ms) {
+    Limiter *l = &g_limiter;
+    pthread_mutex_lock(&l->lock);
+    if (--l->in_flight == 0) l->busy_ns += now_ns() - l->busy_since_ns;
+
+    if (elapsed_ms > 0) {
+        l->completions++;
+        l->bytes += bytes;
+        l->latency_sum += latency_sample(bytes, elapsed_ms);
+        if (l->completions >= l->limit) {
+            // Count the transfers still running as busy time up to now
+            if (l->in_flight > 0) {
+                long long now = now_ns();
+                l->busy_ns += now - l->busy_since_ns;
+                l->busy_since_ns = now;
+            }
+            close_window(l);
+        }
+    }
+    pthread_cond_signal(&l->cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+int limiter_max(void) {
+    pthread_mutex_lock(&g_limiter.lock);
+    int max = g_limiter.max;
+    pthread_mutex_unlock(&g_limiter.lock);
+    return max;
+}
+
+void limiter_print_stats(void) {
+    Limiter *l = &g_limiter;
+    pthread_mutex_lock(&l->lock);
+    if (!l->used) {
+        pthread_mutex_unlock(&l->lock);
+        return;
+    }
+    if (g_json_mode) {
+        fprintf(stderr, ",\"concurrency\":{\"limit\":%d,\"peak\":%d,\"max\":%d,\"increases\":%d,"
+                "\"decreases\":%d,\"last_reason\":\"%s\"}",
+                l->limit, l->peak, l->max, l->increases, l->decreases, l->last_reason);
+    } else {
+        fprintf(stderr, "  Concurrency:      %d (peak %d, max %d; %d up, %d down%s%s)\n",
+                l->limit, l->peak, l->max, l->increases, l->decreases,
+                l->last_reason[0] ? "; last: " : "", l->last_reason);
+    }
+    pthread_mutex_unlock(&l->lock);
+}
@@ -0,0 +1,30 @@
+#ifndef LIMITER_H
+#define LIMITER_H
+
+#define LIMITER_INITIAL 2               // Transfers allowed at the start
+#define LIMITER_DEFAULT_MAX 16          // Ceiling when --jobs is not given
+#define LIMITER_GROWTH 1.05             // Throughput gain that justifies another transfer
+#define LIMITER_LATENCY_TOLERANCE 2.0   // Latency over baseline that counts as queueing
+#define LIMITER_PROBE_WINDOWS 4         // Flat windows before trying one more transfer
+
+// Adaptive concurrency for the transfer pool (AIMD). The limit grows by one
+// while aggregate throughput keeps improving and is cut multiplicatively
+// when Drive throttles (429/5xx) or latency climbs well above its baseline.
+// Process-wide, like the request pacer.
+
+// Set the ceiling (--jobs, else LIMITER_DEFAULT_MAX) and reset the limit
+void limiter_init(int max);
+
+// Block until another transfer may start
+void limiter_acquire(void);
+
+// A transfer finished; bytes and elapsed_ms feed the controller. A
+// transfer abandoned before it started passes 0 for both.
+void limiter_release(long long bytes, long long elapsed_ms);
+
+int limiter_max(void);
+// Stats line for --stats; under --json, a "concurrency" member to splice
+// into the stats object
+void limiter_print_stats(void);
+
+#endif // LIMITER_H
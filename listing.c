@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "listing.h"
+
+#define LISTING_PAGE_SIZE 1000
+#define LISTING_FIELDS "nextPageToken,files(id,name,mimeType,size,modifiedTime)"
+#define LISTING_MAX_MIME_TYPES 65535
+
+void listing_init(Listing *listing) {
+    memset(listing, 0, sizeof(*listing));
+}
+
+void listing_free(Listing *listing) {
+    free(listing->id_off);
+    free(listing->name_off);
+    free(listing->mime);
+    free(listing->size);
+    free(listing->modified_ms);
+    free(listing->folder_bits);
+    free(listing->pool);
+    free(listing->mime_off);
+    free(listing->order);
+    memset(listing, 0, sizeof(*listing));
+}
+
+// Grow *array to hold capacity elements of elem_size bytes
+static int grow_array(void *array, size_t elem_size, int capacity) {
+    void **ptr = (void **)array;
+    void *grown = realloc(*ptr, elem_size * (size_t)capacity);
+    if (!grown) return -1;
+    *ptr = grown;
+    return 0;
+}
+
+static int reserve_entries(Listing *listing, int needed) {
+    if (needed <= listing->capacity) return 0;
+    int capacity = listing->capacity ? listing->capacity : 256;
+    while (capacity < needed) capacity *= 2;
+
+    if (grow_array(&listing->id_off, sizeof(uint32_t), capacity) != 0 ||
+        grow_array(&listing->name_off, sizeof(uint32_t), capacity) != 0 ||
+        grow_array(&listing->mime, sizeof(uint16_t), capacity) != 0 ||
+        grow_array(&listing->size, sizeof(int64_t), capacity) != 0 ||
+        grow_array(&listing->modified_ms, sizeof(int64_t), capacity) != 0 ||
+        grow_array(&listing->order, sizeof(uint32_t), capacity) != 0) {
+        return -1;
+    }
+
+    int words = (capacity + 63) / 64;
+    int old_words = (listing->capacity + 63) / 64;
+    if (grow_array(&listing->folder_bits, sizeof(uint64_t), words) != 0) return -1;
+    memset(listing->folder_bits + old_words, 0, sizeof(uint64_t) * (size_t)(words - old_words));
+
+    listing->capacity = capacity;
+    return 0;
+}
+
+// Copy s into the string pool; returns its offset or -1
+static long long pool_add(Listing *listing, const char *s) {
+    size_t len = strlen(s) + 1;
+    if (listing->pool_size + len > UINT32_MAX) return -1;
+    if (listing->pool_size + len > listing->pool_capacity) {
+        size_t capacity = listing->pool_capacity ? listing->pool_capacity : 16384;
+        while (capacity < listing->pool_size + len) capacity *= 2;
+        char *pool = realloc(listing->pool, capacity);
+        if (!pool) return -1;
+        listing->pool = pool;
+        listing->pool_capacity = capacity;
+    }
+    memcpy(listing->pool + listing->pool_size, s, len);
+    listing->pool_size += len;
+    return (long long)(listing->pool_size - len);
+}
+
+static int intern_mime(Listing *listing, const char *mime_type) {
+    for (int i = 0; i < listing->mime_count; i++) {
+        if (strcmp(listing->pool + listing->mime_off[i], mime_type) == 0) return i;
+    }
+    if (listing->mime_count >= LISTING_MAX_MIME_TYPES) return -1;
+    if (listing->mime_count == listing->mime_capacity) {
+        int capacity = listing->mime_capacity ? listing->mime_capacity * 2 : 16;
+        if (grow_array(&listing->mime_off, sizeof(uint32_t), capacity) != 0) return -1;
+        listing->mime_capacity = capacity;
+    }
+    long long off = pool_add(listing, mime_type);
+    if (off < 0) return -1;
+    listing->mime_off[listing->mime_count] = (uint32_t)off;
+    return listing->mime_count++;
+}
+
+int listing_append(Listing *listing, const char *id, const char *name, const char *mime_type,
+                   int64_t size, int64_t modified_ms) {
+    if (reserve_entries(listing, listing->count + 1) != 0) return -1;
+
+    int mime = intern_mime(listing, mime_type ? mime_type : "");
+    long long id_off = pool_add(listing, id);
+    long long name_off = pool_add(listing, name ? name : "");
+    if (mime < 0 || id_off < 0 || name_off < 0) return -1;
+
+    int i = listing->count++;
+    listing->id_off[i] = (uint32_t)id_off;
+    listing->name_off[i] = (uint32_t)name_off;
+    listing->mime[i] = (uint16_t)mime;
+    listing->size[i] = size;
+    listing->modified_ms[i] = modified_ms;
+    if (mime_type && strcmp(mime_type, "application/vnd.google-apps.folder") == 0) {
+        listing->folder_bits[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+    listing->order[listing->order_count++] = (uint32_t)i;
+    return i;
+}
+
+typedef struct {
+    const Listing *listing;
+    ListingSortKey key;
+    int descending;
+    int folders_first;
+} SortSpec;
+
+static int compare_entries(const SortSpec *spec, uint32_t a, uint32_t b) {
+    const Listing *listing = spec->listing;
+    if (spec->folders_first) {
+        int fa = listing_is_folder(listing, (int)a);
+        int fb = listing_is_folder(listing, (int)b);
+        if (fa != fb) return fb - fa;
+    }
+
+    int cmp = 0;
+    switch (spec->key) {
+        case LISTING_SORT_NAME:
+            cmp = strcasecmp(listing_name(listing, (int)a), listing_name(listing, (int)b));
+            break;
+        case LISTING_SORT_SIZE:
+            cmp = (listing->size[a] > listing->size[b]) - (listing->size[a] < listing->size[b]);
+            break;
+        case LISTING_SORT_MODIFIED:
+            cmp = (listing->modified_ms[a] > listing->modified_ms[b]) -
+                  (listing->modified_ms[a] < listing->modified_ms[b]);
+            break;
+        default:
+            break;
+    }
+    return spec->descending ? -cmp : cmp;
+}
+
+// Bottom-up merge sort of the index view; stable, so equal keys keep the
+// order Drive returned them in.
+void listing_sort(Listing *listing, ListingSortKey key, int descending, int folders_first) {
+    int n = listing->order_count;
+    if (n < 2 || (key == LISTING_SORT_NONE && !folders_first)) return;
+
+    uint32_t *tmp = malloc(sizeof(uint32_t) * (size_t)n);
+    if (!tmp) return;
+
+    SortSpec spec = {listing, key, descending, folders_first};
+    uint32_t *src = listing->order;
+    uint32_t *dst = tmp;
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = lo + width < n ? lo + width : n;
+            int hi = lo + 2 * width < n ? lo + 2 * width : n;
+            int i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                dst[k++] = compare_entries(&spec, src[j], src[i]) < 0 ? src[j++] : src[i++];
+            }
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        uint32_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != listing->order) memcpy(listing->order, src, sizeof(uint32_t) * (size_t)n);
+    free(tmp);
+}
+
+int listing_filter(Listing *listing, listing_predicate keep, void *userdata) {
+    int kept = 0;
+    for (int i = 0; i < listing->order_count; i++) {
+        if (keep(listing, (int)listing->order[i], userdata)) {
+            listing->order[kept++] = listing->order[i];
+        }
+    }
+    listing->order_count = kept;
+    return kept;
+}
+
+typedef struct {
+    Listing *listing;
+    const JsonStream *stream;
+    int page_delivered;      // Items of the current page already appended
+    int failed;
+} FetchState;
+
+static int append_streamed_entry(JsonField *fields, int num_fields, void *userdata) {
+    FetchState *state = (FetchState *)userdata;
+    (void)num_fields;
+
+    // A retried page streams again from its first item
+    if (state->stream->items <= state->page_delivered) return 0;
+    state->page_delivered = state->stream->items;
+
+    if (!fields[0].found || !fields[0].dest[0]) return 0;
+    int64_t size = fields[3].found ? strtoll(fields[3].dest, NULL, 10) : LISTING_NO_SIZE;
+    int64_t modified = fields[4].found ? listing_parse_time(fields[4].dest) : LISTING_NO_TIME;
+
+    if (listing_append(state->listing, fields[0].dest, fields[1].found ? fields[1].dest : "",
+                       fields[2].found ? fields[2].dest : "", size, modified) < 0) {
+        state->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int listing_fetch(Listing *listing, const char *query, const char *order_by) {
+    char id[128], name[1024], mime_type[128], size[32], modified[40];
+    char next_page_token[1024];
+    JsonField item_fields[] = {
+        {"id", id, sizeof(id), 0, 0},
+        {"name", name, sizeof(name), 0, 0},
+        {"mimeType", mime_type, sizeof(mime_type), 0, 0},
+        {"size", size, sizeof(size), 0, 0},
+        {"modifiedTime", modified, sizeof(modified), 0, 0},
+    };
+    JsonField top_fields[] = {
+        {"nextPageToken", next_page_token, sizeof(next_page_token), 0, 0},
+    };
+
+    JsonStream stream;
+    FetchState state = {listing, &stream, 0, 0};
+    json_stream_init(&stream, "files", item_fields, 5, top_fields, 1, append_streamed_entry, &state);
+
+    char page_token[sizeof(next_page_token)] = {0};
+    do {
+        char url[MAX_URL_SIZE];
+        snprintf(url, sizeof(url), "%s?q=%s&pageSize=%d&fields=%s",
+                 DRIVE_API_URL, query, LISTING_PAGE_SIZE, LISTING_FIELDS);
+        if (order_by) url_append_param(url, sizeof(url), "orderBy", order_by);
+        if (page_token[0]) url_append_param(url, sizeof(url), "pageToken", page_token);
+
+        json_stream_reset(&stream);
+        state.page_delivered = 0;
+        if (cdrive_api_get_stream(url, &stream) != 0) return -1;
+        if (state.failed) {
+            print_error("Memory allocation failed.");
+            return -1;
+        }
+
+        strcpy(page_token, next_page_token);
+    } while (page_token[0]);
+
+    return 0;
+}
+
+void listing_print(const Listing *listing) {
+    if (g_json_mode) {
+        printf("[");
+        for (int k = 0; k < listing->order_count; k++) {
+            int i = (int)listing->order[k];
+            if (k > 0) printf(",");
+            printf("{\"id\":");
+            json_print_string(stdout, listing_id(listing, i));
+            printf(",\"name\":");
+            json_print_string(stdout, listing_name(listing, i));
+            printf(",\"mimeType\":");
+            json_print_string(stdout, listing_mime(listing, i));
+            // Drive reports int64 values as strings; keep that shape
+            if (listing->size[i] != LISTING_NO_SIZE) printf(",\"size\":\"%lld\"", (long long)listing->size[i]);
+            if (listing->modified_ms[i] != LISTING_NO_TIME) {
+                char time_str[40];
+                listing_format_time(time_str, sizeof(time_str), listing->modified_ms[i]);
+                printf(",\"modifiedTime\":\"%s\"", time_str);
+            }
+            printf("}");
+        }
+        printf("]");
+        return;
+    }
+
+    printf("\n");
+    print_colored("TYPE\tNAME\t\t\t\t\tID\n", COLOR_BOLD);
+    print_colored("----\t----\t\t\t\t\t--\n", COLOR_BOLD);
+    for (int k = 0; k < listing->order_count; k++) {
+        int i = (int)listing->order[k];
+        if (listing_is_folder(listing, i)) {
+            print_colored("[DIR] ", COLOR_CYAN);
+        } else {
+            print_colored("[FILE]", COLOR_WHITE);
+        }
+        printf("\t%-40.40s\t", listing_name(listing, i));
+        print_colored(listing_id(listing, i), COLOR_YELLOW);
+        printf("\n");
+    }
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant's algorithm)
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int *year, unsigned *month, unsigned *day) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int)((int64_t)yoe + era * 400 + (*month <= 2));
+}
+
+int64_t listing_parse_time(const char *rfc3339) {
+    int year, month, day, hour, minute, second;
+    if (sscanf(rfc3339, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+        return LISTING_NO_TIME;
+    }
+
+    int64_t ms = 0;
+    const char *frac = rfc3339 + 19;
+    if (*frac == '.') {
+        int digits = 0;
+        for (frac++; *frac >= '0' && *frac <= '9'; frac++, digits++) {
+            if (digits < 3) ms = ms * 10 + (*frac - '0');
+        }
+        for (; digits < 3; digits++) ms *= 10;
+    }
+
+    int64_t days = days_from_civil(year, (unsigned)month, (unsigned)day);
+    int64_t seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+    return seconds * 1000 + ms;
+}
+
+void listing_format_time(char *buf, size_t size, int64_t ms) {
+    int64_t seconds = ms >= 0 ? ms / 1000 : (ms - 999) / 1000;
+    int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+    int64_t rem = seconds - days * 86400;
+    int year;
+    unsigned month, day;
+    civil_from_days(days, &year, &month, &day);
+    snprintf(buf, size, "%04d-%02u-%02uT%02d:%02d:%02d.%03dZ", year, month, day,
+             (int)(rem / 3600), (int)(rem / 60 % 60), (int)(rem % 60), (int)(ms - seconds * 1000));
+}
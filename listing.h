@@ -0,0 +1,85 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LISTING_NO_SIZE (-1)
+#define LISTING_NO_TIME INT64_MIN
+
+typedef enum {
+    LISTING_SORT_NONE = 0,
+    LISTING_SORT_NAME,
+    LISTING_SORT_SIZE,
+    LISTING_SORT_MODIFIED
+} ListingSortKey;
+
+// Folder listing stored as parallel arrays. Strings live back to back in a
+// single pool and are referenced by offset; MIME types are interned because
+// a folder rarely holds more than a handful of distinct ones. A 100k-entry
+// folder costs a few MB instead of one fixed-size record per entry.
+typedef struct {
+    int count;
+    int capacity;
+    uint32_t *id_off;
+    uint32_t *name_off;
+    uint16_t *mime;          // Index into mime_off
+    int64_t *size;           // LISTING_NO_SIZE for folders and Google Docs
+    int64_t *modified_ms;    // Milliseconds since the epoch, LISTING_NO_TIME if unknown
+    uint64_t *folder_bits;   // One bit per entry
+
+    char *pool;
+    size_t pool_size;
+    size_t pool_capacity;
+
+    uint32_t *mime_off;
+    int mime_count;
+    int mime_capacity;
+
+    // View over the entries: sort and filter permute/shrink this, render
+    // walks it. Entry indices themselves never move.
+    uint32_t *order;
+    int order_count;
+} Listing;
+
+// Return non-zero to keep entry i
+typedef int (*listing_predicate)(const Listing *listing, int i, void *userdata);
+
+void listing_init(Listing *listing);
+void listing_free(Listing *listing);
+
+// Returns the new entry index, or -1 when out of memory
+int listing_append(Listing *listing, const char *id, const char *name, const char *mime_type,
+                   int64_t size, int64_t modified_ms);
+
+static inline const char *listing_id(const Listing *listing, int i) {
+    return listing->pool + listing->id_off[i];
+}
+static inline const char *listing_name(const Listing *listing, int i) {
+    return listing->pool + listing->name_off[i];
+}
+static inline const char *listing_mime(const Listing *listing, int i) {
+    return listing->pool + listing->mime_off[listing->mime[i]];
+}
+static inline int listing_is_folder(const Listing *listing, int i) {
+    return (int)((listing->folder_bits[i >> 6] >> (i & 63)) & 1);
+}
+
+// Stable sort of the current view; folders_first groups folders on top
+void listing_sort(Listing *listing, ListingSortKey key, int descending, int folders_first);
+
+// Drop entries from the current view; returns the number kept
+int listing_filter(Listing *listing, listing_predicate keep, void *userdata);
+
+// Fetch every page of a files.list query (q already URL-encoded) into the
+// listing. order_by may be NULL.
+int listing_fetch(Listing *listing, const char *query, const char *order_by);
+
+// Print the current view as a table, or as a JSON array in --json mode
+void listing_print(const Listing *listing);
+
+// RFC 3339 timestamp <-> milliseconds since the epoch (UTC)
+int64_t listing_parse_time(const char *rfc3339);
+void listing_format_time(char *buf, size_t size, int64_t ms);
+
+#endif // LISTING_H
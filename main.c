@@ -1,13 +1,20 @@
 #define _GNU_SOURCE
 #include "cdrive.h"
+#include "walk.h"
+#include "sync.h"
+#include "watch.h"
+#include "daemon.h"
+#include "batch.h"
 
 // Global variables
 ClientCredentials g_client_creds;
 OAuthTokens g_tokens;
 char g_last_upload_link[MAX_URL_SIZE] = {0};
 int g_json_mode = 0;
+int g_jobs = 0;
+Arena g_arena;
 
-int main(int argc, char *argv[]) {
+int cdrive_main(int argc, char *argv[]) {
     if (argc < 2) {
         print_usage();
         return 1;
@@ -20,6 +27,57 @@ int main(int argc, char *argv[]) {
             for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
             argc--;
             i--;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            g_jobs = atoi(argv[i + 1]);
+            for (int j = i; j < argc - 2; j++) argv[j] = argv[j + 2];
+            argc -= 2;
+            i--;
+        } else if (strcmp(argv[i], "--retry-budget") == 0 && i + 1 < argc) {
+            retry_set_budget(atoi(argv[i + 1]));
+            for (int j = i; j < argc - 2; j++) argv[j] = argv[j + 2];
+            argc -= 2;
+            i--;
+        } else if (strcmp(argv[i], "--quota") == 0 && i + 1 < argc) {
+            pacer_set_quota(atoi(argv[i + 1]));
+            for (int j = i; j < argc - 2; j++) argv[j] = argv[j + 2];
+            argc -= 2;
+            i--;
+        } else if (strcmp(argv[i], "--http3") == 0) {
+            g_http3 = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        } else if (strcmp(argv[i], "--trace-timing") == 0 || strncmp(argv[i], "--trace-timing=", 15) == 0) {
+            const char *path = argv[i][14] == '=' ? argv[i] + 15 : NULL;
+            if (trace_open(path) != 0) {
+                print_error("Could not open the --trace-timing file");
+                return 1;
+            }
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            if (metrics_open(argv[i + 1]) != 0) {
+                print_error("Could not write the --metrics file");
+                return 1;
+            }
+            for (int j = i; j < argc - 2; j++) argv[j] = argv[j + 2];
+            argc -= 2;
+            i--;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+#ifdef CDRIVE_PROFILE
+            g_profile = 1;
+#else
+            print_warning("This build has no profiling timers; rebuild with 'make PROFILE=1'.");
+#endif
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            g_show_stats = 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
         }
     }
 
@@ -30,6 +88,28 @@ int main(int argc, char *argv[]) {
 
     // Initialize curl
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    arena_init(&g_arena, 0);
+    // Daemon workers print stats per command instead
+    static int stats_registered = 0;
+    if (g_show_stats && !stats_registered && !g_daemon_worker) {
+        atexit(retry_print_stats);
+        stats_registered = 1;
+    }
+    static int trace_registered = 0;
+    if (trace_enabled() && !trace_registered && !g_daemon_worker) {
+        atexit(trace_print_summary);
+        trace_registered = 1;
+    }
+    static int metrics_registered = 0;
+    if (metrics_enabled() && !metrics_registered && !g_daemon_worker) {
+        atexit(metrics_write);
+        metrics_registered = 1;
+    }
+    static int profile_registered = 0;
+    if (g_profile && !profile_registered && !g_daemon_worker) {
+        atexit(profile_print);
+        profile_registered = 1;
+    }
 
     // Setup configuration directory
     if (setup_config_dir() != 0) {
@@ -121,17 +201,26 @@ int main(int argc, char *argv[]) {
         int has_wildcard = strchr(source, '*') || strchr(source, '?') || strchr(source, '[');
 
         if (has_wildcard) {
-            if (cdrive_glob(source, &expanded_files, &expanded_count) != 0 || expanded_count == 0) {
+            if (cdrive_glob(&g_arena, source, &expanded_files, &expanded_count) != 0 || expanded_count == 0) {
                 print_error("No files match the given pattern.");
                 curl_global_cleanup();
                 return 1;
             }
         } else {
-            expanded_files = malloc(sizeof(char *));
-            expanded_files[0] = strdup(source);
+            expanded_files = arena_alloc(&g_arena, sizeof(char *));
+            if (!expanded_files || !(expanded_files[0] = arena_strdup(&g_arena, source))) {
+                print_error("Memory allocation failed.");
+                curl_global_cleanup();
+                return 1;
+            }
             expanded_count = 1;
         }
 
+        // Each upload checksums its file as it streams and records it here,
+        // so a later sync of the same files does not read them again
+        HashCache hash_cache;
+        hash_cache_open(&hash_cache);
+
         int upload_failures = 0;
         for (int i = 0; i < expanded_count; i++) {
             if (expanded_count > 1) {
@@ -141,13 +230,13 @@ int main(int argc, char *argv[]) {
                 print_colored("]", COLOR_BLUE);
                 printf(" Uploading: %s\n", expanded_files[i]);
             }
-            if (cdrive_upload(expanded_files[i], target_folder) != 0) {
+            if (cdrive_upload(expanded_files[i], target_folder, &hash_cache) != 0) {
                 fprintf(stderr, "upload failed: %s\n", expanded_files[i]);
                 upload_failures++;
             }
-            free(expanded_files[i]);
         }
-        free(expanded_files);
+        hash_cache_save(&hash_cache);
+        hash_cache_close(&hash_cache);
 
         if (upload_failures > 0) {
             fprintf(stderr, "%d upload(s) failed\n", upload_failures);
@@ -155,10 +244,140 @@ int main(int argc, char *argv[]) {
             return 1;
         }
     } else if (strcmp(argv[1], "list") == 0) {
-        const char *folder_id = (argc > 2) ? argv[2] : "root";
-        print_colored("[>] ", COLOR_BLUE);
-        printf("Listing files in folder: %s\n", folder_id);
-        cdrive_list_files(folder_id);
+        int recursive = 0;
+        const char *folder_id = "root";
+        ListOptions list_opts = {0};
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-R") == 0 || strcmp(argv[i], "--recursive") == 0) {
+                recursive = 1;
+            } else if (strcmp(argv[i], "--sort") == 0 && i + 1 < argc) {
+                const char *key = argv[++i];
+                if (strcmp(key, "name") == 0) list_opts.sort = LISTING_SORT_NAME;
+                else if (strcmp(key, "size") == 0) list_opts.sort = LISTING_SORT_SIZE;
+                else if (strcmp(key, "modified") == 0) list_opts.sort = LISTING_SORT_MODIFIED;
+                else {
+                    print_error("Unknown sort key (use name, size or modified)");
+                    curl_global_cleanup();
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--desc") == 0) {
+                list_opts.descending = 1;
+            } else if (strcmp(argv[i], "--folders") == 0) {
+                list_opts.only = LIST_ONLY_FOLDERS;
+            } else if (strcmp(argv[i], "--files") == 0) {
+                list_opts.only = LIST_ONLY_FILES;
+            } else {
+                folder_id = argv[i];
+            }
+        }
+        if (recursive) {
+            print_colored("[>] ", COLOR_BLUE);
+            printf("Listing files in folder: %s\n", folder_id);
+            if (cdrive_list_recursive(folder_id) != 0) {
+                curl_global_cleanup();
+                return 1;
+            }
+        } else {
+            if (g_json_mode) {
+                printf("{\"command\":\"list\",\"folder\":");
+                json_print_string(stdout, folder_id);
+                printf(",\"results\":");
+            } else {
+                print_colored("[>] ", COLOR_BLUE);
+                printf("Listing files in folder: %s\n", folder_id);
+            }
+            int list_result = cdrive_list_files(folder_id, &list_opts);
+            if (g_json_mode) {
+                printf("}\n");
+            }
+            if (list_result != 0) {
+                curl_global_cleanup();
+                return 1;
+            }
+        }
+    } else if (strcmp(argv[1], "du") == 0) {
+        const char *folder_id = "root";
+        int top_k = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+                top_k = atoi(argv[++i]);
+            } else {
+                folder_id = argv[i];
+            }
+        }
+        if (!g_json_mode) {
+            print_colored("[>] ", COLOR_BLUE);
+            printf("Calculating usage of folder: %s\n", folder_id);
+        }
+        if (cdrive_du(folder_id, top_k) != 0) {
+            curl_global_cleanup();
+            return 1;
+        }
+    } else if (strcmp(argv[1], "sync") == 0) {
+        const char *local_dir = NULL;
+        const char *remote_id = NULL;
+        SyncOptions sync_opts = {0};
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--two-way") == 0) {
+                sync_opts.two_way = 1;
+            } else if (strcmp(argv[i], "--delete") == 0) {
+                sync_opts.delete_remote = 1;
+            } else if (strcmp(argv[i], "--dry-run") == 0) {
+                sync_opts.dry_run = 1;
+            } else if (!local_dir) {
+                local_dir = argv[i];
+            } else if (!remote_id) {
+                remote_id = argv[i];
+            }
+        }
+        if (!local_dir || !remote_id) {
+            print_colored("Usage: ", COLOR_BOLD);
+            printf("%s sync <local_dir> <folder_id> [--two-way] [--delete] [--dry-run]\n\n", argv[0]);
+            print_colored("OPTIONS\n", COLOR_BOLD);
+            printf("  --two-way      Also apply remote changes to the local directory\n");
+            printf("  --delete       Trash remote copies of files deleted locally\n");
+            printf("  --dry-run      Show what would be transferred without doing it\n");
+            curl_global_cleanup();
+            return 1;
+        }
+        if (!g_json_mode) {
+            print_colored("[>] ", COLOR_BLUE);
+            printf("Syncing %s -> %s\n", local_dir, remote_id);
+        }
+        if (cdrive_sync(local_dir, remote_id, &sync_opts) != 0) {
+            curl_global_cleanup();
+            return 1;
+        }
+    } else if (strcmp(argv[1], "watch") == 0) {
+        const char *local_dir = NULL;
+        const char *remote_id = NULL;
+        WatchOptions watch_opts = {0};
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--debounce") == 0 && i + 1 < argc) {
+                watch_opts.debounce_ms = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--fanotify") == 0) {
+                watch_opts.use_fanotify = 1;
+            } else if (!local_dir) {
+                local_dir = argv[i];
+            } else if (!remote_id) {
+                remote_id = argv[i];
+            }
+        }
+        if (!local_dir || !remote_id) {
+            print_colored("Usage: ", COLOR_BOLD);
+            printf("%s watch <local_dir> <folder_id> [--debounce <ms>] [--fanotify]\n\n", argv[0]);
+            print_colored("OPTIONS\n", COLOR_BOLD);
+            printf("  --debounce     Quiet period after the last write before uploading (default %d ms)\n",
+                   WATCH_DEFAULT_DEBOUNCE_MS);
+            printf("  --fanotify     Watch the whole mount with fanotify (needs CAP_SYS_ADMIN)\n");
+            printf("  --jobs <n>     Most concurrent uploads; the pool adapts below it (default %d)\n", LIMITER_DEFAULT_MAX);
+            curl_global_cleanup();
+            return 1;
+        }
+        if (cdrive_watch(local_dir, remote_id, &watch_opts) != 0) {
+            curl_global_cleanup();
+            return 1;
+        }
     } else if (strcmp(argv[1], "mkdir") == 0) {
         if (argc < 3) {
             print_colored("Usage: ", COLOR_BOLD);
@@ -381,6 +600,39 @@ int main(int argc, char *argv[]) {
             curl_global_cleanup();
             return 1;
         }
+    } else if (strcmp(argv[1], "daemon") == 0) {
+        if (argc < 3) {
+            print_colored("Usage: ", COLOR_BOLD);
+            printf("%s daemon <start|stop|status|run>\n\n", argv[0]);
+            printf("  start    Start the daemon in the background\n");
+            printf("  stop     Stop a running daemon\n");
+            printf("  status   Show whether the daemon is running\n");
+            printf("  run      Run the daemon in the foreground (for service managers)\n\n");
+            printf("While it runs, upload, list, mkdir, du, sync, pull, search and share are\n");
+            printf("handed to it. Set CDRIVE_NO_DAEMON=1 to run a command in-process.\n");
+            curl_global_cleanup();
+            return 1;
+        }
+        if (cdrive_daemon(argv[2]) != 0) {
+            curl_global_cleanup();
+            return 1;
+        }
+    } else if (strcmp(argv[1], "batch") == 0) {
+        if (argc > 2 && strcmp(argv[2], "--help") == 0) {
+            print_colored("Usage: ", COLOR_BOLD);
+            printf("%s batch [file]\n\n", argv[0]);
+            printf("Runs one command per line from file (or stdin), e.g. 'mkdir Reports root'\n");
+            printf("or the NDJSON form [\"mkdir\", \"Reports\", \"root\"]. Up to --jobs commands\n");
+            printf("(default %d) run at once; output comes back in input order, each line\n", BATCH_DEFAULT_JOBS);
+            printf("tagged [N] with its line number (one JSON object per command with --json).\n");
+            printf("A line reading 'wait' lets everything before it finish first.\n");
+            curl_global_cleanup();
+            return 1;
+        }
+        if (cdrive_batch(argc > 2 ? argv[2] : NULL) != 0) {
+            curl_global_cleanup();
+            return 1;
+        }
     } else if (strcmp(argv[1], "help") == 0 || strcmp(argv[1], "--help") == 0) {
         print_usage();
     } else {
@@ -390,10 +642,18 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    arena_free(&g_arena);
     curl_global_cleanup();
     return 0;
 }
 
+int main(int argc, char *argv[]) {
+    // With a daemon running, it does the work on warm connections
+    int exit_code;
+    if (daemon_forward(argc, argv, &exit_code) == 0) return exit_code;
+    return cdrive_main(argc, argv);
+}
+
 void print_usage(void) {
     printf("\n");
     print_colored("cdrive", COLOR_BOLD_GREEN);
@@ -405,13 +665,18 @@ void print_usage(void) {
     print_colored("CORE COMMANDS\n", COLOR_BOLD);
     printf("  %sauth%s        Manage authentication with Google Drive\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %supload%s      Upload a file to a specific folder\n", COLOR_YELLOW, COLOR_RESET);
-    printf("  %slist%s        List files and folders\n", COLOR_YELLOW, COLOR_RESET);
-    printf("  %smkdir%s       Create a new folder\n\n", COLOR_YELLOW, COLOR_RESET);
+    printf("  %slist%s        List files and folders (-R to recurse, --sort name|size|modified)\n", COLOR_YELLOW, COLOR_RESET);
+    printf("  %smkdir%s       Create a new folder\n", COLOR_YELLOW, COLOR_RESET);
+    printf("  %sdu%s          Show recursive folder usage and the largest items\n", COLOR_YELLOW, COLOR_RESET);
+    printf("  %ssync%s        Mirror a local directory into a Drive folder\n", COLOR_YELLOW, COLOR_RESET);
+    printf("  %swatch%s       Upload files into a Drive folder as they are written\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %spull%s        Download a file or browse interactively\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %ssearch%s      Search files by name\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %sshare%s       Share a file with another user\n\n", COLOR_YELLOW, COLOR_RESET);
     
     print_colored("ADDITIONAL COMMANDS\n", COLOR_BOLD);
+    printf("  %sbatch%s       Run many commands from a file or stdin in one process\n", COLOR_YELLOW, COLOR_RESET);
+    printf("  %sdaemon%s      Keep a resident process with warm connections for faster commands\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %sversion%s     Show version information and check for updates\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %supdate%s      Update cdrive to the latest version\n", COLOR_YELLOW, COLOR_RESET);
     printf("  %shelp%s        Show this help message\n\n", COLOR_YELLOW, COLOR_RESET);
@@ -423,6 +688,8 @@ void print_usage(void) {
     printf("  $ cdrive upload ./document.pdf\n\n");
     printf("  %s# List files in a specific folder%s\n", COLOR_CYAN, COLOR_RESET);
     printf("  $ cdrive list 1BxiMVs...pU\n\n");
+    printf("  %s# List a whole folder tree, 16 folders at a time%s\n", COLOR_CYAN, COLOR_RESET);
+    printf("  $ cdrive list -R 1BxiMVs...pU --jobs 16\n\n");
     printf("  %s# Download a file by its ID (filename is fetched automatically)%s\n", COLOR_CYAN, COLOR_RESET);
     printf("  $ cdrive pull 1BxiMVs...pU\n\n");
     printf("  %s# Browse files interactively to download%s\n", COLOR_CYAN, COLOR_RESET);
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+#include "md5.h"
+
+// Straightforward RFC 1321 implementation
+
+#define MD5_FF(x, y, z) (((x) & (y)) | (~(x) & (z)))
+#define MD5_GG(x, y, z) (((x) & (z)) | ((y) & ~(z)))
+#define MD5_HH(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_II(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+    (a) += f((b), (c), (d)) + (x) + (t); \
+    (a) = MD5_ROTL((a), (s)) + (b)
+
+#define MD5_FILE_CHUNK (64 * 1024)
+
+static uint32_t load_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void md5_transform(uint32_t state[4], const unsigned char block[64]) {
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t x[16];
+    for (int i = 0; i < 16; i++) x[i] = load_le32(block + i * 4);
+
+    MD5_STEP(MD5_FF, a, b, c, d, x[0], 0xd76aa478, 7);
+    MD5_STEP(MD5_FF, d, a, b, c, x[1], 0xe8c7b756, 12);
+    MD5_STEP(MD5_FF, c, d, a, b, x[2], 0x242070db, 17);
+    MD5_STEP(MD5_FF, b, c, d, a, x[3], 0xc1bdceee, 22);
+    MD5_STEP(MD5_FF, a, b, c, d, x[4], 0xf57c0faf, 7);
+    MD5_STEP(MD5_FF, d, a, b, c, x[5], 0x4787c62a, 12);
+    MD5_STEP(MD5_FF, c, d, a, b, x[6], 0xa8304613, 17);
+    MD5_STEP(MD5_FF, b, c, d, a, x[7], 0xfd469501, 22);
+    MD5_STEP(MD5_FF, a, b, c, d, x[8], 0x698098d8, 7);
+    MD5_STEP(MD5_FF, d, a, b, c, x[9], 0x8b44f7af, 12);
+    MD5_STEP(MD5_FF, c, d, a, b, x[10], 0xffff5bb1, 17);
+    MD5_STEP(MD5_FF, b, c, d, a, x[11], 0x895cd7be, 22);
+    MD5_STEP(MD5_FF, a, b, c, d, x[12], 0x6b901122, 7);
+    MD5_STEP(MD5_FF, d, a, b, c, x[13], 0xfd987193, 12);
+    MD5_STEP(MD5_FF, c, d, a, b, x[14], 0xa679438e, 17);
+    MD5_STEP(MD5_FF, b, c, d, a, x[15], 0x49b40821, 22);
+
+    MD5_STEP(MD5_GG, a, b, c, d, x[1], 0xf61e2562, 5);
+    MD5_STEP(MD5_GG, d, a, b, c, x[6], 0xc040b340, 9);
+    MD5_STEP(MD5_GG, c, d, a, b, x[11], 0x265e5a51, 14);
+    MD5_STEP(MD5_GG, b, c, d, a, x[0], 0xe9b6c7aa, 20);
+    MD5_STEP(MD5_GG, a, b, c, d, x[5], 0xd62f105d, 5);
+    MD5_STEP(MD5_GG, d, a, b, c, x[10], 0x02441453, 9);
+    MD5_STEP(MD5_GG, c, d, a, b, x[15], 0xd8a1e681, 14);
+    MD5_STEP(MD5_GG, b, c, d, a, x[4], 0xe7d3fbc8, 20);
+    MD5_STEP(MD5_GG, a, b, c, d, x[9], 0x21e1cde6, 5);
+    MD5_STEP(MD5_GG, d, a, b, c, x[14], 0xc33707d6, 9);
+    MD5_STEP(MD5_GG, c, d, a, b, x[3], 0xf4d50d87, 14);
+    MD5_STEP(MD5_GG, b, c, d, a, x[8], 0x455a14ed, 20);
+    MD5_STEP(MD5_GG, a, b, c, d, x[13], 0xa9e3e905, 5);
+    MD5_STEP(MD5_GG, d, a, b, c, x[2], 0xfcefa3f8, 9);
+    MD5_STEP(MD5_GG, c, d, a, b, x[7], 0x676f02d9, 14);
+    MD5_STEP(MD5_GG, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+    MD5_STEP(MD5_HH, a, b, c, d, x[5], 0xfffa3942, 4);
+    MD5_STEP(MD5_HH, d, a, b, c, x[8], 0x8771f681, 11);
+    MD5_STEP(MD5_HH, c, d, a, b, x[11], 0x6d9d6122, 16);
+    MD5_STEP(MD5_HH, b, c, d, a, x[14], 0xfde5380c, 23);
+    MD5_STEP(MD5_HH, a, b, c, d, x[1], 0xa4beea44, 4);
+    MD5_STEP(MD5_HH, d, a, b, c, x[4], 0x4bdecfa9, 11);
+    MD5_STEP(MD5_HH, c, d, a, b, x[7], 0xf6bb4b60, 16);
+    MD5_STEP(MD5_HH, b, c, d, a, x[10], 0xbebfbc70, 23);
+    MD5_STEP(MD5_HH, a, b, c, d, x[13], 0x289b7ec6, 4);
+    MD5_STEP(MD5_HH, d, a, b, c, x[0], 0xeaa127fa, 11);
+    MD5_STEP(MD5_HH, c, d, a, b, x[3], 0xd4ef3085, 16);
+    MD5_STEP(MD5_HH, b, c, d, a, x[6], 0x04881d05, 23);
+    MD5_STEP(MD5_HH, a, b, c, d, x[9], 0xd9d4d039, 4);
+    MD5_STEP(MD5_HH, d, a, b, c, x[12], 0xe6db99e5, 11);
+    MD5_STEP(MD5_HH, c, d, a, b, x[15], 0x1fa27cf8, 16);
+    MD5_STEP(MD5_HH, b, c, d, a, x[2], 0xc4ac5665, 23);
+
+    MD5_STEP(MD5_II, a, b, c, d, x[0], 0xf4292244, 6);
+    MD5_STEP(MD5_II, d, a, b, c, x[7], 0x432aff97, 10);
+    MD5_STEP(MD5_II, c, d, a, b, x[14], 0xab9423a7, 15);
+    MD5_STEP(MD5_II, b, c, d, a, x[5], 0xfc93a039, 21);
+    MD5_STEP(MD5_II, a, b, c, d, x[12], 0x655b59c3, 6);
+    MD5_STEP(MD5_II, d, a, b, c, x[3], 0x8f0ccc92, 10);
+    MD5_STEP(MD5_II, c, d, a, b, x[10], 0xffeff47d, 15);
+    MD5_STEP(MD5_II, b, c, d, a, x[1], 0x85845dd1, 21);
+    MD5_STEP(MD5_II, a, b, c, d, x[8], 0x6fa87e4f, 6);
+    MD5_STEP(MD5_II, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+    MD5_STEP(MD5_II, c, d, a, b, x[6], 0xa3014314, 15);
+    MD5_STEP(MD5_II, b, c, d, a, x[13], 0x4e0811a1, 21);
+    MD5_STEP(MD5_II, a, b, c, d, x[4], 0xf7537e82, 6);
+    MD5_STEP(MD5_II, d, a, b, c, x[11], 0xbd3af235, 10);
+    MD5_STEP(MD5_II, c, d, a, b, x[2], 0x2ad7d2bb, 15);
+    MD5_STEP(MD5_II, b, c, d, a, x[9], 0xeb86d391, 21);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+void md5_init(MD5Context *ctx) {
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
+
+void md5_update(MD5Context *ctx, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    ctx->length += len;
+
+    if (ctx->buffered > 0) {
+        size_t take = 64 - ctx->buffered;
+        if (take > len) take = len;
+        memcpy(ctx->buffer + ctx->buffered, p, take);
+        ctx->buffered += take;
+        p += take;
+        len -= take;
+        if (ctx->buffered < 64) return;
+        md5_transform(ctx->state, ctx->buffer);
+        ctx->buffered = 0;
+    }
+
+    while (len >= 64) {
+        md5_transform(ctx->state, p);
+        p += 64;
+        len -= 64;
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buffer, p, len);
+        ctx->buffered = len;
+    }
+}
+
+void md5_final(MD5Context *ctx, unsigned char digest[MD5_DIGEST_SIZE]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad[72];
+    size_t pad_len = (ctx->buffered < 56) ? 56 - ctx->buffered : 120 - ctx->buffered;
+
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (int i = 0; i < 8; i++) pad[pad_len + i] = (unsigned char)(bits >> (8 * i));
+    // Length is appended after the padding; don't count it towards ctx->length
+    md5_update(ctx, pad, pad_len + 8);
+
+    for (int i = 0; i < 4; i++) {
+        digest[i * 4] = (unsigned char)(ctx->state[i]);
+        digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i * 4 + 3] = (unsigned char)(ctx->state[i] >> 24);
+    }
+}
+
+void md5_to_hex(const unsigned char digest[MD5_DIGEST_SIZE], char hex[MD5_HEX_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < MD5_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex[MD5_HEX_SIZE - 1] = '\0';
+}
+
+int md5_file(const char *path, char hex[MD5_HEX_SIZE]) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    unsigned char chunk[MD5_FILE_CHUNK];
+    MD5Context ctx;
+    md5_init(&ctx);
+    size_t n;
+    while ((n = fread(chunk, 1, MD5_FILE_CHUNK, fp)) > 0) {
+        md5_update(&ctx, chunk, n);
+    }
+    int failed = ferror(fp);
+    fclose(fp);
+    if (failed) return -1;
+
+    unsigned char digest[MD5_DIGEST_SIZE];
+    md5_final(&ctx, digest);
+    md5_to_hex(digest, hex);
+    return 0;
+}
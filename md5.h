@@ -0,0 +1,42 @@
+#ifndef MD5_H
+#define MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MD5_DIGEST_SIZE 16
+#define MD5_HEX_SIZE 33
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;        // Total bytes processed
+    unsigned char buffer[64];
+    size_t buffered;
+} MD5Context;
+
+void md5_init(MD5Context *ctx);
+void md5_update(MD5Context *ctx, const void *data, size_t len);
+void md5_final(MD5Context *ctx, unsigned char digest[MD5_DIGEST_SIZE]);
+
+// Lowercase hex form, as reported by Drive's md5Checksum
+void md5_to_hex(const unsigned char digest[MD5_DIGEST_SIZE], char hex[MD5_HEX_SIZE]);
+
+// Hash a whole file; returns 0 on success, -1 if it could not be read
+int md5_file(const char *path, char hex[MD5_HEX_SIZE]);
+
+// Multi-buffer hashing (md5_mb.c): several files advance in lockstep, one
+// per SIMD lane, using the widest kernel the CPU supports.
+#define MD5_MAX_LANES 16
+
+// "avx512" (16 lanes), "avx2" (8) or "scalar" (1)
+const char *md5_multi_backend(void);
+int md5_multi_lanes(void);
+// Pick the kernel again on next use, e.g. after CDRIVE_MD5_BACKEND changed
+void md5_multi_reselect(void);
+
+// Hash count files. status[i] is 0 when hex[i] was filled, -1 if the file
+// could not be read. Returns the number of unreadable files. Best fed
+// md5_multi_lanes() files or more at a time.
+int md5_files(const char *const *paths, int count, char (*hex)[MD5_HEX_SIZE], int *status);
+
+#endif // MD5_H
@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "md5.h"
+
+// Multi-buffer MD5: one stream is strictly serial, but independent files
+// are not, so each SIMD lane carries a different file through the same
+// round. AVX2 gives 8 lanes and AVX-512 16; the kernel is chosen once at
+// runtime from the CPU's features.
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MD5_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define MD5_LANE_BUFFER (64 * 1024)
+
+// Per-step constants, shifts and message word order (RFC 1321)
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+static const int md5_s[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+static const int md5_g[64] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+    5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+    0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9
+};
+
+static uint32_t load_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Kernels process `blocks` consecutive 64-byte blocks from each lane's
+// pointer, updating state[word][lane].
+typedef void (*md5_multi_kernel)(uint32_t state[4][MD5_MAX_LANES], const unsigned char *data[MD5_MAX_LANES],
+                                 size_t blocks);
+
+#ifdef MD5_HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+static void md5_x8_avx2(uint32_t state[4][MD5_MAX_LANES], const unsigned char *data[MD5_MAX_LANES],
+                        size_t blocks) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)state[0]);
+    __m256i b = _mm256_loadu_si256((const __m256i *)state[1]);
+    __m256i c = _mm256_loadu_si256((const __m256i *)state[2]);
+    __m256i d = _mm256_loadu_si256((const __m256i *)state[3]);
+    const __m256i ones = _mm256_set1_epi32(-1);
+
+    for (size_t n = 0; n < blocks; n++) {
+        // Transpose: w[i] holds message word i of every lane
+        uint32_t words[16][8] __attribute__((aligned(32)));
+        for (int lane = 0; lane < 8; lane++) {
+            const unsigned char *p = data[lane] + n * 64;
+            for (int i = 0; i < 16; i++) words[i][lane] = load_le32(p + i * 4);
+        }
+        __m256i w[16];
+        for (int i = 0; i < 16; i++) w[i] = _mm256_load_si256((const __m256i *)words[i]);
+
+        __m256i aa = a, bb = b, cc = c, dd = d;
+        for (int i = 0; i < 64; i++) {
+            __m256i f;
+            if (i < 16) f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d));
+            else if (i < 32) f = _mm256_or_si256(_mm256_and_si256(b, d), _mm256_andnot_si256(d, c));
+            else if (i < 48) f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+            else f = _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, ones)));
+
+            f = _mm256_add_epi32(_mm256_add_epi32(f, a),
+                                 _mm256_add_epi32(w[md5_g[i]], _mm256_set1_epi32((int)md5_k[i])));
+            __m128i left = _mm_cvtsi32_si128(md5_s[i]);
+            __m128i right = _mm_cvtsi32_si128(32 - md5_s[i]);
+            f = _mm256_or_si256(_mm256_sll_epi32(f, left), _mm256_srl_epi32(f, right));
+
+            a = d;
+            d = c;
+            c = b;
+            b = _mm256_add_epi32(b, f);
+        }
+        a = _mm256_add_epi32(a, aa);
+        b = _mm256_add_epi32(b, bb);
+        c = _mm256_add_epi32(c, cc);
+        d = _mm256_add_epi32(d, dd);
+    }
+
+    _mm256_storeu_si256((__m256i *)state[0], a);
+    _mm256_storeu_si256((__m256i *)state[1], b);
+    _mm256_storeu_si256((__m256i *)state[2], c);
+    _mm256_storeu_si256((__m256i *)state[3], d);
+}
+
+__attribute__((target("avx512f")))
+static void md5_x16_avx512(uint32_t state[4][MD5_MAX_LANES], const unsigned char *data[MD5_MAX_LANES],
+                           size_t blocks) {
+    __m512i a = _mm512_loadu_si512((const void *)state[0]);
+    __m512i b = _mm512_loadu_si512((const void *)state[1]);
+    __m512i c = _mm512_loadu_si512((const void *)state[2]);
+    __m512i d = _mm512_loadu_si512((const void *)state[3]);
+
+    for (size_t n = 0; n < blocks; n++) {
+        uint32_t words[16][16] __attribute__((aligned(64)));
+        for (int lane = 0; lane < 16; lane++) {
+            const unsigned char *p = data[lane] + n * 64;
+            for (int i = 0; i < 16; i++) words[i][lane] = load_le32(p + i * 4);
+        }
+        __m512i w[16];
+        for (int i = 0; i < 16; i++) w[i] = _mm512_load_si512((const void *)words[i]);
+
+        __m512i aa = a, bb = b, cc = c, dd = d;
+        for (int i = 0; i < 64; i++) {
+            // Each round function is a single three-input boolean op
+            __m512i f;
+            if (i < 16) f = _mm512_ternarylogic_epi32(b, c, d, 0xca);
+            else if (i < 32) f = _mm512_ternarylogic_epi32(b, c, d, 0xe4);
+            else if (i < 48) f = _mm512_ternarylogic_epi32(b, c, d, 0x96);
+            else f = _mm512_ternarylogic_epi32(b, c, d, 0x39);
+
+            f = _mm512_add_epi32(_mm512_add_epi32(f, a),
+                                 _mm512_add_epi32(w[md5_g[i]], _mm512_set1_epi32((int)md5_k[i])));
+            f = _mm512_rolv_epi32(f, _mm512_set1_epi32(md5_s[i]));
+
+            a = d;
+            d = c;
+            c = b;
+            b = _mm512_add_epi32(b, f);
+        }
+        a = _mm512_add_epi32(a, aa);
+        b = _mm512_add_epi32(b, bb);
+        c = _mm512_add_epi32(c, cc);
+        d = _mm512_add_epi32(d, dd);
+    }
+
+    _mm512_storeu_si512((void *)state[0], a);
+    _mm512_storeu_si512((void *)state[1], b);
+    _mm512_storeu_si512((void *)state[2], c);
+    _mm512_storeu_si512((void *)state[3], d);
+}
+
+#endif // MD5_HAVE_X86_SIMD
+
+static md5_multi_kernel g_kernel = NULL;
+static int g_lanes = 0;
+static const char *g_backend = NULL;
+
+// CDRIVE_MD5_BACKEND=scalar|avx2|avx512 narrows the choice, e.g. to
+// compare kernels; a backend the CPU lacks is never selected.
+static void md5_multi_select(void) {
+    if (g_backend) return;
+
+    const char *wanted = getenv("CDRIVE_MD5_BACKEND");
+    md5_multi_kernel kernel = NULL;
+    int lanes = 1;
+    const char *backend = "scalar";
+
+#ifdef MD5_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if ((!wanted || strcmp(wanted, "avx512") == 0) && __builtin_cpu_supports("avx512f")) {
+        kernel = md5_x16_avx512;
+        lanes = 16;
+        backend = "avx512";
+    } else if ((!wanted || strcmp(wanted, "avx2") == 0 || strcmp(wanted, "avx512") == 0) &&
+               __builtin_cpu_supports("avx2")) {
+        kernel = md5_x8_avx2;
+        lanes = 8;
+        backend = "avx2";
+    }
+#else
+    (void)wanted;
+#endif
+
+    g_kernel = kernel;
+    g_lanes = lanes;
+    __atomic_store_n(&g_backend, backend, __ATOMIC_RELEASE);
+}
+
+const char *md5_multi_backend(void) {
+    if (!__atomic_load_n(&g_backend, __ATOMIC_ACQUIRE)) md5_multi_select();
+    return g_backend;
+}
+
+void md5_multi_reselect(void) {
+    __atomic_store_n(&g_backend, NULL, __ATOMIC_RELEASE);
+}
+
+int md5_multi_lanes(void) {
+    md5_multi_backend();
+    return g_lanes;
+}
+
+typedef struct {
+    FILE *fp;
+    int job;             // Index into paths, -1 when the lane is free
+    MD5Context ctx;
+    unsigned char *buf;
+    size_t pos;          // Next unhashed byte
+    size_t len;          // Bytes in buf
+    int eof;
+} MD5Lane;
+
+// Top up a lane so it holds at least one full block unless the file ends
+static int lane_refill(MD5Lane *lane) {
+    if (lane->eof || lane->len - lane->pos >= 64) return 0;
+    size_t left = lane->len - lane->pos;
+    memmove(lane->buf, lane->buf + lane->pos, left);
+    lane->pos = 0;
+    lane->len = left;
+    while (!lane->eof && lane->len < MD5_LANE_BUFFER) {
+        size_t n = fread(lane->buf + lane->len, 1, MD5_LANE_BUFFER - lane->len, lane->fp);
+        if (n == 0) {
+            if (ferror(lane->fp)) return -1;
+            lane->eof = 1;
+        }
+        lane->len += n;
+    }
+    return 0;
+}
+
+static void lane_close(MD5Lane *lane, char (*hex)[MD5_HEX_SIZE], int *status, int ok) {
+    if (ok) {
+        md5_update(&lane->ctx, lane->buf + lane->pos, lane->len - lane->pos);
+        unsigned char digest[MD5_DIGEST_SIZE];
+        md5_final(&lane->ctx, digest);
+        md5_to_hex(digest, hex[lane->job]);
+    }
+    status[lane->job] = ok ? 0 : -1;
+    fclose(lane->fp);
+    lane->fp = NULL;
+    lane->job = -1;
+}
+
+int md5_files(const char *const *paths, int count, char (*hex)[MD5_HEX_SIZE], int *status) {
+    int lanes = md5_multi_lanes();
+    int failed = 0;
+
+    if (lanes == 1 || count == 1) {
+        for (int i = 0; i < count; i++) {
+            status[i] = md5_file(paths[i], hex[i]);
+            if (status[i] != 0) failed++;
+        }
+        return failed;
+    }
+
+    MD5Lane lane[MD5_MAX_LANES];
+    unsigned char *pool = malloc((size_t)lanes * MD5_LANE_BUFFER);
+    if (!pool) return -1;
+    for (int l = 0; l < lanes; l++) {
+        memset(&lane[l], 0, sizeof(lane[l]));
+        lane[l].job = -1;
+        lane[l].buf = pool + (size_t)l * MD5_LANE_BUFFER;
+    }
+
+    // Lanes without data still run through the kernel; point them at
+    // scratch input and discard their state.
+    static const unsigned char idle_block[MD5_LANE_BUFFER];
+    int next = 0;
+
+    for (;;) {
+        int active = 0;
+        for (int l = 0; l < lanes; l++) {
+            // Start files on free lanes, then make sure each has a block ready
+            while (lane[l].job < 0 && next < count) {
+                lane[l].fp = fopen(paths[next], "rb");
+                if (!lane[l].fp) {
+                    status[next++] = -1;
+                    failed++;
+                    continue;
+                }
+                lane[l].job = next++;
+                lane[l].pos = lane[l].len = 0;
+                lane[l].eof = 0;
+                md5_init(&lane[l].ctx);
+            }
+            if (lane[l].job < 0) continue;
+
+            if (lane_refill(&lane[l]) != 0) {
+                lane_close(&lane[l], hex, status, 0);
+                failed++;
+                l--; // Reuse this lane for the next file
+                continue;
+            }
+            if (lane[l].len - lane[l].pos < 64) {
+                lane_close(&lane[l], hex, status, 1);
+                l--;
+                continue;
+            }
+            active++;
+        }
+        if (active == 0) break;
+
+        // Run every busy lane for as many blocks as all of them have buffered
+        size_t blocks = SIZE_MAX;
+        for (int l = 0; l < lanes; l++) {
+            if (lane[l].job < 0) continue;
+            size_t have = (lane[l].len - lane[l].pos) / 64;
+            if (have < blocks) blocks = have;
+        }
+
+        if (active == 1) {
+            // A lone straggler is faster through the scalar code
+            for (int l = 0; l < lanes; l++) {
+                if (lane[l].job < 0) continue;
+                size_t bytes = (lane[l].len - lane[l].pos) & ~(size_t)63;
+                md5_update(&lane[l].ctx, lane[l].buf + lane[l].pos, bytes);
+                lane[l].pos += bytes;
+            }
+            continue;
+        }
+
+        uint32_t state[4][MD5_MAX_LANES];
+        const unsigned char *data[MD5_MAX_LANES];
+        for (int l = 0; l < lanes; l++) {
+            if (lane[l].job >= 0) {
+                for (int w = 0; w < 4; w++) state[w][l] = lane[l].ctx.state[w];
+                data[l] = lane[l].buf + lane[l].pos;
+            } else {
+                for (int w = 0; w < 4; w++) state[w][l] = 0;
+                data[l] = idle_block;
+            }
+        }
+        g_kernel(state, data, blocks);
+        for (int l = 0; l < lanes; l++) {
+            if (lane[l].job < 0) continue;
+            for (int w = 0; w < 4; w++) lane[l].ctx.state[w] = state[w][l];
+            lane[l].ctx.length += blocks * 64;
+            lane[l].pos += blocks * 64;
+        }
+    }
+
+    free(pool);
+    return failed;
+}
@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "metrics.h"
+
+typedef struct {
+    MetricsEndpoint endpoint;
+    int method;
+    long code;            // 0 when the transfer failed
+    long long count;
+} MetricsSeries;
+
+// Per-bucket counts (not cumulative) plus the overflow bucket
+typedef struct {
+    long long buckets[METRICS_BUCKETS + 1];
+    long long count;
+    long long sum_us;
+} MetricsHistogram;
+
+static const char *const g_endpoint_names[ENDPOINT_COUNT] = {
+    "files", "media", "upload", "changes", "about", "token", "other"
+};
+#define METRICS_METHOD_COUNT 6
+static const char *const g_method_names[METRICS_METHOD_COUNT] = {
+    "GET", "POST", "PUT", "PATCH", "DELETE", "OTHER"
+};
+
+static pthread_mutex_t g_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_metrics_on = 0;
+static char g_metrics_path[MAX_PATH_SIZE];
+static unsigned g_generation = 0;     // Bumped to stop the periodic writer
+static int g_writer_started = 0;
+static long long g_bytes_up = 0;
+static long long g_bytes_down = 0;
+static MetricsSeries g_series[METRICS_MAX_SERIES];
+static int g_series_count = 0;
+static long long g_series_dropped = 0;
+static MetricsHistogram g_duration[ENDPOINT_COUNT];
+static MetricsHistogram g_ttfb[ENDPOINT_COUNT];
+
+static long long bucket_bound_us(int i) {
+    long long octave = 1000LL << (i / METRICS_SUB_BUCKETS);
+    return octave * (METRICS_SUB_BUCKETS + i % METRICS_SUB_BUCKETS) / METRICS_SUB_BUCKETS;
+}
+
+static void observe(MetricsHistogram *h, long long us) {
+    int i = 0;
+    while (i < METRICS_BUCKETS && us > bucket_bound_us(i)) i++;
+    h->buckets[i]++;
+    h->count++;
+    h->sum_us += us;
+}
+
+static MetricsEndpoint endpoint_of(const char *url) {
+    const char *path = url ? strstr(url, "://") : NULL;
+    path = path ? strchr(path + 3, '/') : NULL;
+    if (!path) return ENDPOINT_OTHER;
+    if (strncmp(path, "/token", 6) == 0) return ENDPOINT_TOKEN;
+    if (strncmp(path, "/upload/drive/v3/", 17) == 0) return ENDPOINT_UPLOAD;
+    if (strncmp(path, "/drive/v3/", 10) != 0) return ENDPOINT_OTHER;
+    path += 10;
+    if (strncmp(path, "files", 5) == 0) {
+        const char *query = strchr(path, '?');
+        return query && strstr(query, "alt=media") ? ENDPOINT_MEDIA : ENDPOINT_FILES;
+    }
+    if (strncmp(path, "changes", 7) == 0) return ENDPOINT_CHANGES;
+    if (strncmp(path, "about", 5) == 0) return ENDPOINT_ABOUT;
+    return ENDPOINT_OTHER;
+}
+
+static int method_of(const char *method) {
+    for (int i = 0; method && i < METRICS_METHOD_COUNT - 1; i++) {
+        if (strcmp(method, g_method_names[i]) == 0) return i;
+    }
+    return METRICS_METHOD_COUNT - 1;
+}
+
+int metrics_enabled(void) {
+    return __atomic_load_n(&g_metrics_on, __ATOMIC_RELAXED);
+}
+
+void metrics_record(CURL *curl, CURLcode res) {
+    if (!metrics_enabled()) return;
+
+    char *url = NULL;
+    char *method = NULL;
+    long code = 0;
+    curl_off_t bytes_up = 0;
+    curl_off_t bytes_down = 0;
+    curl_off_t total = 0;
+    curl_off_t starttransfer = 0;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_METHOD, &method);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &bytes_up);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes_down);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+    // A transfer that broke off after the headers still failed
+    if (res != CURLE_OK) code = 0;
+
+    MetricsEndpoint endpoint = endpoint_of(url);
+    int m = method_of(method);
+
+    pthread_mutex_lock(&g_metrics_lock);
+    g_bytes_up += (long long)bytes_up;
+    g_bytes_down += (long long)bytes_down;
+
+    MetricsSeries *series = NULL;
+    for (int i = 0; i < g_series_count; i++) {
+        MetricsSeries *s = &g_series[i];
+        if (s->endpoint == endpoint && s->method == m && s->code == code) {
+            series = s;
+            break;
+        }
+    }
+    if (!series && g_series_count < METRICS_MAX_SERIES) {
+        series = &g_series[g_series_count++];
+        series->endpoint = endpoint;
+        series->method = m;
+        series->code = code;
+        series->count = 0;
+    }
+    if (series) series->count++;
+    else g_series_dropped++;
+
+    observe(&g_duration[endpoint], (long long)total);
+    // Requests that never got a response have no time to first byte
+    if (starttransfer > 0) observe(&g_ttfb[endpoint], (long long)starttransfer);
+    pthread_mutex_unlock(&g_metrics_lock);
+}
+
+static void write_counter(FILE *file, const char *name, const char *help, const char *unit, long long value) {
+    fprintf(file, "# TYPE %s counter\n", name);
+    if (unit) fprintf(file, "# UNIT %s %s\n", name, unit);
+    fprintf(file, "# HELP %s %s\n", name, help);
+    fprintf(file, "%s_total %lld\n", name, value);
+}
+
+static void write_seconds_counter(FILE *file, const char *name, const char *help, long long ms) {
+    fprintf(file, "# TYPE %s counter\n# UNIT %s seconds\n# HELP %s %s\n", name, name, name, help);
+    fprintf(file, "%s_total %.3f\n", name, ms / 1000.0);
+}
+
+static void write_histogram(FILE *file, const char *name, const char *help, const MetricsHistogram *h) {
+    fprintf(file, "# TYPE %s histogram\n# UNIT %s seconds\n# HELP %s %s\n", name, name, name, help);
+    for (int e = 0; e < ENDPOINT_COUNT; e++) {
+        if (h[e].count == 0) continue;
+        long long cumulative = 0;
+        for (int i = 0; i < METRICS_BUCKETS; i++) {
+            cumulative += h[e].buckets[i];
+            fprintf(file, "%s_bucket{endpoint=\"%s\",le=\"%g\"} %lld\n",
+                    name, g_endpoint_names[e], bucket_bound_us(i) / 1e6, cumulative);
+        }
+        fprintf(file, "%s_bucket{endpoint=\"%s\",le=\"+Inf\"} %lld\n", name, g_endpoint_names[e], h[e].count);
+        fprintf(file, "%s_count{endpoint=\"%s\"} %lld\n", name, g_endpoint_names[e], h[e].count);
+        fprintf(file, "%s_sum{endpoint=\"%s\"} %.6f\n", name, g_endpoint_names[e], h[e].sum_us / 1e6);
+    }
+}
+
+// Caller holds g_metrics_lock, which also keeps the periodic writer and
+// the exit handler off the same temporary file
+static int write_file(void) {
+    char tmp_path[MAX_PATH_SIZE + 32];
+#ifdef _WIN32
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", g_metrics_path, (long)_getpid());
+#else
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", g_metrics_path, (long)getpid());
+#endif
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) return -1;
+
+    RetryStats stats;
+    retry_get_stats(&stats);
+
+    write_counter(file, "cdrive_upload_bytes", "Request body bytes sent, retries included", "bytes", g_bytes_up);
+    write_counter(file, "cdrive_download_bytes", "Response body bytes received, retries included", "bytes",
+                  g_bytes_down);
+
+    fprintf(file, "# TYPE cdrive_requests counter\n"
+                  "# HELP cdrive_requests HTTP requests by endpoint, method and status code\n");
+    for (int i = 0; i < g_series_count; i++) {
+        const MetricsSeries *s = &g_series[i];
+        char code[24];
+        if (s->code > 0) snprintf(code, sizeof(code), "%ld", s->code);
+        else snprintf(code, sizeof(code), "error");
+        fprintf(file, "cdrive_requests_total{endpoint=\"%s\",method=\"%s\",code=\"%s\"} %lld\n",
+                g_endpoint_names[s->endpoint], g_method_names[s->method], code, s->count);
+    }
+    if (g_series_dropped > 0) {
+        fprintf(file, "cdrive_requests_total{endpoint=\"other\",method=\"OTHER\",code=\"other\"} %lld\n",
+                g_series_dropped);
+    }
+
+    fprintf(file, "# TYPE cdrive_retries counter\n"
+                  "# HELP cdrive_retries Requests sent again after a transient error, by cause\n");
+    fprintf(file, "cdrive_retries_total{reason=\"rate_limited\"} %lld\n", stats.rate_limited);
+    fprintf(file, "cdrive_retries_total{reason=\"server_error\"} %lld\n", stats.server_errors);
+    fprintf(file, "cdrive_retries_total{reason=\"network_error\"} %lld\n", stats.network_errors);
+    write_counter(file, "cdrive_retries_exhausted", "Requests that failed after using up their retries", NULL,
+                  stats.gave_up);
+    write_counter(file, "cdrive_token_refreshes", "Access token refreshes", NULL, stats.token_refreshes);
+    write_seconds_counter(file, "cdrive_backoff_seconds", "Time spent backing off before retries",
+                          stats.backoff_ms);
+    write_seconds_counter(file, "cdrive_pacer_wait_seconds", "Time requests spent queued behind the quota pacer",
+                          pacer_wait_ms());
+
+    write_histogram(file, "cdrive_request_duration_seconds", "Time from start to end of a request", g_duration);
+    write_histogram(file, "cdrive_request_ttfb_seconds", "Time from start of a request to its first response byte",
+                    g_ttfb);
+    fprintf(file, "# EOF\n");
+
+    // Readers such as node_exporter must never see a half-written file
+    int ok = fclose(file) == 0;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, g_metrics_path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, g_metrics_path) == 0;
+#endif
+    if (!ok) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_write(void) {
+    pthread_mutex_lock(&g_metrics_lock);
+    if (metrics_enabled()) write_file();
+    pthread_mutex_unlock(&g_metrics_lock);
+}
+
+static void *metrics_writer(void *arg) {
+    unsigned generation = (unsigned)(size_t)arg;
+    for (;;) {
+        // Short naps so a reset does not leave the writer around for long
+        for (int i = 0; i < METRICS_INTERVAL_S * 10; i++) {
+            cdrive_usleep(100000);
+            if (__atomic_load_n(&g_generation, __ATOMIC_RELAXED) != generation) return NULL;
+        }
+        pthread_mutex_lock(&g_metrics_lock);
+        if (g_generation == generation) write_file();
+        pthread_mutex_unlock(&g_metrics_lock);
+    }
+}
+
+int metrics_open(const char *path) {
+    pthread_mutex_lock(&g_metrics_lock);
+    snprintf(g_metrics_path, sizeof(g_metrics_path), "%s", path);
+    // Write once up front so a bad path fails the command before it starts
+    if (write_file() != 0) {
+        pthread_mutex_unlock(&g_metrics_lock);
+        return -1;
+    }
+    __atomic_store_n(&g_metrics_on, 1, __ATOMIC_RELAXED);
+    if (!g_writer_started) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, metrics_writer, (void *)(size_t)g_generation) == 0) {
+            pthread_detach(thread);
+            g_writer_started = 1;
+        }
+    }
+    pthread_mutex_unlock(&g_metrics_lock);
+    return 0;
+}
+
+void metrics_reset(void) {
+    pthread_mutex_lock(&g_metrics_lock);
+    __atomic_store_n(&g_metrics_on, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_generation, 1, __ATOMIC_RELAXED);
+    g_writer_started = 0;
+    g_metrics_path[0] = '\0';
+    g_bytes_up = 0;
+    g_bytes_down = 0;
+    g_series_count = 0;
+    g_series_dropped = 0;
+    memset(g_duration, 0, sizeof(g_duration));
+    memset(g_ttfb, 0, sizeof(g_ttfb));
+    pthread_mutex_unlock(&g_metrics_lock);
+}
@@ -0,0 +1,43 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <curl/curl.h>
+
+#define METRICS_INTERVAL_S 15      // Rewrite period while a command runs
+#define METRICS_MAX_SERIES 128     // Distinct endpoint/method/code request counters
+// Latency buckets are log-linear like an HDR histogram: every power of two
+// from 1 ms is split into METRICS_SUB_BUCKETS steps, up to about 57 s
+#define METRICS_OCTAVES 16
+#define METRICS_SUB_BUCKETS 4
+#define METRICS_BUCKETS (METRICS_OCTAVES * METRICS_SUB_BUCKETS)
+
+// Drive endpoints requests are labelled with; query strings and file IDs
+// are dropped to keep the label set small
+typedef enum {
+    ENDPOINT_FILES,
+    ENDPOINT_MEDIA,      // files/<id>?alt=media downloads
+    ENDPOINT_UPLOAD,
+    ENDPOINT_CHANGES,
+    ENDPOINT_ABOUT,
+    ENDPOINT_TOKEN,
+    ENDPOINT_OTHER,
+    ENDPOINT_COUNT
+} MetricsEndpoint;
+
+// --metrics <path>: keep OpenMetrics counters and latency histograms, and
+// write them to path (for node_exporter's textfile collector) every
+// METRICS_INTERVAL_S seconds and at exit. The file is replaced atomically.
+int metrics_open(const char *path);
+int metrics_enabled(void);
+
+// Called by transport_record() for every finished request
+void metrics_record(CURL *curl, CURLcode res);
+
+// Write the file now; registered with atexit() by --metrics
+void metrics_write(void);
+
+// Stop the periodic writer and forget everything (daemon workers, per
+// command)
+void metrics_reset(void);
+
+#endif // METRICS_H
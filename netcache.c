@@ -0,0 +1,436 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "netcache.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <arpa/inet.h>
+#endif
+
+// One host's addresses. Entries loaded from disk are handed to curl through
+// CURLOPT_RESOLVE until they expire; entries learned in this process come
+// from connections curl resolved itself.
+typedef struct {
+    char host[256];
+    int port;
+    char addrs[NETCACHE_MAX_ADDRS][64];
+    int addr_count;
+    long long expires;
+    int from_disk;
+} NetHost;
+
+#ifdef NETCACHE_TLS_SESSIONS
+typedef struct {
+    char *key;
+    unsigned char *shmac;
+    size_t shmac_len;
+    unsigned char *data;
+    size_t data_len;
+} NetSession;
+
+static NetSession g_sessions[NETCACHE_MAX_SESSIONS];
+static int g_session_count = 0;
+static int g_sessions_imported = 0;
+#endif
+
+static pthread_mutex_t g_net_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_net_once = PTHREAD_ONCE_INIT;
+static NetHost g_hosts[NETCACHE_MAX_HOSTS];
+static int g_host_count = 0;
+// Handles keep pointing at the list they were given, so lists are never
+// freed; a new one is only built on load and on forget
+static struct curl_slist *g_resolve = NULL;
+static long long g_resolve_expires = 0;
+// After a failed connection: "-host:port" entries that take the stale
+// addresses out of curl's DNS cache, applied until they would have aged out
+static struct curl_slist *g_removal = NULL;
+static long long g_removal_until = 0;
+static int g_proxied = 0;
+static int g_dirty = 0;
+static int g_used = 0;
+
+static int cache_path(char *out, size_t size) {
+    const char *home = getenv(HOME_ENV);
+    if (!home) return -1;
+    int n = snprintf(out, size, "%s%s%s%s%s", home, PATH_SEP, CONFIG_DIR, PATH_SEP, NETCACHE_FILE);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+// Addresses are written back into CURLOPT_RESOLVE strings, so only accept
+// characters that can appear in a numeric IPv4 or IPv6 address
+static int valid_addr(const char *s) {
+    if (!*s || strlen(s) >= 64) return 0;
+    for (; *s; s++) {
+        if (!strchr("0123456789abcdefABCDEF.:", *s)) return 0;
+    }
+    return 1;
+}
+
+static int valid_host(const char *s) {
+    if (!*s || strlen(s) >= 256) return 0;
+    for (; *s; s++) {
+        if (!strchr("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-", *s)) return 0;
+    }
+    return 1;
+}
+
+// Through a proxy the connected address is the proxy's, not the host's
+static int proxy_configured(void) {
+    static const char *const vars[] = {
+        "https_proxy", "HTTPS_PROXY", "http_proxy", "all_proxy", "ALL_PROXY", NULL
+    };
+    for (int i = 0; vars[i]; i++) {
+        const char *v = getenv(vars[i]);
+        if (v && *v) return 1;
+    }
+    return 0;
+}
+
+#ifdef NETCACHE_TLS_SESSIONS
+static void hex_encode(FILE *f, const unsigned char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) fprintf(f, "%02x", data[i]);
+}
+
+static unsigned char *hex_decode(const char *hex, size_t *len) {
+    size_t n = strlen(hex);
+    if (n % 2 != 0) return NULL;
+    unsigned char *out = malloc(n / 2 + 1);
+    if (!out) return NULL;
+    for (size_t i = 0; i < n / 2; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            free(out);
+            return NULL;
+        }
+        out[i] = (unsigned char)byte;
+    }
+    out[n / 2] = '\0';
+    *len = n / 2;
+    return out;
+}
+
+static void load_sessions(json_object *root, long long now) {
+    json_object *sessions;
+    if (!json_object_object_get_ex(root, "sessions", &sessions) ||
+        json_object_get_type(sessions) != json_type_array) {
+        return;
+    }
+    size_t count = json_object_array_length(sessions);
+    for (size_t i = 0; i < count && g_session_count < NETCACHE_MAX_SESSIONS; i++) {
+        json_object *entry = json_object_array_get_idx(sessions, i);
+        json_object *key, *shmac, *data, *expires;
+        if (!json_object_object_get_ex(entry, "key", &key) ||
+            !json_object_object_get_ex(entry, "shmac", &shmac) ||
+            !json_object_object_get_ex(entry, "data", &data) ||
+            !json_object_object_get_ex(entry, "expires", &expires) ||
+            json_object_get_int64(expires) <= now) {
+            continue;
+        }
+        NetSession *s = &g_sessions[g_session_count];
+        size_t key_len;
+        s->key = (char *)hex_decode(json_object_get_string(key), &key_len);
+        s->shmac = hex_decode(json_object_get_string(shmac), &s->shmac_len);
+        s->data = hex_decode(json_object_get_string(data), &s->data_len);
+        if (s->key && s->shmac && s->data) {
+            g_session_count++;
+        } else {
+            free(s->key);
+            free(s->shmac);
+            free(s->data);
+            memset(s, 0, sizeof(*s));
+        }
+    }
+}
+#endif
+
+static void load_hosts(json_object *root, long long now) {
+    json_object *hosts;
+    if (!json_object_object_get_ex(root, "hosts", &hosts) ||
+        json_object_get_type(hosts) != json_type_array) {
+        return;
+    }
+    size_t count = json_object_array_length(hosts);
+    for (size_t i = 0; i < count && g_host_count < NETCACHE_MAX_HOSTS; i++) {
+        json_object *entry = json_object_array_get_idx(hosts, i);
+        json_object *host, *port, *addrs, *expires;
+        if (!json_object_object_get_ex(entry, "host", &host) ||
+            !json_object_object_get_ex(entry, "port", &port) ||
+            !json_object_object_get_ex(entry, "addrs", &addrs) ||
+            !json_object_object_get_ex(entry, "expires", &expires) ||
+            json_object_get_type(addrs) != json_type_array ||
+            !valid_host(json_object_get_string(host)) ||
+            json_object_get_int64(expires) <= now) {
+            continue;
+        }
+
+        NetHost *h = &g_hosts[g_host_count];
+        memset(h, 0, sizeof(*h));
+        snprintf(h->host, sizeof(h->host), "%s", json_object_get_string(host));
+        h->port = json_object_get_int(port);
+        h->expires = json_object_get_int64(expires);
+        h->from_disk = 1;
+        size_t n = json_object_array_length(addrs);
+        for (size_t j = 0; j < n && h->addr_count < NETCACHE_MAX_ADDRS; j++) {
+            const char *addr = json_object_get_string(json_object_array_get_idx(addrs, j));
+            if (addr && valid_addr(addr)) snprintf(h->addrs[h->addr_count++], sizeof(h->addrs[0]), "%s", addr);
+        }
+        if (h->addr_count > 0 && h->port > 0 && h->port < 65536) g_host_count++;
+    }
+
+    // "+host:port:addr,..." entries time out of curl's DNS cache like
+    // resolved ones, so a long-running process picks up address changes
+    for (int i = 0; i < g_host_count; i++) {
+        NetHost *h = &g_hosts[i];
+        char entry[512];
+        int off = snprintf(entry, sizeof(entry), "+%s:%d:", h->host, h->port);
+        for (int j = 0; j < h->addr_count; j++) {
+            const char *fmt = strchr(h->addrs[j], ':') ? "%s[%s]" : "%s%s";
+            off += snprintf(entry + off, sizeof(entry) - (size_t)off, fmt, j ? "," : "", h->addrs[j]);
+        }
+        g_resolve = curl_slist_append(g_resolve, entry);
+        if (g_resolve_expires == 0 || h->expires < g_resolve_expires) g_resolve_expires = h->expires;
+    }
+}
+
+static void netcache_load(void) {
+    char path[MAX_PATH_SIZE];
+    g_proxied = proxy_configured();
+    atexit(netcache_save);
+    if (cache_path(path, sizeof(path)) != 0) return;
+
+    json_object *root = json_object_from_file(path);
+    if (!root) return;
+    long long now = (long long)time(NULL);
+    if (!g_proxied) load_hosts(root, now);
+#ifdef NETCACHE_TLS_SESSIONS
+    load_sessions(root, now);
+#endif
+    json_object_put(root);
+}
+
+// Host part of an http(s) URL
+static int url_host(const char *url, char *host, size_t size) {
+    const char *p = strstr(url, "://");
+    if (!p) return -1;
+    p += 3;
+    size_t len = strcspn(p, ":/?#");
+    if (len == 0 || len >= size) return -1;
+    memcpy(host, p, len);
+    host[len] = '\0';
+    return 0;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x075000
+// Called once a connection is up: remember where the host resolved to
+static int learn_address(void *clientp, char *primary_ip, char *local_ip, int primary_port, int local_port) {
+    (void)local_ip;
+    (void)local_port;
+    CURL *curl = clientp;
+    char *url = NULL;
+    char host[256];
+    unsigned char literal[16];
+
+    __atomic_store_n(&g_used, 1, __ATOMIC_RELAXED);
+    if (g_proxied || !primary_ip || !valid_addr(primary_ip) ||
+        curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK || !url ||
+        url_host(url, host, sizeof(host)) != 0 || !valid_host(host) ||
+        inet_pton(AF_INET, host, literal) == 1) {
+        return CURL_PREREQFUNC_OK;
+    }
+
+    long long now = (long long)time(NULL);
+    pthread_mutex_lock(&g_net_lock);
+    NetHost *h = NULL;
+    for (int i = 0; i < g_host_count && !h; i++) {
+        if (g_hosts[i].port == primary_port && strcmp(g_hosts[i].host, host) == 0) h = &g_hosts[i];
+    }
+    // A fresh entry from disk is what curl just used; extending it would
+    // keep an address alive past its TTL
+    if (h && h->from_disk && h->expires > now) {
+        pthread_mutex_unlock(&g_net_lock);
+        return CURL_PREREQFUNC_OK;
+    }
+    if (h && h->expires <= now) {
+        h->addr_count = 0;
+        h->from_disk = 0;
+    }
+    if (!h) {
+        for (int i = 0; i < g_host_count && !h; i++) {
+            if (g_hosts[i].expires <= now) h = &g_hosts[i];
+        }
+        if (!h && g_host_count < NETCACHE_MAX_HOSTS) h = &g_hosts[g_host_count++];
+        if (h) {
+            memset(h, 0, sizeof(*h));
+            snprintf(h->host, sizeof(h->host), "%s", host);
+            h->port = primary_port;
+        }
+    }
+    if (h) {
+        int known = 0;
+        for (int i = 0; i < h->addr_count; i++) {
+            if (strcmp(h->addrs[i], primary_ip) == 0) known = 1;
+        }
+        if (!known && h->addr_count < NETCACHE_MAX_ADDRS) {
+            snprintf(h->addrs[h->addr_count++], sizeof(h->addrs[0]), "%s", primary_ip);
+            if (h->addr_count == 1) h->expires = now + NETCACHE_DNS_TTL;
+            g_dirty = 1;
+        }
+    }
+    pthread_mutex_unlock(&g_net_lock);
+    return CURL_PREREQFUNC_OK;
+}
+#endif
+
+void netcache_setup(CURL *curl) {
+    pthread_once(&g_net_once, netcache_load);
+
+    long long now = (long long)time(NULL);
+    pthread_mutex_lock(&g_net_lock);
+    if (g_resolve && now < g_resolve_expires) {
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, g_resolve);
+    } else if (g_removal && now < g_removal_until) {
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, g_removal);
+    }
+#ifdef NETCACHE_TLS_SESSIONS
+    // The handle is on the shared pool, so imports land in the shared cache
+    if (!g_sessions_imported) {
+        g_sessions_imported = 1;
+        for (int i = 0; i < g_session_count; i++) {
+            NetSession *s = &g_sessions[i];
+            curl_easy_ssls_import(curl, s->key, s->shmac, s->shmac_len, s->data, s->data_len);
+        }
+    }
+#endif
+    pthread_mutex_unlock(&g_net_lock);
+
+#if LIBCURL_VERSION_NUM >= 0x075000
+    curl_easy_setopt(curl, CURLOPT_PREREQFUNCTION, learn_address);
+    curl_easy_setopt(curl, CURLOPT_PREREQDATA, curl);
+#endif
+}
+
+void netcache_forget(CURL *curl) {
+    struct curl_slist *removal = NULL;
+
+    pthread_mutex_lock(&g_net_lock);
+    for (int i = 0; i < g_host_count; i++) {
+        // Learned addresses were never given to curl; just do not save them
+        if (g_hosts[i].from_disk && g_hosts[i].expires > 0) {
+            char entry[300];
+            snprintf(entry, sizeof(entry), "-%.255s:%d", g_hosts[i].host, g_hosts[i].port);
+            removal = curl_slist_append(removal, entry);
+        }
+        g_hosts[i].expires = 0;
+        g_dirty = 1;
+    }
+    g_resolve_expires = 0;
+    if (removal) {
+        // Leaked like g_resolve; this only happens on failures
+        g_removal = removal;
+        g_removal_until = (long long)time(NULL) + 60;
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, removal);
+    }
+    pthread_mutex_unlock(&g_net_lock);
+}
+
+#ifdef NETCACHE_TLS_SESSIONS
+typedef struct {
+    FILE *file;
+    int count;
+} SessionWriter;
+
+static CURLcode write_session(CURL *handle, void *userptr, const char *session_key,
+                              const unsigned char *shmac, size_t shmac_len,
+                              const unsigned char *sdata, size_t sdata_len,
+                              curl_off_t valid_until, int ietf_tls_id, const char *alpn,
+                              size_t earlydata_max) {
+    (void)handle;
+    (void)ietf_tls_id;
+    (void)alpn;
+    (void)earlydata_max;
+    SessionWriter *w = userptr;
+    if (w->count == NETCACHE_MAX_SESSIONS || valid_until <= (curl_off_t)time(NULL)) return CURLE_OK;
+
+    fprintf(w->file, "%s\n    {\"key\": \"", w->count ? "," : "");
+    hex_encode(w->file, (const unsigned char *)session_key, strlen(session_key));
+    fprintf(w->file, "\", \"shmac\": \"");
+    hex_encode(w->file, shmac, shmac_len);
+    fprintf(w->file, "\", \"data\": \"");
+    hex_encode(w->file, sdata, sdata_len);
+    fprintf(w->file, "\", \"expires\": %lld}", (long long)valid_until);
+    w->count++;
+    return CURLE_OK;
+}
+#endif
+
+void netcache_save(void) {
+    char path[MAX_PATH_SIZE];
+    char tmp_path[MAX_PATH_SIZE + 32];
+
+#ifdef NETCACHE_TLS_SESSIONS
+    // Created before taking the lock: setting it up takes the lock too
+    CURL *curl = __atomic_load_n(&g_used, __ATOMIC_RELAXED) ? cdrive_easy_init() : NULL;
+#endif
+
+    pthread_mutex_lock(&g_net_lock);
+#ifdef NETCACHE_TLS_SESSIONS
+    int save = g_dirty || curl;
+#else
+    int save = g_dirty;
+#endif
+    if (!save || cache_path(path, sizeof(path)) != 0) {
+        pthread_mutex_unlock(&g_net_lock);
+#ifdef NETCACHE_TLS_SESSIONS
+        if (curl) curl_easy_cleanup(curl);
+#endif
+        return;
+    }
+
+    // Session tickets are credentials, so the file is private like token.json
+#ifdef _WIN32
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)_getpid());
+    FILE *file = fopen(tmp_path, "w");
+#else
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file && fd >= 0) close(fd);
+#endif
+    if (!file) {
+        pthread_mutex_unlock(&g_net_lock);
+#ifdef NETCACHE_TLS_SESSIONS
+        if (curl) curl_easy_cleanup(curl);
+#endif
+        return;
+    }
+
+    long long now = (long long)time(NULL);
+    int written = 0;
+    fprintf(file, "{\n  \"hosts\": [");
+    for (int i = 0; i < g_host_count; i++) {
+        NetHost *h = &g_hosts[i];
+        if (h->expires <= now || h->addr_count == 0) continue;
+        fprintf(file, "%s\n    {\"host\": \"%s\", \"port\": %d, \"addrs\": [", written++ ? "," : "", h->host, h->port);
+        for (int j = 0; j < h->addr_count; j++) fprintf(file, "%s\"%s\"", j ? ", " : "", h->addrs[j]);
+        fprintf(file, "], \"expires\": %lld}", h->expires);
+    }
+    fprintf(file, "\n  ],\n  \"sessions\": [");
+#ifdef NETCACHE_TLS_SESSIONS
+    SessionWriter writer = { file, 0 };
+    if (curl) {
+        curl_easy_ssls_export(curl, write_session, &writer);
+        curl_easy_cleanup(curl);
+    }
+#endif
+    fprintf(file, "\n  ]\n}\n");
+    g_dirty = 0;
+    g_used = 0;
+    pthread_mutex_unlock(&g_net_lock);
+
+    int ok = fclose(file) == 0;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, path) == 0;
+#endif
+    if (!ok) remove(tmp_path);
+}
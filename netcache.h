@@ -0,0 +1,32 @@
+#ifndef NETCACHE_H
+#define NETCACHE_H
+
+#include <curl/curl.h>
+
+#define NETCACHE_FILE "netcache.json"
+#define NETCACHE_DNS_TTL 300        // Seconds a learned address is reused
+#define NETCACHE_MAX_HOSTS 8
+#define NETCACHE_MAX_ADDRS 4
+#define NETCACHE_MAX_SESSIONS 8
+
+// TLS sessions can only be exported from libcurl 8.12 on
+#if LIBCURL_VERSION_NUM >= 0x080c00
+#define NETCACHE_TLS_SESSIONS 1
+#endif
+
+// Connection setup state kept under ~/.cdrive between runs, so a short
+// command does not start every connection cold: the addresses Drive's hosts
+// resolved to (with a TTL), and, where libcurl can export them, TLS session
+// tickets for abbreviated handshakes. Called from cdrive_easy_setup() once
+// the handle is on the shared pool.
+void netcache_setup(CURL *curl);
+
+// A connection to a cached address failed: drop the cached addresses and
+// make this handle resolve afresh on its retry
+void netcache_forget(CURL *curl);
+
+// Write what this process learned; runs at exit, and before a worker that
+// serves many commands goes away
+void netcache_save(void);
+
+#endif // NETCACHE_H
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "pacer.h"
+
+// Virtual-time token bucket: next_ns is when the next request may go out,
+// and each admission pushes it on by one interval. Idle time earns at most
+// PACER_BURST - 1 spare tokens, so a quiet spell is never followed by a
+// burst big enough to trip the quota.
+typedef struct {
+    unsigned long next_ticket;
+    unsigned long serving;
+} PaceQueue;
+
+static pthread_mutex_t g_pacer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_pacer_cond = PTHREAD_COND_INITIALIZER;
+static int g_quota = PACER_DEFAULT_QUOTA;
+static long long g_interval_ns = (long long)PACER_WINDOW_MS * 1000000LL / PACER_DEFAULT_QUOTA;
+static long long g_next_ns = 0;
+static PaceQueue g_lanes[PACE_LANE_COUNT];
+static int g_last_lane = PACE_MEDIA;
+static long long g_wait_ms = 0;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime_mono(&ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void pacer_set_quota(int quota) {
+    pthread_mutex_lock(&g_pacer_lock);
+    g_quota = quota > 0 ? quota : 0;
+    g_interval_ns = quota > 0 ? (long long)PACER_WINDOW_MS * 1000000LL / quota : 0;
+    pthread_mutex_unlock(&g_pacer_lock);
+}
+
+int pacer_get_quota(void) {
+    pthread_mutex_lock(&g_pacer_lock);
+    int quota = g_quota;
+    pthread_mutex_unlock(&g_pacer_lock);
+    return quota;
+}
+
+// A lane may take the next slot unless the other lane is waiting too and
+// this lane had the previous one
+static int lane_has_turn(PaceLane lane) {
+    for (int other = 0; other < PACE_LANE_COUNT; other++) {
+        if (other == (int)lane) continue;
+        if (g_lanes[other].next_ticket != g_lanes[other].serving && g_last_lane == (int)lane) return 0;
+    }
+    return 1;
+}
+
+void pacer_admit(PaceLane lane) {
+    long long queued_at = now_ns();
+
+    pthread_mutex_lock(&g_pacer_lock);
+    if (g_interval_ns == 0) {
+        pthread_mutex_unlock(&g_pacer_lock);
+        return;
+    }
+
+    PaceQueue *q = &g_lanes[lane];
+    unsigned long ticket = q->next_ticket++;
+    for (;;) {
+        if (q->serving != ticket || !lane_has_turn(lane)) {
+            pthread_cond_wait(&g_pacer_cond, &g_pacer_lock);
+            continue;
+        }
+
+        long long now = now_ns();
+        long long earliest = now - (PACER_BURST - 1) * g_interval_ns;
+        if (g_next_ns < earliest) g_next_ns = earliest;
+        long long wait_ns = g_next_ns - now;
+        if (wait_ns <= 0) break;
+
+        // Sleep outside the lock in short steps so a hold or a quota change
+        // is picked up promptly
+        pthread_mutex_unlock(&g_pacer_lock);
+        long long step_us = wait_ns / 1000;
+        if (step_us > 200000) step_us = 200000;
+        cdrive_usleep(step_us > 0 ? step_us : 1);
+        pthread_mutex_lock(&g_pacer_lock);
+        if (g_interval_ns == 0) break;
+    }
+
+    g_next_ns += g_interval_ns;
+    q->serving++;
+    g_last_lane = lane;
+    pthread_cond_broadcast(&g_pacer_cond);
+    pthread_mutex_unlock(&g_pacer_lock);
+
+    long long waited = (now_ns() - queued_at) / 1000000LL;
+    if (waited > 0) __atomic_add_fetch(&g_wait_ms, waited, __ATOMIC_RELAXED);
+}
+
+long long pacer_reserve(void) {
+    pthread_mutex_lock(&g_pacer_lock);
+    if (g_interval_ns == 0) {
+        pthread_mutex_unlock(&g_pacer_lock);
+        return 0;
+    }
+    long long now = now_ns();
+    long long earliest = now - (PACER_BURST - 1) * g_interval_ns;
+    if (g_next_ns < earliest) g_next_ns = earliest;
+    long long wait_ns = g_next_ns - now;
+    g_next_ns += g_interval_ns;
+    pthread_mutex_unlock(&g_pacer_lock);
+
+    if (wait_ns <= 0) return 0;
+    __atomic_add_fetch(&g_wait_ms, wait_ns / 1000000LL, __ATOMIC_RELAXED);
+    return (wait_ns + 999999) / 1000000LL;
+}
+
+void pacer_hold(long long ms) {
+    pthread_mutex_lock(&g_pacer_lock);
+    long long until = now_ns() + ms * 1000000LL;
+    if (g_next_ns < until) g_next_ns = until;
+    pthread_mutex_unlock(&g_pacer_lock);
+}
+
+long long pacer_wait_ms(void) {
+    return __atomic_load_n(&g_wait_ms, __ATOMIC_RELAXED);
+}
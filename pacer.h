@@ -0,0 +1,36 @@
+#ifndef PACER_H
+#define PACER_H
+
+// Drive's published per-user limit is 12,000 queries a minute
+#define PACER_DEFAULT_QUOTA 20000   // Queries per 100 seconds
+#define PACER_WINDOW_MS 100000
+#define PACER_BURST 2               // Requests that may go out back to back
+
+// Requests are paced on one shared budget, but queue in separate lanes so a
+// backlog of uploads cannot hold up listings and the other way round
+typedef enum {
+    PACE_METADATA,
+    PACE_MEDIA,
+    PACE_LANE_COUNT
+} PaceLane;
+
+// Set the per-user quota in queries per 100 seconds; 0 turns pacing off
+void pacer_set_quota(int quota);
+int pacer_get_quota(void);
+
+// Block until a request on this lane may be sent. Requests on a lane are
+// admitted in arrival order, and lanes take turns while both are busy.
+void pacer_admit(PaceLane lane);
+
+// Non-blocking form for event-loop callers: claims the next slot on the
+// shared budget and returns how many ms to wait before sending. Bypasses
+// the lane queues, which only order blocked threads.
+long long pacer_reserve(void);
+
+// Quota exhausted: hold every lane for at least ms
+void pacer_hold(long long ms);
+
+// Total time requests spent queued, for --stats
+long long pacer_wait_ms(void);
+
+#endif // PACER_H
@@ -0,0 +1,72 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT (SDT) probes under the provider "cdrive", for bpftrace, perf or
+// SystemTap on a running binary, e.g.
+//
+//   bpftrace -e 'usdt:/usr/local/bin/cdrive:cdrive:request_done { @us = hist(arg6); }'
+//
+// A probe site is a single nop until a tracer attaches to it. Each probe
+// also has a semaphore the tracer raises while attached, so a site whose
+// arguments cost something to gather checks PROBE_*_ENABLED() first. They need
+// <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel) at build time; without
+// it, off Linux, or with CDRIVE_NO_USDT defined, they compile to nothing.
+#if defined(__linux__) && !defined(CDRIVE_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define CDRIVE_USDT 1
+#endif
+#endif
+
+#ifdef CDRIVE_USDT
+// Defined in transport.c, one per probe below
+#define PROBE_SEMAPHORES(X) \
+    X(request_start) X(request_done) X(chunk_received) X(chunk_sent) \
+    X(token_refresh) X(retry) X(file_open) X(file_close)
+#define PROBE_SEMAPHORE_DECLARE(name) extern unsigned short cdrive_##name##_semaphore;
+PROBE_SEMAPHORES(PROBE_SEMAPHORE_DECLARE)
+
+#define PROBE_REQUEST_DONE_ENABLED() __builtin_expect(cdrive_request_done_semaphore, 0)
+
+// A request goes out: curl handle, earlier sends of the same request
+#define PROBE_REQUEST_START(curl, retries) \
+    DTRACE_PROBE2(cdrive, request_start, (void *)(curl), (int)(retries))
+// It finished: curl handle, URL, HTTP status (0 if none), CURLcode, bytes
+// sent, bytes received, total microseconds
+#define PROBE_REQUEST_DONE(curl, url, status, result, bytes_up, bytes_down, total_us) \
+    DTRACE_PROBE7(cdrive, request_done, (void *)(curl), (const char *)(url), (long)(status), (int)(result), \
+                  (long long)(bytes_up), (long long)(bytes_down), (long long)(total_us))
+// Body data handed to or by curl: bytes; for uploads also the source path
+// and its offset
+#define PROBE_CHUNK_RECEIVED(bytes) \
+    DTRACE_PROBE1(cdrive, chunk_received, (long long)(bytes))
+#define PROBE_CHUNK_SENT(path, offset, bytes) \
+    DTRACE_PROBE3(cdrive, chunk_sent, (const char *)(path), (long long)(offset), (long long)(bytes))
+// token_refresh(): 1 refreshed, 0 adopted another refresh, -1 failed
+#define PROBE_TOKEN_REFRESH(result) \
+    DTRACE_PROBE1(cdrive, token_refresh, (int)(result))
+// A backoff retry was scheduled: curl handle, attempt, HTTP status,
+// CURLcode, delay in ms
+#define PROBE_RETRY(curl, attempt, status, result, delay_ms) \
+    DTRACE_PROBE5(cdrive, retry, (void *)(curl), (int)(attempt), (long)(status), (int)(result), \
+                  (long long)(delay_ms))
+// A local file a transfer reads or writes: path, Drive file ID ("" for
+// new uploads), size at open / bytes at close
+#define PROBE_FILE_OPEN(path, file_id, size) \
+    DTRACE_PROBE3(cdrive, file_open, (const char *)(path), (const char *)(file_id), (long long)(size))
+#define PROBE_FILE_CLOSE(path, file_id, size) \
+    DTRACE_PROBE3(cdrive, file_close, (const char *)(path), (const char *)(file_id), (long long)(size))
+#else
+#define PROBE_REQUEST_DONE_ENABLED() 0
+#define PROBE_REQUEST_START(curl, retries) ((void)0)
+#define PROBE_REQUEST_DONE(curl, url, status, result, bytes_up, bytes_down, total_us) ((void)0)
+#define PROBE_CHUNK_RECEIVED(bytes) ((void)0)
+#define PROBE_CHUNK_SENT(path, offset, bytes) ((void)0)
+#define PROBE_TOKEN_REFRESH(result) ((void)0)
+#define PROBE_RETRY(curl, attempt, status, result, delay_ms) ((void)0)
+#define PROBE_FILE_OPEN(path, file_id, size) ((void)0)
+#define PROBE_FILE_CLOSE(path, file_id, size) ((void)0)
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,89 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "profile.h"
+
+int g_profile = 0;
+
+#ifdef CDRIVE_PROFILE
+static const char *const g_phase_names[PROF_COUNT] = {
+    "JSON parsing", "Token file I/O", "Glob expansion", "MIME detection", "Progress output", "Disk writes"
+};
+static const char *const g_phase_keys[PROF_COUNT] = {
+    "json", "token_io", "glob", "mime", "progress", "disk_write"
+};
+
+static pthread_mutex_t g_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_profile_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_profile_key;
+static ProfileCounters g_totals;        // From threads that have exited
+static __thread ProfileCounters *t_counters = NULL;
+
+static void fold(ProfileCounters *counters) {
+    pthread_mutex_lock(&g_profile_lock);
+    for (int p = 0; p < PROF_COUNT; p++) {
+        g_totals.ns[p] += counters->ns[p];
+        g_totals.calls[p] += counters->calls[p];
+    }
+    pthread_mutex_unlock(&g_profile_lock);
+    memset(counters, 0, sizeof(*counters));
+}
+
+static void thread_exit(void *arg) {
+    fold((ProfileCounters *)arg);
+    free(arg);
+}
+
+static void create_key(void) {
+    pthread_key_create(&g_profile_key, thread_exit);
+}
+
+ProfileCounters *profile_counters(void) {
+    if (t_counters) return t_counters;
+    pthread_once(&g_profile_once, create_key);
+    t_counters = calloc(1, sizeof(ProfileCounters));
+    if (t_counters) pthread_setspecific(g_profile_key, t_counters);
+    return t_counters;
+}
+
+// Registered with atexit() by --profile. Threads still running (the
+// worker pools have been joined by now) are not included.
+void profile_print(void) {
+    if (!g_profile) return;
+    if (t_counters) fold(t_counters);
+
+    pthread_mutex_lock(&g_profile_lock);
+    if (g_json_mode) {
+        fprintf(stderr, "{\"profile\":{");
+        for (int p = 0; p < PROF_COUNT; p++) {
+            fprintf(stderr, "%s\"%s\":{\"calls\":%lld,\"total_ms\":%.3f}", p ? "," : "", g_phase_keys[p],
+                    g_totals.calls[p], g_totals.ns[p] / 1e6);
+        }
+        fprintf(stderr, "}}\n");
+    } else {
+        fprintf(stderr, "\n%sProfile%s (all threads)\n", COLOR_BOLD, COLOR_RESET);
+        fprintf(stderr, "  %-16s %9s %10s %10s\n", "Phase", "Calls", "Total", "Mean");
+        for (int p = 0; p < PROF_COUNT; p++) {
+            double total_ms = g_totals.ns[p] / 1e6;
+            double mean_us = g_totals.calls[p] ? g_totals.ns[p] / 1e3 / (double)g_totals.calls[p] : 0;
+            fprintf(stderr, "  %-16s %9lld %8.1fms %8.1fus\n", g_phase_names[p], g_totals.calls[p], total_ms,
+                    mean_us);
+        }
+    }
+    pthread_mutex_unlock(&g_profile_lock);
+}
+
+void profile_reset(void) {
+    g_profile = 0;
+    if (t_counters) memset(t_counters, 0, sizeof(*t_counters));
+    pthread_mutex_lock(&g_profile_lock);
+    memset(&g_totals, 0, sizeof(g_totals));
+    pthread_mutex_unlock(&g_profile_lock);
+}
+#else
+void profile_print(void) {
+}
+
+void profile_reset(void) {
+    g_profile = 0;
+}
+#endif
@@ -0,0 +1,75 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Local work --profile breaks wall time down into. Scopes may nest: token
+// file I/O includes parsing token.json.
+typedef enum {
+    PROF_JSON,         // Response and listing parsing
+    PROF_TOKEN_IO,     // Reading and writing token.json
+    PROF_GLOB,         // Upload pattern expansion
+    PROF_MIME,         // MIME type detection
+    PROF_PROGRESS,     // Progress bars, spinners and scan counters
+    PROF_DISK_WRITE,   // Download writes
+    PROF_COUNT
+} ProfilePhase;
+
+// Set by --profile. The timers only exist in builds made with
+// CDRIVE_PROFILE defined (make PROFILE=1); elsewhere the flag only warns.
+extern int g_profile;
+
+// Calls, total and mean per phase over all threads, on stderr (a
+// "profile" object under --json)
+void profile_print(void);
+
+// Forget the totals (daemon workers, per command)
+void profile_reset(void);
+
+#ifdef CDRIVE_PROFILE
+#include "compat.h"
+
+typedef struct {
+    long long ns[PROF_COUNT];
+    long long calls[PROF_COUNT];
+} ProfileCounters;
+
+typedef struct {
+    int phase;                 // -1 when --profile is off
+    struct timespec start;
+} ProfileScope;
+
+// This thread's counters, created on first use and folded into the totals
+// when the thread exits
+ProfileCounters *profile_counters(void);
+
+static inline ProfileScope profile_scope_begin(int phase) {
+    ProfileScope scope = { -1, { 0, 0 } };
+    if (__builtin_expect(g_profile, 0)) {
+        scope.phase = phase;
+        clock_gettime_mono(&scope.start);
+    }
+    return scope;
+}
+
+static inline void profile_scope_end(ProfileScope *scope) {
+    if (scope->phase < 0) return;
+    struct timespec now;
+    clock_gettime_mono(&now);
+    ProfileCounters *counters = profile_counters();
+    if (!counters) return;
+    counters->ns[scope->phase] += (long long)(now.tv_sec - scope->start.tv_sec) * 1000000000LL +
+                                  (now.tv_nsec - scope->start.tv_nsec);
+    counters->calls[scope->phase]++;
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// Time the rest of the enclosing block, however it is left, as phase
+#define PROFILE_SCOPE(phase) \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__) __attribute__((cleanup(profile_scope_end))) = \
+        profile_scope_begin(phase)
+#else
+#define PROFILE_SCOPE(phase) ((void)0)
+#endif
+
+#endif // PROFILE_H
@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "retry.h"
+#include <errno.h>
+
+int g_show_stats = 0;
+
+static int g_retry_budget = RETRY_DEFAULT_BUDGET;
+static RetryStats g_retry_stats;
+static unsigned long long g_jitter_seq = 0;
+// Retries behind the next request this thread sends, for --trace-timing
+static __thread int t_pending_retries = 0;
+
+static void stat_add(long long *counter, long long value) {
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+// Lock-free jitter source: splitmix64 over a shared sequence
+static unsigned long long jitter_random(void) {
+    unsigned long long x = __atomic_add_fetch(&g_jitter_seq, 0x9e3779b97f4a7c15ULL, __ATOMIC_RELAXED);
+    x ^= (unsigned long long)time(NULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void sleep_ms(long long ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+#endif
+}
+
+static int is_network_error(CURLcode res) {
+    switch (res) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Failed before the request went out: nothing can have been created
+static int is_unsent_error(CURLcode res) {
+    switch (res) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SSL_CONNECT_ERROR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Drive reports quota errors as 403 with a reason in the body
+static int is_rate_limit_body(const char *body) {
+    return body && (strstr(body, "ateLimitExceeded") || strstr(body, "backendError"));
+}
+
+RetryAction retry_classify(CURLcode res, long http_code, const char *body) {
+    if (res != CURLE_OK) return is_network_error(res) ? RETRY_BACKOFF : RETRY_FAIL;
+
+    switch (http_code) {
+        case 401:
+            return RETRY_AUTH;
+        case 403:
+            return is_rate_limit_body(body) ? RETRY_BACKOFF : RETRY_AUTH;
+        case 408:
+        case 429:
+        case 500:
+        case 502:
+        case 503:
+        case 504:
+            return RETRY_BACKOFF;
+        default:
+            return RETRY_FAIL;
+    }
+}
+
+int retry_decide(RetryState *state, CURL *curl, CURLcode res, long http_code, const char *body,
+                 long long *delay_ms) {
+    RetryAction action = retry_classify(res, http_code, body);
+    *delay_ms = 0;
+
+    if (action == RETRY_AUTH) {
+        if (state->refreshed) return 0;
+        state->refreshed = 1;
+        int refreshed = token_refresh(state->token_generation);
+        if (refreshed < 0) return 0;
+        if (refreshed > 0) stat_add(&g_retry_stats.token_refreshes, 1);
+        t_pending_retries = state->attempts + state->refreshed;
+        return 1;
+    }
+    if (action != RETRY_BACKOFF) return 0;
+
+    if (state->attempts >= RETRY_MAX_ATTEMPTS ||
+        __atomic_sub_fetch(&g_retry_budget, 1, __ATOMIC_RELAXED) < 0) {
+        stat_add(&g_retry_stats.gave_up, 1);
+        return 0;
+    }
+    state->attempts++;
+
+    // Decorrelated jitter: uniform in [base, 3 * previous delay], capped.
+    // Spreads out clients that failed together instead of having them
+    // retry in lockstep.
+    long long high = state->last_delay_ms * 3;
+    if (high < RETRY_BASE_DELAY_MS) high = RETRY_BASE_DELAY_MS;
+    long long delay = RETRY_BASE_DELAY_MS + (long long)(jitter_random() % (unsigned long long)(high - RETRY_BASE_DELAY_MS + 1));
+    if (delay > RETRY_MAX_DELAY_MS) delay = RETRY_MAX_DELAY_MS;
+    state->last_delay_ms = delay;
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+    // The server knows best how long to wait
+    curl_off_t retry_after = 0;
+    if (curl && curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) == CURLE_OK && retry_after > 0) {
+        long long wait_ms = (long long)retry_after * 1000;
+        if (wait_ms > RETRY_MAX_RETRY_AFTER_MS) wait_ms = RETRY_MAX_RETRY_AFTER_MS;
+        if (wait_ms > delay) delay = wait_ms;
+    }
+#else
+    (void)curl;
+#endif
+
+    if (res != CURLE_OK) {
+        // The address may have come from the on-disk cache and gone stale
+        if (res == CURLE_COULDNT_CONNECT && curl) netcache_forget(curl);
+        stat_add(&g_retry_stats.network_errors, 1);
+    } else if (http_code == 429 || http_code == 403) {
+        // The quota is per user, so every other request would hit it too
+        stat_add(&g_retry_stats.rate_limited, 1);
+        pacer_hold(delay);
+    } else {
+        stat_add(&g_retry_stats.server_errors, 1);
+    }
+    stat_add(&g_retry_stats.backoff_ms, delay);
+
+    *delay_ms = delay;
+    t_pending_retries = state->attempts + state->refreshed;
+    PROBE_RETRY(curl, state->attempts, http_code, res, delay);
+    return 1;
+}
+
+int retry_next(RetryState *state, CURL *curl, CURLcode res, long http_code, const char *body) {
+    long long delay = 0;
+    if (!retry_decide(state, curl, res, http_code, body, &delay)) return 0;
+    if (delay > 0) sleep_ms(delay);
+    return 1;
+}
+
+// Drive only acts on a request once the whole body has arrived
+static int body_cut_short(CURL *curl) {
+    curl_off_t sent = 0;
+    curl_off_t length = -1;
+    if (!curl || curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &sent) != CURLE_OK ||
+        curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_UPLOAD_T, &length) != CURLE_OK) {
+        return 0;
+    }
+    return length > 0 && sent < length;
+}
+
+int retry_next_create(RetryState *state, CURL *curl, CURLcode res, long http_code, const char *body) {
+    int unsafe = res != CURLE_OK ? !is_unsent_error(res) && !body_cut_short(curl)
+                                 : (http_code == 408 || http_code >= 500);
+    if (unsafe) return 0;
+    return retry_next(state, curl, res, http_code, body);
+}
+
+int retry_take_pending(void) {
+    int retries = t_pending_retries;
+    t_pending_retries = 0;
+    return retries;
+}
+
+int retry_capture_error(CURL *curl, RetryErrorBody *err, const void *data, size_t len) {
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code < 400) return 0;
+
+    size_t space = sizeof(err->data) - 1 - err->len;
+    if (len < space) space = len;
+    memcpy(err->data + err->len, data, space);
+    err->len += space;
+    err->data[err->len] = '\0';
+    return 1;
+}
+
+void retry_set_budget(int budget) {
+    __atomic_store_n(&g_retry_budget, budget, __ATOMIC_RELAXED);
+}
+
+void retry_reset(void) {
+    retry_set_budget(RETRY_DEFAULT_BUDGET);
+    memset(&g_retry_stats, 0, sizeof(g_retry_stats));
+}
+
+void retry_get_stats(RetryStats *out) {
+    out->rate_limited = __atomic_load_n(&g_retry_stats.rate_limited, __ATOMIC_RELAXED);
+    out->server_errors = __atomic_load_n(&g_retry_stats.server_errors, __ATOMIC_RELAXED);
+    out->network_errors = __atomic_load_n(&g_retry_stats.network_errors, __ATOMIC_RELAXED);
+    out->token_refreshes = __atomic_load_n(&g_retry_stats.token_refreshes, __ATOMIC_RELAXED);
+    out->backoff_ms = __atomic_load_n(&g_retry_stats.backoff_ms, __ATOMIC_RELAXED);
+    out->gave_up = __atomic_load_n(&g_retry_stats.gave_up, __ATOMIC_RELAXED);
+}
+
+// Registered with atexit() by --stats; always goes to stderr so it never
+// mixes with command output
+void retry_print_stats(void) {
+    RetryStats s;
+    retry_get_stats(&s);
+    long long retries = s.rate_limited + s.server_errors + s.network_errors;
+
+    if (g_json_mode) {
+        fprintf(stderr, "{\"stats\":{\"retries\":%lld,\"rate_limited\":%lld,\"server_errors\":%lld,"
+                "\"network_errors\":%lld,\"token_refreshes\":%lld,\"backoff_ms\":%lld,\"queued_ms\":%lld,"
+                "\"gave_up\":%lld",
+                retries, s.rate_limited, s.server_errors, s.network_errors, s.token_refreshes,
+                s.backoff_ms, pacer_wait_ms(), s.gave_up);
+        limiter_print_stats();
+        transport_print_stats();
+        fprintf(stderr, "}}\n");
+        return;
+    }
+
+    fprintf(stderr, "\n%sStats%s\n", COLOR_BOLD, COLOR_RESET);
+    fprintf(stderr, "  Retries:          %lld (rate limited %lld, server errors %lld, network %lld)\n",
+            retries, s.rate_limited, s.server_errors, s.network_errors);
+    fprintf(stderr, "  Token refreshes:  %lld\n", s.token_refreshes);
+    fprintf(stderr, "  Time backing off: %.1fs\n", s.backoff_ms / 1000.0);
+    fprintf(stderr, "  Time queued:      %.1fs\n", pacer_wait_ms() / 1000.0);
+    limiter_print_stats();
+    transport_print_stats();
+    if (s.gave_up > 0) fprintf(stderr, "  Gave up:          %lld request(s) after exhausting retries\n", s.gave_up);
+}
@@ -0,0 +1,79 @@
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <curl/curl.h>
+
+#define RETRY_BASE_DELAY_MS 500
+#define RETRY_MAX_DELAY_MS 32000
+#define RETRY_MAX_RETRY_AFTER_MS 300000  // Longest Retry-After we will wait out
+#define RETRY_MAX_ATTEMPTS 6             // Backoff retries for one request
+#define RETRY_DEFAULT_BUDGET 100         // Backoff retries for one command
+#define RETRY_ERROR_BODY_SIZE 1024
+
+typedef enum {
+    RETRY_FAIL,      // Permanent; report it
+    RETRY_AUTH,      // Refresh the access token and try once more
+    RETRY_BACKOFF    // Transient (rate limit, 5xx, dropped connection); wait and retry
+} RetryAction;
+
+// Per-request retry state; zero-initialize before the first attempt
+typedef struct {
+    int attempts;              // Backoff retries so far
+    int refreshed;             // Token already refreshed for this request
+    unsigned token_generation; // From token_auth_header() for the current attempt
+    long long last_delay_ms;
+} RetryState;
+
+// Start of an error response, kept apart from the caller's sink so error
+// JSON never ends up in a download or a streamed listing
+typedef struct {
+    char data[RETRY_ERROR_BODY_SIZE];
+    size_t len;
+} RetryErrorBody;
+
+// Command-wide counters reported by --stats
+typedef struct {
+    long long rate_limited;
+    long long server_errors;
+    long long network_errors;
+    long long token_refreshes;
+    long long backoff_ms;
+    long long gave_up;
+} RetryStats;
+
+extern int g_show_stats;
+
+RetryAction retry_classify(CURLcode res, long http_code, const char *body);
+
+// Call after a failed attempt, before cleaning up curl (it is read for
+// Retry-After). Refreshes the token or sleeps with decorrelated jitter as
+// the error calls for, and returns 1 if the request should be sent again.
+int retry_next(RetryState *state, CURL *curl, CURLcode res, long http_code, const char *body);
+
+// retry_next() for requests that create something (a POST without a file
+// ID). Once the request may have reached Drive, a resend could create a
+// duplicate, so only failures from before the whole body was sent and
+// replies that say nothing was done (auth, rate limits) are retried.
+int retry_next_create(RetryState *state, CURL *curl, CURLcode res, long http_code, const char *body);
+
+// retry_next() for event-loop callers: instead of sleeping, reports the
+// wait in delay_ms for the caller to schedule
+int retry_decide(RetryState *state, CURL *curl, CURLcode res, long http_code, const char *body,
+                 long long *delay_ms);
+
+// How many times the request about to be sent on this thread was sent
+// before: set when retry_decide() says to retry, cleared by taking it
+int retry_take_pending(void);
+
+// For write callbacks: when the transfer on curl is an HTTP error, keep the
+// start of the body in err and return 1 so the caller does not treat it as
+// content.
+int retry_capture_error(CURL *curl, RetryErrorBody *err, const void *data, size_t len);
+
+void retry_set_budget(int budget);
+// Back to a fresh command's budget and counters
+void retry_reset(void);
+void retry_get_stats(RetryStats *out);
+void retry_print_stats(void);
+
+#endif // RETRY_H
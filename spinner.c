@@ -12,9 +12,12 @@ void *spinner_thread(void *arg) {
     int i = 0;
     
     while (spinner->active) {
-        printf("\r" COLOR_YELLOW "%s" COLOR_RESET " %s", spinner_chars[i], spinner->message);
-        fflush(stdout);
-        
+        {
+            PROFILE_SCOPE(PROF_PROGRESS);
+            printf("\r" COLOR_YELLOW "%s" COLOR_RESET " %s", spinner_chars[i], spinner->message);
+            fflush(stdout);
+        }
+
         i = (i + 1) % spinner_count;
         cdrive_usleep(100000); // 100ms delay for smooth animation
     }
@@ -0,0 +1,1091 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "sync.h"
+#include "walk.h"
+#include "md5.h"
+#include "hashcache.h"
+
+#ifdef _WIN32
+
+int cdrive_sync(const char *local_dir, const char *remote_id, const SyncOptions *opts) {
+    (void)local_dir;
+    (void)remote_id;
+    (void)opts;
+    print_error("sync is not supported on Windows yet.");
+    return -1;
+}
+
+#else
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+#define SYNC_MANIFEST_MAGIC "cdrive-sync 1"
+#define SYNC_PROGRESS_INTERVAL_MS 500.0
+#define SYNC_CHANGES_FIELDS "nextPageToken,newStartPageToken," \
+    "changes(fileId,removed,file(name,mimeType,md5Checksum,headRevisionId,parents,trashed))"
+
+// One manifest row. Strings live in g_arena (or in the loaded manifest
+// buffer, which is itself arena memory), so entries are never freed singly.
+typedef struct {
+    char *path;               // Relative to the sync root, '/' separated
+    char *remote_id;          // NULL until uploaded or matched remotely
+    char *revision;           // headRevisionId, NULL when unknown
+    long long size;           // -1 forces a rehash on the next scan
+    long long mtime_ns;
+    unsigned long long inode;
+    char md5[MD5_HEX_SIZE];   // "" when unknown
+    char is_dir;
+    char local;               // Has existed locally; 0 for remote-only rows from the first-run index
+    char seen;                // Present in this run's local scan
+    char removed;             // Dropped; not written back
+} ManifestEntry;
+
+typedef struct {
+    ManifestEntry *entries;
+    int count;
+    int capacity;
+
+    // Path -> entry index, open addressing
+    int *slots;
+    size_t slot_capacity;
+
+    char changes_token[256];
+    int dirty;
+} Manifest;
+
+// A file found changed (or new) by the scan, processed after the walk
+typedef struct {
+    int entry;
+    const char *parent_id;
+    HashKey key;          // stat snapshot from the scan
+} SyncPending;
+
+typedef struct {
+    const SyncOptions *opts;
+    const char *remote_root;
+    char root[PATH_MAX];
+    Manifest manifest;
+
+    SyncPending *pending;
+    int pending_count;
+    int pending_capacity;
+
+    // Remote ID -> entry index, only built for two-way runs
+    int *id_slots;
+    size_t id_slot_capacity;
+    size_t id_slot_used;
+
+    long long scanned;
+    long long unchanged;
+    long long uploaded;
+    long long updated;
+    long long folders_created;
+    long long downloaded;
+    long long deleted;
+    long long failed;
+    struct timespec last_progress;
+} SyncState;
+
+static unsigned long sync_hash(const char *s) {
+    unsigned long hash = 5381;
+    while (*s) hash = ((hash << 5) + hash) + (unsigned char)*s++;
+    return hash;
+}
+
+// --- Manifest ---
+
+static int manifest_find(const Manifest *m, const char *path) {
+    if (m->slot_capacity == 0) return -1;
+    size_t i = sync_hash(path) & (m->slot_capacity - 1);
+    while (m->slots[i] >= 0) {
+        if (strcmp(m->entries[m->slots[i]].path, path) == 0) return m->slots[i];
+        i = (i + 1) & (m->slot_capacity - 1);
+    }
+    return -1;
+}
+
+static int manifest_rehash(Manifest *m, size_t capacity) {
+    int *slots = malloc(sizeof(int) * capacity);
+    if (!slots) return -1;
+    for (size_t i = 0; i < capacity; i++) slots[i] = -1;
+    for (int n = 0; n < m->count; n++) {
+        size_t i = sync_hash(m->entries[n].path) & (capacity - 1);
+        while (slots[i] >= 0) i = (i + 1) & (capacity - 1);
+        slots[i] = n;
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->slot_capacity = capacity;
+    return 0;
+}
+
+// Append an entry for path (taken as-is, not copied). Returns its index.
+static int manifest_add(Manifest *m, char *path, int is_dir) {
+    if (m->count == m->capacity) {
+        int capacity = m->capacity ? m->capacity * 2 : 1024;
+        ManifestEntry *entries = realloc(m->entries, sizeof(ManifestEntry) * (size_t)capacity);
+        if (!entries) return -1;
+        m->entries = entries;
+        m->capacity = capacity;
+    }
+    if ((size_t)(m->count + 1) * 2 > m->slot_capacity) {
+        if (manifest_rehash(m, m->slot_capacity ? m->slot_capacity * 2 : 2048) != 0) return -1;
+    }
+
+    ManifestEntry *e = &m->entries[m->count];
+    memset(e, 0, sizeof(*e));
+    e->path = path;
+    e->size = -1;
+    e->is_dir = (char)is_dir;
+
+    size_t i = sync_hash(path) & (m->slot_capacity - 1);
+    while (m->slots[i] >= 0) i = (i + 1) & (m->slot_capacity - 1);
+    m->slots[i] = m->count;
+    m->dirty = 1;
+    return m->count++;
+}
+
+static void manifest_free(Manifest *m) {
+    free(m->entries);
+    free(m->slots);
+    memset(m, 0, sizeof(*m));
+}
+
+// Tabs, newlines and backslashes in paths are escaped so rows stay one line
+static void write_escaped(FILE *fp, const char *s) {
+    for (; *s; s++) {
+        if (*s == '\t') fputs("\\t", fp);
+        else if (*s == '\n') fputs("\\n", fp);
+        else if (*s == '\\') fputs("\\\\", fp);
+        else fputc(*s, fp);
+    }
+}
+
+static void unescape_in_place(char *s) {
+    char *out = s;
+    for (; *s; s++) {
+        if (*s == '\\' && s[1]) {
+            s++;
+            *out++ = *s == 't' ? '\t' : (*s == 'n' ? '\n' : *s);
+        } else {
+            *out++ = *s;
+        }
+    }
+    *out = '\0';
+}
+
+static char *next_field(char **cursor) {
+    char *start = *cursor;
+    if (!start) return NULL;
+    char *tab = strchr(start, '\t');
+    if (tab) {
+        *tab = '\0';
+        *cursor = tab + 1;
+    } else {
+        *cursor = NULL;
+    }
+    return start;
+}
+
+// Returns 0 when loaded, 1 when there is no usable manifest yet, -1 on error.
+// The file is read in one go into arena memory and rows are split in place,
+// so loading costs no per-entry allocations.
+static int manifest_load(Manifest *m, const char *file, const char *remote_root) {
+    FILE *fp = fopen(file, "rb");
+    if (!fp) return errno == ENOENT ? 1 : -1;
+
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (file_size <= 0) {
+        fclose(fp);
+        return 1;
+    }
+
+    char *buf = arena_alloc(&g_arena, (size_t)file_size + 1);
+    if (!buf || fread(buf, 1, (size_t)file_size, fp) != (size_t)file_size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    buf[file_size] = '\0';
+
+    char *line = buf;
+    char *eol = strchr(line, '\n');
+    if (!eol) return 1;
+    *eol = '\0';
+
+    // Header: magic, remote root, changes page token
+    char *cursor = line;
+    char *magic = next_field(&cursor);
+    char *root = next_field(&cursor);
+    char *token = next_field(&cursor);
+    if (!magic || strcmp(magic, SYNC_MANIFEST_MAGIC) != 0 || !root || strcmp(root, remote_root) != 0) {
+        return 1;
+    }
+    snprintf(m->changes_token, sizeof(m->changes_token), "%s", token ? token : "");
+
+    for (line = eol + 1; *line; line = eol + 1) {
+        eol = strchr(line, '\n');
+        if (eol) *eol = '\0';
+
+        cursor = line;
+        char *type = next_field(&cursor);
+        char *size = next_field(&cursor);
+        char *mtime = next_field(&cursor);
+        char *inode = next_field(&cursor);
+        char *md5 = next_field(&cursor);
+        char *remote_id = next_field(&cursor);
+        char *revision = next_field(&cursor);
+        char *path = cursor;
+        if (!type || !revision || !path || !*path) {
+            if (!eol) break;
+            continue;
+        }
+
+        unescape_in_place(path);
+        int idx = manifest_add(m, path, type[0] == 'd' || type[0] == 'D');
+        if (idx < 0) return -1;
+        ManifestEntry *e = &m->entries[idx];
+        e->local = type[0] == 'd' || type[0] == 'f';
+        e->size = strtoll(size, NULL, 10);
+        e->mtime_ns = strtoll(mtime, NULL, 10);
+        e->inode = strtoull(inode, NULL, 10);
+        if (strcmp(md5, "-") != 0) snprintf(e->md5, sizeof(e->md5), "%s", md5);
+        if (strcmp(remote_id, "-") != 0) e->remote_id = remote_id;
+        if (strcmp(revision, "-") != 0) e->revision = revision;
+
+        if (!eol) break;
+    }
+
+    m->dirty = 0;
+    return 0;
+}
+
+// Written to a temporary file and renamed over the old one, so an
+// interrupted save never leaves a truncated manifest behind.
+static int manifest_save(const Manifest *m, const char *file, const char *remote_root) {
+    char tmp_file[PATH_MAX];
+    int n = snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", file);
+    if (n < 0 || (size_t)n >= sizeof(tmp_file)) return -1;
+
+    FILE *fp = fopen(tmp_file, "wb");
+    if (!fp) return -1;
+    static char io_buffer[1 << 16];
+    setvbuf(fp, io_buffer, _IOFBF, sizeof(io_buffer));
+
+    fprintf(fp, "%s\t%s\t%s\n", SYNC_MANIFEST_MAGIC, remote_root, m->changes_token);
+    for (int i = 0; i < m->count; i++) {
+        const ManifestEntry *e = &m->entries[i];
+        if (e->removed) continue;
+        // Upper case marks rows that only exist remotely
+        char type = e->is_dir ? 'd' : 'f';
+        if (!e->local) type = (char)(type - 'a' + 'A');
+        fprintf(fp, "%c\t%lld\t%lld\t%llu\t%s\t%s\t%s\t", type, e->size, e->mtime_ns,
+                e->inode, e->md5[0] ? e->md5 : "-", e->remote_id ? e->remote_id : "-",
+                e->revision ? e->revision : "-");
+        write_escaped(fp, e->path);
+        fputc('\n', fp);
+    }
+
+    if (fclose(fp) != 0) {
+        remove(tmp_file);
+        return -1;
+    }
+    return rename(tmp_file, file);
+}
+
+// ~/.cdrive/sync/<hash of local root and remote folder>.tsv
+static int manifest_path(char *out, size_t out_size, const char *root, const char *remote_id) {
+    const char *home_dir = getenv(HOME_ENV);
+    if (!home_dir) return -1;
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/%s/%s", home_dir, CONFIG_DIR, SYNC_MANIFEST_DIR);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+
+    // FNV-1a over "root\nremote"
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char *p = root; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    hash = (hash ^ '\n') * 1099511628211ULL;
+    for (const char *p = remote_id; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+
+    int n = snprintf(out, out_size, "%s/%016llx.tsv", dir, hash);
+    return (n < 0 || (size_t)n >= out_size) ? -1 : 0;
+}
+
+// --- Remote helpers ---
+
+static int remote_id_find(const SyncState *st, const char *id) {
+    if (st->id_slot_capacity == 0) return -1;
+    size_t i = sync_hash(id) & (st->id_slot_capacity - 1);
+    while (st->id_slots[i] >= 0) {
+        const ManifestEntry *e = &st->manifest.entries[st->id_slots[i]];
+        // Rows whose remote copy went away keep their slot with a NULL ID
+        if (!e->removed && e->remote_id && strcmp(e->remote_id, id) == 0) return st->id_slots[i];
+        i = (i + 1) & (st->id_slot_capacity - 1);
+    }
+    return -1;
+}
+
+static int remote_id_index(SyncState *st) {
+    size_t capacity = 2048;
+    while (capacity < (size_t)st->manifest.count * 2 + 2) capacity *= 2;
+    int *slots = malloc(sizeof(int) * capacity);
+    if (!slots) return -1;
+    for (size_t i = 0; i < capacity; i++) slots[i] = -1;
+    size_t used = 0;
+    for (int n = 0; n < st->manifest.count; n++) {
+        if (!st->manifest.entries[n].remote_id) continue;
+        size_t i = sync_hash(st->manifest.entries[n].remote_id) & (capacity - 1);
+        while (slots[i] >= 0) i = (i + 1) & (capacity - 1);
+        slots[i] = n;
+        used++;
+    }
+    free(st->id_slots);
+    st->id_slots = slots;
+    st->id_slot_capacity = capacity;
+    st->id_slot_used = used;
+    return 0;
+}
+
+// Add one entry to the ID index, rebuilding it only once it is half full
+static int remote_id_insert(SyncState *st, int idx) {
+    if ((st->id_slot_used + 1) * 2 > st->id_slot_capacity) return remote_id_index(st);
+    size_t i = sync_hash(st->manifest.entries[idx].remote_id) & (st->id_slot_capacity - 1);
+    while (st->id_slots[i] >= 0) i = (i + 1) & (st->id_slot_capacity - 1);
+    st->id_slots[i] = idx;
+    st->id_slot_used++;
+    return 0;
+}
+
+static int trash_remote(const char *file_id) {
+    char url[MAX_URL_SIZE];
+    snprintf(url, sizeof(url), "%s/%s?fields=id", DRIVE_API_URL, file_id);
+
+    // Trashing is idempotent, so any transient failure can be retried
+    RetryState retry = {0};
+    for (;;) {
+        CURL *curl = cdrive_easy_init();
+        if (!curl) return -1;
+
+        char auth_header[MAX_HEADER_SIZE];
+        retry.token_generation = token_auth_header(auth_header, sizeof(auth_header));
+        struct curl_slist *headers = NULL;
+        headers = curl_slist_append(headers, auth_header);
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+
+        APIResponse response = {0};
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "{\"trashed\":true}");
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+        pacer_admit(PACE_METADATA);
+        CURLcode res = cdrive_easy_perform(curl);
+        long http_code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+        // Already gone is as good as trashed
+        int done = res == CURLE_OK && (http_code == 200 || http_code == 404);
+        int again = !done && retry_next(&retry, curl, res, http_code, response.data);
+        curl_slist_free_all(headers);
+        curl_easy_cleanup(curl);
+        api_response_free(&response);
+
+        if (done) return 0;
+        if (!again) return -1;
+    }
+}
+
+static int seed_from_remote(const WalkEntry *entry, void *userdata) {
+    SyncState *st = (SyncState *)userdata;
+    // Native Google files have no content to compare against
+    if (!entry->is_folder && !entry->md5_checksum[0]) return 0;
+    if (manifest_find(&st->manifest, entry->path) >= 0) return 0;
+
+    char *path = arena_strdup(&g_arena, entry->path);
+    char *remote_id = arena_strdup(&g_arena, entry->id);
+    if (!path || !remote_id) return 1;
+    int idx = manifest_add(&st->manifest, path, entry->is_folder);
+    if (idx < 0) return 1;
+    st->manifest.entries[idx].remote_id = remote_id;
+    snprintf(st->manifest.entries[idx].md5, MD5_HEX_SIZE, "%s", entry->md5_checksum);
+    return 0;
+}
+
+// --- Local scan ---
+
+// Absolute path of rel under the sync root; -1 if it does not fit
+static int local_path(const SyncState *st, const char *rel, char out[PATH_MAX]) {
+    int n = rel[0] ? snprintf(out, PATH_MAX, "%s/%s", st->root, rel)
+                   : snprintf(out, PATH_MAX, "%s", st->root);
+    return (n < 0 || n >= PATH_MAX) ? -1 : 0;
+}
+
+static void sync_progress(SyncState *st, int force) {
+    if (g_json_mode) return;
+
+    struct timespec now;
+    clock_gettime_mono(&now);
+    double elapsed_ms = (now.tv_sec - st->last_progress.tv_sec) * 1000.0 +
+                        (now.tv_nsec - st->last_progress.tv_nsec) / 1000000.0;
+    if (!force && elapsed_ms < SYNC_PROGRESS_INTERVAL_MS) return;
+    st->last_progress = now;
+    PROFILE_SCOPE(PROF_PROGRESS);
+
+    fprintf(stderr, "\r\033[K%s[*]%s Scanned %lld item(s), %d changed",
+            COLOR_BLUE, COLOR_RESET, st->scanned, st->pending_count);
+    fflush(stderr);
+}
+
+static int local_matches(const ManifestEntry *e, const struct stat *sb) {
+    return e->size == (long long)sb->st_size &&
+           e->mtime_ns == CDRIVE_STAT_MTIME_NS(*sb) &&
+           e->inode == (unsigned long long)sb->st_ino;
+}
+
+static int add_pending(SyncState *st, int entry, const char *parent_id, const struct stat *sb) {
+    if (st->pending_count == st->pending_capacity) {
+        int capacity = st->pending_capacity ? st->pending_capacity * 2 : 256;
+        SyncPending *pending = realloc(st->pending, sizeof(SyncPending) * (size_t)capacity);
+        if (!pending) return -1;
+        st->pending = pending;
+        st->pending_capacity = capacity;
+    }
+    SyncPending *p = &st->pending[st->pending_count++];
+    p->entry = entry;
+    p->parent_id = parent_id;
+    hash_key_from_stat(&p->key, sb);
+    return 0;
+}
+
+// Depth-first walk of the local tree. Folders are created remotely as they
+// are reached so their children have a parent ID; files that do not match
+// their manifest row are queued for hashing. Returns -1 if any part of the
+// tree could not be read, in which case unseen rows prove nothing.
+static int scan_dir(SyncState *st, const char *rel, const char *parent_id) {
+    char dir_path[PATH_MAX];
+    DIR *dir = local_path(st, rel, dir_path) == 0 ? opendir(dir_path) : NULL;
+    if (!dir) {
+        fprintf(stderr, "\ncannot open %s: %s\n", dir_path, strerror(errno));
+        st->failed++;
+        return -1;
+    }
+
+    int result = 0;
+    for (;;) {
+        errno = 0;
+        struct dirent *de = readdir(dir);
+        if (!de) {
+            if (errno != 0) {
+                fprintf(stderr, "\ncannot read %s: %s\n", dir_path, strerror(errno));
+                st->failed++;
+                result = -1;
+            }
+            break;
+        }
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        struct stat sb;
+        if (fstatat(dirfd(dir), de->d_name, &sb, AT_SYMLINK_NOFOLLOW) != 0) {
+            if (errno == ENOENT) continue; // Removed since readdir
+            st->failed++;
+            result = -1;
+            continue;
+        }
+        if (!S_ISDIR(sb.st_mode) && !S_ISREG(sb.st_mode)) continue; // Symlinks, sockets, ...
+
+        char child[PATH_MAX];
+        int n = rel[0] ? snprintf(child, sizeof(child), "%s/%s", rel, de->d_name)
+                       : snprintf(child, sizeof(child), "%s", de->d_name);
+        if (n < 0 || (size_t)n >= sizeof(child)) {
+            st->failed++;
+            result = -1;
+            continue;
+        }
+
+        st->scanned++;
+        int idx = manifest_find(&st->manifest, child);
+        if (idx < 0) {
+            char *path = arena_strdup(&g_arena, child);
+            if (!path || (idx = manifest_add(&st->manifest, path, S_ISDIR(sb.st_mode))) < 0) {
+                closedir(dir);
+                return -1;
+            }
+        }
+        ManifestEntry *e = &st->manifest.entries[idx];
+        e->seen = 1;
+        if (!e->local) {
+            e->local = 1;
+            st->manifest.dirty = 1;
+        }
+
+        if (S_ISDIR(sb.st_mode)) {
+            if (!e->remote_id && parent_id && !st->opts->dry_run) {
+                char folder_id[128];
+                if (cdrive_create_folder_id(de->d_name, parent_id, folder_id, sizeof(folder_id)) != 0) {
+                    st->failed++;
+                    result = -1;
+                    continue;
+                }
+                e = &st->manifest.entries[idx];
+                e->remote_id = arena_strdup(&g_arena, folder_id);
+                e->is_dir = 1;
+                st->manifest.dirty = 1;
+                st->folders_created++;
+            } else if (!e->remote_id && st->opts->dry_run) {
+                printf("would create folder: %s\n", child);
+            }
+            if (scan_dir(st, child, st->manifest.entries[idx].remote_id) != 0) result = -1;
+        } else if (e->remote_id && local_matches(e, &sb)) {
+            st->unchanged++;
+        } else if (add_pending(st, idx, parent_id, &sb) != 0) {
+            closedir(dir);
+            return -1;
+        }
+
+        sync_progress(st, 0);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+static void record_stat(ManifestEntry *e, const HashKey *key) {
+    e->size = key->size;
+    e->mtime_ns = key->mtime_ns;
+    e->inode = key->ino;
+}
+
+// One upload decided by process_pending(), run by the transfer pool
+typedef struct {
+    int pending;             // Index into st->pending
+    const char *full_path;
+    const char *md5;         // Local checksum
+    long long bytes;
+    int updated;             // Replaced an existing remote file
+    int rc;
+    UploadResult result;
+} SyncUpload;
+
+typedef struct {
+    SyncState *st;
+    SyncUpload *uploads;
+    int count;
+    int next;                // Next upload to claim
+    int show_progress;       // Single upload: draw its progress bar
+    pthread_mutex_t print_lock;
+} SyncUploadPool;
+
+static void run_upload(SyncUploadPool *pool, SyncUpload *u) {
+    SyncState *st = pool->st;
+    const SyncPending *p = &st->pending[u->pending];
+    const ManifestEntry *e = &st->manifest.entries[p->entry];
+
+    UploadRequest req = {0};
+    req.source_path = u->full_path;
+    req.parent_id = p->parent_id;
+    req.file_id = e->remote_id;
+    req.show_progress = pool->show_progress;
+
+    if (pool->show_progress) {
+        print_colored(e->remote_id ? "[~] " : "[+] ", e->remote_id ? COLOR_YELLOW : COLOR_GREEN);
+        printf("%s\n", e->path);
+    }
+
+    limiter_acquire();
+    struct timespec start, end;
+    clock_gettime_mono(&start);
+    u->rc = cdrive_upload_media(&req, &u->result);
+    if (u->rc != 0 && e->remote_id && u->result.http_code == 404) {
+        // Remote copy was deleted behind our back; upload a fresh one
+        req.file_id = NULL;
+        u->rc = cdrive_upload_media(&req, &u->result);
+    }
+    clock_gettime_mono(&end);
+    limiter_release(u->rc == 0 ? u->bytes : 0,
+                    (end.tv_sec - start.tv_sec) * 1000LL + (end.tv_nsec - start.tv_nsec) / 1000000);
+    u->updated = req.file_id != NULL;
+
+    if (!pool->show_progress && !g_json_mode && u->rc == 0) {
+        pthread_mutex_lock(&pool->print_lock);
+        print_colored(u->updated ? "[~] " : "[+] ", u->updated ? COLOR_YELLOW : COLOR_GREEN);
+        printf("%s\n", e->path);
+        fflush(stdout);
+        pthread_mutex_unlock(&pool->print_lock);
+    }
+}
+
+static void *upload_worker(void *arg) {
+    SyncUploadPool *pool = (SyncUploadPool *)arg;
+    for (;;) {
+        int i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (i >= pool->count) break;
+        run_upload(pool, &pool->uploads[i]);
+    }
+    return NULL;
+}
+
+// Run the uploads on one thread per slot the limiter may hand out; the
+// limiter decides how many are actually in flight
+static void run_uploads(SyncState *st, SyncUpload *uploads, int count) {
+    SyncUploadPool pool = { st, uploads, count, 0, count == 1 && !g_json_mode, PTHREAD_MUTEX_INITIALIZER };
+    limiter_init(g_jobs);
+
+    int threads = limiter_max();
+    if (threads > count) threads = count;
+    pthread_t *workers = threads > 1 ? calloc((size_t)threads, sizeof(pthread_t)) : NULL;
+    int started = 0;
+    while (workers && started < threads && pthread_create(&workers[started], NULL, upload_worker, &pool) == 0) {
+        started++;
+    }
+    upload_worker(&pool);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&pool.print_lock);
+}
+
+static void process_pending(SyncState *st) {
+    if (st->pending_count == 0) return;
+
+    // Checksum everything up front: warm files come straight from the hash
+    // cache, the rest are read in parallel.
+    HashJob *jobs = arena_calloc(&g_arena, (size_t)st->pending_count, sizeof(HashJob));
+    SyncUpload *uploads = arena_calloc(&g_arena, (size_t)st->pending_count, sizeof(SyncUpload));
+    if (!jobs || !uploads) {
+        st->failed += st->pending_count;
+        return;
+    }
+    for (int i = 0; i < st->pending_count; i++) {
+        jobs[i].path = arena_sprintf(&g_arena, "%s/%s", st->root, st->manifest.entries[st->pending[i].entry].path);
+        jobs[i].key = st->pending[i].key;
+        if (!jobs[i].path) jobs[i].status = -1;
+    }
+    HashCache cache;
+    hash_cache_open(&cache);
+    hash_cache_fill(&cache, jobs, st->pending_count, g_jobs > 0 ? g_jobs : WALK_DEFAULT_CONCURRENCY);
+    hash_cache_save(&cache);
+    hash_cache_close(&cache);
+
+    int upload_count = 0;
+    for (int i = 0; i < st->pending_count; i++) {
+        const SyncPending *p = &st->pending[i];
+        ManifestEntry *e = &st->manifest.entries[p->entry];
+
+        if (jobs[i].status < 0) {
+            fprintf(stderr, "cannot read %s\n", jobs[i].path ? jobs[i].path : e->path);
+            st->failed++;
+            continue;
+        }
+
+        // Touched but identical content: only the manifest row changes
+        if (e->remote_id && strcmp(jobs[i].md5, e->md5) == 0) {
+            record_stat(e, &p->key);
+            st->manifest.dirty = 1;
+            st->unchanged++;
+            continue;
+        }
+
+        if (st->opts->dry_run) {
+            printf("would %s: %s\n", e->remote_id ? "update" : "upload", e->path);
+            continue;
+        }
+        if (!p->parent_id) {
+            st->failed++;
+            continue;
+        }
+
+        SyncUpload *u = &uploads[upload_count++];
+        u->pending = i;
+        u->full_path = jobs[i].path;
+        u->md5 = jobs[i].md5;
+        u->bytes = p->key.size;
+    }
+
+    // The manifest is only read while uploads run; results are applied below
+    if (upload_count > 0) run_uploads(st, uploads, upload_count);
+
+    for (int i = 0; i < upload_count; i++) {
+        const SyncUpload *u = &uploads[i];
+        const SyncPending *p = &st->pending[u->pending];
+        ManifestEntry *e = &st->manifest.entries[p->entry];
+
+        if (u->rc != 0) {
+            // Leave the old checksum so the next run retries this file
+            e->size = -1;
+            st->manifest.dirty = 1;
+            st->failed++;
+            continue;
+        }
+
+        if (u->updated) st->updated++;
+        else st->uploaded++;
+        e->remote_id = arena_strdup(&g_arena, u->result.id);
+        e->revision = u->result.head_revision[0] ? arena_strdup(&g_arena, u->result.head_revision) : NULL;
+        if (u->result.md5[0] && strcmp(u->result.md5, u->md5) != 0) {
+            print_warning("Drive reports a different checksum; the file changed during upload");
+            fprintf(stderr, "  %s\n", e->path);
+            e->size = -1; // Hash and compare again next run
+        } else {
+            record_stat(e, &p->key);
+        }
+        snprintf(e->md5, sizeof(e->md5), "%s", u->result.md5[0] ? u->result.md5 : u->md5);
+        st->manifest.dirty = 1;
+    }
+}
+
+// Trashes the remote copy of every row the scan did not see. Rows that
+// never existed locally (remote-only items indexed on the first run) are
+// left alone: their absence says nothing about a local deletion.
+static void process_local_deletions(SyncState *st) {
+    for (int i = 0; i < st->manifest.count; i++) {
+        ManifestEntry *e = &st->manifest.entries[i];
+        if (e->seen || e->removed || !e->local) continue;
+
+        if (st->opts->dry_run) {
+            if (e->remote_id) printf("would trash: %s\n", e->path);
+            continue;
+        }
+        if (e->remote_id) {
+            if (trash_remote(e->remote_id) != 0) {
+                fprintf(stderr, "could not trash remote copy of %s\n", e->path);
+                st->failed++;
+                continue;
+            }
+        }
+        e->removed = 1;
+        st->manifest.dirty = 1;
+        st->deleted++;
+    }
+}
+
+// --- Two-way: remote deltas from the changes feed ---
+
+static int fetch_start_page_token(char *token, size_t token_size) {
+    APIResponse response = {0};
+    response.arena = &g_arena;
+    char url[MAX_URL_SIZE];
+    snprintf(url, sizeof(url), "%s/startPageToken", api_url(API_CHANGES));
+    if (cdrive_api_get(url, &response) != 0) return -1;
+
+    int result = -1;
+    json_object *root = cdrive_json_parse(response.data);
+    if (root) {
+        json_object *value;
+        if (json_object_object_get_ex(root, "startPageToken", &value)) {
+            snprintf(token, token_size, "%s", json_object_get_string(value));
+            result = 0;
+        }
+        json_object_put(root);
+    }
+    return result;
+}
+
+// Path of a new remote item under a known parent folder, or NULL
+static char *remote_child_path(SyncState *st, json_object *file, const char *name) {
+    json_object *parents;
+    if (!json_object_object_get_ex(file, "parents", &parents) ||
+        json_object_array_length(parents) == 0) {
+        return NULL;
+    }
+    const char *parent_id = json_object_get_string(json_object_array_get_idx(parents, 0));
+
+    const char *parent_path = NULL;
+    if (strcmp(parent_id, st->remote_root) == 0) {
+        parent_path = "";
+    } else {
+        int parent = remote_id_find(st, parent_id);
+        if (parent < 0 || !st->manifest.entries[parent].is_dir) return NULL;
+        parent_path = st->manifest.entries[parent].path;
+    }
+
+    // Drive names may contain '/', which cannot appear in a local file name
+    char *safe_name = arena_strdup(&g_arena, name);
+    if (!safe_name) return NULL;
+    for (char *c = safe_name; *c; c++) {
+        if (*c == '/') *c = '_';
+    }
+    if (parent_path[0]) return arena_sprintf(&g_arena, "%s/%s", parent_path, safe_name);
+    return safe_name;
+}
+
+static int track_remote_item(SyncState *st, char *path, const char *id, int is_dir) {
+    int idx = manifest_add(&st->manifest, path, is_dir);
+    if (idx < 0) return -1;
+    st->manifest.entries[idx].remote_id = arena_strdup(&g_arena, id);
+    if (remote_id_insert(st, idx) != 0) return -1;
+    return idx;
+}
+
+static void apply_remote_change(SyncState *st, json_object *change) {
+    json_object *value, *file = NULL;
+    if (!json_object_object_get_ex(change, "fileId", &value)) return;
+    const char *file_id = json_object_get_string(value);
+
+    int removed = json_object_object_get_ex(change, "removed", &value) && json_object_get_boolean(value);
+    json_object_object_get_ex(change, "file", &file);
+    if (file && json_object_object_get_ex(file, "trashed", &value) && json_object_get_boolean(value)) {
+        removed = 1;
+    }
+
+    int idx = remote_id_find(st, file_id);
+    char full_path[PATH_MAX];
+
+    if (removed) {
+        if (idx < 0) return;
+        ManifestEntry *e = &st->manifest.entries[idx];
+        if (local_path(st, e->path, full_path) != 0) return;
+
+        struct stat sb;
+        if (!e->is_dir && stat(full_path, &sb) == 0 && !local_matches(e, &sb)) {
+            print_warning("Remote copy was deleted but the local file changed; keeping it");
+            fprintf(stderr, "  %s\n", e->path);
+            e->remote_id = NULL;
+            e->size = -1;
+            st->manifest.dirty = 1;
+            return;
+        }
+        if (st->opts->dry_run) {
+            printf("would delete locally: %s\n", e->path);
+            return;
+        }
+        if (e->is_dir) rmdir(full_path); // Only succeeds once emptied
+        else unlink(full_path);
+        e->removed = 1;
+        st->manifest.dirty = 1;
+        st->deleted++;
+        return;
+    }
+
+    if (!file) return;
+    const char *name = json_object_object_get_ex(file, "name", &value) ? json_object_get_string(value) : NULL;
+    const char *mime = json_object_object_get_ex(file, "mimeType", &value) ? json_object_get_string(value) : "";
+    const char *md5 = json_object_object_get_ex(file, "md5Checksum", &value) ? json_object_get_string(value) : NULL;
+    const char *revision = json_object_object_get_ex(file, "headRevisionId", &value) ? json_object_get_string(value) : NULL;
+    int is_folder = strcmp(mime, "application/vnd.google-apps.folder") == 0;
+
+    if (is_folder) {
+        if (idx >= 0 || !name) return; // Renames and moves are not mirrored
+        char *path = remote_child_path(st, file, name);
+        if (!path) return;
+        if (st->opts->dry_run) {
+            printf("would create local folder: %s\n", path);
+            return;
+        }
+        if (local_path(st, path, full_path) != 0) return;
+        if (mkdir(full_path, 0755) != 0 && errno != EEXIST) {
+            st->failed++;
+            return;
+        }
+        idx = track_remote_item(st, path, file_id, 1);
+        if (idx >= 0) st->manifest.entries[idx].local = 1;
+        return;
+    }
+
+    // Native Google files cannot be downloaded as-is
+    if (!md5) return;
+
+    char *path;
+    if (idx >= 0) {
+        ManifestEntry *e = &st->manifest.entries[idx];
+        if (strcmp(e->md5, md5) == 0) return; // Our own upload, or no content change
+        path = e->path;
+        if (local_path(st, path, full_path) != 0) return;
+
+        struct stat sb;
+        if (stat(full_path, &sb) == 0 && !local_matches(e, &sb)) {
+            print_warning("Changed on both sides; keeping the local version");
+            fprintf(stderr, "  %s\n", path);
+            return;
+        }
+    } else {
+        if (!name || !(path = remote_child_path(st, file, name))) return;
+        if (local_path(st, path, full_path) != 0) return;
+        if (access(full_path, F_OK) == 0) return; // Local file of that name wins; the scan reconciles it
+    }
+
+    if (st->opts->dry_run) {
+        printf("would download: %s\n", path);
+        return;
+    }
+    if (cdrive_pull_file_by_id(file_id, full_path) != 0) {
+        st->failed++;
+        return;
+    }
+
+    if (idx < 0 && (idx = track_remote_item(st, path, file_id, 0)) < 0) return;
+    ManifestEntry *e = &st->manifest.entries[idx];
+    e->local = 1;
+    struct stat sb;
+    if (stat(full_path, &sb) == 0) {
+        e->size = (long long)sb.st_size;
+        e->mtime_ns = CDRIVE_STAT_MTIME_NS(sb);
+        e->inode = (unsigned long long)sb.st_ino;
+    }
+    snprintf(e->md5, sizeof(e->md5), "%s", md5);
+    e->revision = revision ? arena_strdup(&g_arena, revision) : NULL;
+    st->manifest.dirty = 1;
+    st->downloaded++;
+}
+
+static int pull_remote_changes(SyncState *st) {
+    Manifest *m = &st->manifest;
+
+    // First two-way run: remember where the feed starts; the initial state
+    // was already matched from the remote tree.
+    if (!m->changes_token[0]) {
+        if (fetch_start_page_token(m->changes_token, sizeof(m->changes_token)) != 0) return -1;
+        m->dirty = 1;
+        return 0;
+    }
+    if (remote_id_index(st) != 0) return -1;
+
+    char page_token[sizeof(m->changes_token)];
+    snprintf(page_token, sizeof(page_token), "%s", m->changes_token);
+    while (page_token[0]) {
+        char url[MAX_URL_SIZE];
+        snprintf(url, sizeof(url), "%s?pageSize=1000&fields=%s", api_url(API_CHANGES), SYNC_CHANGES_FIELDS);
+        url_append_param(url, sizeof(url), "pageToken", page_token);
+
+        ArenaMark scope = arena_mark(&g_arena);
+        APIResponse response = {0};
+        response.arena = &g_arena;
+        if (cdrive_api_get(url, &response) != 0) return -1;
+
+        json_object *root = cdrive_json_parse(response.data);
+        arena_rewind(&g_arena, scope);
+        if (!root) return -1;
+
+        json_object *changes, *value;
+        if (json_object_object_get_ex(root, "changes", &changes)) {
+            int n = (int)json_object_array_length(changes);
+            for (int i = 0; i < n; i++) apply_remote_change(st, json_object_array_get_idx(changes, i));
+        }
+
+        page_token[0] = '\0';
+        if (json_object_object_get_ex(root, "nextPageToken", &value)) {
+            snprintf(page_token, sizeof(page_token), "%s", json_object_get_string(value));
+        } else if (json_object_object_get_ex(root, "newStartPageToken", &value)) {
+            snprintf(m->changes_token, sizeof(m->changes_token), "%s", json_object_get_string(value));
+            m->dirty = 1;
+        }
+        json_object_put(root);
+    }
+    return 0;
+}
+
+// --- Command ---
+
+static void print_sync_summary(const SyncState *st, const char *local_dir) {
+    if (g_json_mode) {
+        printf("{\"command\":\"sync\",\"local\":");
+        json_print_string(stdout, local_dir);
+        printf(",\"remote\":");
+        json_print_string(stdout, st->remote_root);
+        printf(",\"scanned\":%lld,\"uploaded\":%lld,\"updated\":%lld,\"unchanged\":%lld,"
+               "\"folders_created\":%lld,\"downloaded\":%lld,\"deleted\":%lld,\"failed\":%lld}\n",
+               st->scanned, st->uploaded, st->updated, st->unchanged,
+               st->folders_created, st->downloaded, st->deleted, st->failed);
+        return;
+    }
+
+    printf("\n");
+    print_colored("[+] ", COLOR_GREEN);
+    printf("Sync %s: %lld uploaded, %lld updated, %lld unchanged, %lld folder(s) created\n",
+           st->opts->dry_run ? "preview" : "complete",
+           st->uploaded, st->updated, st->unchanged, st->folders_created);
+    if (st->opts->two_way || st->deleted > 0) {
+        printf("    %lld downloaded, %lld deleted\n", st->downloaded, st->deleted);
+    }
+    if (st->failed > 0) {
+        print_warning("Some items could not be synced; they will be retried next run.");
+        fprintf(stderr, "%lld item(s) failed\n", st->failed);
+    }
+}
+
+int cdrive_sync(const char *local_dir, const char *remote_id, const SyncOptions *opts) {
+    SyncOptions default_opts = {0};
+    if (!opts) opts = &default_opts;
+
+    SyncState st;
+    memset(&st, 0, sizeof(st));
+    st.opts = opts;
+    st.remote_root = remote_id;
+
+    struct stat root_stat;
+    if (!realpath(local_dir, st.root) || stat(st.root, &root_stat) != 0 || !S_ISDIR(root_stat.st_mode)) {
+        print_error("Local path is not a directory");
+        return -1;
+    }
+
+    if (load_tokens(&g_tokens) != 0) {
+        print_error("Not authenticated. Run 'cdrive auth login' first.");
+        return -1;
+    }
+
+    char manifest_file[PATH_MAX];
+    if (manifest_path(manifest_file, sizeof(manifest_file), st.root, remote_id) != 0) {
+        print_error("Could not create the sync manifest directory");
+        return -1;
+    }
+
+    int loaded = manifest_load(&st.manifest, manifest_file, remote_id);
+    if (loaded < 0) {
+        print_error("Could not read the sync manifest");
+        manifest_free(&st.manifest);
+        return -1;
+    }
+    if (loaded == 1) {
+        // No manifest yet: match what already exists remotely so the first
+        // run updates those files instead of uploading duplicates.
+        if (!g_json_mode) print_info("First sync of this folder pair; indexing the remote folder...");
+        WalkOptions walk_opts = {0};
+        walk_opts.concurrency = g_jobs;
+        if (cdrive_walk(remote_id, &walk_opts, seed_from_remote, &st, NULL) != 0) {
+            print_error("Failed to list the remote folder");
+            manifest_free(&st.manifest);
+            return -1;
+        }
+    }
+
+    if (opts->two_way && pull_remote_changes(&st) != 0) {
+        print_warning("Could not read remote changes; continuing with upload only.");
+    }
+
+    clock_gettime_mono(&st.last_progress);
+    int result = scan_dir(&st, "", remote_id);
+    sync_progress(&st, 1);
+    if (!g_json_mode) fprintf(stderr, "\n");
+
+    process_pending(&st);
+    if (opts->delete_remote) {
+        // A row can only be taken as deleted if the whole tree was read
+        if (result == 0 && st.failed == 0) {
+            process_local_deletions(&st);
+        } else {
+            print_warning("Some items failed; not deleting anything remotely this run.");
+        }
+    }
+
+    if (st.manifest.dirty && !opts->dry_run) {
+        if (manifest_save(&st.manifest, manifest_file, remote_id) != 0) {
+            print_error("Could not write the sync manifest");
+            result = -1;
+        }
+    }
+
+    print_sync_summary(&st, local_dir);
+
+    free(st.pending);
+    free(st.id_slots);
+    manifest_free(&st.manifest);
+    return (result == 0 && st.failed == 0) ? 0 : -1;
+}
+
+#endif // _WIN32
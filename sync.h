@@ -0,0 +1,19 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "cdrive.h"
+
+#define SYNC_MANIFEST_DIR "sync"
+
+typedef struct {
+    int two_way;         // Also pull remote changes using the Drive changes feed
+    int delete_remote;   // Trash remote copies of files deleted locally
+    int dry_run;         // Report what would be transferred without doing it
+} SyncOptions;
+
+// `cdrive sync <local> <remote>`: upload new and changed files under
+// local_dir into the remote folder, tracking state in a per-pair manifest
+// under ~/.cdrive/sync so unchanged files are skipped without reading them.
+int cdrive_sync(const char *local_dir, const char *remote_id, const SyncOptions *opts);
+
+#endif // SYNC_H
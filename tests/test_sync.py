@@ -0,0 +1,301 @@
+#!/usr/bin/env python3
+"""Regression tests for `cdrive sync` and friends against bench/mock_drive.py.
+
+    python3 tests/test_sync.py [--cdrive out/dist/cdrive]
+
+Run by `make test`. Each test gets a fresh mock server and a throwaway
+HOME. When run as root, cdrive is started as nobody so that unreadable
+directories really are unreadable.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+import urllib.parse
+import urllib.request
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+MOCK = os.path.join(ROOT, "bench", "mock_drive.py")
+CDRIVE = os.path.join(ROOT, "out", "dist", "cdrive")
+NOBODY = 65534
+
+
+class MockDrive:
+    def __init__(self, *args):
+        self.proc = subprocess.Popen([sys.executable, MOCK, "--port", "0"] + list(args),
+                                     stdout=subprocess.PIPE, text=True)
+        line = self.proc.stdout.readline().strip()
+        if not line.startswith("listening on "):
+            self.proc.kill()
+            raise RuntimeError("mock server did not start: %r" % line)
+        self.root = line.split(" ", 2)[2]
+
+    def close(self):
+        self.proc.terminate()
+        self.proc.wait()
+        self.proc.stdout.close()
+
+    def call(self, method, path, body=None):
+        data = json.dumps(body).encode() if body is not None else None
+        req = urllib.request.Request(self.root + path, data=data, method=method,
+                                     headers={"Authorization": "Bearer mock-test",
+                                              "Content-Type": "application/json"})
+        with urllib.request.urlopen(req) as resp:
+            raw = resp.read()
+        return json.loads(raw) if raw else None
+
+    def find(self, name, parent=None):
+        q = "name = '%s'" % name
+        if parent:
+            q += " and '%s' in parents" % parent
+        files = self.call("GET", "/drive/v3/files?pageSize=1000&q=" + urllib.parse.quote(q))["files"]
+        return files[0] if files else None
+
+    def trash(self, file_id):
+        self.call("PATCH", "/drive/v3/files/%s" % file_id, {"trashed": True})
+
+
+class SyncTest(unittest.TestCase):
+    mock_args = ()
+
+    def setUp(self):
+        self.mock = MockDrive(*self.mock_args)
+        self.work = tempfile.mkdtemp(prefix="cdrive-test-")
+        self.home = os.path.join(self.work, "home")
+        self.src = os.path.join(self.work, "src")
+        config = os.path.join(self.home, ".cdrive")
+        os.makedirs(config)
+        os.makedirs(self.src)
+        with open(os.path.join(config, "client_id.json"), "w") as f:
+            json.dump({"client_id": "mock", "client_secret": "mock"}, f)
+        with open(os.path.join(config, "token.json"), "w") as f:
+            json.dump({"access_token": "mock-initial", "refresh_token": "mock-refresh",
+                       "token_type": "Bearer", "expires_in": 3599}, f)
+
+    def tearDown(self):
+        self.mock.close()
+        shutil.rmtree(self.work, ignore_errors=True)
+
+    def write(self, rel, content):
+        path = os.path.join(self.src, rel)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(content)
+
+    def sync(self, *args):
+        return self.cdrive("sync", self.src, *args)
+
+    def cdrive(self, *args, env=None):
+        overrides = env
+        as_root = os.geteuid() == 0
+        binary = CDRIVE
+        if as_root:
+            # nobody may not be able to reach the build tree
+            binary = os.path.join(self.work, "cdrive")
+            if not os.path.exists(binary):
+                shutil.copy2(CDRIVE, binary)
+            for top, dirs, files in os.walk(self.work):
+                for name in [top] + [os.path.join(top, n) for n in dirs + files]:
+                    os.lchown(name, NOBODY, NOBODY)
+
+        def drop_privileges():
+            if as_root:
+                os.setgroups([])
+                os.setgid(NOBODY)
+                os.setuid(NOBODY)
+
+        env = dict(os.environ, HOME=self.home, CDRIVE_NO_DAEMON="1", CDRIVE_API_ROOT=self.mock.root)
+        env.update(overrides or {})
+        proc = subprocess.run([binary, "--quota", "0"] + list(args), env=env,
+                              stdin=subprocess.DEVNULL, capture_output=True, text=True,
+                              cwd=self.work, preexec_fn=drop_privileges, timeout=120)
+        self.assertGreaterEqual(proc.returncode, 0, "cdrive died: %s" % proc.stderr[-2000:])
+        return proc
+
+
+class DeleteTest(SyncTest):
+    mock_args = ("--seed-files", "2")
+
+    def test_unreadable_subdirectory_is_not_deleted(self):
+        self.write("a/f1.txt", "one")
+        self.write("b/f2.txt", "two")
+        self.write("top.txt", "top")
+        self.assertEqual(self.sync("bench-uploads").returncode, 0)
+        f2 = self.mock.find("f2.txt")
+        self.assertIsNotNone(f2)
+
+        os.chmod(os.path.join(self.src, "b"), 0)
+        try:
+            proc = self.sync("bench-uploads", "--delete")
+        finally:
+            os.chmod(os.path.join(self.src, "b"), 0o755)
+        self.assertNotEqual(proc.returncode, 0)
+        self.assertFalse(self.mock.find("f2.txt")["trashed"], proc.stderr)
+        self.assertFalse(self.mock.find("b")["trashed"], proc.stderr)
+
+    def test_remote_only_items_are_not_deleted(self):
+        self.write("x.txt", "x")
+        self.assertEqual(self.sync("bench-small").returncode, 0)
+        proc = self.sync("bench-small", "--delete")
+        self.assertEqual(proc.returncode, 0, proc.stderr)
+        for name in ("file-000000.bin", "file-000001.bin", "x.txt"):
+            self.assertFalse(self.mock.find(name, "bench-small")["trashed"], name)
+
+        # A file that did exist locally still goes
+        os.remove(os.path.join(self.src, "x.txt"))
+        self.assertEqual(self.sync("bench-small", "--delete").returncode, 0)
+        self.assertTrue(self.mock.find("x.txt", "bench-small")["trashed"])
+        self.assertFalse(self.mock.find("file-000000.bin", "bench-small")["trashed"])
+
+
+
+class TwoWayTest(SyncTest):
+    def test_repeated_remote_delete_of_changed_file(self):
+        self.write("a.txt", "one")
+        self.write("b.txt", "two")
+        self.assertEqual(self.sync("bench-uploads", "--two-way").returncode, 0)
+        a = self.mock.find("a.txt")
+        self.assertIsNotNone(a)
+
+        # Two change records for the same ID while the local copy has moved on
+        self.mock.trash(a["id"])
+        self.mock.trash(a["id"])
+        self.write("a.txt", "changed locally")
+        proc = self.sync("bench-uploads", "--two-way")
+        self.assertIn("local file changed", proc.stdout + proc.stderr)
+        with open(os.path.join(self.src, "a.txt")) as f:
+            self.assertEqual(f.read(), "changed locally")
+
+
+class CreateRetryTest(SyncTest):
+    """A create that may have reached Drive is never resent."""
+
+    def retry_stats(self, *args):
+        proc = self.cdrive("--json", "--stats", *args)
+        self.assertNotEqual(proc.returncode, 0)
+        for line in (proc.stdout + proc.stderr).splitlines():
+            if line.startswith('{"stats":'):
+                return json.loads(line)["stats"]
+        self.fail("no stats in output: %s" % proc.stderr)
+
+    def restart_mock(self, *args):
+        self.mock.close()
+        self.mock = MockDrive(*args)
+
+    def test_server_error_is_not_resent(self):
+        self.restart_mock("--error-rate", "1", "--error-codes", "503")
+        self.write("new.txt", "new")
+        stats = self.retry_stats("upload", os.path.join(self.src, "new.txt"), "bench-uploads")
+        self.assertEqual(stats["retries"], 0)
+        stats = self.retry_stats("mkdir", "newdir", "bench-uploads")
+        self.assertEqual(stats["retries"], 0)
+
+    def test_rate_limit_is_retried(self):
+        self.restart_mock("--error-rate", "1", "--error-codes", "429")
+        self.write("new.txt", "new")
+        stats = self.retry_stats("--retry-budget", "1", "upload", os.path.join(self.src, "new.txt"), "bench-uploads")
+        self.assertEqual(stats["rate_limited"], 1)
+        stats = self.retry_stats("--retry-budget", "1", "mkdir", "newdir", "bench-uploads")
+        self.assertEqual(stats["rate_limited"], 1)
+
+
+    def test_body_cut_short_is_resent(self):
+        self.restart_mock("--reset-rate", "1")
+        # Larger than the socket buffers, so the reset lands before curl has queued it all
+        self.write("big.bin", "x" * (16 << 20))
+        stats = self.retry_stats("--retry-budget", "1", "upload", os.path.join(self.src, "big.bin"), "bench-uploads")
+        self.assertEqual(stats["network_errors"], 1)
+        self.assertIsNone(self.mock.find("big.bin"))
+
+
+class ListRetryTest(SyncTest):
+    """A listing page cut short and fetched again is reported once."""
+    # Seed 1 cuts the first attempt of each listing body
+    mock_args = ("--seed-files", "300", "--list-reset-rate", "0.5", "--fault-seed", "1")
+
+    def command_json(self, *args):
+        proc = self.cdrive("--json", "--retry-budget", "10", *args)
+        self.assertEqual(proc.returncode, 0, proc.stderr)
+        return json.loads(proc.stdout.strip().splitlines()[-1])
+
+    def test_retried_page_is_not_repeated(self):
+        ids = [f["id"] for f in self.command_json("list", "bench-small")["results"]]
+        self.assertEqual(len(ids), 300)
+        self.assertEqual(len(set(ids)), 300)
+        du = self.command_json("du", "bench-small")
+        self.assertEqual(du["files"], 300)
+        self.assertEqual(du["total_bytes"], 300 * 4096)
+
+
+class UploadHashTest(SyncTest):
+    def test_upload_checksum_seeds_cache(self):
+        data = os.urandom(300000)
+        with open(os.path.join(self.src, "r.bin"), "wb") as f:
+            f.write(data)
+        proc = self.cdrive("upload", os.path.join(self.src, "r.bin"), "bench-uploads")
+        self.assertEqual(proc.returncode, 0, proc.stderr)
+        self.assertNotIn("mismatch", proc.stdout + proc.stderr)
+        self.assertEqual(self.mock.find("r.bin")["md5Checksum"], hashlib.md5(data).hexdigest())
+        with open(os.path.join(self.home, ".cdrive", "hashcache.bin"), "rb") as f:
+            self.assertIn(hashlib.md5(data).digest(), f.read())
+
+
+class DaemonEnvTest(SyncTest):
+    def test_forwarded_command_uses_client_environment(self):
+        other = MockDrive()
+        self.addCleanup(other.close)
+        started = self.cdrive("daemon", "start", env={"CDRIVE_NO_DAEMON": "", "CDRIVE_API_ROOT": other.root})
+        self.assertEqual(started.returncode, 0, started.stdout + started.stderr)
+        try:
+            proc = self.cdrive("mkdir", "from-client", "bench-uploads", env={"CDRIVE_NO_DAEMON": ""})
+        finally:
+            self.cdrive("daemon", "stop", env={"CDRIVE_NO_DAEMON": ""})
+        self.assertEqual(proc.returncode, 0, proc.stdout + proc.stderr)
+        self.assertIsNotNone(self.mock.find("from-client"))
+        self.assertIsNone(other.find("from-client"))
+
+    def test_second_run_does_not_take_over(self):
+        env = {"CDRIVE_NO_DAEMON": ""}
+        started = self.cdrive("daemon", "start", env=env)
+        self.assertEqual(started.returncode, 0, started.stdout + started.stderr)
+        try:
+            second = self.cdrive("daemon", "run", env=env)
+            self.assertNotEqual(second.returncode, 0)
+            self.assertIn("running", self.cdrive("daemon", "status", env=env).stdout)
+        finally:
+            self.cdrive("daemon", "stop", env=env)
+
+    def test_stale_pid_file_is_not_signalled(self):
+        # Stands in for an unrelated process that reused the crashed daemon's pid
+        bystander = subprocess.Popen(["sleep", "60"],
+                                     preexec_fn=(lambda: os.setuid(NOBODY)) if os.geteuid() == 0 else None)
+        self.addCleanup(bystander.wait)
+        self.addCleanup(bystander.kill)
+        pid_path = os.path.join(self.home, ".cdrive", "daemon.pid")
+        with open(pid_path, "w") as f:
+            f.write("%d\n" % bystander.pid)
+        proc = self.cdrive("daemon", "stop", env={"CDRIVE_NO_DAEMON": ""})
+        self.assertEqual(proc.returncode, 0, proc.stderr)
+        self.assertIsNone(bystander.poll())
+        self.assertFalse(os.path.exists(pid_path))
+
+
+def main():
+    global CDRIVE
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--cdrive", default=CDRIVE)
+    args, rest = parser.parse_known_args()
+    CDRIVE = os.path.abspath(args.cdrive)
+    if not os.access(CDRIVE, os.X_OK):
+        sys.exit("cdrive binary not found: %s (run make first)" % CDRIVE)
+    unittest.main(argv=[sys.argv[0]] + rest, verbosity=2)
+
+
+if __name__ == "__main__":
+    main()
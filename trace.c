@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "trace.h"
+
+typedef struct {
+    long long us[PHASE_COUNT];
+} TraceSample;
+
+static const char *const g_phase_names[PHASE_COUNT] = {
+    "DNS", "Connect", "TLS", "Send", "Wait (TTFB)", "Transfer"
+};
+static const char *const g_phase_keys[PHASE_COUNT] = {
+    "dns", "connect", "tls", "send", "wait", "transfer"
+};
+
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_trace_on = 0;
+static FILE *g_trace_file = NULL;   // NULL writes to stderr
+static char g_trace_path[MAX_PATH_SIZE];
+static TraceSample *g_samples = NULL;
+static size_t g_sample_count = 0;
+static size_t g_sample_capacity = 0;
+static long long g_retried = 0;
+static long long g_failed = 0;
+
+int trace_open(const char *path) {
+    pthread_mutex_lock(&g_trace_lock);
+    if (path) {
+        FILE *file = fopen(path, "a");
+        if (!file) {
+            pthread_mutex_unlock(&g_trace_lock);
+            return -1;
+        }
+        if (g_trace_file) fclose(g_trace_file);
+        g_trace_file = file;
+        snprintf(g_trace_path, sizeof(g_trace_path), "%s", path);
+    }
+    __atomic_store_n(&g_trace_on, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_trace_lock);
+    return 0;
+}
+
+int trace_enabled(void) {
+    return __atomic_load_n(&g_trace_on, __ATOMIC_RELAXED);
+}
+
+const char *trace_path(void) {
+    return g_trace_file ? g_trace_path : NULL;
+}
+
+static long long timer_us(CURL *curl, CURLINFO info) {
+    curl_off_t value = 0;
+    curl_easy_getinfo(curl, info, &value);
+    return (long long)value;
+}
+
+static long long span(long long from, long long to) {
+    return to > from ? to - from : 0;
+}
+
+void trace_record(CURL *curl, CURLcode res, int retries) {
+    if (!trace_enabled()) return;
+
+    long long namelookup = timer_us(curl, CURLINFO_NAMELOOKUP_TIME_T);
+    long long connected = timer_us(curl, CURLINFO_CONNECT_TIME_T);
+    long long appconnect = timer_us(curl, CURLINFO_APPCONNECT_TIME_T);
+    long long pretransfer = timer_us(curl, CURLINFO_PRETRANSFER_TIME_T);
+    long long starttransfer = timer_us(curl, CURLINFO_STARTTRANSFER_TIME_T);
+    long long total = timer_us(curl, CURLINFO_TOTAL_TIME_T);
+    curl_off_t bytes_up = 0;
+    curl_off_t bytes_down = 0;
+    long status = 0;
+    char *method = NULL;
+    char *url = NULL;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &bytes_up);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes_down);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_METHOD, &method);
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+
+    // Timers are cumulative from the start of the request; a failed request
+    // may stop at any of them
+    TraceSample sample;
+    long long secured = appconnect > 0 ? appconnect : connected;
+    sample.us[PHASE_DNS] = namelookup;
+    sample.us[PHASE_CONNECT] = span(namelookup, connected);
+    sample.us[PHASE_TLS] = appconnect > 0 ? span(connected, appconnect) : 0;
+    sample.us[PHASE_SEND] = span(secured, pretransfer);
+    sample.us[PHASE_WAIT] = starttransfer > 0 ? span(pretransfer, starttransfer) : 0;
+    sample.us[PHASE_TRANSFER] = starttransfer > 0 ? span(starttransfer, total) : 0;
+    if (starttransfer == 0) {
+        // Charge the rest to the phase the request never got through
+        TracePhase stuck = pretransfer > 0 ? PHASE_WAIT
+                         : namelookup == 0 ? PHASE_DNS
+                         : connected == 0 ? PHASE_CONNECT
+                         : PHASE_TLS;
+        long long reached = pretransfer > 0 ? pretransfer : secured > namelookup ? secured : namelookup;
+        sample.us[stuck] += span(reached, total);
+    }
+
+    // The query string can be long (page tokens) and says little about timing
+    size_t url_len = url ? strcspn(url, "?") : 0;
+
+    pthread_mutex_lock(&g_trace_lock);
+    FILE *out = g_trace_file ? g_trace_file : stderr;
+    fprintf(out, "{\"ts\":%lld,\"method\":\"%s\",\"url\":\"%.*s\",\"status\":%ld,\"result\":%d,"
+            "\"protocol\":\"%s\",\"retries\":%d,\"bytes_up\":%lld,\"bytes_down\":%lld,"
+            "\"namelookup_us\":%lld,\"connect_us\":%lld,\"appconnect_us\":%lld,\"pretransfer_us\":%lld,"
+            "\"starttransfer_us\":%lld,\"total_us\":%lld}\n",
+            (long long)time(NULL), method ? method : "GET", (int)url_len, url ? url : "", status, (int)res,
+            transport_protocol(curl), retries, (long long)bytes_up, (long long)bytes_down,
+            namelookup, connected, appconnect, pretransfer, starttransfer, total);
+    fflush(out);
+
+    if (g_sample_count == g_sample_capacity) {
+        size_t capacity = g_sample_capacity ? g_sample_capacity * 2 : 64;
+        TraceSample *grown = realloc(g_samples, capacity * sizeof(TraceSample));
+        if (grown) {
+            g_samples = grown;
+            g_sample_capacity = capacity;
+        }
+    }
+    if (g_sample_count < g_sample_capacity) g_samples[g_sample_count++] = sample;
+    if (retries > 0) g_retried++;
+    if (res != CURLE_OK || status >= 400) g_failed++;
+    pthread_mutex_unlock(&g_trace_lock);
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+void trace_print_summary(void) {
+    pthread_mutex_lock(&g_trace_lock);
+    size_t n = g_sample_count;
+    if (!trace_enabled() || n == 0) {
+        pthread_mutex_unlock(&g_trace_lock);
+        return;
+    }
+
+    long long *values = malloc(n * sizeof(long long));
+    if (!values) {
+        pthread_mutex_unlock(&g_trace_lock);
+        return;
+    }
+
+    if (g_json_mode) {
+        fprintf(stderr, "{\"timing\":{\"requests\":%zu,\"retried\":%lld,\"failed\":%lld,\"phases\":{",
+                n, g_retried, g_failed);
+    } else {
+        fprintf(stderr, "\n%sTiming%s (%zu requests, %lld retried, %lld failed)\n",
+                COLOR_BOLD, COLOR_RESET, n, g_retried, g_failed);
+        fprintf(stderr, "  %-12s %10s %9s %9s %9s\n", "Phase", "Total", "Mean", "p95", "Max");
+    }
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        long long sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            values[i] = g_samples[i].us[p];
+            sum += values[i];
+        }
+        qsort(values, n, sizeof(long long), compare_ll);
+        double total_ms = sum / 1000.0;
+        double mean_ms = total_ms / (double)n;
+        double p95_ms = values[(n - 1) * 95 / 100] / 1000.0;
+        double max_ms = values[n - 1] / 1000.0;
+
+        if (g_json_mode) {
+            fprintf(stderr, "%s\"%s\":{\"total_ms\":%.3f,\"mean_ms\":%.3f,\"p95_ms\":%.3f,\"max_ms\":%.3f}",
+                    p ? "," : "", g_phase_keys[p], total_ms, mean_ms, p95_ms, max_ms);
+        } else {
+            fprintf(stderr, "  %-12s %9.1fs %7.1fms %7.1fms %7.1fms\n",
+                    g_phase_names[p], total_ms / 1000.0, mean_ms, p95_ms, max_ms);
+        }
+    }
+    if (g_json_mode) fprintf(stderr, "}}}\n");
+
+    free(values);
+    pthread_mutex_unlock(&g_trace_lock);
+}
+
+void trace_reset(void) {
+    pthread_mutex_lock(&g_trace_lock);
+    __atomic_store_n(&g_trace_on, 0, __ATOMIC_RELAXED);
+    if (g_trace_file) fclose(g_trace_file);
+    g_trace_file = NULL;
+    g_trace_path[0] = '\0';
+    free(g_samples);
+    g_samples = NULL;
+    g_sample_count = 0;
+    g_sample_capacity = 0;
+    g_retried = 0;
+    g_failed = 0;
+    pthread_mutex_unlock(&g_trace_lock);
+}
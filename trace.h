@@ -0,0 +1,36 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <curl/curl.h>
+
+// Phases of one request, from curl's cumulative timers. A request on a
+// reused connection spends nothing in DNS, connect or TLS.
+typedef enum {
+    PHASE_DNS,        // NAMELOOKUP
+    PHASE_CONNECT,    // CONNECT - NAMELOOKUP
+    PHASE_TLS,        // APPCONNECT - CONNECT
+    PHASE_SEND,       // PRETRANSFER - APPCONNECT (or CONNECT)
+    PHASE_WAIT,       // STARTTRANSFER - PRETRANSFER: time to first byte
+    PHASE_TRANSFER,   // TOTAL - STARTTRANSFER
+    PHASE_COUNT
+} TracePhase;
+
+// --trace-timing: append one NDJSON line per request to path (stderr when
+// path is NULL) and summarize the phases at exit. Returns -1 if the file
+// cannot be opened.
+int trace_open(const char *path);
+int trace_enabled(void);
+// The file given to trace_open(), or NULL for stderr
+const char *trace_path(void);
+
+// Called by transport_record() for every finished request
+void trace_record(CURL *curl, CURLcode res, int retries);
+
+// Per-phase totals, mean, p95 and max on stderr (a "timing" object under
+// --json)
+void trace_print_summary(void);
+
+// Close the trace and forget the samples (daemon workers, per command)
+void trace_reset(void);
+
+#endif // TRACE_H
@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "transport.h"
+
+int g_http3 = 0;
+
+static long long g_protocol_counts[PROTO_COUNT];
+static int g_http3_warned = 0;
+
+static const char *const g_protocol_names[PROTO_COUNT] = { "HTTP/1.1", "HTTP/2", "HTTP/3" };
+static const char *const g_protocol_keys[PROTO_COUNT] = { "http1", "http2", "http3" };
+
+static int http3_available(void) {
+    return (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP3) != 0;
+}
+
+void transport_setup(CURL *curl) {
+    if (!g_http3) return;
+    if (!http3_available()) {
+        if (!__atomic_exchange_n(&g_http3_warned, 1, __ATOMIC_RELAXED)) {
+            print_warning("This libcurl was built without HTTP/3 support; using HTTP/2.");
+        }
+        return;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x075800
+    // Since 7.88 this races QUIC against TCP and keeps whichever connects,
+    // so networks that drop UDP still work (HTTP_VERSION_3ONLY would not)
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_3);
+#endif
+    // Drive advertises h3 in Alt-Svc; with the cache on disk, the first
+    // request of a later run already knows where to find it
+    char path[MAX_PATH_SIZE];
+    const char *home = getenv(HOME_ENV);
+    if (home) {
+        int n = snprintf(path, sizeof(path), "%s%s%s%s%s", home, PATH_SEP, CONFIG_DIR, PATH_SEP, ALTSVC_FILE);
+        if (n > 0 && (size_t)n < sizeof(path)) {
+            curl_easy_setopt(curl, CURLOPT_ALTSVC_CTRL, (long)(CURLALTSVC_H1 | CURLALTSVC_H2 | CURLALTSVC_H3));
+            curl_easy_setopt(curl, CURLOPT_ALTSVC, path);
+        }
+    }
+}
+
+static int protocol_of(CURL *curl) {
+    long version = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version) != CURLE_OK || version == 0) return -1;
+    if (version == CURL_HTTP_VERSION_3) return PROTO_HTTP3;
+    if (version == CURL_HTTP_VERSION_2_0) return PROTO_HTTP2;
+    return PROTO_HTTP1;
+}
+
+#ifdef CDRIVE_USDT
+// The section is where dtrace -G puts them; tracers find them via the notes
+#define PROBE_SEMAPHORE_DEFINE(name) \
+    unsigned short cdrive_##name##_semaphore __attribute__((unused, section(".probes")));
+PROBE_SEMAPHORES(PROBE_SEMAPHORE_DEFINE)
+
+// Five getinfo calls per request, so only made while a tracer is attached
+static void probe_request_done(CURL *curl, CURLcode res) {
+    char *url = NULL;
+    long status = 0;
+    curl_off_t bytes_up = 0;
+    curl_off_t bytes_down = 0;
+    curl_off_t total_us = 0;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &bytes_up);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes_down);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_us);
+    PROBE_REQUEST_DONE(curl, url, status, res, bytes_up, bytes_down, total_us);
+}
+#endif
+
+void transport_record(CURL *curl, CURLcode res, int retries) {
+    int protocol = protocol_of(curl);
+    if (protocol >= 0) __atomic_add_fetch(&g_protocol_counts[protocol], 1, __ATOMIC_RELAXED);
+    trace_record(curl, res, retries);
+    metrics_record(curl, res);
+#ifdef CDRIVE_USDT
+    if (PROBE_REQUEST_DONE_ENABLED()) probe_request_done(curl, res);
+#endif
+}
+
+const char *transport_protocol(CURL *curl) {
+    int protocol = protocol_of(curl);
+    return protocol >= 0 ? g_protocol_names[protocol] : "unknown";
+}
+
+void transport_reset(void) {
+    for (int i = 0; i < PROTO_COUNT; i++) __atomic_store_n(&g_protocol_counts[i], 0, __ATOMIC_RELAXED);
+}
+
+void transport_print_stats(void) {
+    long long counts[PROTO_COUNT];
+    long long total = 0;
+    for (int i = 0; i < PROTO_COUNT; i++) {
+        counts[i] = __atomic_load_n(&g_protocol_counts[i], __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+    if (total == 0) return;
+
+    if (g_json_mode) {
+        fprintf(stderr, ",\"protocols\":{");
+        for (int i = 0; i < PROTO_COUNT; i++) {
+            fprintf(stderr, "%s\"%s\":%lld", i ? "," : "", g_protocol_keys[i], counts[i]);
+        }
+        fprintf(stderr, "}");
+        return;
+    }
+
+    fprintf(stderr, "  Protocols:       ");
+    int first = 1;
+    for (int i = PROTO_COUNT - 1; i >= 0; i--) {
+        if (counts[i] == 0) continue;
+        fprintf(stderr, "%s %s %lld", first ? "" : ",", g_protocol_names[i], counts[i]);
+        first = 0;
+    }
+    fprintf(stderr, "\n");
+}
@@ -0,0 +1,40 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <curl/curl.h>
+
+#define ALTSVC_FILE "altsvc.txt"
+
+// Protocols a finished transfer can have used, for --stats
+typedef enum {
+    PROTO_HTTP1,
+    PROTO_HTTP2,
+    PROTO_HTTP3,
+    PROTO_COUNT
+} TransportProtocol;
+
+// Set by --http3: offer HTTP/3 (QUIC) to Drive and remember Alt-Svc
+// adverts in ~/.cdrive/altsvc.txt, so later runs go straight to QUIC.
+// Connections fall back to TCP where QUIC is blocked; without QUIC support
+// in libcurl the flag only prints a warning.
+extern int g_http3;
+
+// Protocol options for a Drive or OAuth handle; called from
+// cdrive_easy_setup()
+void transport_setup(CURL *curl);
+
+// Account for a finished transfer (protocol counts, --trace-timing,
+// --metrics);
+// cdrive_easy_perform() and the event loop call it for every request.
+// retries is how many times this request had already been sent.
+void transport_record(CURL *curl, CURLcode res, int retries);
+
+// "HTTP/1.1", "HTTP/2" or "HTTP/3" for the handle's last response
+const char *transport_protocol(CURL *curl);
+
+void transport_reset(void);
+// Stats line for --stats; under --json, a "protocols" member to splice
+// into the stats object
+void transport_print_stats(void);
+
+#endif // TRANSPORT_H
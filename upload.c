@@ -2,6 +2,7 @@
 #include "cdrive.h"
 
 char *get_file_mime_type(const char *filename) {
+    PROFILE_SCOPE(PROF_MIME);
     const char *extension = strrchr(filename, '.');
     if (!extension) return strdup("application/octet-stream");
     
@@ -60,6 +61,7 @@ int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_
         }
 
         progress->last_update_time = current_time;
+        PROFILE_SCOPE(PROF_PROGRESS);
 
         double percentage = (double)ulnow / ultotal * 100.0;
 
@@ -100,122 +102,63 @@ int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_
 }
 
 int cdrive_search(const char *query) {
-    APIResponse response = {0};
-
     if (load_tokens(&g_tokens) != 0) {
+        if (g_json_mode) printf("[]");
         print_error("Not authenticated. Run 'cdrive auth login' first.");
         return -1;
     }
 
-    char url[2048];
     char *encoded_query = url_encode(query);
     if (!encoded_query) {
         print_error("Failed to encode search query");
         return -1;
     }
 
-    snprintf(url, sizeof(url),
-             "%s?q=name%%20contains%%20%%27%s%%27%%20and%%20trashed=false&fields=files(id,name,mimeType,size,modifiedTime)",
-             DRIVE_API_URL, encoded_query);
+    char q[MAX_URL_SIZE / 2];
+    snprintf(q, sizeof(q), "name%%20contains%%20%%27%s%%27%%20and%%20trashed=false", encoded_query);
     free(encoded_query);
 
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        print_error("Error initializing curl");
-        return -1;
-    }
-
-    char auth_header[MAX_HEADER_SIZE];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
-    struct curl_slist *headers = curl_slist_append(NULL, auth_header);
-
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-
-    CURLcode res = curl_easy_perform(curl);
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-
-    if (res != CURLE_OK || http_code != 200) {
-        if (response.data) free(response.data);
+    Listing listing;
+    listing_init(&listing);
+    if (listing_fetch(&listing, q, NULL) != 0) {
+        listing_free(&listing);
+        if (g_json_mode) printf("[]");
         print_error("Search failed");
         return -1;
     }
 
-    if (response.data) {
-        json_object *root = json_tokener_parse(response.data);
-        if (root) {
-            json_object *files_array;
-            if (json_object_object_get_ex(root, "files", &files_array) &&
-                json_object_get_type(files_array) == json_type_array) {
-                int num_files = json_object_array_length(files_array);
-
-                if (g_json_mode) {
-                    printf("[");
-                    for (int i = 0; i < num_files; i++) {
-                        json_object *file_obj = json_object_array_get_idx(files_array, i);
-                        printf("%s", json_object_to_json_string(file_obj));
-                        if (i < num_files - 1) printf(",");
-                    }
-                    printf("]");
-                } else {
-                    printf("\n");
-                    if (num_files > 0) {
-                        print_colored("TYPE\tNAME\t\t\t\t\tID\n", COLOR_BOLD);
-                        print_colored("----\t----\t\t\t\t\t--\n", COLOR_BOLD);
-
-                        for (int i = 0; i < num_files; i++) {
-                            json_object *file_obj = json_object_array_get_idx(files_array, i);
-                            json_object *id_obj, *name_obj, *mime_type_obj;
-
-                            if (json_object_object_get_ex(file_obj, "id", &id_obj) &&
-                                json_object_object_get_ex(file_obj, "name", &name_obj) &&
-                                json_object_object_get_ex(file_obj, "mimeType", &mime_type_obj)) {
-                                const char *mime_type = json_object_get_string(mime_type_obj);
-                                if (strcmp(mime_type, "application/vnd.google-apps.folder") == 0) {
-                                    print_colored("[DIR] ", COLOR_CYAN);
-                                } else {
-                                    print_colored("[FILE]", COLOR_WHITE);
-                                }
-                                printf("\t%-40.40s\t", json_object_get_string(name_obj));
-                                print_colored(json_object_get_string(id_obj), COLOR_YELLOW);
-                                printf("\n");
-                            }
-                        }
-                    } else {
-                        print_info("No files found matching the search query.");
-                    }
-                }
-            }
-            json_object_put(root);
-        }
-        free(response.data);
+    if (g_json_mode || listing.order_count > 0) {
+        listing_print(&listing);
+    } else {
+        printf("\n");
+        print_info("No files found matching the search query.");
     }
 
+    listing_free(&listing);
     return 0;
 }
 
 int cdrive_share(const char *file_id, const char *email, const char *role) {
     APIResponse response = {0};
+    response.arena = &g_arena;
 
     if (load_tokens(&g_tokens) != 0) {
         print_error("Not authenticated. Run 'cdrive auth login' first.");
         return -1;
     }
 
-    CURL *curl = curl_easy_init();
+    CURL *curl = cdrive_easy_init();
     if (!curl) {
         print_error("Error initializing curl");
         return -1;
     }
 
-    char url[1024];
-    snprintf(url, sizeof(url), "https://www.googleapis.com/drive/v3/files/%s/permissions", file_id);
+    char *url = arena_sprintf(&g_arena, "%s/%s/permissions", DRIVE_API_URL, file_id);
+    if (!url) {
+        print_error("Memory allocation failed.");
+        curl_easy_cleanup(curl);
+        return -1;
+    }
 
     char post_data[512];
     snprintf(post_data, sizeof(post_data),
@@ -223,7 +166,7 @@ int cdrive_share(const char *file_id, const char *email, const char *role) {
              role, email);
 
     char auth_header[MAX_HEADER_SIZE];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
+    token_auth_header(auth_header, sizeof(auth_header));
 
     struct curl_slist *headers = NULL;
     headers = curl_slist_append(headers, auth_header);
@@ -235,7 +178,8 @@ int cdrive_share(const char *file_id, const char *email, const char *role) {
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
 
-    CURLcode res = curl_easy_perform(curl);
+    pacer_admit(PACE_METADATA);
+    CURLcode res = cdrive_easy_perform(curl);
     long http_code = 0;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
@@ -245,7 +189,7 @@ int cdrive_share(const char *file_id, const char *email, const char *role) {
     if (res != CURLE_OK || http_code != 200) {
         print_error("Failed to share file");
         if (response.data) {
-            json_object *root = json_tokener_parse(response.data);
+            json_object *root = cdrive_json_parse(response.data);
             if (root) {
                 json_object *error_obj, *message_obj;
                 if (json_object_object_get_ex(root, "error", &error_obj) &&
@@ -255,11 +199,11 @@ int cdrive_share(const char *file_id, const char *email, const char *role) {
                 json_object_put(root);
             }
         }
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
 
-    if (response.data) free(response.data);
+    api_response_free(&response);
 
     print_success("File shared successfully!");
     printf("  File ID: %s\n", file_id);
@@ -272,50 +216,52 @@ int cdrive_share(const char *file_id, const char *email, const char *role) {
 // Portable glob expansion
 #ifdef _WIN32
     #include <io.h>
-    int cdrive_glob(const char *pattern, char ***results, int *count) {
+    int cdrive_glob(Arena *arena, const char *pattern, char ***results, int *count) {
+        PROFILE_SCOPE(PROF_GLOB);
         struct _finddata_t fd;
         intptr_t handle = _findfirst(pattern, &fd);
         if (handle == -1) return -1;
 
         int capacity = 16;
-        *results = malloc(sizeof(char *) * (size_t)capacity);
+        *results = arena_alloc(arena, sizeof(char *) * (size_t)capacity);
         *count = 0;
+        if (!*results) { _findclose(handle); return -1; }
 
         do {
             if (strcmp(fd.name, ".") == 0 || strcmp(fd.name, "..") == 0) continue;
             if (*count >= capacity) {
-                capacity *= 2;
-                char **new_results = realloc(*results, sizeof(char *) * (size_t)capacity);
-                if (!new_results) { free(*results); return -1; }
+                char **new_results = arena_realloc(arena, *results, sizeof(char *) * (size_t)capacity,
+                                                   sizeof(char *) * (size_t)capacity * 2);
+                if (!new_results) { _findclose(handle); return -1; }
                 *results = new_results;
+                capacity *= 2;
             }
-            (*results)[*count] = strdup(fd.name);
-            if (!(*results)[*count]) { free(*results); return -1; }
+            (*results)[*count] = arena_strdup(arena, fd.name);
+            if (!(*results)[*count]) { _findclose(handle); return -1; }
             (*count)++;
         } while (_findnext(handle, &fd) == 0);
 
         _findclose(handle);
 
-        if (*count == 0) { free(*results); *results = NULL; return -1; }
+        if (*count == 0) { *results = NULL; return -1; }
         return 0;
     }
 #else
     #include <glob.h>
-    int cdrive_glob(const char *pattern, char ***results, int *count) {
+    // Results are allocated from the arena and released with it
+    int cdrive_glob(Arena *arena, const char *pattern, char ***results, int *count) {
+        PROFILE_SCOPE(PROF_GLOB);
         glob_t g;
         int ret = glob(pattern, GLOB_NOCHECK | GLOB_MARK, NULL, &g);
         if (ret != 0) return -1;
 
         *count = (int)g.gl_pathc;
-        *results = malloc(sizeof(char *) * (size_t)(*count));
+        *results = arena_alloc(arena, sizeof(char *) * (size_t)(*count));
         if (!*results) { globfree(&g); return -1; }
 
         for (int i = 0; i < *count; i++) {
-            (*results)[i] = strdup(g.gl_pathv[i]);
-            if (!(*results)[i]) {
-                for (int j = 0; j < i; j++) free((*results)[j]);
-                free(*results); globfree(&g); return -1;
-            }
+            (*results)[i] = arena_strdup(arena, g.gl_pathv[i]);
+            if (!(*results)[i]) { globfree(&g); return -1; }
         }
 
         globfree(&g);
@@ -323,114 +269,115 @@ int cdrive_share(const char *file_id, const char *email, const char *role) {
     }
 #endif
 
-int cdrive_upload(const char *source_path, const char *target_folder) {
-    CURL *curl;
-    CURLcode res;
-    APIResponse response = {0};
-    LoadingSpinner setup_spinner = {0};
-    curl_mime *mime = NULL;
-    curl_mimepart *part;
-    
-    // Check if the source file exists and is a regular file
-    struct stat path_stat;
-    if (stat(source_path, &path_stat) != 0) {
-        print_error("File not found or cannot be accessed");
-        perror(source_path);
-        return -1;
-    }
+static const char *path_basename(const char *path) {
+    const char *filename_fslash = strrchr(path, '/');
+    const char *filename_bslash = strrchr(path, '\\');
+    const char *filename = filename_fslash > filename_bslash ? filename_fslash : filename_bslash;
+    return filename ? filename + 1 : path;
+}
 
-    if (!S_ISREG(path_stat.st_mode)) {
-        print_error("The specified path is not a regular file.");
-        return -1;
+static void print_api_error_message(const APIResponse *response) {
+    if (!response->data) return;
+    // Try to parse for a more specific error message from Google
+    json_object *root = cdrive_json_parse(response->data);
+    if (root) {
+        json_object *error_obj, *message_obj;
+        if (json_object_object_get_ex(root, "error", &error_obj) &&
+            json_object_object_get_ex(error_obj, "message", &message_obj)) {
+            fprintf(stderr, "API Message: %s\n", json_object_get_string(message_obj));
+        }
+        json_object_put(root);
     }
+}
 
-    // Extract filename from path
-    const char *filename_fslash = strrchr(source_path, '/');
-    const char *filename_bslash = strrchr(source_path, '\\');
-    const char *filename = filename_fslash > filename_bslash ? filename_fslash : filename_bslash;
-    if (filename) {
-        filename++; // Skip the '/'
-    } else {
-        filename = source_path;
+// The media part is fed to curl from here rather than by
+// curl_mime_filedata(), so file and chunk probes see the upload side too
+typedef struct {
+    FILE *fp;
+    const char *path;
+    long long offset;
+    MD5Context md5;         // Over the bytes read so far, so the file is never read twice
+    long long hashed;
+} MediaSource;
+
+static size_t media_read(char *buffer, size_t size, size_t nitems, void *arg) {
+    MediaSource *source = (MediaSource *)arg;
+    size_t n = fread(buffer, 1, size * nitems, source->fp);
+    if (n == 0 && ferror(source->fp)) return CURL_READFUNC_ABORT;
+    PROBE_CHUNK_SENT(source->path, source->offset, n);
+    if (source->offset == source->hashed) {
+        md5_update(&source->md5, buffer, n);
+        source->hashed += (long long)n;
     }
-    
-    // Get file MIME type
-    char *mime_type = get_file_mime_type(source_path);
-
-    // Prepare metadata JSON
-    char metadata_str[512];
-    if (strcmp(target_folder, "root") == 0) {
-        snprintf(metadata_str, sizeof(metadata_str), 
-                "{\"name\":\"%s\"}", filename);
-    } else {
-        snprintf(metadata_str, sizeof(metadata_str), 
-                "{\"name\":\"%s\",\"parents\":[\"%s\"]}", filename, target_folder);
+    source->offset += (long long)n;
+    return n;
+}
+
+// curl only seeks back to the start, when it has to resend the body
+static int media_seek(void *arg, curl_off_t offset, int origin) {
+    MediaSource *source = (MediaSource *)arg;
+#ifdef _WIN32
+    if (_fseeki64(source->fp, (__int64)offset, origin) != 0) return CURL_SEEKFUNC_CANTSEEK;
+#else
+    if (fseeko(source->fp, (off_t)offset, origin) != 0) return CURL_SEEKFUNC_CANTSEEK;
+#endif
+    source->offset = (long long)offset;
+    if (offset == 0) {
+        md5_init(&source->md5);
+        source->hashed = 0;
     }
-    
+    return CURL_SEEKFUNC_OK;
+}
+
+int cdrive_upload_media(const UploadRequest *req, UploadResult *result) {
+    CURL *curl;
+    CURLcode res = CURLE_OK;
+    APIResponse response = {0};
+    curl_mime *mime = NULL;
+    curl_mimepart *part;
     long http_code = 0;
 
-    start_spinner(&setup_spinner, "Preparing upload...");
+    const char *filename = req->name ? req->name : path_basename(req->source_path);
+    if (result) memset(result, 0, sizeof(*result));
 
-    // Load tokens from file
-    if (load_tokens(&g_tokens) != 0) {
-        stop_spinner(&setup_spinner);
-        print_error("Not authenticated. Run 'cdrive auth login' first.");
-        free(mime_type);
+    struct stat sb;
+    MediaSource source = {0};
+    source.path = req->source_path;
+    if (stat(req->source_path, &sb) != 0 || !(source.fp = fopen(req->source_path, "rb"))) {
+        print_error("Could not open file for reading.");
+        perror(req->source_path);
         return -1;
     }
-
-    // Validate token before upload by making a quick API call
-    CURL *test_curl = curl_easy_init();
-    if (test_curl) {
-        APIResponse test_response = {0};
-        char auth_header[MAX_HEADER_SIZE];
-        snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
-        struct curl_slist *test_headers = NULL;
-        test_headers = curl_slist_append(test_headers, auth_header);
-        
-        curl_easy_setopt(test_curl, CURLOPT_URL, "https://www.googleapis.com/drive/v3/about?fields=user");
-        curl_easy_setopt(test_curl, CURLOPT_HTTPHEADER, test_headers);
-        curl_easy_setopt(test_curl, CURLOPT_WRITEFUNCTION, write_response_callback);
-        curl_easy_setopt(test_curl, CURLOPT_WRITEDATA, &test_response);
-        
-        CURLcode test_res = curl_easy_perform(test_curl);
-        long test_http_code = 0;
-        curl_easy_getinfo(test_curl, CURLINFO_RESPONSE_CODE, &test_http_code);
-        
-        curl_slist_free_all(test_headers);
-        curl_easy_cleanup(test_curl);
-        if (test_response.data) free(test_response.data);
-        
-        // If token is expired, refresh it before upload
-        if (test_res == CURLE_OK && (test_http_code == 401 || test_http_code == 403)) {
-            stop_spinner(&setup_spinner);
-            printf("\n");
-            print_info("Access token expired. Refreshing...");
-            if (refresh_access_token(&g_tokens) != 0 || save_tokens(&g_tokens) != 0) {
-                print_error("Failed to refresh token. Please re-authenticate with 'cdrive auth login'.");
-                free(mime_type);
-                return -1;
-            }
-            print_success("Token refreshed successfully");
-            start_spinner(&setup_spinner, "Preparing upload...");
+    PROBE_FILE_OPEN(req->source_path, req->file_id ? req->file_id : "", (long long)sb.st_size);
+    char *mime_type = get_file_mime_type(req->source_path);
+
+    // Prepare metadata JSON. Updates keep the existing name and parents.
+    json_object *metadata = json_object_new_object();
+    if (!req->file_id) {
+        json_object_object_add(metadata, "name", json_object_new_string(filename));
+        if (req->parent_id && strcmp(req->parent_id, "root") != 0) {
+            json_object *parents = json_object_new_array();
+            json_object_array_add(parents, json_object_new_string(req->parent_id));
+            json_object_object_add(metadata, "parents", parents);
         }
     }
+    const char *metadata_str = json_object_to_json_string(metadata);
 
-    for (int attempt = 0; attempt < 2; attempt++) {
-        if (attempt == 1) {
-            // Second attempt, try to refresh the token
-            printf("\n");
-            print_info("Upload failed due to authentication. Attempting to refresh token...");
-            if (refresh_access_token(&g_tokens) != 0 || save_tokens(&g_tokens) != 0) {
-                print_error("Failed to refresh token. Please re-authenticate with 'cdrive auth login'.");
-                break; // Exit loop, will fail with the previous error code
-            }
-            print_info("Token refreshed. Retrying upload...");
-        }
+    char url[MAX_URL_SIZE];
+    if (req->file_id) {
+        // files.update keeps the file ID, sharing and history stable
+        snprintf(url, sizeof(url), "%s/%s?uploadType=multipart&fields=%s",
+                 UPLOAD_API_URL, req->file_id, UPLOAD_RESULT_FIELDS);
+    } else {
+        snprintf(url, sizeof(url), "%s?uploadType=multipart&fields=%s", UPLOAD_API_URL, UPLOAD_RESULT_FIELDS);
+    }
 
-        curl = curl_easy_init();
+    RetryState retry = {0};
+    for (;;) {
+        curl = cdrive_easy_init();
         if (!curl) {
             print_error("Error initializing curl");
+            res = CURLE_FAILED_INIT;
             break;
         }
 
@@ -442,12 +389,17 @@ int cdrive_upload(const char *source_path, const char *target_folder) {
         curl_mime_type(part, "application/json; charset=UTF-8");
         part = curl_mime_addpart(mime);
         curl_mime_name(part, "media");
-        curl_mime_filedata(part, source_path);
+        rewind(source.fp);
+        source.offset = 0;
+        md5_init(&source.md5);
+        source.hashed = 0;
+        curl_mime_data_cb(part, (curl_off_t)sb.st_size, media_read, media_seek, NULL, &source);
+        curl_mime_filename(part, path_basename(req->source_path));
         curl_mime_type(part, mime_type);
 
         // Set up authorization header
         char auth_header[MAX_HEADER_SIZE];
-        snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
+        retry.token_generation = token_auth_header(auth_header, sizeof(auth_header));
         struct curl_slist *headers = NULL;
         headers = curl_slist_append(headers, auth_header);
 
@@ -456,298 +408,361 @@ int cdrive_upload(const char *source_path, const char *target_folder) {
         strncpy(progress_data.filename, filename, sizeof(progress_data.filename) - 1);
 
         // Configure curl options
-        curl_easy_setopt(curl, CURLOPT_URL, "https://www.googleapis.com/upload/drive/v3/files?uploadType=multipart");
+        curl_easy_setopt(curl, CURLOPT_URL, url);
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
         curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+        if (req->file_id) curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
-        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &progress_data);
-
-        if (attempt == 0) stop_spinner(&setup_spinner);
+        if (req->show_progress) {
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &progress_data);
+        }
 
-        res = curl_easy_perform(curl);
-        fprintf(stderr, "\r\033[K"); // Clear progress line
+        pacer_admit(PACE_MEDIA);
+        res = cdrive_easy_perform(curl);
+        if (req->show_progress) fprintf(stderr, "\r\033[K"); // Clear progress line
 
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (result) snprintf(result->protocol, sizeof(result->protocol), "%s", transport_protocol(curl));
+
+        // Rate limits, 5xx and dropped connections back off and resend;
+        // an auth failure refreshes the token once. A new file is only
+        // resent if Drive cannot have created it.
+        int again = !(res == CURLE_OK && http_code == 200) &&
+                    (req->file_id ? retry_next(&retry, curl, res, http_code, response.data)
+                                  : retry_next_create(&retry, curl, res, http_code, response.data));
 
         // Clean up for this attempt
         curl_slist_free_all(headers);
         curl_mime_free(mime);
         curl_easy_cleanup(curl);
 
-        if (res == CURLE_OK && http_code == 200) {
-            break; // Success, exit loop
-        }
-
-        if (res != CURLE_OK || (http_code != 401 && http_code != 403)) {
-            break; // A non-auth error occurred, exit loop
-        }
+        if (!again) break;
+        api_response_free(&response);
+        if (req->show_progress) print_info("Retrying upload...");
+    }
 
-        // If we are here, it was a 401/403 error, loop will try to refresh
-        if (response.data) {
-            free(response.data);
-            response.data = NULL;
-            response.size = 0;
-        }
+    json_object_put(metadata);
+    free(mime_type);
+    PROBE_FILE_CLOSE(req->source_path, req->file_id ? req->file_id : "", source.offset);
+    fclose(source.fp);
+    if (result) result->http_code = http_code;
+    if (result && source.hashed == (long long)sb.st_size) {
+        unsigned char digest[MD5_DIGEST_SIZE];
+        md5_final(&source.md5, digest);
+        md5_to_hex(digest, result->local_md5);
     }
-    
+
     // After the loop, check the final result
     if (res != CURLE_OK) {
-        printf("\n");
+        if (req->show_progress) printf("\n");
         fprintf(stderr, "upload failed: %s\n", curl_easy_strerror(res));
-        if (response.data) free(response.data);
-        free(mime_type);
+        api_response_free(&response);
         return -1;
     }
     
     // Check for HTTP errors from the API
     if (http_code != 200) {
-        printf("\n"); // Newline after progress bar
+        if (req->show_progress) printf("\n"); // Newline after progress bar
         print_error("Upload failed due to an API error");
         fprintf(stderr, "HTTP Error: %ld\n", http_code);
-        if (response.data) {
-            // Try to parse for a more specific error message from Google
-            json_object *root = json_tokener_parse(response.data);
-            if (root) {
-                json_object *error_obj, *message_obj;
-                if (json_object_object_get_ex(root, "error", &error_obj) &&
-                    json_object_object_get_ex(error_obj, "message", &message_obj)) {
-                    fprintf(stderr, "API Message: %s\n", json_object_get_string(message_obj));
-                }
-                json_object_put(root);
-            }
-        }
+        print_api_error_message(&response);
         if (http_code == 401 || http_code == 403) {
             print_warning("Authentication token may be invalid or expired. Please run 'cdrive auth login' again.");
         }
-        if (response.data) free(response.data);
-        free(mime_type);
+        api_response_free(&response);
         return -1;
     }
 
     // Parse response to get file info
-    if (response.data) {
-        json_object *root = json_tokener_parse(response.data);
+    int parsed = -1;
+    if (response.data && result) {
+        json_object *root = cdrive_json_parse(response.data);
         if (root) {
-            json_object *id_obj;
-            const char *file_id = NULL;
-            
-            if (json_object_object_get_ex(root, "id", &id_obj)) {
-                file_id = json_object_get_string(id_obj);
-                
-                // Generate direct download link
-                char download_link[MAX_URL_SIZE];
-                snprintf(download_link, sizeof(download_link), 
-                        "https://drive.google.com/uc?export=download&id=%s", file_id);
-                
-                // Store in global variable for potential future use
-                strncpy(g_last_upload_link, download_link, MAX_URL_SIZE - 1);
-                g_last_upload_link[MAX_URL_SIZE - 1] = '\0';
-                
-                // Simple, clean output like GitHub CLI
-                print_success("Upload complete!");
-                printf("\n%s\n\n", download_link);
+            json_object *value;
+            if (json_object_object_get_ex(root, "id", &value)) {
+                snprintf(result->id, sizeof(result->id), "%s", json_object_get_string(value));
+                parsed = 0;
+            }
+            if (json_object_object_get_ex(root, "md5Checksum", &value)) {
+                snprintf(result->md5, sizeof(result->md5), "%s", json_object_get_string(value));
+            }
+            if (json_object_object_get_ex(root, "headRevisionId", &value)) {
+                snprintf(result->head_revision, sizeof(result->head_revision), "%s", json_object_get_string(value));
             }
-            
             json_object_put(root);
         }
-        free(response.data);
+    } else if (!result) {
+        parsed = 0;
     }
+    api_response_free(&response);
+
+    return parsed;
+}
+
+int cdrive_upload(const char *source_path, const char *target_folder, HashCache *hashes) {
+    LoadingSpinner setup_spinner = {0};
     
-    free(mime_type);
+    // Check if the source file exists and is a regular file
+    struct stat path_stat;
+    if (stat(source_path, &path_stat) != 0) {
+        print_error("File not found or cannot be accessed");
+        perror(source_path);
+        return -1;
+    }
+
+    if (!S_ISREG(path_stat.st_mode)) {
+        print_error("The specified path is not a regular file.");
+        return -1;
+    }
+
+    start_spinner(&setup_spinner, "Preparing upload...");
+
+    // Load tokens from file
+    if (load_tokens(&g_tokens) != 0) {
+        stop_spinner(&setup_spinner);
+        print_error("Not authenticated. Run 'cdrive auth login' first.");
+        return -1;
+    }
+
+    // Validate token before upload by making a quick API call
+    CURL *test_curl = cdrive_easy_init();
+    if (test_curl) {
+        APIResponse test_response = {0};
+        char auth_header[MAX_HEADER_SIZE];
+        unsigned token_generation = token_auth_header(auth_header, sizeof(auth_header));
+        struct curl_slist *test_headers = NULL;
+        test_headers = curl_slist_append(test_headers, auth_header);
+        
+        char test_url[MAX_URL_SIZE];
+        snprintf(test_url, sizeof(test_url), "%s?fields=user", api_url(API_ABOUT));
+        curl_easy_setopt(test_curl, CURLOPT_URL, test_url);
+        curl_easy_setopt(test_curl, CURLOPT_HTTPHEADER, test_headers);
+        curl_easy_setopt(test_curl, CURLOPT_WRITEFUNCTION, write_response_callback);
+        curl_easy_setopt(test_curl, CURLOPT_WRITEDATA, &test_response);
+        
+        pacer_admit(PACE_METADATA);
+        CURLcode test_res = cdrive_easy_perform(test_curl);
+        long test_http_code = 0;
+        curl_easy_getinfo(test_curl, CURLINFO_RESPONSE_CODE, &test_http_code);
+        
+        curl_slist_free_all(test_headers);
+        curl_easy_cleanup(test_curl);
+        api_response_free(&test_response);
+        
+        // If token is expired, refresh it before upload
+        if (test_res == CURLE_OK && (test_http_code == 401 || test_http_code == 403)) {
+            stop_spinner(&setup_spinner);
+            printf("\n");
+            print_info("Access token expired. Refreshing...");
+            if (token_refresh(token_generation) < 0) {
+                print_error("Failed to refresh token. Please re-authenticate with 'cdrive auth login'.");
+                return -1;
+            }
+            print_success("Token refreshed successfully");
+            start_spinner(&setup_spinner, "Preparing upload...");
+        }
+    }
+
+    stop_spinner(&setup_spinner);
+
+    UploadRequest req = {0};
+    req.source_path = source_path;
+    req.parent_id = target_folder;
+    req.show_progress = 1;
+
+    UploadResult result;
+    if (cdrive_upload_media(&req, &result) != 0) return -1;
+
+    // Confirm Drive stored what was sent, and remember the checksum for
+    // later syncs; both from the hash taken while the body streamed
+    if (result.local_md5[0]) {
+        if (result.md5[0] && strcmp(result.local_md5, result.md5) != 0) {
+            print_warning("Checksum mismatch: the upload was corrupted in transit.");
+            fprintf(stderr, "local %s, Drive %s\n", result.local_md5, result.md5);
+        }
+        HashKey key;
+        hash_key_from_stat(&key, &path_stat);
+        if (hashes) hash_cache_store_if_unchanged(hashes, source_path, &key, result.local_md5);
+    }
+
+    // Generate direct download link
+    char download_link[MAX_URL_SIZE];
+    snprintf(download_link, sizeof(download_link), 
+            "https://drive.google.com/uc?export=download&id=%s", result.id);
+    
+    // Store in global variable for potential future use
+    strncpy(g_last_upload_link, download_link, MAX_URL_SIZE - 1);
+    g_last_upload_link[MAX_URL_SIZE - 1] = '\0';
+    
+    // Simple, clean output like GitHub CLI
+    print_success("Upload complete!");
+    if (g_http3) printf("Transferred over %s\n", result.protocol);
+    printf("\n%s\n\n", download_link);
     
     return 0;
 }
 
-int cdrive_list_files(const char *folder_id) {
-    CURL *curl;
-    CURLcode res;
-    APIResponse response = {0};
+static int keep_type(const Listing *listing, int i, void *userdata) {
+    int only = *(const int *)userdata;
+    return listing_is_folder(listing, i) == (only == LIST_ONLY_FOLDERS);
+}
+
+int cdrive_list_files(const char *folder_id, const ListOptions *opts) {
     LoadingSpinner list_spinner = {0};
+    ListOptions default_opts = {0};
+    if (!opts) opts = &default_opts;
     
-    start_spinner(&list_spinner, "Fetching files from Google Drive...");
+    if (!g_json_mode) start_spinner(&list_spinner, "Fetching files from Google Drive...");
     
     // Load tokens
     if (load_tokens(&g_tokens) != 0) {
         stop_spinner(&list_spinner);
+        if (g_json_mode) printf("[]");
         print_error("Not authenticated. Run 'cdrive auth login' first.");
         return -1;
     }
     
-    curl = curl_easy_init();
-    if (!curl) {
-        stop_spinner(&list_spinner);
-        print_error("Error initializing curl");
+    char q[512];
+    snprintf(q, sizeof(q), "%%27%s%%27%%20in%%20parents%%20and%%20trashed=false", folder_id);
+
+    Listing listing;
+    listing_init(&listing);
+    int result = listing_fetch(&listing, q, NULL);
+
+    stop_spinner(&list_spinner);
+    
+    if (result != 0) {
+        listing_free(&listing);
+        if (g_json_mode) printf("[]");
+        print_error("Failed to list files");
         return -1;
     }
+
+    if (opts->only != LIST_ONLY_ALL) listing_filter(&listing, keep_type, (void *)&opts->only);
+    listing_sort(&listing, opts->sort, opts->descending, opts->sort != LISTING_SORT_NONE);
     
-    // Build URL
-    char url[1024];
-    if (strcmp(folder_id, "root") == 0) {
-        snprintf(url, sizeof(url), 
-                "%s?q=%%27root%%27%%20in%%20parents%%20and%%20trashed=false&fields=files(id,name,mimeType,size,modifiedTime)", 
-                DRIVE_API_URL);
+    if (g_json_mode) {
+        listing_print(&listing);
+    } else if (listing.order_count > 0) {
+        listing_print(&listing);
+        printf("\n");
     } else {
-        snprintf(url, sizeof(url), 
-                "%s?q=%%27%s%%27%%20in%%20parents%%20and%%20trashed=false&fields=files(id,name,mimeType,size,modifiedTime)", 
-                DRIVE_API_URL, folder_id);
+        printf("\n");
+        print_info("This folder is empty.");
     }
     
-    // Set up authorization header
-    char auth_header[MAX_HEADER_SIZE];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
-    
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, auth_header);
-    
-    // Configure curl
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    
-    // Perform request
-    res = curl_easy_perform(curl);
+    listing_free(&listing);
+    return 0;
+}
+
+int cdrive_create_folder_id(const char *folder_name, const char *parent_id, char *id_out, size_t id_size) {
+    CURL *curl;
+    CURLcode res;
+    long http_code = 0;
+    APIResponse response = {0};
     
-    // Clean up
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    // Prepare JSON data
+    json_object *metadata = json_object_new_object();
+    json_object_object_add(metadata, "name", json_object_new_string(folder_name));
+    json_object_object_add(metadata, "mimeType", json_object_new_string("application/vnd.google-apps.folder"));
+    if (strcmp(parent_id, "root") != 0) {
+        json_object *parents = json_object_new_array();
+        json_object_array_add(parents, json_object_new_string(parent_id));
+        json_object_object_add(metadata, "parents", parents);
+    }
     
-    stop_spinner(&list_spinner);
+    char url[MAX_URL_SIZE];
+    snprintf(url, sizeof(url), "%s?fields=id", DRIVE_API_URL);
+
+    RetryState retry = {0};
+    for (;;) {
+        curl = cdrive_easy_init();
+        if (!curl) {
+            print_error("Error initializing curl");
+            json_object_put(metadata);
+            return -1;
+        }
+
+        // Set up headers
+        char auth_header[MAX_HEADER_SIZE];
+        retry.token_generation = token_auth_header(auth_header, sizeof(auth_header));
+
+        struct curl_slist *headers = NULL;
+        headers = curl_slist_append(headers, auth_header);
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+
+        // Configure curl
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(metadata));
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+        // Perform request
+        pacer_admit(PACE_METADATA);
+        res = cdrive_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+        // A resend after the request went out could create a second folder
+        int again = !(res == CURLE_OK && http_code == 200) &&
+                    retry_next_create(&retry, curl, res, http_code, response.data);
+
+        // Clean up
+        curl_slist_free_all(headers);
+        curl_easy_cleanup(curl);
+        if (!again) break;
+        api_response_free(&response);
+    }
+    json_object_put(metadata);
     
     if (res != CURLE_OK) {
-        print_error("Failed to list files");
+        print_error("Failed to create folder");
         printf("Details: %s\n", curl_easy_strerror(res));
-        if (response.data) free(response.data);
+        api_response_free(&response);
+        return -1;
+    }
+    if (http_code != 200) {
+        print_error("Failed to create folder");
+        fprintf(stderr, "HTTP Error: %ld\n", http_code);
+        print_api_error_message(&response);
+        api_response_free(&response);
         return -1;
     }
     
-    // Parse and display results
-    if (response.data) {
-        json_object *root = json_tokener_parse(response.data);
-        if (root) {
-            json_object *files_array;
-            if (json_object_object_get_ex(root, "files", &files_array) && 
-                json_object_get_type(files_array) == json_type_array) {
-                int num_files = json_object_array_length(files_array);
-                
-                printf("\n");
-                if (num_files > 0) {
-                    print_colored("TYPE\tNAME\t\t\t\t\tID\n", COLOR_BOLD);
-                    print_colored("----\t----\t\t\t\t\t--\n", COLOR_BOLD);
-
-                    for (int i = 0; i < num_files; i++) {
-                        json_object *file_obj = json_object_array_get_idx(files_array, i);
-                        json_object *id_obj, *name_obj, *mime_type_obj;
-                        
-                        if (json_object_object_get_ex(file_obj, "id", &id_obj) &&
-                            json_object_object_get_ex(file_obj, "name", &name_obj) &&
-                            json_object_object_get_ex(file_obj, "mimeType", &mime_type_obj)) 
-                        {
-                            const char *mime_type = json_object_get_string(mime_type_obj);
-                            
-                            if (strcmp(mime_type, "application/vnd.google-apps.folder") == 0) {
-                                print_colored("[DIR] ", COLOR_CYAN);
-                            } else {
-                                print_colored("[FILE]", COLOR_WHITE);
-                            }
-                            
-                            printf("\t%-40.40s\t", json_object_get_string(name_obj));
-                            print_colored(json_object_get_string(id_obj), COLOR_YELLOW);
-                            printf("\n");
-                        }
-                    }
-                    printf("\n");
-                } else {
-                    print_info("This folder is empty.");
-                }
-            }
-            json_object_put(root);
+    // Parse response
+    int result = -1;
+    json_object *root = response.data ? cdrive_json_parse(response.data) : NULL;
+    if (root) {
+        json_object *id_obj;
+        if (json_object_object_get_ex(root, "id", &id_obj)) {
+            snprintf(id_out, id_size, "%s", json_object_get_string(id_obj));
+            result = 0;
         }
-        free(response.data);
+        json_object_put(root);
     }
+    api_response_free(&response);
     
-    return 0;
+    return result;
 }
 
 int cdrive_create_folder(const char *folder_name, const char *parent_id) {
-    CURL *curl;
-    CURLcode res;
-    APIResponse response = {0};
-    
     // Load tokens
     if (load_tokens(&g_tokens) != 0) {
         print_error("Not authenticated. Run 'cdrive auth login' first.");
         return -1;
     }
     
-    curl = curl_easy_init();
-    if (!curl) {
-        print_error("Error initializing curl");
-        return -1;
-    }
-    
-    // Prepare JSON data
-    char json_data[512];
-    if (strcmp(parent_id, "root") == 0) {
-        snprintf(json_data, sizeof(json_data), 
-                "{\"name\":\"%s\",\"mimeType\":\"application/vnd.google-apps.folder\"}", 
-                folder_name);
-    } else {
-        snprintf(json_data, sizeof(json_data), 
-                "{\"name\":\"%s\",\"mimeType\":\"application/vnd.google-apps.folder\",\"parents\":[\"%s\"]}", 
-                folder_name, parent_id);
-    }
-    
-    // Set up headers
-    char auth_header[MAX_HEADER_SIZE];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", g_tokens.access_token);
-    
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, auth_header);
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    
-    // Configure curl
-    curl_easy_setopt(curl, CURLOPT_URL, DRIVE_API_URL);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    
-    // Perform request
-    res = curl_easy_perform(curl);
-    
-    // Clean up
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        print_error("Failed to create folder");
-        printf("Details: %s\n", curl_easy_strerror(res));
-        if (response.data) free(response.data);
+    char folder_id[128];
+    if (cdrive_create_folder_id(folder_name, parent_id, folder_id, sizeof(folder_id)) != 0) {
         return -1;
     }
     
-    // Parse response
-    if (response.data) {
-        json_object *root = json_tokener_parse(response.data);
-        if (root) {
-            json_object *id_obj, *name_obj;
-            
-            if (json_object_object_get_ex(root, "id", &id_obj) &&
-                json_object_object_get_ex(root, "name", &name_obj)) 
-            {
-                printf("\n");
-                print_colored("  Name: ", COLOR_BOLD); printf("%s\n", json_object_get_string(name_obj));
-                print_colored("  ID:   ", COLOR_BOLD); printf("%s\n\n", json_object_get_string(id_obj));
-            }
-            
-            json_object_put(root);
-        }
-        free(response.data);
-    }
+    printf("\n");
+    print_colored("  Name: ", COLOR_BOLD); printf("%s\n", folder_name);
+    print_colored("  ID:   ", COLOR_BOLD); printf("%s\n\n", folder_id);
     
     return 0;
 }
@@ -292,6 +292,7 @@ int check_for_updates(UpdateInfo *update_info) {
     CURL *curl;
     CURLcode res;
     APIResponse response = {0};
+    response.arena = &g_arena;
     
     curl = curl_easy_init();
     if (!curl) {
@@ -329,7 +330,7 @@ int check_for_updates(UpdateInfo *update_info) {
     
     // Handle different error cases
     if (res != CURLE_OK) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         if (res == CURLE_OPERATION_TIMEDOUT) {
             return -1; // Timeout
         }
@@ -338,25 +339,25 @@ int check_for_updates(UpdateInfo *update_info) {
     
     // Handle HTTP error codes
     if (http_code == 403) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -2; // Rate limited
     } else if (http_code == 404) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -3; // Repository not found
     } else if (http_code != 200) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1; // Other HTTP error
     }
     
     if (!response.data || response.size == 0) {
-        if (response.data) free(response.data);
+        api_response_free(&response);
         return -1;
     }
     
     // Parse JSON response
-    json_object *root = json_tokener_parse(response.data);
+    json_object *root = cdrive_json_parse(response.data);
     if (!root) {
-        free(response.data);
+        api_response_free(&response);
         return -1;
     }
     
@@ -366,7 +367,7 @@ int check_for_updates(UpdateInfo *update_info) {
         const char *message = json_object_get_string(message_obj);
         if (strstr(message, "rate limit") || strstr(message, "Rate limit")) {
             json_object_put(root);
-            free(response.data);
+            api_response_free(&response);
             return -2;
         }
     }
@@ -378,7 +379,7 @@ int check_for_updates(UpdateInfo *update_info) {
     if (json_object_object_get_ex(root, "prerelease", &prerelease_obj)) {
         if (json_object_get_boolean(prerelease_obj)) {
             json_object_put(root);
-            free(response.data);
+            api_response_free(&response);
             return -3; // Skip prereleases
         }
     }
@@ -476,12 +477,12 @@ int check_for_updates(UpdateInfo *update_info) {
         update_info->is_newer = (compare_versions(CDRIVE_VERSION, update_info->version) > 0);
     } else {
         json_object_put(root);
-        free(response.data);
+        api_response_free(&response);
         return -1; // No valid version found
     }
     
     json_object_put(root);
-    free(response.data);
+    api_response_free(&response);
     
     return 0;
 }
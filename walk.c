@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "walk.h"
+#include "evloop.h"
+
+#define WALK_PAGE_SIZE 1000
+#define WALK_FIELDS "nextPageToken,files(id,name,mimeType,size,quotaBytesUsed,modifiedTime,md5Checksum)"
+#define FOLDER_MIME_TYPE "application/vnd.google-apps.folder"
+
+// A folder waiting in the BFS frontier
+typedef struct WalkFolder {
+    char *id;
+    char *path;
+    int depth;
+    struct WalkFolder *next;
+} WalkFolder;
+
+// Open-addressing set of folder IDs already queued, so folders reachable
+// through several parents (or shortcuts back up the tree) are listed once.
+typedef struct {
+    char **slots;
+    size_t capacity;
+    size_t count;
+} IdSet;
+
+typedef struct {
+    const WalkOptions *opts;
+    walk_callback callback;
+    void *userdata;
+    EventLoop *loop;
+    int concurrency;
+
+    WalkFolder *head;
+    WalkFolder *tail;
+    int active;      // Folders currently being listed
+    int stop;        // Set when the callback asks to stop
+    IdSet visited;
+
+    WalkStats stats;
+} WalkState;
+
+static unsigned long hash_id(const char *s) {
+    unsigned long hash = 5381;
+    while (*s) hash = ((hash << 5) + hash) + (unsigned char)*s++;
+    return hash;
+}
+
+static int idset_grow(IdSet *set) {
+    size_t new_capacity = set->capacity ? set->capacity * 2 : 1024;
+    char **slots = calloc(new_capacity, sizeof(char *));
+    if (!slots) return -1;
+    for (size_t i = 0; i < set->capacity; i++) {
+        if (!set->slots[i]) continue;
+        size_t j = hash_id(set->slots[i]) & (new_capacity - 1);
+        while (slots[j]) j = (j + 1) & (new_capacity - 1);
+        slots[j] = set->slots[i];
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = new_capacity;
+    return 0;
+}
+
+// Returns 1 if the ID was newly inserted, 0 if already present, -1 on OOM
+static int idset_insert(IdSet *set, const char *id) {
+    if ((set->count + 1) * 2 > set->capacity && idset_grow(set) != 0) return -1;
+    size_t i = hash_id(id) & (set->capacity - 1);
+    while (set->slots[i]) {
+        if (strcmp(set->slots[i], id) == 0) return 0;
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->slots[i] = strdup(id);
+    if (!set->slots[i]) return -1;
+    set->count++;
+    return 1;
+}
+
+static void idset_free(IdSet *set) {
+    for (size_t i = 0; i < set->capacity; i++) free(set->slots[i]);
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+// Queue a folder if it has not been seen yet
+static void enqueue_folder(WalkState *state, const char *id, const char *path, int depth) {
+    if (idset_insert(&state->visited, id) != 1) return;
+
+    WalkFolder *folder = calloc(1, sizeof(WalkFolder));
+    if (!folder) return;
+    folder->id = strdup(id);
+    folder->path = strdup(path);
+    folder->depth = depth;
+    if (!folder->id || !folder->path) {
+        free(folder->id);
+        free(folder->path);
+        free(folder);
+        return;
+    }
+
+    if (state->tail) state->tail->next = folder;
+    else state->head = folder;
+    state->tail = folder;
+}
+
+static void free_folder(WalkFolder *folder) {
+    free(folder->id);
+    free(folder->path);
+    free(folder);
+}
+
+// One folder being listed: a small state machine driven by the event loop
+// that fetches page after page, retrying each as the retry policy allows.
+// Children are handed to the callback as the response streams in.
+typedef struct {
+    Transfer transfer;       // First, so the loop's Transfer * is the listing
+    WalkState *state;
+    WalkFolder *folder;
+    struct curl_slist *headers;
+    RetryState retry;
+    RetryErrorBody error;
+    JsonStream stream;
+    JsonField item_fields[7];
+    JsonField top_fields[1];
+    char id[128], name[1024], mime_type[128], size[32], quota[32], modified[40], md5[40];
+    char next_page_token[1024];
+    char page_token[1024];
+    int page_delivered;      // Children of this page already handed to the callback
+} WalkListing;
+
+// Drive returns int64 fields as JSON strings
+static long long field_ll(const JsonField *field) {
+    return field->found ? strtoll(field->dest, NULL, 10) : -1;
+}
+
+static int report_child(JsonField *fields, int num_fields, void *userdata) {
+    WalkListing *listing = (WalkListing *)userdata;
+    WalkState *state = listing->state;
+    const WalkFolder *folder = listing->folder;
+    (void)num_fields;
+
+    // A retried page streams again from its first child; only report the rest
+    if (listing->stream.items <= listing->page_delivered) return state->stop;
+    listing->page_delivered = listing->stream.items;
+
+    if (!fields[0].found || !fields[0].dest[0]) return 0;
+    const char *id = fields[0].dest;
+    const char *name = fields[1].found ? fields[1].dest : "";
+
+    char path[MAX_PATH_SIZE * 2];
+    if (folder->path[0]) snprintf(path, sizeof(path), "%s/%s", folder->path, name);
+    else snprintf(path, sizeof(path), "%s", name);
+
+    WalkEntry entry = {0};
+    entry.id = id;
+    entry.name = name;
+    entry.mime_type = fields[2].found ? fields[2].dest : "";
+    entry.parent_id = folder->id;
+    entry.path = path;
+    entry.modified_time = fields[5].found ? fields[5].dest : "";
+    entry.md5_checksum = fields[6].found ? fields[6].dest : "";
+    entry.size = field_ll(&fields[3]);
+    entry.quota_bytes = field_ll(&fields[4]);
+    entry.depth = folder->depth + 1;
+    entry.is_folder = strcmp(entry.mime_type, FOLDER_MIME_TYPE) == 0;
+
+    if (entry.is_folder) state->stats.folders++;
+    else state->stats.files++;
+
+    if (!state->stop && state->callback(&entry, state->userdata) != 0) {
+        state->stop = 1;
+    }
+
+    if (entry.is_folder && !state->stop &&
+        (state->opts->max_depth <= 0 || entry.depth < state->opts->max_depth)) {
+        enqueue_folder(state, id, path, entry.depth);
+    }
+    return state->stop;
+}
+
+static size_t listing_write(char *data, size_t size, size_t nmemb, void *userdata) {
+    WalkListing *listing = (WalkListing *)userdata;
+    if (retry_capture_error(listing->transfer.easy, &listing->error, data, size * nmemb)) return size * nmemb;
+    return json_stream_write_callback(data, size, nmemb, &listing->stream);
+}
+
+static void listing_done(EventLoop *loop, Transfer *t, CURLcode res, long http_code);
+
+// Queue a request for the current page, after delay_ms plus our turn on the
+// request pacer
+static void request_page(WalkListing *listing, long long delay_ms) {
+    CURL *easy = listing->transfer.easy;
+    curl_easy_reset(easy);
+    cdrive_easy_setup(easy);
+
+    char url[MAX_URL_SIZE];
+    snprintf(url, sizeof(url),
+             "%s?q=%%27%s%%27%%20in%%20parents%%20and%%20trashed=false&pageSize=%d&fields=%s",
+             DRIVE_API_URL, listing->folder->id, WALK_PAGE_SIZE, WALK_FIELDS);
+    if (listing->page_token[0]) url_append_param(url, sizeof(url), "pageToken", listing->page_token);
+
+    // Rebuilt every time, as a retry may follow a token refresh
+    char auth_header[MAX_HEADER_SIZE];
+    listing->retry.token_generation = token_auth_header(auth_header, sizeof(auth_header));
+    curl_slist_free_all(listing->headers);
+    listing->headers = curl_slist_append(NULL, auth_header);
+
+    json_stream_reset(&listing->stream);
+    listing->next_page_token[0] = '\0';
+    listing->error.len = 0;
+    listing->error.data[0] = '\0';
+
+    curl_easy_setopt(easy, CURLOPT_URL, url);
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, listing->headers);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, listing_write);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, listing);
+    curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 2L);
+
+    listing->transfer.done = listing_done;
+    listing->transfer.retries = retry_take_pending();
+    ev_submit_after(listing->state->loop, &listing->transfer, delay_ms + pacer_reserve());
+}
+
+static void start_listings(WalkState *state);
+
+static void finish_listing(WalkListing *listing, int failed) {
+    WalkState *state = listing->state;
+    if (failed) state->stats.failed_folders++;
+    state->active--;
+
+    curl_slist_free_all(listing->headers);
+    curl_easy_cleanup(listing->transfer.easy);
+    free_folder(listing->folder);
+    free(listing);
+
+    start_listings(state);
+}
+
+static void listing_done(EventLoop *loop, Transfer *t, CURLcode res, long http_code) {
+    WalkListing *listing = (WalkListing *)t;
+    WalkState *state = listing->state;
+    (void)loop;
+
+    if (res == CURLE_OK && http_code == 200) {
+        state->stats.pages++;
+        if (json_stream_finish(&listing->stream) != 0) {
+            finish_listing(listing, 1);
+        } else if (listing->next_page_token[0] && !state->stop) {
+            strcpy(listing->page_token, listing->next_page_token);
+            listing->retry = (RetryState){0};
+            listing->page_delivered = 0;
+            request_page(listing, 0);
+        } else {
+            finish_listing(listing, 0);
+        }
+        return;
+    }
+
+    long long delay_ms = 0;
+    if (!state->stop && retry_decide(&listing->retry, t->easy, res, http_code, listing->error.data, &delay_ms)) {
+        request_page(listing, delay_ms);
+    } else {
+        finish_listing(listing, 1);
+    }
+}
+
+// Start listing queued folders until the concurrency limit is reached
+static void start_listings(WalkState *state) {
+    while (state->head && !state->stop && state->active < state->concurrency) {
+        WalkFolder *folder = state->head;
+        state->head = folder->next;
+        if (!state->head) state->tail = NULL;
+
+        WalkListing *listing = calloc(1, sizeof(WalkListing));
+        CURL *easy = listing ? curl_easy_init() : NULL;
+        if (!easy) {
+            free(listing);
+            free_folder(folder);
+            state->stats.failed_folders++;
+            continue;
+        }
+        listing->transfer.easy = easy;
+        listing->state = state;
+        listing->folder = folder;
+
+        JsonField item_fields[] = {
+            {"id", listing->id, sizeof(listing->id), 0, 0},
+            {"name", listing->name, sizeof(listing->name), 0, 0},
+            {"mimeType", listing->mime_type, sizeof(listing->mime_type), 0, 0},
+            {"size", listing->size, sizeof(listing->size), 0, 0},
+            {"quotaBytesUsed", listing->quota, sizeof(listing->quota), 0, 0},
+            {"modifiedTime", listing->modified, sizeof(listing->modified), 0, 0},
+            {"md5Checksum", listing->md5, sizeof(listing->md5), 0, 0},
+        };
+        memcpy(listing->item_fields, item_fields, sizeof(item_fields));
+        listing->top_fields[0] = (JsonField){"nextPageToken", listing->next_page_token,
+                                             sizeof(listing->next_page_token), 0, 0};
+        json_stream_init(&listing->stream, "files", listing->item_fields, 7,
+                         listing->top_fields, 1, report_child, listing);
+
+        state->active++;
+        request_page(listing, 0);
+    }
+}
+
+int cdrive_walk(const char *root_id, const WalkOptions *opts,
+                walk_callback callback, void *userdata, WalkStats *stats) {
+    WalkOptions default_opts = {0};
+    if (!opts) opts = &default_opts;
+
+    WalkState state;
+    memset(&state, 0, sizeof(state));
+    state.opts = opts;
+    state.callback = callback;
+    state.userdata = userdata;
+    state.concurrency = opts->concurrency > 0 ? opts->concurrency : WALK_DEFAULT_CONCURRENCY;
+
+    state.loop = ev_loop_new();
+    if (!state.loop) return -1;
+
+    enqueue_folder(&state, root_id, "", 0);
+    if (!state.head) {
+        ev_loop_free(state.loop);
+        idset_free(&state.visited);
+        return -1;
+    }
+
+    // Every listing runs on this thread; the loop multiplexes them
+    start_listings(&state);
+    if (ev_run(state.loop) != 0) {
+        // Fail what is still in flight so finish_listing frees each listing
+        // before the multi handle goes away; stop keeps them from retrying
+        state.stop = 1;
+        state.stats.failed_folders++;
+        ev_cancel_all(state.loop);
+    }
+    ev_loop_free(state.loop);
+
+    // Drop anything left in the frontier after an early stop
+    while (state.head) {
+        WalkFolder *next = state.head->next;
+        free_folder(state.head);
+        state.head = next;
+    }
+
+    idset_free(&state.visited);
+
+    if (stats) *stats = state.stats;
+    return state.stats.failed_folders > 0 ? -1 : 0;
+}
+
+static int print_walk_entry(const WalkEntry *entry, void *userdata) {
+    (void)userdata;
+    if (entry->is_folder) {
+        print_colored("[DIR] ", COLOR_CYAN);
+    } else {
+        print_colored("[FILE]", COLOR_WHITE);
+    }
+    printf("\t%-40s\t", entry->path);
+    print_colored(entry->id, COLOR_YELLOW);
+    printf("\n");
+    return 0;
+}
+
+int cdrive_list_recursive(const char *folder_id) {
+    if (load_tokens(&g_tokens) != 0) {
+        print_error("Not authenticated. Run 'cdrive auth login' first.");
+        return -1;
+    }
+
+    WalkOptions opts = {0};
+    opts.concurrency = g_jobs;
+
+    printf("\n");
+    print_colored("TYPE\tPATH\t\t\t\t\tID\n", COLOR_BOLD);
+    print_colored("----\t----\t\t\t\t\t--\n", COLOR_BOLD);
+
+    WalkStats stats = {0};
+    int result = cdrive_walk(folder_id, &opts, print_walk_entry, NULL, &stats);
+
+    printf("\n");
+    print_colored("[*] ", COLOR_BLUE);
+    printf("%lld folder(s), %lld file(s)\n", stats.folders, stats.files);
+
+    if (result != 0) {
+        if (stats.failed_folders > 0) {
+            fprintf(stderr, "%d folder(s) could not be listed\n", stats.failed_folders);
+        } else {
+            print_error("Failed to list files");
+        }
+        return -1;
+    }
+    return 0;
+}
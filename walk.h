@@ -0,0 +1,51 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include "cdrive.h"
+
+// Default number of folders listed in parallel by the tree walker
+#define WALK_DEFAULT_CONCURRENCY 8
+
+// A single remote item delivered by the tree walker. Pointers are only
+// valid for the duration of the callback.
+typedef struct {
+    const char *id;
+    const char *name;
+    const char *mime_type;
+    const char *parent_id;
+    const char *path;          // Slash-separated path relative to the walk root
+    const char *modified_time;
+    const char *md5_checksum;  // "" for folders and Google Docs
+    long long size;            // -1 when Drive reports no size (folders, Google Docs)
+    long long quota_bytes;     // quotaBytesUsed, -1 when not reported
+    int depth;                 // 1 for direct children of the root
+    int is_folder;
+} WalkEntry;
+
+// Called once per item, always on the thread that called cdrive_walk(), so
+// callbacks need no locking.
+// Return non-zero to stop the walk early.
+typedef int (*walk_callback)(const WalkEntry *entry, void *userdata);
+
+typedef struct {
+    int concurrency;   // Folder listings in flight at once (0 = WALK_DEFAULT_CONCURRENCY)
+    int max_depth;     // 0 = unlimited
+} WalkOptions;
+
+typedef struct {
+    long long folders;
+    long long files;
+    long long pages;
+    int failed_folders;
+} WalkStats;
+
+// Walk the folder tree under root_id breadth-first. Listings are multiplexed
+// on an event loop on the calling thread, so concurrency costs no threads. Returns 0 on success,
+// -1 if the walk could not start or any folder failed to list.
+int cdrive_walk(const char *root_id, const WalkOptions *opts,
+                walk_callback callback, void *userdata, WalkStats *stats);
+
+// `cdrive list -R`
+int cdrive_list_recursive(const char *folder_id);
+
+#endif // WALK_H
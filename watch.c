@@ -0,0 +1,866 @@
+#define _GNU_SOURCE
+#include "cdrive.h"
+#include "watch.h"
+
+#ifndef __linux__
+
+int cdrive_watch(const char *local_dir, const char *remote_id, const WatchOptions *opts) {
+    (void)local_dir;
+    (void)remote_id;
+    (void)opts;
+    print_error("watch is only supported on Linux.");
+    return -1;
+}
+
+#else
+
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <poll.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+
+#define WATCH_DIR_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY | IN_ONLYDIR | IN_EXCL_UNLINK)
+#define WATCH_EVENT_BUFFER (64 * 1024)
+
+enum {
+    WATCH_IDLE,        // Nothing to do
+    WATCH_PENDING,     // Written recently; waiting for the debounce window
+    WATCH_QUEUED,      // Waiting for an upload worker
+    WATCH_UPLOADING
+};
+
+typedef struct WatchItem {
+    char *path;              // Relative to the watch root
+    char *remote_id;         // Drive ID once uploaded (files) or found/created (folders)
+    int is_dir;
+    int state;
+    int dirty;               // Written again while uploading
+    long long due_ms;        // Debounce deadline while pending
+    struct WatchItem *next;  // Upload queue link
+} WatchItem;
+
+typedef struct {
+    const char *remote_root;
+    char root[PATH_MAX];
+    int debounce_ms;
+    int jobs;
+
+    // Guards the item table, pending list, queue, journal and counters
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // Held while resolving or creating remote folders so concurrent
+    // uploads into a new directory create it only once
+    pthread_mutex_t folder_lock;
+
+    WatchItem **slots;
+    size_t slot_capacity;
+    size_t item_count;
+
+    WatchItem **pending;
+    int pending_count;
+    int pending_capacity;
+
+    WatchItem *queue_head;
+    WatchItem *queue_tail;
+    int queued;
+    int stopping;
+
+    FILE *journal;
+    char journal_path[PATH_MAX];
+
+    // inotify watch descriptor -> relative directory path
+    char **wd_paths;
+    int wd_capacity;
+
+    int wake_pipe[2];
+
+    long long uploaded;
+    long long updated;
+    long long failed;
+} WatchState;
+
+static volatile sig_atomic_t g_watch_stop = 0;
+
+static void watch_signal_handler(int sig) {
+    (void)sig;
+    g_watch_stop = 1;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime_mono(&ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned long watch_hash(const char *s) {
+    unsigned long hash = 5381;
+    while (*s) hash = ((hash << 5) + hash) + (unsigned char)*s++;
+    return hash;
+}
+
+// --- Item table (caller holds st->lock) ---
+
+static WatchItem *item_find(const WatchState *st, const char *path) {
+    if (st->slot_capacity == 0) return NULL;
+    size_t i = watch_hash(path) & (st->slot_capacity - 1);
+    while (st->slots[i]) {
+        if (strcmp(st->slots[i]->path, path) == 0) return st->slots[i];
+        i = (i + 1) & (st->slot_capacity - 1);
+    }
+    return NULL;
+}
+
+static int item_table_grow(WatchState *st) {
+    size_t capacity = st->slot_capacity ? st->slot_capacity * 2 : 1024;
+    WatchItem **slots = calloc(capacity, sizeof(WatchItem *));
+    if (!slots) return -1;
+    for (size_t n = 0; n < st->slot_capacity; n++) {
+        WatchItem *item = st->slots[n];
+        if (!item) continue;
+        size_t i = watch_hash(item->path) & (capacity - 1);
+        while (slots[i]) i = (i + 1) & (capacity - 1);
+        slots[i] = item;
+    }
+    free(st->slots);
+    st->slots = slots;
+    st->slot_capacity = capacity;
+    return 0;
+}
+
+static WatchItem *item_get(WatchState *st, const char *path, int is_dir) {
+    WatchItem *item = item_find(st, path);
+    if (item) return item;
+
+    if ((st->item_count + 1) * 2 > st->slot_capacity && item_table_grow(st) != 0) return NULL;
+    item = calloc(1, sizeof(WatchItem));
+    if (!item || !(item->path = strdup(path))) {
+        free(item);
+        return NULL;
+    }
+    item->is_dir = is_dir;
+
+    size_t i = watch_hash(path) & (st->slot_capacity - 1);
+    while (st->slots[i]) i = (i + 1) & (st->slot_capacity - 1);
+    st->slots[i] = item;
+    st->item_count++;
+    return item;
+}
+
+// --- Journal ---
+//
+// One line per state change: "Q\t-\tpath" when a file is queued,
+// "D\tid\tpath" when it has been uploaded and "F\tid\tpath" for folders.
+// Files queued but never marked done are uploaded again on the next start.
+
+static void journal_write(WatchState *st, char type, const WatchItem *item) {
+    if (!st->journal) return;
+    fprintf(st->journal, "%c\t%s\t%s\n", type, item->remote_id ? item->remote_id : "-", item->path);
+    fflush(st->journal);
+}
+
+static void enqueue_locked(WatchState *st, WatchItem *item) {
+    item->state = WATCH_QUEUED;
+    item->next = NULL;
+    if (st->queue_tail) st->queue_tail->next = item;
+    else st->queue_head = item;
+    st->queue_tail = item;
+    st->queued++;
+    journal_write(st, 'Q', item);
+    pthread_cond_signal(&st->cond);
+}
+
+static int journal_open(WatchState *st) {
+    const char *home_dir = getenv(HOME_ENV);
+    if (!home_dir) return -1;
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/%s/%s", home_dir, CONFIG_DIR, WATCH_STATE_DIR);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+
+    // FNV-1a over "root\nremote", so each directory/folder pair has its own journal
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char *p = st->root; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    hash = (hash ^ '\n') * 1099511628211ULL;
+    for (const char *p = st->remote_root; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    int n = snprintf(st->journal_path, sizeof(st->journal_path), "%s/%016llx.journal", dir, hash);
+    if (n < 0 || (size_t)n >= sizeof(st->journal_path)) return -1;
+
+    // Replay: later lines win
+    FILE *fp = fopen(st->journal_path, "r");
+    if (fp) {
+        char line[PATH_MAX + 256];
+        while (fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\n")] = '\0';
+            char *id = strchr(line, '\t');
+            char *path = id ? strchr(id + 1, '\t') : NULL;
+            if (!path || !path[1]) continue;
+            *id++ = '\0';
+            *path++ = '\0';
+
+            WatchItem *item = item_get(st, path, line[0] == 'F');
+            if (!item) break;
+            if (line[0] == 'Q') {
+                item->state = WATCH_QUEUED;
+            } else if (line[0] == 'D' || line[0] == 'F') {
+                item->state = WATCH_IDLE;
+                free(item->remote_id);
+                item->remote_id = strdup(id);
+            }
+        }
+        fclose(fp);
+    }
+
+    // Compact into a fresh file holding only the current state
+    char tmp_path[PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", st->journal_path);
+    fp = fopen(tmp_path, "w");
+    if (!fp) return -1;
+    for (size_t i = 0; i < st->slot_capacity; i++) {
+        WatchItem *item = st->slots[i];
+        if (!item || !item->remote_id) continue;
+        fprintf(fp, "%c\t%s\t%s\n", item->is_dir ? 'F' : 'D', item->remote_id, item->path);
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, st->journal_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    st->journal = fopen(st->journal_path, "a");
+    if (!st->journal) return -1;
+
+    // Resume uploads interrupted by the last exit
+    int resumed = 0;
+    for (size_t i = 0; i < st->slot_capacity; i++) {
+        WatchItem *item = st->slots[i];
+        if (!item || item->state != WATCH_QUEUED) continue;
+
+        char full_path[PATH_MAX];
+        struct stat sb;
+        n = snprintf(full_path, sizeof(full_path), "%s/%s", st->root, item->path);
+        if (n > 0 && (size_t)n < sizeof(full_path) && stat(full_path, &sb) == 0 && S_ISREG(sb.st_mode)) {
+            enqueue_locked(st, item);
+            resumed++;
+        } else {
+            item->state = WATCH_IDLE;
+        }
+    }
+    if (resumed > 0 && !g_json_mode) {
+        print_colored("[*] ", COLOR_BLUE);
+        printf("Resuming %d queued upload(s) from the last run\n", resumed);
+    }
+    return 0;
+}
+
+// --- Change tracking ---
+
+// Partial files are normally renamed into place when complete; the rename
+// shows up as its own event, so the temporary name is not worth uploading.
+static int is_temporary_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || name[len - 1] == '~') return 1;
+    if (strncmp(name, ".#", 2) == 0) return 1;
+    if (len > 5 && strcmp(name + len - 5, ".part") == 0) return 1;
+    if (len > 4 && strcmp(name + len - 4, ".tmp") == 0) return 1;
+    if (len > 4 && strcmp(name + len - 4, ".swp") == 0) return 1;
+    return 0;
+}
+
+static void wake_main_loop(WatchState *st) {
+    char byte = 1;
+    ssize_t ignored = write(st->wake_pipe[1], &byte, 1);
+    (void)ignored;
+}
+
+// Record a write to rel. A close or move-in (complete = 1) starts the
+// debounce window; plain modifications only push an existing one back.
+static void note_write(WatchState *st, const char *rel, int complete) {
+    const char *base = strrchr(rel, '/');
+    if (is_temporary_name(base ? base + 1 : rel)) return;
+    if (strchr(rel, '\t') || strchr(rel, '\n')) return; // Cannot be journaled
+
+    pthread_mutex_lock(&st->lock);
+    WatchItem *item = complete ? item_get(st, rel, 0) : item_find(st, rel);
+    if (!item || item->is_dir) {
+        pthread_mutex_unlock(&st->lock);
+        return;
+    }
+
+    if (item->state == WATCH_IDLE && complete) {
+        if (st->pending_count == st->pending_capacity) {
+            int capacity = st->pending_capacity ? st->pending_capacity * 2 : 64;
+            WatchItem **pending = realloc(st->pending, sizeof(WatchItem *) * (size_t)capacity);
+            if (!pending) {
+                pthread_mutex_unlock(&st->lock);
+                return;
+            }
+            st->pending = pending;
+            st->pending_capacity = capacity;
+        }
+        st->pending[st->pending_count++] = item;
+        item->state = WATCH_PENDING;
+    } else if (item->state == WATCH_UPLOADING) {
+        // The upload may have read a mix of old and new data; send it again
+        item->dirty = 1;
+    }
+    if (item->state == WATCH_PENDING) item->due_ms = now_ms() + st->debounce_ms;
+    pthread_mutex_unlock(&st->lock);
+}
+
+// Queue every pending file whose debounce window has passed. Returns the
+// poll timeout until the next deadline, or -1 when nothing is pending.
+static int flush_due(WatchState *st) {
+    long long now = now_ms();
+    long long next = -1;
+
+    pthread_mutex_lock(&st->lock);
+    for (int i = 0; i < st->pending_count;) {
+        WatchItem *item = st->pending[i];
+        if (item->due_ms > now) {
+            if (next < 0 || item->due_ms < next) next = item->due_ms;
+            i++;
+            continue;
+        }
+
+        st->pending[i] = st->pending[--st->pending_count];
+        char full_path[PATH_MAX];
+        struct stat sb;
+        int n = snprintf(full_path, sizeof(full_path), "%s/%s", st->root, item->path);
+        if (n > 0 && (size_t)n < sizeof(full_path) && stat(full_path, &sb) == 0 && S_ISREG(sb.st_mode)) {
+            enqueue_locked(st, item);
+        } else {
+            item->state = WATCH_IDLE; // Deleted or renamed away before it settled
+        }
+    }
+    pthread_mutex_unlock(&st->lock);
+
+    if (next < 0) return -1;
+    return (int)(next - now);
+}
+
+// --- Remote side ---
+
+static int find_remote_folder(const char *name, const char *parent_id, char *id_out, size_t id_size) {
+    // Drive query strings escape quotes and backslashes with a backslash
+    char escaped[PATH_MAX * 2];
+    size_t len = 0;
+    for (const char *p = name; *p && len + 2 < sizeof(escaped); p++) {
+        if (*p == '\'' || *p == '\\') escaped[len++] = '\\';
+        escaped[len++] = *p;
+    }
+    escaped[len] = '\0';
+
+    char query[sizeof(escaped) + 256];
+    snprintf(query, sizeof(query),
+             "name='%s' and '%s' in parents and mimeType='application/vnd.google-apps.folder' and trashed=false",
+             escaped, parent_id);
+
+    char url[MAX_URL_SIZE];
+    snprintf(url, sizeof(url), "%s?pageSize=1&fields=files(id)", DRIVE_API_URL);
+    url_append_param(url, sizeof(url), "q", query);
+
+    APIResponse response = {0};
+    if (cdrive_api_get(url, &response) != 0) return -1;
+
+    int found = -1;
+    json_object *root = cdrive_json_parse(response.data);
+    json_object *files, *id;
+    if (root && json_object_object_get_ex(root, "files", &files) && json_object_array_length(files) > 0 &&
+        json_object_object_get_ex(json_object_array_get_idx(files, 0), "id", &id)) {
+        snprintf(id_out, id_size, "%s", json_object_get_string(id));
+        found = 0;
+    }
+    if (root) json_object_put(root);
+    api_response_free(&response);
+    return found;
+}
+
+// Resolve the remote folder for the relative directory rel_dir, reusing
+// existing folders and creating missing ones level by level.
+static int ensure_remote_dir(WatchState *st, const char *rel_dir, char *id_out, size_t id_size) {
+    snprintf(id_out, id_size, "%s", st->remote_root);
+    if (!rel_dir[0]) return 0;
+
+    char prefix[PATH_MAX];
+    snprintf(prefix, sizeof(prefix), "%s", rel_dir);
+
+    pthread_mutex_lock(&st->folder_lock);
+    int result = 0;
+    char *cursor = prefix;
+    while (cursor) {
+        char *slash = strchr(cursor, '/');
+        if (slash) *slash = '\0';
+        const char *name = cursor;
+
+        pthread_mutex_lock(&st->lock);
+        WatchItem *dir = item_get(st, prefix, 1);
+        int known = dir && dir->remote_id;
+        if (known) snprintf(id_out, id_size, "%s", dir->remote_id);
+        pthread_mutex_unlock(&st->lock);
+
+        if (!dir) {
+            result = -1;
+            break;
+        }
+        if (!known) {
+            char folder_id[128];
+            if (find_remote_folder(name, id_out, folder_id, sizeof(folder_id)) != 0 &&
+                cdrive_create_folder_id(name, id_out, folder_id, sizeof(folder_id)) != 0) {
+                result = -1;
+                break;
+            }
+            pthread_mutex_lock(&st->lock);
+            dir->remote_id = strdup(folder_id);
+            journal_write(st, 'F', dir);
+            pthread_mutex_unlock(&st->lock);
+            snprintf(id_out, id_size, "%s", folder_id);
+        }
+
+        if (slash) {
+            *slash = '/';
+            cursor = slash + 1;
+        } else {
+            cursor = NULL;
+        }
+    }
+    pthread_mutex_unlock(&st->folder_lock);
+    return result;
+}
+
+static void report_upload(const char *path, const char *id, int updated, int ok) {
+    if (g_json_mode) {
+        printf("{\"event\":\"%s\",\"path\":", ok ? (updated ? "updated" : "uploaded") : "failed");
+        json_print_string(stdout, path);
+        if (ok) {
+            printf(",\"id\":");
+            json_print_string(stdout, id);
+        }
+        printf("}\n");
+        fflush(stdout);
+    } else if (ok) {
+        printf("%s%s%s %s\n", updated ? COLOR_YELLOW : COLOR_GREEN, updated ? "[~]" : "[+]", COLOR_RESET, path);
+        fflush(stdout);
+    } else {
+        fprintf(stderr, "%s[!]%s %s: upload failed; it will be retried on the next start\n",
+                COLOR_RED, COLOR_RESET, path);
+    }
+}
+
+static void *upload_worker(void *arg) {
+    WatchState *st = (WatchState *)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        while (!st->queue_head && !st->stopping) pthread_cond_wait(&st->cond, &st->lock);
+        if (st->stopping) {
+            // Anything still queued stays in the journal for the next start
+            pthread_mutex_unlock(&st->lock);
+            break;
+        }
+        WatchItem *item = st->queue_head;
+        st->queue_head = item->next;
+        if (!st->queue_head) st->queue_tail = NULL;
+        st->queued--;
+        item->state = WATCH_UPLOADING;
+        item->dirty = 0;
+        char *path = strdup(item->path);
+        char *file_id = item->remote_id ? strdup(item->remote_id) : NULL;
+        pthread_mutex_unlock(&st->lock);
+
+        // One thread per possible slot; the limiter decides how many run
+        limiter_acquire();
+        pthread_mutex_lock(&st->lock);
+        int stopping = st->stopping;
+        pthread_mutex_unlock(&st->lock);
+        if (stopping) {
+            // Still journaled as queued
+            limiter_release(0, 0);
+            free(path);
+            free(file_id);
+            break;
+        }
+        long long started_ms = now_ms();
+        long long bytes = 0;
+
+        char full_path[PATH_MAX];
+        char parent_rel[PATH_MAX];
+        char parent_id[128];
+        UploadResult result;
+        int rc = -1;
+
+        int n = path ? snprintf(full_path, sizeof(full_path), "%s/%s", st->root, path) : -1;
+        if (n > 0 && (size_t)n < sizeof(full_path)) {
+            snprintf(parent_rel, sizeof(parent_rel), "%s", path);
+            char *slash = strrchr(parent_rel, '/');
+            if (slash) *slash = '\0';
+            else parent_rel[0] = '\0';
+
+            struct stat sb;
+            if (stat(full_path, &sb) == 0) bytes = sb.st_size;
+
+            if (ensure_remote_dir(st, parent_rel, parent_id, sizeof(parent_id)) == 0) {
+                UploadRequest req = {0};
+                req.source_path = full_path;
+                req.parent_id = parent_id;
+                req.file_id = file_id;
+                rc = cdrive_upload_media(&req, &result);
+                if (rc != 0 && file_id && result.http_code == 404) {
+                    // Deleted remotely since the last upload
+                    req.file_id = NULL;
+                    free(file_id);
+                    file_id = NULL;
+                    rc = cdrive_upload_media(&req, &result);
+                }
+            }
+        }
+        limiter_release(rc == 0 ? bytes : 0, now_ms() - started_ms);
+
+        pthread_mutex_lock(&st->lock);
+        if (rc == 0) {
+            free(item->remote_id);
+            item->remote_id = strdup(result.id);
+            journal_write(st, 'D', item);
+            if (file_id) st->updated++;
+            else st->uploaded++;
+        } else {
+            st->failed++;
+        }
+
+        item->state = WATCH_IDLE;
+        if (item->dirty) {
+            // Rewritten mid-upload: go round the debounce window again
+            item->dirty = 0;
+            if (st->pending_count < st->pending_capacity) {
+                item->state = WATCH_PENDING;
+                item->due_ms = now_ms() + st->debounce_ms;
+                st->pending[st->pending_count++] = item;
+            } else {
+                enqueue_locked(st, item);
+            }
+        }
+        pthread_mutex_unlock(&st->lock);
+
+        report_upload(path ? path : "?", rc == 0 ? result.id : NULL, file_id != NULL, rc == 0);
+        wake_main_loop(st);
+        free(path);
+        free(file_id);
+    }
+    return NULL;
+}
+
+// --- inotify ---
+
+static int remember_wd(WatchState *st, int wd, const char *rel) {
+    if (wd >= st->wd_capacity) {
+        int capacity = st->wd_capacity ? st->wd_capacity : 256;
+        while (capacity <= wd) capacity *= 2;
+        char **paths = realloc(st->wd_paths, sizeof(char *) * (size_t)capacity);
+        if (!paths) return -1;
+        memset(paths + st->wd_capacity, 0, sizeof(char *) * (size_t)(capacity - st->wd_capacity));
+        st->wd_paths = paths;
+        st->wd_capacity = capacity;
+    }
+    free(st->wd_paths[wd]);
+    st->wd_paths[wd] = strdup(rel);
+    return st->wd_paths[wd] ? 0 : -1;
+}
+
+// Watch rel and every directory below it. Directories that appear while
+// running were created or moved in with content we never saw written, so
+// their files are treated as freshly closed (new_dir = 1).
+static int watch_tree(WatchState *st, int fd, const char *rel, int new_dir) {
+    char dir_path[PATH_MAX];
+    int n = rel[0] ? snprintf(dir_path, sizeof(dir_path), "%s/%s", st->root, rel)
+                   : snprintf(dir_path, sizeof(dir_path), "%s", st->root);
+    if (n < 0 || (size_t)n >= sizeof(dir_path)) return -1;
+
+    int wd = inotify_add_watch(fd, dir_path, WATCH_DIR_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            print_error("Out of inotify watches; raise fs.inotify.max_user_watches or use --fanotify");
+        } else {
+            fprintf(stderr, "cannot watch %s: %s\n", dir_path, strerror(errno));
+        }
+        return -1;
+    }
+    if (remember_wd(st, wd, rel) != 0) return -1;
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) return 0;
+
+    int result = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        struct stat sb;
+        if (fstatat(dirfd(dir), de->d_name, &sb, AT_SYMLINK_NOFOLLOW) != 0) continue;
+
+        char child[PATH_MAX];
+        n = rel[0] ? snprintf(child, sizeof(child), "%s/%s", rel, de->d_name)
+                   : snprintf(child, sizeof(child), "%s", de->d_name);
+        if (n < 0 || (size_t)n >= sizeof(child)) continue;
+
+        if (S_ISDIR(sb.st_mode)) {
+            if (watch_tree(st, fd, child, new_dir) != 0) result = -1;
+        } else if (new_dir && S_ISREG(sb.st_mode)) {
+            note_write(st, child, 1);
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+static void handle_inotify(WatchState *st, int fd) {
+    char buf[WATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) return; // EAGAIN: drained
+
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                print_warning("Event queue overflowed; some changes were missed. Run 'cdrive sync' to reconcile.");
+                continue;
+            }
+            if (ev->wd < 0 || ev->wd >= st->wd_capacity || !st->wd_paths[ev->wd]) continue;
+            if (ev->mask & IN_IGNORED) {
+                free(st->wd_paths[ev->wd]);
+                st->wd_paths[ev->wd] = NULL;
+                continue;
+            }
+            if (ev->len == 0 || !ev->name[0]) continue;
+
+            const char *dir = st->wd_paths[ev->wd];
+            char child[PATH_MAX];
+            int n = dir[0] ? snprintf(child, sizeof(child), "%s/%s", dir, ev->name)
+                           : snprintf(child, sizeof(child), "%s", ev->name);
+            if (n < 0 || (size_t)n >= sizeof(child)) continue;
+
+            if (ev->mask & IN_ISDIR) {
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) watch_tree(st, fd, child, 1);
+            } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                note_write(st, child, 1);
+            } else if (ev->mask & IN_MODIFY) {
+                note_write(st, child, 0);
+            }
+        }
+    }
+}
+
+// --- fanotify ---
+
+// One mark covers the whole mount, so huge trees need no per-directory
+// watches. Only close-after-write is reported this way; files moved in
+// without being written are not seen.
+static int setup_fanotify(WatchState *st) {
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_CLOSE_WRITE, AT_FDCWD, st->root) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void handle_fanotify(WatchState *st, int fd) {
+    char buf[WATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    size_t root_len = strlen(st->root);
+
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) return;
+
+        struct fanotify_event_metadata *ev = (struct fanotify_event_metadata *)buf;
+        for (; FAN_EVENT_OK(ev, len); ev = FAN_EVENT_NEXT(ev, len)) {
+            if (ev->mask & FAN_Q_OVERFLOW) {
+                print_warning("Event queue overflowed; some changes were missed. Run 'cdrive sync' to reconcile.");
+                continue;
+            }
+            if (ev->fd < 0) continue;
+
+            char link[64];
+            char path[PATH_MAX];
+            snprintf(link, sizeof(link), "/proc/self/fd/%d", ev->fd);
+            ssize_t n = readlink(link, path, sizeof(path) - 1);
+            close(ev->fd);
+            if (n <= 0) continue;
+            path[n] = '\0';
+
+            // The mark sees the whole mount; keep only our tree
+            if ((size_t)n > root_len + 1 && strncmp(path, st->root, root_len) == 0 && path[root_len] == '/') {
+                note_write(st, path + root_len + 1, 1);
+            }
+        }
+    }
+}
+
+// --- Command ---
+
+static void watch_state_free(WatchState *st) {
+    for (size_t i = 0; i < st->slot_capacity; i++) {
+        if (!st->slots[i]) continue;
+        free(st->slots[i]->path);
+        free(st->slots[i]->remote_id);
+        free(st->slots[i]);
+    }
+    free(st->slots);
+    free(st->pending);
+    for (int i = 0; i < st->wd_capacity; i++) free(st->wd_paths[i]);
+    free(st->wd_paths);
+    if (st->journal) fclose(st->journal);
+    pthread_mutex_destroy(&st->lock);
+    pthread_mutex_destroy(&st->folder_lock);
+    pthread_cond_destroy(&st->cond);
+}
+
+int cdrive_watch(const char *local_dir, const char *remote_id, const WatchOptions *opts) {
+    WatchOptions default_opts = {0};
+    if (!opts) opts = &default_opts;
+
+    WatchState *st = calloc(1, sizeof(WatchState));
+    if (!st) return -1;
+    st->remote_root = remote_id;
+    st->debounce_ms = opts->debounce_ms > 0 ? opts->debounce_ms : WATCH_DEFAULT_DEBOUNCE_MS;
+    st->jobs = opts->jobs > 0 ? opts->jobs : (g_jobs > 0 ? g_jobs : LIMITER_DEFAULT_MAX);
+    limiter_init(st->jobs);
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_mutex_init(&st->folder_lock, NULL);
+    pthread_cond_init(&st->cond, NULL);
+
+    struct stat root_stat;
+    if (!realpath(local_dir, st->root) || stat(st->root, &root_stat) != 0 || !S_ISDIR(root_stat.st_mode)) {
+        print_error("Local path is not a directory");
+        watch_state_free(st);
+        free(st);
+        return -1;
+    }
+
+    if (load_tokens(&g_tokens) != 0) {
+        print_error("Not authenticated. Run 'cdrive auth login' first.");
+        watch_state_free(st);
+        free(st);
+        return -1;
+    }
+
+    // Reserve the pending list up front so workers can requeue without allocating
+    st->pending_capacity = 1024;
+    st->pending = malloc(sizeof(WatchItem *) * (size_t)st->pending_capacity);
+    if (!st->pending || pipe2(st->wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        print_error("Failed to initialize the watcher");
+        watch_state_free(st);
+        free(st);
+        return -1;
+    }
+    if (journal_open(st) != 0) {
+        print_error("Could not open the upload journal in ~/.cdrive/watch");
+        close(st->wake_pipe[0]);
+        close(st->wake_pipe[1]);
+        watch_state_free(st);
+        free(st);
+        return -1;
+    }
+
+    int notify_fd = -1;
+    int using_fanotify = 0;
+    if (opts->use_fanotify) {
+        notify_fd = setup_fanotify(st);
+        if (notify_fd >= 0) {
+            using_fanotify = 1;
+        } else {
+            print_warning("fanotify is not permitted here (needs CAP_SYS_ADMIN); falling back to inotify");
+        }
+    }
+    if (notify_fd < 0) {
+        notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify_fd < 0 || watch_tree(st, notify_fd, "", 0) != 0) {
+            print_error("Failed to watch the directory tree");
+            if (notify_fd >= 0) close(notify_fd);
+            close(st->wake_pipe[0]);
+            close(st->wake_pipe[1]);
+            watch_state_free(st);
+            free(st);
+            return -1;
+        }
+    }
+
+    // No SA_RESTART, so poll() returns as soon as we are interrupted
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = watch_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    struct sigaction old_int, old_term;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    g_watch_stop = 0;
+
+    pthread_t *workers = calloc((size_t)st->jobs, sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < st->jobs &&
+           pthread_create(&workers[started], NULL, upload_worker, st) == 0) {
+        started++;
+    }
+
+    if (!g_json_mode) {
+        print_colored("[*] ", COLOR_BLUE);
+        printf("Watching %s -> %s (%s, up to %d uploads in parallel). Press Ctrl+C to stop.\n",
+               st->root, remote_id, using_fanotify ? "fanotify" : "inotify", started);
+    }
+
+    while (!g_watch_stop && started > 0) {
+        int timeout = flush_due(st);
+        struct pollfd fds[2] = {
+            { notify_fd, POLLIN, 0 },
+            { st->wake_pipe[0], POLLIN, 0 },
+        };
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(st->wake_pipe[0], drain, sizeof(drain)) > 0) {}
+        }
+        if (fds[0].revents & POLLIN) {
+            if (using_fanotify) handle_fanotify(st, notify_fd);
+            else handle_inotify(st, notify_fd);
+        }
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->stopping = 1;
+    // Files still settling are journaled too, so the next start picks them up
+    for (int i = 0; i < st->pending_count; i++) journal_write(st, 'Q', st->pending[i]);
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    close(notify_fd);
+    close(st->wake_pipe[0]);
+    close(st->wake_pipe[1]);
+
+    int left = st->queued + st->pending_count;
+    if (!g_json_mode) {
+        printf("\n");
+        print_colored("[+] ", COLOR_GREEN);
+        printf("Stopped: %lld uploaded, %lld updated, %lld failed", st->uploaded, st->updated, st->failed);
+        if (left > 0) printf(", %d left for the next run", left);
+        printf("\n");
+    }
+    int result = (started > 0 && st->failed == 0) ? 0 : -1;
+    watch_state_free(st);
+    free(st);
+    return result;
+}
+
+#endif // __linux__
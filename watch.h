@@ -0,0 +1,21 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "cdrive.h"
+
+#define WATCH_STATE_DIR "watch"
+#define WATCH_DEFAULT_DEBOUNCE_MS 2000
+
+typedef struct {
+    int debounce_ms;   // Quiet period after the last write before uploading (0 = WATCH_DEFAULT_DEBOUNCE_MS)
+    int jobs;          // Most concurrent uploads (0 = --jobs, else LIMITER_DEFAULT_MAX)
+    int use_fanotify;  // Watch the whole mount with fanotify when permitted
+} WatchOptions;
+
+// `cdrive watch <dir> <folder>`: upload files under local_dir to the remote
+// folder as they are closed after writing or moved in. Queued uploads are
+// journaled under ~/.cdrive/watch and resumed on the next start. Runs until
+// interrupted.
+int cdrive_watch(const char *local_dir, const char *remote_id, const WatchOptions *opts);
+
+#endif // WATCH_H